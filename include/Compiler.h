@@ -34,6 +34,21 @@ namespace vc4c
         SEVERE = 'S'
     };
 
+    /*
+     * Statistics about the accesses to the persistent compilation cache (see Configuration#cacheDirectory)
+     */
+    struct CompilationCacheStatistics
+    {
+        // the number of compilations whose result was found in the cache
+        std::size_t hits;
+        // the number of compilations whose result was not found in the cache
+        std::size_t misses;
+        // the number of compilation results written to the cache
+        std::size_t stores;
+        // the number of cache entries removed to keep the cache within its size limit
+        std::size_t evictions;
+    };
+
     /*
      * Base class for the compilation process
      */
@@ -80,6 +95,11 @@ namespace vc4c
      * This defaults to logging to the console
      */
     void setLogger(std::wostream& outputStream, bool coloredOutput, LogLevel level = LogLevel::WARNING);
+
+    /*
+     * Returns the statistics for all accesses to the compilation cache of the current process
+     */
+    CompilationCacheStatistics getCompilationCacheStatistics();
 } // namespace vc4c
 
 #endif /* COMPILER_H */
@@ -132,6 +132,15 @@ namespace vc4c
          */
         unsigned accumulatorThreshold = 6;
 
+        /*
+         * The factor the accesses to a local are weighted with per loop the access is nested in, when the register
+         * allocation selects the locals to be mapped to accumulators. The locals with the most (weighted) accesses are
+         * assigned first, so values used within (inner) loops are preferred over values used in straight-line code.
+         *
+         * A value of zero disables the weighting, the accumulators are then assigned in no particular order.
+         */
+        unsigned accumulatorLoopWeight = 8;
+
         /*
          * Maximum number of instructions to check for reordering.
          * This prevents long runs for huge linear programs at the cost of less performant code
@@ -161,6 +170,13 @@ namespace vc4c
          */
         unsigned maxOptimizationIterations = 512;
 
+        /*
+         * The minimum number of independent basic blocks to run a block-local optimization pass for in parallel.
+         *
+         * A value of zero runs all block-local passes serially. The generated code does not depend on this value.
+         */
+        unsigned minParallelBlocks = 2;
+
         /*
          * Maximum distance between two instructions to be combined for the common subexpression optimization.
          *
@@ -219,6 +235,22 @@ namespace vc4c
          * Whether to stop compilation when instruction verification failed
          */
         bool stopWhenVerificationFailed = true;
+        /*
+         * The directory to store the persistent compilation cache in. If this is empty, no cache is used.
+         *
+         * NOTE: The same directory can be shared between multiple processes running compilations in parallel
+         */
+        std::string cacheDirectory = "";
+        /*
+         * The maximum size (in bytes) of all entries in the compilation cache. If the cache grows larger, the least
+         * recently used entries are evicted.
+         */
+        std::size_t maxCacheSize = 64 * 1024 * 1024;
+        /*
+         * The file to write the compilation telemetry (time and instruction count per kernel and pass) into in JSON
+         * format. If this is empty, no telemetry is recorded.
+         */
+        std::string telemetryFile = "";
     };
 
     /*
@@ -33,6 +33,49 @@ namespace vc4c
             std::array<uint32_t, 3> globalOffsets = {{0, 0, 0}};
         };
 
+        /*
+         * A file mapped into the emulated memory as buffer parameter
+         */
+        struct MappedFile
+        {
+            std::string fileName;
+            /*
+             * The minimum size of the buffer in bytes. Smaller (or not existing) files are enlarged (or created).
+             */
+            std::size_t minimumSize = 0;
+        };
+
+        /*
+         * Configuration for snapshots of the complete emulator state, which allow to resume an emulation at a later
+         * cycle instead of re-running it from the start
+         */
+        struct SnapshotConfig
+        {
+            /*
+             * The number of cycles between two snapshots, zero to not write any snapshot.
+             *
+             * If snapshots are enabled, an additional snapshot is written when the emulation reaches the maximum
+             * number of cycles, so it can be resumed with a higher limit.
+             */
+            uint32_t interval = 0;
+            /*
+             * The prefix of the snapshot files written, a snapshot of the state after a cycle is written into the file
+             * <prefix>.<cycle>.snapshot
+             *
+             * NOTE: Only the first snapshot contains the whole memory, all following snapshots only contain the memory
+             * pages modified since and refer to the previous snapshot file. So all files of a series need to be kept
+             * to resume from one of them.
+             */
+            std::string filePrefix = "emulation";
+            /*
+             * The snapshot file to resume the emulation from, empty to start the emulation at the first cycle.
+             *
+             * The emulation resumed needs to be configured the same as the emulation writing the snapshot, i.e. the
+             * same module, kernel, parameters, work-group configuration and emulation backend.
+             */
+            std::string resumeFile;
+        };
+
         /*
          * Data container for all configuration required to emulate a kernel-execution
          */
@@ -55,6 +98,14 @@ namespace vc4c
              * Also, the output values are NOT stored back into the parameter, but need to be read via an extra function
              */
             std::vector<std::pair<uint32_t, Optional<std::vector<uint32_t>>>> parameter;
+            /*
+             * The files to map into the emulated memory as buffer parameters, by parameter index.
+             *
+             * A mapped file is neither loaded nor copied, the kernel accesses (and modifies) the file contents
+             * directly. The corresponding entries of #parameter are only place-holders and no result is read back for
+             * them.
+             */
+            std::map<std::size_t, MappedFile> mappedParameters;
             /*
              * The work-group configuration to run the execution with
              */
@@ -71,6 +122,27 @@ namespace vc4c
              * The path to dump the results of the instrumentation
              */
             std::string instrumentationDump;
+            /*
+             * Whether to use the native emulation backend, which stores the QPU registers as plain arrays of words
+             * instead of Values. This yields the same results, but runs considerably faster.
+             */
+            bool useNativeBackend = false;
+            /*
+             * The number of host threads to distribute the work-groups over.
+             *
+             * Every thread emulates a disjoint range of the work-groups with its own set of QPUs (and VPM, semaphores,
+             * etc.). Only the memory and the hardware mutex are shared, so work-groups can still communicate via
+             * atomic operations. The number of cycles reported is the maximum of all threads, the instrumentation
+             * results are summed up.
+             */
+            uint32_t numThreads = 1;
+            /*
+             * The configuration for writing and resuming from snapshots of the emulator state.
+             *
+             * Snapshots are only supported if all work-groups are emulated in a single host thread (see #numThreads),
+             * since the emulation of multiple threads is not deterministic.
+             */
+            SnapshotConfig snapshots;
 
             explicit EmulationData() {}
 
@@ -136,6 +208,10 @@ namespace vc4c
              * The path to dump the results of the instrumentation
              */
             std::string instrumentationDump;
+            /*
+             * Whether to use the native emulation backend, see EmulationData#useNativeBackend
+             */
+            bool useNativeBackend = false;
 
             LowLevelEmulationData(const std::map<uint32_t, std::reference_wrapper<std::vector<uint8_t>>>& buffers,
                 uint64_t* startAddress, uint32_t numInstructions, const std::vector<uint32_t>& uniformAddresses,
@@ -184,8 +260,25 @@ namespace vc4c
              * Counts the total number, this instruction was executed
              */
             unsigned numExecutions;
+            /*
+             * Counts the number of executions of this instruction which triggered a TMU load
+             */
+            unsigned numTMULoads;
+            /*
+             * Counts the number of executions of this instruction which read from or wrote to the VPM
+             */
+            unsigned numVPMAccesses;
+            /*
+             * Counts the number of executions of this instruction which started a DMA transfer between VPM and memory
+             */
+            unsigned numDMAAccesses;
 
             std::string to_string() const;
+
+            /*
+             * Adds the counters of the other result (e.g. for the same instruction executed in another thread)
+             */
+            InstrumentationResult& operator+=(const InstrumentationResult& other);
         };
 
         /*
@@ -202,6 +295,10 @@ namespace vc4c
              * execution limit (false)
              */
             bool executionSuccessful = false;
+            /*
+             * The number of cycles emulated until all QPUs finished (or the execution limit was reached)
+             */
+            uint32_t numCycles = 0;
             /*
              * The final contents of the parameter passed to the emulation (e.g. for output-parameter).
              */
@@ -227,6 +324,10 @@ namespace vc4c
              * execution limit (false)
              */
             bool executionSuccessful = false;
+            /*
+             * The number of cycles emulated until all QPUs finished (or the execution limit was reached)
+             */
+            uint32_t numCycles = 0;
             /*
              * The instrumentation result for the emulation run. The indices of the instrumentation result correspond to
              * the indices of the instruction in the executed kernel
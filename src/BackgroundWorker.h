@@ -7,6 +7,8 @@
 #ifndef BACKGROUND_WORKER_H
 #define BACKGROUND_WORKER_H
 
+#include "ThreadPool.h"
+
 #include <exception>
 #include <functional>
 #include <list>
@@ -49,50 +51,22 @@ namespace vc4c
 
         static void waitForAll(std::vector<BackgroundWorker>& worker);
 
+        /*
+         * Runs the given function for all elements of the container in parallel and waits for all of them to finish.
+         *
+         * The functions are executed by the process-wide ThreadPool, so this can also be called from within a function
+         * run by this method to parallelize nested work.
+         */
         template <typename T, typename Container = std::list<T>>
         static void scheduleAll(const Container& c, const std::function<void(const T&)>& func, const std::string name)
         {
-            auto it = c.begin();
-#ifdef MULTI_THREADED
-            // the maximum number of parallel running workers
-            static constexpr unsigned maxRunning = 16;
-            std::mutex containerGuard;
-            const auto scheduler = [&]() {
-                while(true)
-                {
-                    const T* item = nullptr;
-                    {
-                        std::lock_guard<std::mutex> guard(containerGuard);
-                        if(it == c.end())
-                            return;
-                        item = &(*it);
-                        ++it;
-                    }
-                    func(*item);
-                }
-            };
-#else
-            static constexpr unsigned maxRunning = 1;
-            const auto scheduler = [&]() {
-                while(true)
-                {
-                    if(it == c.end())
-                        return;
-                    const auto& item = *it;
-                    ++it;
-                    func(item);
-                }
-            };
-#endif
-            std::vector<BackgroundWorker> workers;
-            workers.reserve(maxRunning);
-            for(unsigned i = 0; i < std::min(maxRunning, static_cast<unsigned>(c.size())); ++i)
+            ThreadPool::TaskGroup group(name);
+            for(const auto& item : c)
             {
-                workers.emplace_back(scheduler, name);
-                workers.back().operator()();
+                const T* element = &item;
+                group.schedule([&func, element]() { func(*element); });
             }
-
-            waitForAll(workers);
+            group.waitForAll();
         }
     };
 
@@ -19,7 +19,8 @@ using namespace vc4c;
 const std::string BasicBlock::DEFAULT_BLOCK("%start_of_function");
 const std::string BasicBlock::LAST_BLOCK("%end_of_function");
 
-BasicBlock::BasicBlock(Method& method, intermediate::BranchLabel* label) : method(method), instructions()
+BasicBlock::BasicBlock(Method& method, intermediate::BranchLabel* label) :
+    method(method), instructions(&method.arena)
 {
     instructions.emplace_back(label);
 }
@@ -66,7 +67,7 @@ std::size_t BasicBlock::size() const
 
 bool BasicBlock::isLocallyLimited(InstructionWalker curIt, const Local* locale, const std::size_t threshold) const
 {
-    auto remainingUsers = locale->getUsers();
+    auto remainingUsers = locale->copyUsers();
 
     int32_t usageRangeLeft = static_cast<int32_t>(threshold);
     // check whether the local is written in the instruction before (and this)
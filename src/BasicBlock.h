@@ -10,6 +10,7 @@
 #include "Optional.h"
 #include "config.h"
 
+#include "InstructionList.h"
 #include "Locals.h"
 #include "helper.h"
 #include "performance.h"
@@ -18,11 +19,9 @@ namespace vc4c
 {
     namespace intermediate
     {
-        class IntermediateInstruction;
         struct BranchLabel;
 
-        using IL = std::unique_ptr<IntermediateInstruction>;
-        using InstructionsList = FastModificationList<IL>;
+        using InstructionsList = InstructionList;
         using InstructionsIterator = InstructionsList::iterator;
         using ConstInstructionsIterator = InstructionsList::const_iterator;
     } // namespace intermediate
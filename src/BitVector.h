@@ -0,0 +1,145 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#ifndef VC4C_BIT_VECTOR_H
+#define VC4C_BIT_VECTOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace vc4c
+{
+    /*
+     * A set of (small) indices of dynamic size, stored as a dense sequence of bits.
+     *
+     * This is used as a compact set of objects with a dense numbering (e.g. locals via their per-method index), where
+     * set operations on whole sets are cheap word-wise operations.
+     */
+    class BitVector
+    {
+    public:
+        explicit BitVector(std::size_t numBits = 0) : numBits(numBits), words(toNumWords(numBits), 0) {}
+
+        /*
+         * Changes the number of bits, newly added bits are cleared
+         */
+        void resize(std::size_t newNumBits)
+        {
+            numBits = newNumBits;
+            words.resize(toNumWords(newNumBits), 0);
+            // clear the unused part of the last word, so bits removed are not set again when growing later
+            if(numBits % WORD_BITS != 0)
+                words.back() &= (Word{1} << (numBits % WORD_BITS)) - 1;
+        }
+
+        std::size_t size() const noexcept
+        {
+            return numBits;
+        }
+
+        bool test(std::size_t index) const noexcept
+        {
+            return (words[index / WORD_BITS] >> (index % WORD_BITS)) & 1;
+        }
+
+        void set(std::size_t index) noexcept
+        {
+            words[index / WORD_BITS] |= Word{1} << (index % WORD_BITS);
+        }
+
+        void reset(std::size_t index) noexcept
+        {
+            words[index / WORD_BITS] &= ~(Word{1} << (index % WORD_BITS));
+        }
+
+        /*
+         * Clears all bits
+         */
+        void clear() noexcept
+        {
+            std::fill(words.begin(), words.end(), 0);
+        }
+
+        bool any() const noexcept
+        {
+            return std::any_of(words.begin(), words.end(), [](Word w) -> bool { return w != 0; });
+        }
+
+        std::size_t count() const noexcept
+        {
+            std::size_t num = 0;
+            for(Word w : words)
+                num += static_cast<std::size_t>(__builtin_popcountll(w));
+            return num;
+        }
+
+        /*
+         * Sets all bits set in the other vector and returns whether any bit was changed
+         */
+        bool merge(const BitVector& other) noexcept
+        {
+            Word changed = 0;
+            for(std::size_t i = 0; i < std::min(words.size(), other.words.size()); ++i)
+            {
+                changed |= other.words[i] & ~words[i];
+                words[i] |= other.words[i];
+            }
+            return changed != 0;
+        }
+
+        /*
+         * Clears all bits set in the other vector
+         */
+        void subtract(const BitVector& other) noexcept
+        {
+            for(std::size_t i = 0; i < std::min(words.size(), other.words.size()); ++i)
+                words[i] &= ~other.words[i];
+        }
+
+        /*
+         * Runs the consumer for the indices of all set bits in ascending order
+         */
+        template <typename Consumer>
+        void forAllSetBits(Consumer&& consumer) const
+        {
+            for(std::size_t i = 0; i < words.size(); ++i)
+            {
+                Word w = words[i];
+                while(w != 0)
+                {
+                    consumer(i * WORD_BITS + static_cast<std::size_t>(__builtin_ctzll(w)));
+                    // clear lowest set bit
+                    w &= w - 1;
+                }
+            }
+        }
+
+        bool operator==(const BitVector& other) const noexcept
+        {
+            return numBits == other.numBits && words == other.words;
+        }
+
+        bool operator!=(const BitVector& other) const noexcept
+        {
+            return !(*this == other);
+        }
+
+    private:
+        using Word = uint64_t;
+        static constexpr std::size_t WORD_BITS = 64;
+
+        std::size_t numBits;
+        std::vector<Word> words;
+
+        static std::size_t toNumWords(std::size_t numBits) noexcept
+        {
+            return (numBits + WORD_BITS - 1) / WORD_BITS;
+        }
+    };
+} // namespace vc4c
+
+#endif /* VC4C_BIT_VECTOR_H */
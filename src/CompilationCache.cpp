@@ -0,0 +1,344 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#include "CompilationCache.h"
+
+#include "Precompiler.h"
+#include "log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <vector>
+
+using namespace vc4c;
+
+#ifndef VC4C_VERSION
+#define VC4C_VERSION ""
+#endif
+#ifndef LLVM_LIBRARY_VERSION
+#define LLVM_LIBRARY_VERSION 0
+#endif
+
+// "VC4C" in ASCII
+static constexpr uint32_t CACHE_MAGIC_NUMBER = 0x43344356;
+// needs to be incremented on every change to the cache file format
+static constexpr uint32_t CACHE_FORMAT_VERSION = 1;
+static const std::string CACHE_FILE_EXTENSION = ".vc4c-cache";
+
+struct EntryHeader
+{
+    uint32_t magicNumber;
+    uint32_t formatVersion;
+    CompilationCache::Key key;
+    uint64_t bytesWritten;
+    uint64_t dataSize;
+};
+
+static std::atomic<std::size_t> numHits{0};
+static std::atomic<std::size_t> numMisses{0};
+static std::atomic<std::size_t> numStores{0};
+static std::atomic<std::size_t> numEvictions{0};
+
+/*
+ * Simple 128-bit hash consisting of two independent 64-bit hashes (FNV-1a and a multiplicative rotating hash).
+ *
+ * This is no cryptographic hash, but good enough to identify the cache entries, the key is also stored in and checked
+ * against the entry itself
+ */
+class Hasher
+{
+public:
+    void update(const void* data, std::size_t size)
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(data);
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            fnv = (fnv ^ bytes[i]) * 0x100000001B3;
+            rotating = ((rotating << 5) | (rotating >> 59)) ^ bytes[i];
+            rotating *= 0x9E3779B97F4A7C15;
+        }
+    }
+
+    void update(const std::string& s)
+    {
+        // also hash the size, so the boundaries of strings are part of the hash
+        uint64_t size = s.size();
+        update(&size, sizeof(size));
+        update(s.data(), s.size());
+    }
+
+    CompilationCache::Key finish() const
+    {
+        return CompilationCache::Key{{fnv, rotating}};
+    }
+
+private:
+    uint64_t fnv = 0xCBF29CE484222325;
+    uint64_t rotating = 0x6A09E667F3BCC908;
+};
+
+/*
+ * Identifies the current compiler build.
+ *
+ * Since the compiler code (and thus the output) can change without changing the version, the location, size and
+ * modification time of the library containing this code is used too.
+ */
+static std::string getCompilerBuildID()
+{
+    std::stringstream s;
+    s << VC4C_VERSION << ';' << LLVM_LIBRARY_VERSION;
+    Dl_info info;
+    struct stat fileStats;
+    if(dladdr(reinterpret_cast<void*>(&getCompilerBuildID), &info) != 0 && info.dli_fname != nullptr &&
+        stat(info.dli_fname, &fileStats) == 0)
+        s << ';' << info.dli_fname << ';' << fileStats.st_size << ';' << fileStats.st_mtime;
+    return s.str();
+}
+
+/*
+ * The pre-compiled VC4CL standard-library is part of every compilation, so any change in it invalidates the cache
+ */
+static std::string getStandardLibraryID()
+{
+    std::stringstream s;
+    const auto& files = Precompiler::findStandardLibraryFiles();
+    for(const auto& file : {files.configurationHeader, files.precompiledHeader, files.llvmModule})
+    {
+        struct stat fileStats;
+        s << file << ';';
+        if(!file.empty() && stat(file.data(), &fileStats) == 0)
+            s << fileStats.st_size << ';' << fileStats.st_mtime << ';';
+    }
+    return s.str();
+}
+
+static std::string toConfigurationString(const Configuration& config)
+{
+    // NOTE: All members which have an effect on the generated code need to be listed here!
+    std::stringstream s;
+    s << static_cast<unsigned>(config.mathType) << ';' << static_cast<unsigned>(config.outputMode) << ';'
+      << config.writeKernelInfo << ';' << config.availableVPMSize << ';' << static_cast<unsigned>(config.frontend)
+      << ';' << static_cast<unsigned>(config.optimizationLevel) << ';';
+    // the sets are unordered, so sort their entries to get a stable string representation
+    for(const auto& pass :
+        std::set<std::string>(config.additionalEnabledOptimizations.begin(), config.additionalEnabledOptimizations.end()))
+        s << '+' << pass << ';';
+    for(const auto& pass : std::set<std::string>(
+            config.additionalDisabledOptimizations.begin(), config.additionalDisabledOptimizations.end()))
+        s << '-' << pass << ';';
+    const auto& options = config.additionalOptions;
+    s << options.combineLoadThreshold << ';' << options.accumulatorThreshold << ';' << options.accumulatorLoopWeight
+      << ';' << options.replaceNopThreshold << ';' << options.registerResolverMaxRounds << ';'
+      << options.moveConstantsDepth << ';' << options.maxOptimizationIterations << ';'
+      << options.maxCommonExpressionDinstance << ';';
+    s << config.useOpt << ';' << config.stopWhenVerificationFailed;
+    return s.str();
+}
+
+static bool createDirectories(const std::string& path)
+{
+    std::size_t pos = 0;
+    do
+    {
+        pos = path.find('/', pos + 1);
+        const std::string part = path.substr(0, pos);
+        // EEXIST is fine here, e.g. created in the mean time by another process
+        if(mkdir(part.data(), 0755) != 0 && errno != EEXIST)
+            return false;
+    } while(pos != std::string::npos);
+    return true;
+}
+
+CompilationCache::CompilationCache(const Configuration& config) : config(config) {}
+
+bool CompilationCache::isCacheable(const std::string& input, const std::string& options)
+{
+    // any option adding include paths or files: -I, -include, -imacros, -iquote, -isystem, etc.
+    std::istringstream optionStream(options);
+    std::string option;
+    while(optionStream >> option)
+    {
+        if(option.find("-I") == 0 || option.find("-i") == 0 || option.find("--include") == 0)
+            return false;
+    }
+
+    // any pre-processor include directive, e.g. "#include" or "#  include"
+    std::size_t pos = 0;
+    while((pos = input.find('#', pos)) != std::string::npos)
+    {
+        const auto directiveStart = input.find_first_not_of(" \t", pos + 1);
+        if(directiveStart != std::string::npos && input.compare(directiveStart, 7, "include") == 0)
+            return false;
+        ++pos;
+    }
+    return true;
+}
+
+CompilationCache::Key CompilationCache::calculateKey(const std::string& input, const std::string& options) const
+{
+    static const std::string buildID = getCompilerBuildID() + ';' + getStandardLibraryID();
+
+    Hasher hasher;
+    hasher.update(buildID);
+    hasher.update(toConfigurationString(config));
+    hasher.update(options);
+    hasher.update(input);
+    return hasher.finish();
+}
+
+Optional<CompilationCache::Entry> CompilationCache::lookup(const Key& key) const
+{
+    const auto path = getEntryPath(key);
+    std::ifstream file(path, std::ios_base::in | std::ios_base::binary);
+    EntryHeader header;
+    if(!file.is_open() || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magicNumber != CACHE_MAGIC_NUMBER || header.formatVersion != CACHE_FORMAT_VERSION || header.key != key)
+    {
+        CPPLOG_LAZY(logging::Level::DEBUG, log << "Compilation cache miss for: " << path << logging::endl);
+        ++numMisses;
+        return {};
+    }
+
+    Entry entry{static_cast<std::size_t>(header.bytesWritten), std::string(header.dataSize, '\0')};
+    if(!file.read(&entry.data[0], static_cast<std::streamsize>(header.dataSize)))
+    {
+        logging::warn() << "Failed to read compilation cache entry, ignoring it: " << path << logging::endl;
+        ++numMisses;
+        return {};
+    }
+
+    // update the modification time for the least-recently-used eviction
+    if(utime(path.data(), nullptr) != 0)
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Failed to update time-stamp of compilation cache entry: " << strerror(errno) << logging::endl);
+    CPPLOG_LAZY(logging::Level::INFO, log << "Compilation cache hit for: " << path << logging::endl);
+    ++numHits;
+    return entry;
+}
+
+void CompilationCache::store(const Key& key, const Entry& entry) const
+{
+    if(!createDirectories(config.cacheDirectory))
+    {
+        logging::warn() << "Failed to create compilation cache directory '" << config.cacheDirectory
+                        << "': " << strerror(errno) << logging::endl;
+        return;
+    }
+
+    // write into a temporary file in the same directory (and therefore the same file-system) and then atomically
+    // rename it, so other processes never see partially written entries
+    std::string tmpName = config.cacheDirectory + "/.tmp-XXXXXX";
+    int fd = mkstemp(&tmpName[0]);
+    if(fd < 0)
+    {
+        logging::warn() << "Failed to create temporary compilation cache entry: " << strerror(errno) << logging::endl;
+        return;
+    }
+    EntryHeader header{
+        CACHE_MAGIC_NUMBER, CACHE_FORMAT_VERSION, key, static_cast<uint64_t>(entry.bytesWritten), entry.data.size()};
+    bool success = write(fd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header));
+    std::size_t offset = 0;
+    while(success && offset < entry.data.size())
+    {
+        auto numWritten = write(fd, entry.data.data() + offset, entry.data.size() - offset);
+        success = numWritten > 0;
+        offset += success ? static_cast<std::size_t>(numWritten) : 0;
+    }
+    success = close(fd) == 0 && success;
+
+    const auto path = getEntryPath(key);
+    if(!success || rename(tmpName.data(), path.data()) != 0)
+    {
+        logging::warn() << "Failed to write compilation cache entry '" << path << "': " << strerror(errno)
+                        << logging::endl;
+        remove(tmpName.data());
+        return;
+    }
+    CPPLOG_LAZY(logging::Level::DEBUG, log << "Stored compilation cache entry: " << path << logging::endl);
+    ++numStores;
+
+    evictEntries();
+}
+
+CompilationCacheStatistics CompilationCache::getStatistics()
+{
+    return CompilationCacheStatistics{numHits, numMisses, numStores, numEvictions};
+}
+
+std::string CompilationCache::getEntryPath(const Key& key) const
+{
+    std::stringstream s;
+    s << config.cacheDirectory << '/' << std::hex << std::setfill('0') << std::setw(16) << key[0] << std::setw(16)
+      << key[1] << CACHE_FILE_EXTENSION;
+    return s.str();
+}
+
+void CompilationCache::evictEntries() const
+{
+    struct CacheFile
+    {
+        std::string path;
+        std::size_t size;
+        time_t lastUsed;
+    };
+
+    DIR* dir = opendir(config.cacheDirectory.data());
+    if(dir == nullptr)
+        return;
+    std::vector<CacheFile> files;
+    std::size_t totalSize = 0;
+    while(auto dirEntry = readdir(dir))
+    {
+        const std::string name(dirEntry->d_name);
+        if(name.size() <= CACHE_FILE_EXTENSION.size() ||
+            name.compare(name.size() - CACHE_FILE_EXTENSION.size(), CACHE_FILE_EXTENSION.size(),
+                CACHE_FILE_EXTENSION) != 0)
+            continue;
+        struct stat fileStats;
+        const std::string path = config.cacheDirectory + "/" + name;
+        if(stat(path.data(), &fileStats) != 0)
+            // e.g. already evicted by another process
+            continue;
+        files.emplace_back(CacheFile{path, static_cast<std::size_t>(fileStats.st_size), fileStats.st_mtime});
+        totalSize += files.back().size;
+    }
+    closedir(dir);
+
+    if(totalSize <= config.maxCacheSize)
+        return;
+
+    std::sort(files.begin(), files.end(),
+        [](const CacheFile& one, const CacheFile& other) -> bool { return one.lastUsed < other.lastUsed; });
+    for(const auto& file : files)
+    {
+        if(totalSize <= config.maxCacheSize)
+            break;
+        // another process might have removed the file already, in which case the space is freed too
+        if(remove(file.path.data()) == 0)
+        {
+            CPPLOG_LAZY(logging::Level::DEBUG, log << "Evicted compilation cache entry: " << file.path << logging::endl);
+            ++numEvictions;
+        }
+        totalSize -= file.size;
+    }
+}
+
+CompilationCacheStatistics vc4c::getCompilationCacheStatistics()
+{
+    return CompilationCache::getStatistics();
+}
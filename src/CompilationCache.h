@@ -0,0 +1,90 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#ifndef VC4C_COMPILATION_CACHE_H
+#define VC4C_COMPILATION_CACHE_H
+
+#include "Compiler.h"
+#include "Optional.h"
+#include "config.h"
+
+#include <array>
+#include <string>
+
+namespace vc4c
+{
+    /*
+     * Persistent content-addressed on-disk cache for the results of Compiler#compile.
+     *
+     * The cache entries are looked up by a key calculated over the input code, the pre-compiler options, all
+     * configuration values affecting the generated code and an identifier of the compiler build. Each entry contains the
+     * complete compilation output (incl. the module and kernel meta-data header), so on a cache hit neither the
+     * pre-compiler nor the compiler itself need to be run.
+     *
+     * Entries are written into a temporary file and then atomically renamed, so the cache directory can be shared by
+     * multiple processes. If the total size of all entries exceeds the configured limit, the least recently used
+     * entries are evicted.
+     *
+     * NOTE: Any error accessing the cache is not fatal, it is logged and handled like a cache miss.
+     *
+     * NOTE: Only the input code itself is part of the key, not any header it includes. Therefore inputs including other
+     * files (or options adding include paths or files) are never cached, see #isCacheable().
+     */
+    class CompilationCache
+    {
+    public:
+        using Key = std::array<uint64_t, 2>;
+
+        /*
+         * A single cache entry
+         */
+        struct Entry
+        {
+            // the value returned by the compilation
+            std::size_t bytesWritten;
+            // the complete compilation output
+            std::string data;
+        };
+
+        explicit CompilationCache(const Configuration& config);
+
+        /*
+         * Returns whether the result of compiling the given input code with the given options can be cached.
+         *
+         * This is not the case if the compilation depends on other files, e.g. headers included by the input code or
+         * the include directories (incl. the directory of the input file, which is added by the pre-compiler)
+         */
+        static bool isCacheable(const std::string& input, const std::string& options);
+
+        /*
+         * Calculates the cache key for compiling the given input code with the given options
+         */
+        Key calculateKey(const std::string& input, const std::string& options) const;
+
+        /*
+         * Looks up the cached compilation result for the given key
+         */
+        Optional<Entry> lookup(const Key& key) const;
+
+        /*
+         * Stores the compilation result for the given key and evicts old entries if the cache grew too large
+         */
+        void store(const Key& key, const Entry& entry) const;
+
+        /*
+         * Returns the statistics for all cache accesses of the current process
+         */
+        static CompilationCacheStatistics getStatistics();
+
+    private:
+        const Configuration config;
+
+        std::string getEntryPath(const Key& key) const;
+        void evictEntries() const;
+    };
+} // namespace vc4c
+
+#endif /* VC4C_COMPILATION_CACHE_H */
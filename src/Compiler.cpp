@@ -7,10 +7,13 @@
 #include "Compiler.h"
 
 #include "BackgroundWorker.h"
+#include "CompilationCache.h"
 #include "CompilationError.h"
+#include "MemoryArena.h"
 #include "Parser.h"
 #include "Precompiler.h"
 #include "Profiler.h"
+#include "Telemetry.h"
 #include "asm/CodeGenerator.h"
 #include "log.h"
 #include "logger.h"
@@ -95,27 +98,62 @@ std::size_t Compiler::convert()
 
     std::unique_ptr<Parser> parser = getParser(input);
     PROFILE_START(Parser);
+    telemetry::PassMeasurement parsing(config, "parse");
     parser->parse(module);
+    parsing.finish();
     PROFILE_END(Parser);
 
     normalization::Normalizer norm(config);
     optimizations::Optimizer opt(config);
     qpu_asm::CodeGenerator codeGen(module, config);
 
-    PROFILE_START(Normalizer);
-    norm.normalize(module);
-    PROFILE_END(Normalizer);
+    PROFILE_START(ModuleNormalizer);
+    norm.prepareKernels(module);
+    PROFILE_END(ModuleNormalizer);
 
-    PROFILE_START(Optimizer);
-    opt.optimize(module);
-    PROFILE_END(Optimizer);
+    // After the module-wide steps, every kernel runs through its own pipeline independent of the other kernels, so a
+    // single huge kernel does not hold up the processing of all other kernels at every stage
+    const auto f = [&](Method* kernelFunc) -> void {
+        // all instructions created for the kernel are owned by its arena
+        MemoryArena::Scope arenaScope(&kernelFunc->getArena());
+        PROFILE_START(Normalizer);
+        telemetry::PassMeasurement normalization(config, *kernelFunc, "normalization");
+        norm.normalizeMethod(module, *kernelFunc);
+        normalization.finish(*kernelFunc);
+        PROFILE_END(Normalizer);
 
-    PROFILE_START(SecondNormalizer);
-    norm.adjust(module);
-    PROFILE_END(SecondNormalizer);
+        PROFILE_START(Optimizer);
+        telemetry::PassMeasurement optimization(config, *kernelFunc, "optimization");
+        opt.optimizeMethod(module, *kernelFunc);
+        optimization.finish(*kernelFunc);
+        PROFILE_END(Optimizer);
 
-    const auto f = [&codeGen](Method* kernelFunc) -> void { codeGen.toMachineCode(*kernelFunc); };
-    BackgroundWorker::scheduleAll<Method*>(module.getKernels(), f, "CodeGenerator");
+        PROFILE_START(SecondNormalizer);
+        telemetry::PassMeasurement adjustment(config, *kernelFunc, "adjustment");
+        norm.adjustMethod(module, *kernelFunc);
+        adjustment.finish(*kernelFunc);
+        PROFILE_END(SecondNormalizer);
+
+        PROFILE_START(CodeGenerator);
+        telemetry::PassMeasurement codeGeneration(config, *kernelFunc, "code-generation");
+        codeGen.toMachineCode(*kernelFunc);
+        codeGeneration.finish(*kernelFunc);
+        PROFILE_END(CodeGenerator);
+
+        // the kernel is not modified anymore, so no other thread allocates from its arena. Without the arena, every
+        // allocation would be a heap allocation, with it only the chunks and the allocations too big to be pooled are
+        const auto arenaStatistics = kernelFunc->getArena().getStatistics();
+        telemetry::addToCounter(config, *kernelFunc, "Arena allocations",
+            arenaStatistics.numPooledAllocations + arenaStatistics.numHeapAllocations);
+        telemetry::addToCounter(config, *kernelFunc, "Arena reused blocks", arenaStatistics.numReusedBlocks);
+        telemetry::addToCounter(config, *kernelFunc, "Arena heap allocations",
+            arenaStatistics.numChunks + arenaStatistics.numHeapAllocations);
+        PROFILE_COUNTER(vc4c::profiler::COUNTER_GENERAL + 200, "Arena pooled allocations",
+            arenaStatistics.numPooledAllocations);
+        PROFILE_COUNTER(vc4c::profiler::COUNTER_GENERAL + 201, "Arena heap allocations",
+            arenaStatistics.numChunks + arenaStatistics.numHeapAllocations);
+    };
+    BackgroundWorker::scheduleAll<Method*>(module.getKernels(), f, "KernelPipeline");
 
     // TODO could discard unused globals
     // since they are exported, they are still in the intermediate code, even if not used (e.g. optimized away)
@@ -142,10 +180,45 @@ std::size_t Compiler::compile(std::istream& input, std::ostream& output, const C
 {
     try
     {
+        std::unique_ptr<CompilationCache> cache;
+        CompilationCache::Key cacheKey{};
+        // the input actually passed to the pre-compiler
+        std::istream* source = &input;
+        std::istringstream bufferedInput;
+        if(!config.cacheDirectory.empty())
+        {
+            // the whole input is required to calculate the key
+            std::string inputData{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+            if(input.bad())
+                throw CompilationError(CompilationStep::GENERAL, "Failed to read the input to compile");
+
+            if(CompilationCache::isCacheable(inputData, options))
+            {
+                cache.reset(new CompilationCache(config));
+                cacheKey = cache->calculateKey(inputData, options);
+            }
+            else
+                CPPLOG_LAZY(logging::Level::INFO,
+                    log << "Skipping compilation cache, since the input depends on included files" << logging::endl);
+            // the input stream is consumed and cannot be rewound in general (e.g. for stdin or pipes), so the
+            // pre-compiler reads the buffered input
+            bufferedInput.str(std::move(inputData));
+            source = &bufferedInput;
+            if(auto entry = cache ? cache->lookup(cacheKey) : Optional<CompilationCache::Entry>{})
+            {
+                output.write(entry->data.data(), static_cast<std::streamsize>(entry->data.size()));
+                output.flush();
+                if(!config.telemetryFile.empty())
+                    // nothing was compiled, but still write the file to not leave a stale one from a previous run
+                    telemetry::writeRecords(config.telemetryFile);
+                return entry->bytesWritten;
+            }
+        }
+
         // pre-compilation
         TemporaryFile tmpFile;
         std::unique_ptr<std::istream> in;
-        Precompiler::precompile(input, in, config, options, inputFile, tmpFile.fileName);
+        Precompiler::precompile(*source, in, config, options, inputFile, tmpFile.fileName);
 
         if(in == nullptr ||
             (dynamic_cast<std::istringstream*>(in.get()) != nullptr &&
@@ -154,11 +227,23 @@ std::size_t Compiler::compile(std::istream& input, std::ostream& output, const C
             tmpFile.openInputStream(in);
 
         // compilation
-        Compiler conv(*in.get(), output);
+        // if the result is cached, write into a buffer first, so we can store the result afterwards
+        std::ostringstream cacheBuffer;
+        Compiler conv(*in.get(), cache ? cacheBuffer : output);
 
         conv.getConfiguration() = config;
         std::size_t result = conv.convert();
 
+        if(cache)
+        {
+            const auto data = cacheBuffer.str();
+            output.write(data.data(), static_cast<std::streamsize>(data.size()));
+            cache->store(cacheKey, CompilationCache::Entry{result, data});
+        }
+
+        if(!config.telemetryFile.empty())
+            telemetry::writeRecords(config.telemetryFile);
+
         // clean-up
         std::wcout.flush();
         std::wcerr.flush();
@@ -145,6 +145,15 @@ namespace vc4c
             removeEdge(*it->second);
         }
 
+        /*
+         * Removes all edges from and to this node
+         */
+        void removeAllEdges()
+        {
+            while(!edges.empty())
+                removeEdge(*edges.begin()->second);
+        }
+
         /*
          * Returns the single neighbor with the given relation.
          * Returns nullptr otherwise, if there is no or more than one neighbor with this relation.
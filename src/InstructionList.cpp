@@ -0,0 +1,96 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#include "InstructionList.h"
+
+#include "intermediate/IntermediateInstruction.h"
+
+#include <algorithm>
+#include <new>
+
+using namespace vc4c;
+using namespace vc4c::intermediate;
+
+InstructionList::InstructionList(MemoryArena* arena) :
+    sentinel{&sentinel, &sentinel}, numElements(0), freeNodes(nullptr), nextUnusedNode(0), allocator(arena)
+{
+}
+
+InstructionList::~InstructionList()
+{
+    clear();
+    for(const auto& slab : slabs)
+        allocator.deallocate(slab.nodes, slab.numNodes);
+}
+
+InstructionList::iterator InstructionList::emplace(const_iterator pos, IntermediateInstruction* instr)
+{
+    Node* node = allocateNode();
+    node->value.reset(instr);
+    NodeBase* next = pos.node;
+    node->next = next;
+    node->prev = next->prev;
+    next->prev->next = node;
+    next->prev = node;
+    ++numElements;
+    return iterator(node);
+}
+
+void InstructionList::emplace_back(IntermediateInstruction* instr)
+{
+    emplace(end(), instr);
+}
+
+InstructionList::iterator InstructionList::erase(const_iterator pos)
+{
+    auto node = static_cast<Node*>(pos.node);
+    NodeBase* next = node->next;
+    node->prev->next = next;
+    next->prev = node->prev;
+    --numElements;
+    // unlink the node before destroying the instruction, in case the destructor accesses the list
+    node->~Node();
+    freeNodes = new(static_cast<void*>(node)) NodeBase{nullptr, freeNodes};
+    return iterator(next);
+}
+
+void InstructionList::clear()
+{
+    while(!empty())
+        erase(begin());
+}
+
+InstructionList::Node* InstructionList::allocateNode()
+{
+    void* storage = nullptr;
+    if(freeNodes != nullptr)
+    {
+        storage = static_cast<void*>(freeNodes);
+        freeNodes = freeNodes->next;
+    }
+    else
+    {
+        if(slabs.empty() || nextUnusedNode == slabs.back().numNodes)
+        {
+            // new slabs grow with the block, so small blocks do not waste memory and big blocks need few slabs.
+            // The arena serves blocks bigger than a few nodes in powers of two, so the slabs are sized to fill them.
+            std::size_t numNodes = MIN_SLAB_SIZE;
+            if(!slabs.empty())
+            {
+                const std::size_t minBytes = 2 * slabs.back().numNodes * sizeof(Node);
+                std::size_t slabBytes = 1;
+                while(slabBytes < minBytes && slabBytes < MemoryArena::MAX_BLOCK_SIZE)
+                    slabBytes *= 2;
+                numNodes = slabBytes / sizeof(Node);
+            }
+            slabs.emplace_back(Slab{allocator.allocate(numNodes), numNodes});
+            nextUnusedNode = 0;
+        }
+        storage = slabs.back().nodes + nextUnusedNode;
+        ++nextUnusedNode;
+    }
+    return new(storage) Node{};
+}
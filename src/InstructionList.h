@@ -0,0 +1,231 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#ifndef VC4C_INSTRUCTION_LIST_H
+#define VC4C_INSTRUCTION_LIST_H
+
+#include "MemoryArena.h"
+#include "Optional.h"
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace vc4c
+{
+    namespace intermediate
+    {
+        class IntermediateInstruction;
+
+        using IL = std::unique_ptr<IntermediateInstruction>;
+
+        /*
+         * Doubly-linked list of the instructions of a single basic block.
+         *
+         * Other than std::list, which allocates every node separately, the nodes are allocated in slabs owned by the
+         * list. This places the nodes of a basic block next to each other in memory (in order of creation), so walking
+         * over the block touches only a few cache lines. Erased nodes are kept in a free-list and reused for the next
+         * insertion.
+         *
+         * Just like for std::list, iterators to an element stay valid until that element is erased, independent of
+         * insertions and erasures of other elements.
+         */
+        class InstructionList : private NonCopyable
+        {
+            struct NodeBase
+            {
+                NodeBase* prev;
+                NodeBase* next;
+            };
+
+            struct Node : public NodeBase
+            {
+                IL value;
+            };
+
+            template <typename T>
+            class Iterator
+            {
+            public:
+                using iterator_category = std::bidirectional_iterator_tag;
+                using value_type = IL;
+                using difference_type = std::ptrdiff_t;
+                using pointer = T*;
+                using reference = T&;
+
+                Iterator() noexcept : node(nullptr) {}
+                explicit Iterator(NodeBase* node) noexcept : node(node) {}
+                // allows to convert a mutable iterator to a constant one
+                template <typename U,
+                    typename =
+                        typename std::enable_if<std::is_same<const U, T>::value && !std::is_same<U, T>::value>::type>
+                Iterator(const Iterator<U>& other) noexcept : node(other.node)
+                {
+                }
+
+                reference operator*() const noexcept
+                {
+                    return static_cast<Node*>(node)->value;
+                }
+
+                pointer operator->() const noexcept
+                {
+                    return &static_cast<Node*>(node)->value;
+                }
+
+                Iterator& operator++() noexcept
+                {
+                    node = node->next;
+                    return *this;
+                }
+
+                Iterator operator++(int) noexcept
+                {
+                    Iterator tmp(*this);
+                    node = node->next;
+                    return tmp;
+                }
+
+                Iterator& operator--() noexcept
+                {
+                    node = node->prev;
+                    return *this;
+                }
+
+                Iterator operator--(int) noexcept
+                {
+                    Iterator tmp(*this);
+                    node = node->prev;
+                    return tmp;
+                }
+
+                template <typename U>
+                bool operator==(const Iterator<U>& other) const noexcept
+                {
+                    return node == other.node;
+                }
+
+                template <typename U>
+                bool operator!=(const Iterator<U>& other) const noexcept
+                {
+                    return node != other.node;
+                }
+
+            private:
+                NodeBase* node;
+
+                template <typename U>
+                friend class Iterator;
+                friend class InstructionList;
+            };
+
+        public:
+            using value_type = IL;
+            using size_type = std::size_t;
+            using iterator = Iterator<IL>;
+            using const_iterator = Iterator<const IL>;
+
+            explicit InstructionList(MemoryArena* arena = nullptr);
+            InstructionList(const InstructionList&) = delete;
+            InstructionList(InstructionList&&) = delete;
+            ~InstructionList();
+
+            InstructionList& operator=(const InstructionList&) = delete;
+            InstructionList& operator=(InstructionList&&) = delete;
+
+            inline iterator begin() noexcept
+            {
+                return iterator(sentinel.next);
+            }
+
+            inline const_iterator begin() const noexcept
+            {
+                return const_iterator(sentinel.next);
+            }
+
+            inline iterator end() noexcept
+            {
+                return iterator(&sentinel);
+            }
+
+            inline const_iterator end() const noexcept
+            {
+                // the sentinel is never modified via a constant iterator
+                return const_iterator(const_cast<NodeBase*>(&sentinel));
+            }
+
+            inline bool empty() const noexcept
+            {
+                return numElements == 0;
+            }
+
+            inline size_type size() const noexcept
+            {
+                return numElements;
+            }
+
+            inline IL& front() noexcept
+            {
+                return *begin();
+            }
+
+            inline const IL& front() const noexcept
+            {
+                return *begin();
+            }
+
+            inline IL& back() noexcept
+            {
+                return *iterator(sentinel.prev);
+            }
+
+            inline const IL& back() const noexcept
+            {
+                return *const_iterator(sentinel.prev);
+            }
+
+            /*
+             * Inserts the given instruction before the given position and returns the position of the new element
+             */
+            iterator emplace(const_iterator pos, IntermediateInstruction* instr);
+            void emplace_back(IntermediateInstruction* instr);
+
+            /*
+             * Removes the element at the given position (destroying the instruction) and returns the position of the
+             * following element
+             */
+            iterator erase(const_iterator pos);
+
+            void clear();
+
+        private:
+            // the number of nodes in the first slab, every further slab doubles in size up to the biggest block served
+            // by the memory arena (see MemoryArena::MAX_BLOCK_SIZE)
+            static constexpr std::size_t MIN_SLAB_SIZE = 8;
+
+            struct Slab
+            {
+                Node* nodes;
+                std::size_t numNodes;
+            };
+
+            NodeBase sentinel;
+            std::size_t numElements;
+            // the list of free nodes, only linked via their next-pointer
+            NodeBase* freeNodes;
+            // the slabs all nodes are allocated in and the position of the next node never used so far in the last slab
+            std::vector<Slab> slabs;
+            std::size_t nextUnusedNode;
+            ArenaAllocator<Node> allocator;
+
+            Node* allocateNode();
+        };
+    } // namespace intermediate
+} // namespace vc4c
+
+#endif /* VC4C_INSTRUCTION_LIST_H */
@@ -8,9 +8,118 @@
 
 #include "intermediate/IntermediateInstruction.h"
 
+#include <algorithm>
+
+#ifdef MULTI_THREADED
+#include <array>
+#include <mutex>
+#endif
+
 using namespace vc4c;
 
-Local::Local(DataType type, const std::string& name) : type(type), name(name), reference(nullptr, ANY_ELEMENT) {}
+#ifdef MULTI_THREADED
+/*
+ * Block-local optimization passes modify the users of Locals accessed from multiple basic blocks concurrently (e.g.
+ * parameters), so the access to the users is synchronized.
+ *
+ * To not increase the size of every single Local, a fixed number of locks is shared between all Locals.
+ */
+static std::array<std::mutex, 64> userLocks;
+
+static std::mutex& getUsersLock(const Local* local)
+{
+    // the lower bits are always the same due to the alignment
+    return userLocks[(reinterpret_cast<uintptr_t>(local) / alignof(Local)) % userLocks.size()];
+}
+
+#define LOCK_USERS std::lock_guard<std::mutex> usersGuard(getUsersLock(this))
+#else
+#define LOCK_USERS
+#endif
+
+constexpr std::size_t LocalUsersMap::INDEX_THRESHOLD;
+
+LocalUsersMap::LocalUsersMap(MemoryArena* arena) :
+    entries(Entries::allocator_type(arena)),
+    positions(0, std::hash<const LocalUser*>{}, std::equal_to<const LocalUser*>{},
+        decltype(positions)::allocator_type(arena)),
+    isIndexed(false)
+{
+}
+
+LocalUsersMap::iterator LocalUsersMap::find(const LocalUser* user)
+{
+    return entries.begin() + static_cast<std::ptrdiff_t>(findPosition(user));
+}
+
+LocalUsersMap::const_iterator LocalUsersMap::find(const LocalUser* user) const
+{
+    return entries.begin() + static_cast<std::ptrdiff_t>(findPosition(user));
+}
+
+LocalUse& LocalUsersMap::operator[](const LocalUser* user)
+{
+    auto pos = findPosition(user);
+    if(pos != entries.size())
+        return entries[pos].second;
+    entries.emplace_back(user, LocalUse{});
+    if(isIndexed)
+        positions.emplace(user, pos);
+    else if(entries.size() > INDEX_THRESHOLD)
+    {
+        positions.reserve(entries.size() * 2);
+        for(std::size_t i = 0; i < entries.size(); ++i)
+            positions.emplace(entries[i].first, i);
+        isIndexed = true;
+    }
+    return entries.back().second;
+}
+
+std::size_t LocalUsersMap::erase(const LocalUser* user)
+{
+    auto it = find(user);
+    if(it == entries.end())
+        return 0;
+    erase(it);
+    return 1;
+}
+
+void LocalUsersMap::erase(const_iterator it)
+{
+    auto pos = static_cast<std::size_t>(it - entries.begin());
+    if(isIndexed)
+        positions.erase(it->first);
+    if(pos + 1 != entries.size())
+    {
+        // move the last entry into the gap instead of shifting all following entries
+        entries[pos] = entries.back();
+        if(isIndexed)
+            positions[entries[pos].first] = pos;
+    }
+    entries.pop_back();
+}
+
+std::size_t LocalUsersMap::findPosition(const LocalUser* user) const
+{
+    if(isIndexed)
+    {
+        auto it = positions.find(user);
+        return it != positions.end() ? it->second : entries.size();
+    }
+    for(std::size_t i = 0; i < entries.size(); ++i)
+    {
+        if(entries[i].first == user)
+            return i;
+    }
+    return entries.size();
+}
+
+constexpr std::size_t Local::INVALID_INDEX;
+
+Local::Local(DataType type, const std::string& name, MemoryArena* arena) :
+    type(type), name(name), reference(nullptr, ANY_ELEMENT), users(arena)
+{
+}
 
 bool Local::operator<(const Local& other) const
 {
@@ -31,13 +140,20 @@ Value Local::createReference(int index) const
     return Value(this, type);
 }
 
-const SortedMap<const LocalUser*, LocalUse>& Local::getUsers() const
+const LocalUsersMap& Local::getUsers() const
+{
+    return users;
+}
+
+LocalUsersMap Local::copyUsers() const
 {
+    LOCK_USERS;
     return users;
 }
 
 FastSet<const LocalUser*> Local::getUsers(const LocalUse::Type type) const
 {
+    LOCK_USERS;
     FastSet<const LocalUser*> users;
     for(const auto& pair : this->users)
     {
@@ -48,41 +164,81 @@ FastSet<const LocalUser*> Local::getUsers(const LocalUse::Type type) const
     return users;
 }
 
+std::size_t Local::countUsers(LocalUse::Type type) const
+{
+    LOCK_USERS;
+    return static_cast<std::size_t>(std::count_if(users.begin(), users.end(), [type](const auto& pair) -> bool {
+        return (has_flag(type, LocalUse::Type::READER) && pair.second.readsLocal()) ||
+            (has_flag(type, LocalUse::Type::WRITER) && pair.second.writesLocal());
+    }));
+}
+
+bool Local::hasUsers(LocalUse::Type type) const
+{
+    LOCK_USERS;
+    return std::any_of(users.begin(), users.end(), [type](const auto& pair) -> bool {
+        return (has_flag(type, LocalUse::Type::READER) && pair.second.readsLocal()) ||
+            (has_flag(type, LocalUse::Type::WRITER) && pair.second.writesLocal());
+    });
+}
+
+const LocalUser* Local::findUser(LocalUse::Type type, const std::function<bool(const LocalUser*)>& predicate) const
+{
+    LOCK_USERS;
+    for(const auto& pair : users)
+    {
+        if(((has_flag(type, LocalUse::Type::READER) && pair.second.readsLocal()) ||
+               (has_flag(type, LocalUse::Type::WRITER) && pair.second.writesLocal())) &&
+            predicate(pair.first))
+            return pair.first;
+    }
+    return nullptr;
+}
+
 void Local::forUsers(const LocalUse::Type type, const std::function<void(const LocalUser*)>& consumer) const
 {
-    for(const auto& pair : this->users)
+    // the lock must not be held while running the consumer, since it might modify the users of this or other Locals
+    FastAccessList<const LocalUser*> matchingUsers;
     {
-        if((has_flag(type, LocalUse::Type::READER) && pair.second.readsLocal()) ||
-            (has_flag(type, LocalUse::Type::WRITER) && pair.second.writesLocal()))
-            consumer(pair.first);
+        LOCK_USERS;
+        matchingUsers.reserve(users.size());
+        for(const auto& pair : this->users)
+        {
+            if((has_flag(type, LocalUse::Type::READER) && pair.second.readsLocal()) ||
+                (has_flag(type, LocalUse::Type::WRITER) && pair.second.writesLocal()))
+                matchingUsers.push_back(pair.first);
+        }
     }
+    for(const LocalUser* user : matchingUsers)
+        consumer(user);
 }
 
 void Local::removeUser(const LocalUser& user, const LocalUse::Type type)
 {
+    LOCK_USERS;
     if(type == LocalUse::Type::BOTH)
     {
         // if we remove the user completely, ignore if it was a user
         users.erase(&user);
         return;
     }
-    if(users.find(&user) == users.end())
+    auto it = users.find(&user);
+    if(it == users.end())
         throw CompilationError(
             CompilationStep::GENERAL, "Trying to remove a not registered user for a local", user.to_string());
-    LocalUse& use = users.at(&user);
+    LocalUse& use = it->second;
     if(type == LocalUse::Type::READER)
         --use.numReads;
     else if(type == LocalUse::Type::WRITER)
         --use.numWrites;
     if(!use.readsLocal() && !use.writesLocal())
-        users.erase(&user);
+        users.erase(it);
 }
 
 void Local::addUser(const LocalUser& user, const LocalUse::Type type)
 {
-    if(users.find(&user) == users.end())
-        users.emplace(&user, LocalUse());
-    LocalUse& use = users.at(&user);
+    LOCK_USERS;
+    LocalUse& use = users[&user];
     if(has_flag(type, LocalUse::Type::READER))
         ++use.numReads;
     if(has_flag(type, LocalUse::Type::WRITER))
@@ -91,6 +247,7 @@ void Local::addUser(const LocalUser& user, const LocalUse::Type type)
 
 const LocalUser* Local::getSingleWriter() const
 {
+    LOCK_USERS;
     const LocalUser* writer = nullptr;
     for(const auto& pair : this->users)
     {
@@ -7,10 +7,14 @@
 #ifndef LOCALS_H
 #define LOCALS_H
 
+#include "MemoryArena.h"
 #include "Values.h"
 
 #include <functional>
+#include <limits>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace vc4c
 {
@@ -62,6 +66,77 @@ namespace vc4c
         }
     };
 
+    /*
+     * Container for the users of a Local, allocated from the memory arena of the method owning the Local (if any).
+     *
+     * The users are stored in a flat list, which is cheap to iterate. Locals with many users additionally get a
+     * hash-index mapping the users to their position in the list. Together with erasing entries by replacing them with
+     * the last entry, this makes adding, finding and removing users constant-time operations.
+     * The tools/users_benchmark.cpp micro-benchmark compares this container against the sorted map used before.
+     *
+     * NOTE: The order of the users is arbitrary and changes when users are removed!
+     */
+    class LocalUsersMap
+    {
+        using Entries = std::vector<std::pair<const LocalUser*, LocalUse>,
+            ArenaAllocator<std::pair<const LocalUser*, LocalUse>>>;
+
+    public:
+        using value_type = Entries::value_type;
+        using iterator = Entries::iterator;
+        using const_iterator = Entries::const_iterator;
+
+        explicit LocalUsersMap(MemoryArena* arena = nullptr);
+
+        const_iterator begin() const noexcept
+        {
+            return entries.begin();
+        }
+
+        const_iterator end() const noexcept
+        {
+            return entries.end();
+        }
+
+        std::size_t size() const noexcept
+        {
+            return entries.size();
+        }
+
+        bool empty() const noexcept
+        {
+            return entries.empty();
+        }
+
+        iterator find(const LocalUser* user);
+        const_iterator find(const LocalUser* user) const;
+
+        /*
+         * Returns the use for the given user, inserting an empty use if the user is not yet contained
+         */
+        LocalUse& operator[](const LocalUser* user);
+
+        /*
+         * Removes the given user (if contained) and returns the number of users removed
+         */
+        std::size_t erase(const LocalUser* user);
+        void erase(const_iterator it);
+
+    private:
+        // up to this number of users, a linear search is faster than building and maintaining the hash-index, see the
+        // users micro-benchmark
+        static constexpr std::size_t INDEX_THRESHOLD = 32;
+
+        Entries entries;
+        // the positions of the users in the entries, only filled for locals with more users than the threshold
+        std::unordered_map<const LocalUser*, std::size_t, std::hash<const LocalUser*>,
+            std::equal_to<const LocalUser*>, ArenaAllocator<std::pair<const LocalUser* const, std::size_t>>>
+            positions;
+        bool isIndexed;
+
+        std::size_t findPosition(const LocalUser* user) const;
+    };
+
     /*
      * A Local is a Value stored in a (name) variable and represents any Value which is neither a Register, a constant
      * value nor a compound constant value.
@@ -93,14 +168,42 @@ namespace vc4c
 
         /*
          * Returns all the LocalUsers accessing this object
+         *
+         * NOTE: The access to the users is not synchronized, so this must only be used in single-threaded phases (e.g.
+         * register allocation, code generation). Block-local optimization passes, which can modify the users
+         * concurrently, need to use #countUsers(), #hasUsers(), #findUser(), #forUsers() or #copyUsers() instead.
          */
-        const SortedMap<const LocalUser*, LocalUse>& getUsers() const;
+        const LocalUsersMap& getUsers() const;
+        /*
+         * Returns a copy of all the LocalUsers accessing this object, taken while holding the lock on the users
+         *
+         * NOTE: This copies the whole container, so it should only be used when the copy is modified afterwards
+         */
+        LocalUsersMap copyUsers() const;
         /*
          * Returns the users of the given kind (reading or writing) accessing this Local
          */
         FastSet<const LocalUser*> getUsers(LocalUse::Type type) const;
+        /*
+         * Returns the number of users of the given kind (reading or writing) accessing this Local
+         */
+        std::size_t countUsers(LocalUse::Type type) const;
+        /*
+         * Returns whether there is any user of the given kind (reading or writing) accessing this Local
+         */
+        bool hasUsers(LocalUse::Type type) const;
+        /*
+         * Returns the first user of the given kind (reading or writing) the predicate holds for, or nullptr if there
+         * is no such user
+         *
+         * NOTE: The predicate is executed while holding the lock on the users, so it must not access the users of any
+         * Local. Use #forUsers() for consumers which do.
+         */
+        const LocalUser* findUser(LocalUse::Type type, const std::function<bool(const LocalUser*)>& predicate) const;
         /*
          * Executes the consumer for all users of the type specified
+         *
+         * NOTE: The consumer is executed for a snapshot of the users, so it may modify the users of this Local
          */
         void forUsers(const LocalUse::Type type, const std::function<void(const LocalUser*)>& consumer) const;
         /*
@@ -166,6 +269,20 @@ namespace vc4c
          */
         const Local* getBase(bool includeOffsets) const;
 
+        /*
+         * Returns the dense index of this local within the method owning it.
+         *
+         * The indices of all locals of a method are below Method#getLocalIndexLimit(), which allows to use them e.g. as
+         * positions in bit-vectors. Locals not owned by a method (globals, parameters, stack allocations) return
+         * INVALID_INDEX.
+         */
+        std::size_t getIndex() const
+        {
+            return index;
+        }
+
+        static constexpr std::size_t INVALID_INDEX = std::numeric_limits<std::size_t>::max();
+
         /*
          * The type of the data represented by this local
          */
@@ -184,12 +301,11 @@ namespace vc4c
         std::pair<Local*, int> reference;
 
     protected:
-        Local(DataType type, const std::string& name);
+        Local(DataType type, const std::string& name, MemoryArena* arena = nullptr);
 
     private:
-        // FIXME unordered_map randomly throws SEGFAULT somewhere in stdlib in #removeUser called by
-        // IntermediateInstruction#erase
-        SortedMap<const LocalUser*, LocalUse> users;
+        LocalUsersMap users;
+        std::size_t index = INVALID_INDEX;
 
         friend class Method;
     };
@@ -0,0 +1,177 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#include "MemoryArena.h"
+
+#include "log.h"
+
+#include <new>
+#include <tuple>
+
+using namespace vc4c;
+
+static thread_local MemoryArena* currentArena = nullptr;
+
+// the header stored in front of memory allocated via MemoryArena#allocateFromCurrentArena, padded to keep the alignment
+static constexpr std::size_t HEADER_SIZE = alignof(std::max_align_t);
+static_assert(HEADER_SIZE >= sizeof(MemoryArena*), "Arena header cannot store the owning arena");
+
+#ifdef MULTI_THREADED
+#define LOCK_ARENA std::lock_guard<std::mutex> guard(lock)
+#else
+#define LOCK_ARENA
+#endif
+
+MemoryArena::Scope::Scope(MemoryArena* arena) : previousArena(currentArena)
+{
+    currentArena = arena;
+}
+
+MemoryArena::Scope::~Scope()
+{
+    currentArena = previousArena;
+}
+
+static std::atomic<std::size_t> nextArenaId{1};
+
+MemoryArena::MemoryArena() : id(nextArenaId++), numLiveObjects(0) {}
+
+MemoryArena::~MemoryArena()
+{
+#ifdef DEBUG_MODE
+    if(numLiveObjects != 0)
+        logging::error() << numLiveObjects << " instructions allocated from a memory arena outlive the arena"
+                         << logging::endl;
+#endif
+}
+
+MemoryArena::ThreadCache& MemoryArena::getThreadCache()
+{
+    // threads usually allocate from the same arena for a long time, so remember the last cache used
+    static thread_local std::pair<std::size_t, ThreadCache*> lastCache{0, nullptr};
+    if(lastCache.first == id)
+        return *lastCache.second;
+
+    LOCK_ARENA;
+    auto& cache = threadCaches[std::this_thread::get_id()];
+    if(!cache)
+        cache.reset(new ThreadCache());
+    lastCache = std::make_pair(id, cache.get());
+    return *cache;
+}
+
+std::pair<std::size_t, std::size_t> MemoryArena::getBlockSize(std::size_t numBytes)
+{
+    if(numBytes <= MAX_SMALL_BLOCK_SIZE)
+    {
+        const std::size_t index = numBytes == 0 ? 0 : (numBytes - 1) / BLOCK_GRANULARITY;
+        return std::make_pair(index, (index + 1) * BLOCK_GRANULARITY);
+    }
+    std::size_t index = NUM_SMALL_BLOCK_SIZES;
+    std::size_t blockSize = MAX_SMALL_BLOCK_SIZE * 2;
+    while(blockSize < numBytes)
+    {
+        blockSize *= 2;
+        ++index;
+    }
+    return std::make_pair(index, blockSize);
+}
+
+void* MemoryArena::allocate(std::size_t numBytes)
+{
+    ThreadCache& cache = getThreadCache();
+    if(numBytes > MAX_BLOCK_SIZE)
+    {
+        ++cache.statistics.numHeapAllocations;
+        return ::operator new(numBytes);
+    }
+    std::size_t index;
+    std::size_t blockSize;
+    std::tie(index, blockSize) = getBlockSize(numBytes);
+
+    ++cache.statistics.numPooledAllocations;
+    if(auto block = cache.freeLists[index])
+    {
+        cache.freeLists[index] = block->next;
+        ++cache.statistics.numReusedBlocks;
+        return block;
+    }
+    if(cache.chunkPosition == nullptr || static_cast<std::size_t>(cache.chunkEnd - cache.chunkPosition) < blockSize)
+    {
+        // the rest of the current chunk is too small and simply not used
+        cache.chunks.emplace_back(new char[CHUNK_SIZE]);
+        cache.chunkPosition = cache.chunks.back().get();
+        cache.chunkEnd = cache.chunkPosition + CHUNK_SIZE;
+        ++cache.statistics.numChunks;
+    }
+    void* block = cache.chunkPosition;
+    cache.chunkPosition += blockSize;
+    return block;
+}
+
+void MemoryArena::deallocate(void* ptr, std::size_t numBytes)
+{
+    if(ptr == nullptr)
+        return;
+    if(numBytes > MAX_BLOCK_SIZE)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+    const std::size_t index = getBlockSize(numBytes).first;
+    // the block is reused by this thread, independent of which thread allocated it, since all chunks are freed together
+    ThreadCache& cache = getThreadCache();
+    auto block = static_cast<FreeBlock*>(ptr);
+    block->next = cache.freeLists[index];
+    cache.freeLists[index] = block;
+}
+
+MemoryArena::Statistics MemoryArena::getStatistics() const
+{
+    LOCK_ARENA;
+    Statistics statistics;
+    for(const auto& cache : threadCaches)
+    {
+        statistics.numPooledAllocations += cache.second->statistics.numPooledAllocations;
+        statistics.numReusedBlocks += cache.second->statistics.numReusedBlocks;
+        statistics.numHeapAllocations += cache.second->statistics.numHeapAllocations;
+        statistics.numChunks += cache.second->statistics.numChunks;
+    }
+    return statistics;
+}
+
+MemoryArena* MemoryArena::getCurrentArena()
+{
+    return currentArena;
+}
+
+void* MemoryArena::allocateFromCurrentArena(std::size_t numBytes)
+{
+    MemoryArena* arena = currentArena;
+    void* ptr = arena ? arena->allocate(numBytes + HEADER_SIZE) : ::operator new(numBytes + HEADER_SIZE);
+    *static_cast<MemoryArena**>(ptr) = arena;
+#ifdef DEBUG_MODE
+    if(arena)
+        ++arena->numLiveObjects;
+#endif
+    return static_cast<char*>(ptr) + HEADER_SIZE;
+}
+
+void MemoryArena::deallocateToOwningArena(void* ptr, std::size_t numBytes)
+{
+    if(ptr == nullptr)
+        return;
+    void* base = static_cast<char*>(ptr) - HEADER_SIZE;
+    if(MemoryArena* arena = *static_cast<MemoryArena**>(base))
+    {
+#ifdef DEBUG_MODE
+        --arena->numLiveObjects;
+#endif
+        arena->deallocate(base, numBytes + HEADER_SIZE);
+    }
+    else
+        ::operator delete(base);
+}
@@ -0,0 +1,222 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#ifndef VC4C_MEMORY_ARENA_H
+#define VC4C_MEMORY_ARENA_H
+
+#include "Optional.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#ifdef MULTI_THREADED
+#include <mutex>
+#endif
+
+namespace vc4c
+{
+    /*
+     * Pool allocator owning all small objects allocated for a single method (e.g. instructions, locals and their
+     * users), which are all freed at once when the arena is destroyed.
+     *
+     * The memory is allocated in big chunks, which are split into blocks of a few fixed sizes: small blocks in steps of
+     * the alignment, bigger blocks (e.g. the slabs of the instruction lists) in powers of two. Freed blocks are kept in
+     * a free-list per size and reused for the next allocation of the same size. Allocations too big for any block size
+     * are forwarded to the global heap.
+     *
+     * This reduces the number of heap allocations and places objects allocated together (e.g. the instructions of a
+     * basic block) close to each other in memory.
+     *
+     * Every thread allocating from an arena gets its own chunks and free-lists, so threads allocating concurrently
+     * from the same arena (e.g. block-local optimizations for the same method) are not synchronized. Blocks freed by
+     * another thread than the allocating one are reused by the freeing thread.
+     */
+    class MemoryArena : private NonCopyable
+    {
+    public:
+        /*
+         * Statistics about the allocations served by an arena
+         */
+        struct Statistics
+        {
+            // the number of allocations served from the chunks of the arena
+            std::size_t numPooledAllocations = 0;
+            // the number of pooled allocations which reused a previously freed block
+            std::size_t numReusedBlocks = 0;
+            // the number of allocations too big to be pooled and forwarded to the heap
+            std::size_t numHeapAllocations = 0;
+            // the number of chunks allocated from the heap
+            std::size_t numChunks = 0;
+        };
+
+        /*
+         * Makes the given arena the arena to allocate instructions from for the current thread while this object
+         * exists.
+         *
+         * NOTE: All instructions created while the scope is active need to belong to the method owning the arena and
+         * must not outlive it, since the memory of all instructions is freed with the arena! In debug builds, the
+         * arena reports any such instruction still alive when it is destroyed.
+         */
+        class Scope : private NonCopyable
+        {
+        public:
+            explicit Scope(MemoryArena* arena);
+            Scope(const Scope&) = delete;
+            Scope(Scope&&) = delete;
+            ~Scope();
+
+            Scope& operator=(const Scope&) = delete;
+            Scope& operator=(Scope&&) = delete;
+
+        private:
+            MemoryArena* previousArena;
+        };
+
+        MemoryArena();
+        MemoryArena(const MemoryArena&) = delete;
+        MemoryArena(MemoryArena&&) = delete;
+        ~MemoryArena();
+
+        MemoryArena& operator=(const MemoryArena&) = delete;
+        MemoryArena& operator=(MemoryArena&&) = delete;
+
+        void* allocate(std::size_t numBytes);
+        void deallocate(void* ptr, std::size_t numBytes);
+
+        /*
+         * Returns the statistics summed up over all threads
+         *
+         * NOTE: This function must not be called while other threads allocate from this arena
+         */
+        Statistics getStatistics() const;
+
+        /*
+         * Returns the arena set via a Scope for the current thread, if any
+         */
+        static MemoryArena* getCurrentArena();
+
+        /*
+         * Allocates memory from the arena currently active for this thread, if any, or from the heap otherwise.
+         *
+         * The memory needs to be released via #deallocateToOwningArena(), which returns it to the arena it was
+         * allocated from, independent of the arena active at that time.
+         */
+        static void* allocateFromCurrentArena(std::size_t numBytes);
+        static void deallocateToOwningArena(void* ptr, std::size_t numBytes);
+
+        // the size of the biggest blocks served from the arena, bigger allocations are forwarded to the heap
+        static constexpr std::size_t MAX_BLOCK_SIZE = 16 * 1024;
+
+    private:
+        // the size granularity of the small blocks, also guarantees the alignment of all blocks
+        static constexpr std::size_t BLOCK_GRANULARITY = alignof(std::max_align_t);
+        // up to this size, the block sizes are multiples of the granularity, above powers of two
+        static constexpr std::size_t MAX_SMALL_BLOCK_SIZE = 256;
+        static constexpr std::size_t NUM_SMALL_BLOCK_SIZES = MAX_SMALL_BLOCK_SIZE / BLOCK_GRANULARITY;
+        // 512, 1024, ..., 16384
+        static constexpr std::size_t NUM_BIG_BLOCK_SIZES = 6;
+        static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+        static_assert((MAX_SMALL_BLOCK_SIZE << NUM_BIG_BLOCK_SIZES) == MAX_BLOCK_SIZE, "Invalid arena block sizes");
+
+        struct FreeBlock
+        {
+            FreeBlock* next;
+        };
+
+        /*
+         * The chunks and free-lists used by a single thread
+         */
+        struct ThreadCache
+        {
+            std::vector<std::unique_ptr<char[]>> chunks;
+            char* chunkPosition = nullptr;
+            char* chunkEnd = nullptr;
+            std::array<FreeBlock*, NUM_SMALL_BLOCK_SIZES + NUM_BIG_BLOCK_SIZES> freeLists{};
+            Statistics statistics;
+        };
+
+        // unique over all arenas ever created, so a thread never confuses the cache of a destroyed arena with the
+        // cache of a new arena created at the same address
+        const std::size_t id;
+        std::unordered_map<std::thread::id, std::unique_ptr<ThreadCache>> threadCaches;
+        // the number of instructions allocated via #allocateFromCurrentArena() not yet freed, only tracked in debug
+        // builds
+        std::atomic<std::size_t> numLiveObjects;
+#ifdef MULTI_THREADED
+        // only guards the creation of the thread caches, not the allocations themselves
+        mutable std::mutex lock;
+#endif
+
+        ThreadCache& getThreadCache();
+        /*
+         * Returns the index of the free-list for and the size of the block serving the given allocation size
+         */
+        static std::pair<std::size_t, std::size_t> getBlockSize(std::size_t numBytes);
+    };
+
+    /*
+     * Standard-library compatible allocator allocating from a memory arena.
+     *
+     * If no arena is given, the memory is allocated from the heap, so containers not owned by any method (e.g. the
+     * users of global data) can use the same type.
+     */
+    template <typename T>
+    class ArenaAllocator
+    {
+    public:
+        using value_type = T;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        ArenaAllocator() noexcept : arena(nullptr) {}
+        explicit ArenaAllocator(MemoryArena* arena) noexcept : arena(arena) {}
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena)
+        {
+        }
+
+        T* allocate(std::size_t num)
+        {
+            if(arena)
+                return static_cast<T*>(arena->allocate(num * sizeof(T)));
+            return static_cast<T*>(::operator new(num * sizeof(T)));
+        }
+
+        void deallocate(T* ptr, std::size_t num) noexcept
+        {
+            if(arena)
+                arena->deallocate(ptr, num * sizeof(T));
+            else
+                ::operator delete(ptr);
+        }
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U>& other) const noexcept
+        {
+            return arena == other.arena;
+        }
+
+        template <typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const noexcept
+        {
+            return arena != other.arena;
+        }
+
+    private:
+        MemoryArena* arena;
+
+        template <typename U>
+        friend class ArenaAllocator;
+    };
+} // namespace vc4c
+
+#endif /* VC4C_MEMORY_ARENA_H */
@@ -38,7 +38,8 @@ const std::string Method::GROUP_LOOP_SIZE("%group_loop_size");
 
 Method::Method(const Module& module) :
     isKernel(false), name(), returnType(TYPE_UNKNOWN),
-    vpm(new periphery::VPM(module.compilationConfig.availableVPMSize)), module(module)
+    vpm(new periphery::VPM(module.compilationConfig.availableVPMSize)), module(module), arena(),
+    locals(decltype(locals)::allocator_type(&arena))
 {
 }
 
@@ -48,8 +49,16 @@ Method::~Method()
     basicBlocks.clear();
 }
 
+MemoryArena& Method::getArena()
+{
+    return arena;
+}
+
 const Local* Method::findLocal(const std::string& name) const
 {
+#ifdef MULTI_THREADED
+    std::lock_guard<std::mutex> guard(localsLock);
+#endif
     auto it = locals.find(name);
     if(it != locals.end())
         return &(it->second);
@@ -92,12 +101,15 @@ const Local* Method::findOrCreateLocal(DataType type, const std::string& name)
         loc = findStackAllocation(name);
     if(loc != nullptr)
         return loc;
-    auto it = locals.emplace(name, Local(type, name));
-    return &(it.first->second);
+#ifdef MULTI_THREADED
+    std::lock_guard<std::mutex> guard(localsLock);
+#endif
+    // if the local was created in the mean time by another thread, the existing local is returned
+    return emplaceLocal(type, name).first;
 }
 
 static NODISCARD bool removeUsagesInBasicBlock(const Method& method, const BasicBlock& bb, const Local* locale,
-    SortedMap<const LocalUser*, LocalUse>& remainingUsers, int& usageRangeLeft)
+    LocalUsersMap& remainingUsers, int& usageRangeLeft)
 {
     auto it = bb.walk();
     while(usageRangeLeft >= 0 && !it.isEndOfMethod())
@@ -118,7 +130,7 @@ static NODISCARD bool removeUsagesInBasicBlock(const Method& method, const Basic
 
 bool Method::isLocallyLimited(InstructionWalker curIt, const Local* locale, const std::size_t threshold) const
 {
-    auto remainingUsers = locale->getUsers();
+    auto remainingUsers = locale->copyUsers();
 
     int32_t usageRangeLeft = static_cast<int32_t>(threshold);
     // check whether the local is written in the instruction before (and this)
@@ -153,11 +165,13 @@ static std::atomic_size_t tmpIndex{0};
 const Value Method::addNewLocal(DataType type, const std::string& prefix, const std::string& postfix)
 {
     const std::string name = createLocalName(prefix, postfix);
-    if(findLocal(name) != nullptr)
-        throw CompilationError(
-            CompilationStep::GENERAL, "Local with this name already exists", findLocal(name)->to_string());
-    auto it = locals.emplace(name, Local(type, name));
-    return it.first->second.createReference();
+#ifdef MULTI_THREADED
+    std::lock_guard<std::mutex> guard(localsLock);
+#endif
+    auto it = emplaceLocal(type, name);
+    if(!it.second)
+        throw CompilationError(CompilationStep::GENERAL, "Local with this name already exists", it.first->to_string());
+    return it.first->createReference();
 }
 
 std::string Method::createLocalName(const std::string& prefix, const std::string& postfix)
@@ -265,6 +279,54 @@ std::size_t Method::getNumLocals() const
     return locals.size();
 }
 
+std::size_t Method::getLocalIndexLimit() const
+{
+#ifdef MULTI_THREADED
+    std::lock_guard<std::mutex> guard(localsLock);
+#endif
+    return numLocalIndices;
+}
+
+void Method::reindexLocals(std::size_t firstIndex)
+{
+    FastMap<const Local*, std::size_t> newIndices;
+    std::size_t nextIndex = firstIndex;
+    for(const BasicBlock& block : basicBlocks)
+    {
+        for(auto it = block.walk(); !it.isEndOfBlock(); it.nextInBlock())
+        {
+            if(!it.has())
+                continue;
+            it->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+                if(loc->index != Local::INVALID_INDEX && loc->index >= firstIndex &&
+                    newIndices.emplace(loc, nextIndex).second)
+                    ++nextIndex;
+            });
+        }
+    }
+#ifdef MULTI_THREADED
+    std::lock_guard<std::mutex> guard(localsLock);
+#endif
+    for(auto& pair : locals)
+    {
+        Local& loc = pair.second;
+        if(loc.index == Local::INVALID_INDEX || loc.index < firstIndex)
+            continue;
+        auto it = newIndices.find(&loc);
+        // locals not used anymore get the remaining indices
+        loc.index = it != newIndices.end() ? it->second : nextIndex++;
+    }
+}
+
+std::pair<Local*, bool> Method::emplaceLocal(DataType type, const std::string& name)
+{
+    auto it = locals.emplace(name, Local(type, name, &arena));
+    if(it.second)
+        // indices are never reused, so they stay unique even if locals are removed
+        it.first->second.index = numLocalIndices++;
+    return std::make_pair(&it.first->second, it.second);
+}
+
 void Method::cleanLocals()
 {
     // FIXME deletes locals which still have Local#reference to them
@@ -295,7 +357,7 @@ void Method::cleanLocals()
             throw CompilationError(
                 CompilationStep::GENERAL, "Local is already defined for method", it->second.to_string());
 #endif
-        if((*it).second.getUsers().empty())
+        if(!(*it).second.hasUsers(LocalUse::Type::BOTH))
         {
             it = locals.erase(it);
             ++numCleaned;
@@ -380,8 +442,14 @@ bool Method::removeBlock(BasicBlock& block, bool overwriteUsages)
 
 BasicBlock& Method::createAndInsertNewBlock(BasicBlockList::iterator position, const std::string& labelName)
 {
-    auto newLabel = locals.emplace(labelName, Local(TYPE_LABEL, labelName));
-    auto& block = *basicBlocks.emplace(position, *this, new intermediate::BranchLabel(newLabel.first->second));
+    const Local* newLabel = nullptr;
+    {
+#ifdef MULTI_THREADED
+        std::lock_guard<std::mutex> guard(localsLock);
+#endif
+        newLabel = emplaceLocal(TYPE_LABEL, labelName).first;
+    }
+    auto& block = *basicBlocks.emplace(position, *this, new intermediate::BranchLabel(*newLabel));
     updateCFGOnBlockInsertion(&block);
     return block;
 }
@@ -11,6 +11,10 @@
 #include "KernelMetaData.h"
 #include "Optional.h"
 
+#ifdef MULTI_THREADED
+#include <mutex>
+#endif
+
 namespace vc4c
 {
     namespace periphery
@@ -158,6 +162,18 @@ namespace vc4c
         InstructionWalker appendToEnd();
 
         std::size_t getNumLocals() const;
+        /*
+         * Returns the upper bound (exclusive) of the indices of all locals owned by this method (see Local#getIndex())
+         */
+        std::size_t getLocalIndexLimit() const;
+        /*
+         * Reassigns the indices of all locals created since the given index in the order of their first use in the
+         * method.
+         *
+         * Locals created concurrently (e.g. by block-local optimizations) get their indices in an arbitrary order, this
+         * makes the indices (and everything depending on them) independent of the order the locals were created in.
+         */
+        void reindexLocals(std::size_t firstIndex);
         /*
          * Removes all locals without any usages left
          */
@@ -282,7 +298,18 @@ namespace vc4c
         DataType createImageType(
             uint8_t dimensions, bool isImageArray = false, bool isImageBuffer = false, bool isSampled = false);
 
+        /*
+         * Returns the arena owning the instructions, locals and local users of this method
+         */
+        MemoryArena& getArena();
+
     private:
+        /*
+         * The memory arena for the instructions and locals of this method.
+         *
+         * NOTE: Needs to be declared before all members allocating from it, so it is destroyed after them
+         */
+        MemoryArena arena;
         /*
          * The list of basic blocks
          */
@@ -290,7 +317,19 @@ namespace vc4c
         /*
          * The list of locals
          */
-        FastMap<std::string, Local> locals;
+        std::unordered_map<std::string, Local, std::hash<std::string>, std::equal_to<std::string>,
+            ArenaAllocator<std::pair<const std::string, Local>>>
+            locals;
+        /*
+         * The index assigned to the next local created
+         */
+        std::size_t numLocalIndices = 0;
+#ifdef MULTI_THREADED
+        /*
+         * Guards the list of locals, since block-local optimizations may create new locals concurrently
+         */
+        mutable std::mutex localsLock;
+#endif
         /*
          * The currently valid CFG
          *
@@ -299,6 +338,12 @@ namespace vc4c
         std::unique_ptr<ControlFlowGraph> cfg;
 
         std::string createLocalName(const std::string& prefix = "", const std::string& postfix = "");
+        /*
+         * Inserts a new local with the given name (if it does not yet exist) and assigns it the next free index.
+         *
+         * NOTE: Needs to be called with the locals lock held (if any)
+         */
+        std::pair<Local*, bool> emplaceLocal(DataType type, const std::string& name);
 
         BasicBlock* getNextBlockAfter(const BasicBlock* block);
         BasicBlock* getPreviousBlock(const BasicBlock* block);
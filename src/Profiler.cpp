@@ -6,6 +6,7 @@
 
 #include "Profiler.h"
 
+#include "ThreadLocalBuffers.h"
 #include "log.h"
 
 #include <chrono>
@@ -14,10 +15,6 @@
 #include <set>
 #include <unordered_map>
 
-#ifdef MULTI_THREADED
-#include <mutex>
-#endif
-
 using namespace vc4c;
 
 using Clock = std::chrono::system_clock;
@@ -57,32 +54,62 @@ struct Counter
     }
 };
 
-static std::unordered_map<std::string, Entry> times;
-static std::map<std::size_t, Counter> counters;
-#ifdef MULTI_THREADED
-static std::mutex lockTimes;
-static std::mutex lockCounters;
-#endif
+/*
+ * The profiling results collected by a single thread
+ */
+struct ProfilingData
+{
+    std::unordered_map<std::string, Entry> times;
+    std::map<std::size_t, Counter> counters;
+};
+
+// every thread records its results into its own buffer, so the threads are not synchronized by profiling
+static ThreadLocalBuffers<ProfilingData> profilingData;
 
 void profiler::endFunctionCall(ProfilingResult&& result)
 {
-#ifdef MULTI_THREADED
-    std::lock_guard<std::mutex> guard(lockTimes);
-#endif
-    auto& entry = times[result.name];
-    entry.name = std::move(result.name);
-    entry.duration += std::chrono::duration_cast<Duration>(Clock::now() - result.startTime);
-    entry.invocations += 1;
-    entry.fileName = std::move(result.fileName);
-    entry.lineNumber = result.lineNumber;
+    const auto duration = std::chrono::duration_cast<Duration>(Clock::now() - result.startTime);
+    profilingData.modifyLocal([&](ProfilingData& data) {
+        auto& entry = data.times[result.name];
+        entry.name = std::move(result.name);
+        entry.duration += duration;
+        entry.invocations += 1;
+        entry.fileName = std::move(result.fileName);
+        entry.lineNumber = result.lineNumber;
+    });
 }
 
 void profiler::dumpProfileResults(bool writeAsWarning)
 {
+    // merge the results of all threads
+    ProfilingData mergedData;
+    profilingData.forAll([&](ProfilingData& data) {
+        for(auto& pair : data.times)
+        {
+            auto& entry = mergedData.times[pair.first];
+            entry.duration += pair.second.duration;
+            entry.invocations += pair.second.invocations;
+            entry.fileName = std::move(pair.second.fileName);
+            entry.lineNumber = pair.second.lineNumber;
+        }
+        for(auto& pair : data.counters)
+        {
+            auto& counter = mergedData.counters[pair.first];
+            counter.name = std::move(pair.second.name);
+            counter.count += pair.second.count;
+            counter.index = pair.second.index;
+            counter.invocations += pair.second.invocations;
+            counter.prevCounter = pair.second.prevCounter;
+            counter.fileName = std::move(pair.second.fileName);
+            counter.lineNumber = pair.second.lineNumber;
+        }
+        data.times.clear();
+        data.counters.clear();
+    });
+    auto& times = mergedData.times;
+    auto& counters = mergedData.counters;
+
     logging::logLazy(writeAsWarning ? logging::Level::WARNING : logging::Level::DEBUG, [&]() {
-#ifdef MULTI_THREADED
-        std::lock_guard<std::mutex> guard(lockTimes);
-#endif
         std::set<Entry> entries;
         std::set<Counter> counts;
         for(auto& entry : times)
@@ -128,21 +155,19 @@ void profiler::dumpProfileResults(bool writeAsWarning)
                       << logging::endl;
         }
     });
-    times.clear();
-    counters.clear();
 }
 
 void profiler::increaseCounter(const std::size_t index, std::string name, const std::size_t value, std::string file,
     const std::size_t line, const std::size_t prevIndex)
 {
-#ifdef MULTI_THREADED
-    std::lock_guard<std::mutex> guard(lockCounters);
-#endif
-    counters[index].index = index;
-    counters[index].name = std::move(name);
-    counters[index].count += value;
-    counters[index].invocations += 1;
-    counters[index].prevCounter = prevIndex;
-    counters[index].fileName = std::move(file);
-    counters[index].lineNumber = line;
+    profilingData.modifyLocal([&](ProfilingData& data) {
+        auto& counter = data.counters[index];
+        counter.index = index;
+        counter.name = std::move(name);
+        counter.count += static_cast<int64_t>(value);
+        counter.invocations += 1;
+        counter.prevCounter = prevIndex;
+        counter.fileName = std::move(file);
+        counter.lineNumber = line;
+    });
 }
@@ -0,0 +1,247 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#include "Telemetry.h"
+
+#include "CompilationError.h"
+#include "Method.h"
+#include "ThreadLocalBuffers.h"
+#include "config.h"
+#include "log.h"
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <sstream>
+
+using namespace vc4c;
+using namespace vc4c::telemetry;
+
+// every thread records into its own buffer, so the threads are not synchronized by recording
+static ThreadLocalBuffers<std::vector<PassRecord>> passRecords;
+static ThreadLocalBuffers<std::vector<CounterRecord>> counterRecords;
+
+static Duration getThreadCPUTime()
+{
+    struct timespec time;
+    if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+        return Duration{0};
+    return std::chrono::duration_cast<Duration>(
+        std::chrono::seconds{time.tv_sec} + std::chrono::nanoseconds{time.tv_nsec});
+}
+
+PassMeasurement::PassMeasurement(const Configuration& config, const Method& method, const std::string& stage,
+    const std::string& passName, unsigned iteration) :
+    enabled(!config.telemetryFile.empty()),
+    record{}, cpuStartTime(0)
+{
+    if(!enabled)
+        return;
+    record.kernelName = method.name;
+    record.stage = stage;
+    record.passName = passName;
+    record.iteration = iteration;
+    start(method.countInstructions());
+}
+
+PassMeasurement::PassMeasurement(const Configuration& config, const std::string& stage) :
+    enabled(!config.telemetryFile.empty()), record{}, cpuStartTime(0)
+{
+    if(!enabled)
+        return;
+    record.stage = stage;
+    start(0);
+}
+
+void PassMeasurement::finish(const Method& method)
+{
+    if(!enabled)
+        return;
+    store(method.countInstructions());
+}
+
+void PassMeasurement::finish()
+{
+    if(!enabled)
+        return;
+    store(0);
+}
+
+void PassMeasurement::start(std::size_t numInstructions)
+{
+    record.instructionsBefore = numInstructions;
+    cpuStartTime = getThreadCPUTime();
+    record.startTime = Clock::now();
+}
+
+void PassMeasurement::store(std::size_t numInstructions)
+{
+    record.wallTime = std::chrono::duration_cast<Duration>(Clock::now() - record.startTime);
+    record.cpuTime = getThreadCPUTime() - cpuStartTime;
+    record.instructionsAfter = numInstructions;
+    passRecords.modifyLocal([this](std::vector<PassRecord>& records) { records.emplace_back(std::move(record)); });
+    enabled = false;
+}
+
+void telemetry::addToCounter(
+    const Configuration& config, const Method& method, const std::string& name, std::size_t value)
+{
+    if(config.telemetryFile.empty())
+        return;
+    counterRecords.modifyLocal([&](std::vector<CounterRecord>& records) {
+        auto it = std::find_if(records.begin(), records.end(), [&](const CounterRecord& record) -> bool {
+            return record.kernelName == method.name && record.name == name;
+        });
+        if(it != records.end())
+            it->value += value;
+        else
+            records.emplace_back(CounterRecord{method.name, name, value});
+    });
+}
+
+std::vector<PassRecord> telemetry::collectRecords()
+{
+    std::vector<PassRecord> records;
+    passRecords.forAll([&records](std::vector<PassRecord>& threadRecords) {
+        std::move(threadRecords.begin(), threadRecords.end(), std::back_inserter(records));
+        threadRecords.clear();
+    });
+    std::sort(records.begin(), records.end(), [](const PassRecord& one, const PassRecord& other) -> bool {
+        if(one.kernelName != other.kernelName)
+            return one.kernelName < other.kernelName;
+        return one.startTime < other.startTime;
+    });
+    return records;
+}
+
+std::vector<CounterRecord> telemetry::collectCounters()
+{
+    std::map<std::pair<std::string, std::string>, std::size_t> counters;
+    counterRecords.forAll([&counters](std::vector<CounterRecord>& threadRecords) {
+        for(const auto& record : threadRecords)
+            counters[std::make_pair(record.kernelName, record.name)] += record.value;
+        threadRecords.clear();
+    });
+    std::vector<CounterRecord> records;
+    records.reserve(counters.size());
+    for(const auto& counter : counters)
+        records.emplace_back(CounterRecord{counter.first.first, counter.first.second, counter.second});
+    return records;
+}
+
+static std::string toJSONString(const std::string& s)
+{
+    std::stringstream ss;
+    ss << '"';
+    for(char c : s)
+    {
+        if(c == '"' || c == '\\')
+            ss << '\\' << c;
+        else if(static_cast<unsigned char>(c) < 0x20)
+            ss << "\\u" << std::hex << std::setfill('0') << std::setw(4) << static_cast<unsigned>(c) << std::dec;
+        else
+            ss << c;
+    }
+    ss << '"';
+    return ss.str();
+}
+
+static void writeRecord(std::ostream& out, const PassRecord& record)
+{
+    out << "{\"stage\": " << toJSONString(record.stage);
+    if(!record.passName.empty())
+        out << ", \"pass\": " << toJSONString(record.passName) << ", \"iteration\": " << record.iteration;
+    out << ", \"wallTimeUs\": " << record.wallTime.count() << ", \"cpuTimeUs\": " << record.cpuTime.count()
+        << ", \"instructionsBefore\": " << record.instructionsBefore
+        << ", \"instructionsAfter\": " << record.instructionsAfter << "}";
+}
+
+void telemetry::writeRecords(const std::string& fileName)
+{
+    const auto records = collectRecords();
+    const auto counters = collectCounters();
+
+    // group by kernel, the records are already sorted by kernel
+    std::vector<const PassRecord*> moduleRecords;
+    std::map<std::string, std::vector<const PassRecord*>> kernelRecords;
+    for(const auto& record : records)
+    {
+        if(record.kernelName.empty())
+            moduleRecords.push_back(&record);
+        else
+            kernelRecords[record.kernelName].push_back(&record);
+    }
+
+    std::ofstream out(fileName, std::ios_base::out | std::ios_base::trunc);
+    if(!out.is_open())
+        throw CompilationError(CompilationStep::GENERAL, "Failed to open telemetry output file", fileName);
+
+    out << "{" << std::endl << "  \"stages\": [";
+    bool firstStage = true;
+    for(const auto record : moduleRecords)
+    {
+        out << (firstStage ? "" : ",") << std::endl << "    ";
+        writeRecord(out, *record);
+        firstStage = false;
+    }
+    out << std::endl << "  ]," << std::endl << "  \"kernels\": [";
+    bool firstKernel = true;
+    for(const auto& kernel : kernelRecords)
+    {
+        unsigned numIterations = 0;
+        for(const auto record : kernel.second)
+            numIterations = std::max(numIterations, record->iteration);
+
+        out << (firstKernel ? "" : ",") << std::endl;
+        out << "    {" << std::endl;
+        out << "      \"name\": " << toJSONString(kernel.first) << "," << std::endl;
+        out << "      \"optimizationIterations\": " << numIterations << "," << std::endl;
+        out << "      \"counters\": {";
+        bool firstCounter = true;
+        for(const auto& counter : counters)
+        {
+            if(counter.kernelName != kernel.first)
+                continue;
+            out << (firstCounter ? "" : ",") << std::endl << "        ";
+            out << toJSONString(counter.name) << ": " << counter.value;
+            firstCounter = false;
+        }
+        out << std::endl << "      }," << std::endl;
+        out << "      \"stages\": [";
+        bool firstRecord = true;
+        for(const auto record : kernel.second)
+        {
+            if(!record->passName.empty())
+                continue;
+            out << (firstRecord ? "" : ",") << std::endl << "        ";
+            writeRecord(out, *record);
+            firstRecord = false;
+        }
+        out << std::endl << "      ]," << std::endl;
+        out << "      \"passes\": [";
+        firstRecord = true;
+        for(const auto record : kernel.second)
+        {
+            if(record->passName.empty())
+                continue;
+            out << (firstRecord ? "" : ",") << std::endl << "        ";
+            writeRecord(out, *record);
+            firstRecord = false;
+        }
+        out << std::endl << "      ]" << std::endl;
+        out << "    }";
+        firstKernel = false;
+    }
+    out << std::endl << "  ]" << std::endl << "}" << std::endl;
+
+    if(!out)
+        throw CompilationError(CompilationStep::GENERAL, "Failed to write telemetry output file", fileName);
+    CPPLOG_LAZY(logging::Level::INFO,
+        log << "Wrote " << records.size() << " telemetry records to: " << fileName << logging::endl);
+}
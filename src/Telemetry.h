@@ -0,0 +1,122 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#ifndef VC4C_TELEMETRY_H
+#define VC4C_TELEMETRY_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace vc4c
+{
+    class Method;
+    struct Configuration;
+
+    /*
+     * Low-overhead recording of the compilation time and effect of the single compilation steps per kernel.
+     *
+     * Unlike the profiler, the telemetry is available in all builds and is enabled by setting
+     * Configuration#telemetryFile. The records are written to the configured file in JSON format at the end of the
+     * compilation.
+     */
+    namespace telemetry
+    {
+        using Clock = std::chrono::steady_clock;
+        using Duration = std::chrono::microseconds;
+
+        /*
+         * A single execution of a compilation stage or optimization pass for a single kernel
+         */
+        struct PassRecord
+        {
+            // the kernel the record belongs to, empty for module-wide stages
+            std::string kernelName;
+            // the compilation stage, e.g. "optimization"
+            std::string stage;
+            // the optimization pass, empty for the record of the whole stage
+            std::string passName;
+            // the 1-based iteration of the repeated optimization passes, 0 for all other passes
+            unsigned iteration;
+            Clock::time_point startTime;
+            Duration wallTime;
+            // the CPU time of the thread running the pass (excluding any nested tasks run by other threads)
+            Duration cpuTime;
+            std::size_t instructionsBefore;
+            std::size_t instructionsAfter;
+        };
+
+        /*
+         * A value counted for a single kernel, e.g. the number of instructions processed by an optimization pass
+         */
+        struct CounterRecord
+        {
+            std::string kernelName;
+            std::string name;
+            std::size_t value;
+        };
+
+        /*
+         * Measures a single execution of a compilation stage or optimization pass.
+         *
+         * If telemetry is disabled for the given configuration, no values are measured.
+         */
+        class PassMeasurement
+        {
+        public:
+            PassMeasurement(const Configuration& config, const Method& method, const std::string& stage,
+                const std::string& passName = "", unsigned iteration = 0);
+            /*
+             * Measures a module-wide stage (e.g. parsing) not associated with any kernel
+             */
+            PassMeasurement(const Configuration& config, const std::string& stage);
+
+            /*
+             * Finishes the measurement and records the result
+             */
+            void finish(const Method& method);
+            /*
+             * Finishes the measurement of a module-wide stage
+             */
+            void finish();
+
+        private:
+            bool enabled;
+            PassRecord record;
+            Duration cpuStartTime;
+
+            void start(std::size_t numInstructions);
+            void store(std::size_t numInstructions);
+        };
+
+        /*
+         * Adds the given value to the counter with the given name for the given kernel.
+         *
+         * If telemetry is disabled for the given configuration, nothing is recorded.
+         */
+        void addToCounter(
+            const Configuration& config, const Method& method, const std::string& name, std::size_t value);
+
+        /*
+         * Returns and removes all records collected by all threads so far, ordered by kernel and start time
+         */
+        std::vector<PassRecord> collectRecords();
+        /*
+         * Returns and removes all counters collected by all threads so far, summed up and ordered by kernel and name
+         */
+        std::vector<CounterRecord> collectCounters();
+
+        /*
+         * Writes all records collected so far (and removes them) as JSON into the given file
+         *
+         * NOTE: If multiple compilations run in parallel within the same process, the records of all of them are
+         * written.
+         */
+        void writeRecords(const std::string& fileName);
+    } // namespace telemetry
+} // namespace vc4c
+
+#endif /* VC4C_TELEMETRY_H */
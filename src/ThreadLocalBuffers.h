@@ -0,0 +1,96 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#ifndef VC4C_THREAD_LOCAL_BUFFERS_H
+#define VC4C_THREAD_LOCAL_BUFFERS_H
+
+#include "Optional.h"
+
+#include <memory>
+#include <vector>
+
+#ifdef MULTI_THREADED
+#include <mutex>
+#endif
+
+namespace vc4c
+{
+    /*
+     * Container for data collected by several threads, where every thread writes into its own buffer.
+     *
+     * The buffer of a thread is only locked by the thread itself and when all buffers are collected, so the threads
+     * never wait for each other while collecting data. The buffers outlive their threads, so no data is lost if a
+     * thread exits before the data is collected.
+     *
+     * NOTE: The thread-local buffer is shared between all instances with the same data type, so there must only be a
+     * single instance per data type!
+     */
+    template <typename T>
+    class ThreadLocalBuffers : private NonCopyable
+    {
+    public:
+        /*
+         * Runs the given function with the data of the current thread
+         */
+        template <typename Func>
+        void modifyLocal(Func&& func)
+        {
+            auto& buffer = getLocalBuffer();
+#ifdef MULTI_THREADED
+            std::lock_guard<std::mutex> guard(buffer.lock);
+#endif
+            func(buffer.data);
+        }
+
+        /*
+         * Runs the given function for the data of all threads
+         */
+        template <typename Func>
+        void forAll(Func&& func)
+        {
+#ifdef MULTI_THREADED
+            std::lock_guard<std::mutex> guard(buffersLock);
+#endif
+            for(auto& buffer : buffers)
+            {
+#ifdef MULTI_THREADED
+                std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+#endif
+                func(buffer->data);
+            }
+        }
+
+    private:
+        struct Buffer
+        {
+#ifdef MULTI_THREADED
+            std::mutex lock;
+#endif
+            T data;
+        };
+
+        std::vector<std::shared_ptr<Buffer>> buffers;
+#ifdef MULTI_THREADED
+        std::mutex buffersLock;
+#endif
+
+        Buffer& getLocalBuffer()
+        {
+            static thread_local std::shared_ptr<Buffer> localBuffer;
+            if(!localBuffer)
+            {
+                localBuffer = std::make_shared<Buffer>();
+#ifdef MULTI_THREADED
+                std::lock_guard<std::mutex> guard(buffersLock);
+#endif
+                buffers.emplace_back(localBuffer);
+            }
+            return *localBuffer;
+        }
+    };
+} // namespace vc4c
+
+#endif /* VC4C_THREAD_LOCAL_BUFFERS_H */
@@ -0,0 +1,270 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#include "ThreadPool.h"
+
+#include "MemoryArena.h"
+#include "log.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef MULTI_THREADED
+#include <dlfcn.h>
+#include <sys/prctl.h>
+#endif
+
+using namespace vc4c;
+
+#ifdef MULTI_THREADED
+// the index of the queue of the current worker thread, SIZE_MAX for any thread not belonging to the pool
+static thread_local std::size_t currentWorkerIndex = SIZE_MAX;
+#endif
+
+ThreadPool::TaskGroup::TaskGroup(const std::string& name, ThreadPool& pool) :
+    name(name), pool(pool), error(nullptr)
+#ifdef MULTI_THREADED
+    ,
+    numPending(0), numQueued(0)
+#endif
+{
+}
+
+ThreadPool::TaskGroup::~TaskGroup()
+{
+    // the tasks reference this object, so we can't return before they all finished
+    waitForTasks();
+}
+
+void ThreadPool::TaskGroup::schedule(std::function<void()>&& task)
+{
+#ifdef MULTI_THREADED
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ++numPending;
+        ++numQueued;
+    }
+    // the task allocates its instructions from the same arena as the scheduling thread
+    auto arena = MemoryArena::getCurrentArena();
+    pool.push(Task{[arena, task = std::move(task)]() {
+                       MemoryArena::Scope arenaScope(arena);
+                       task();
+                   },
+        this});
+    // wake up a thread waiting for this group, e.g. if a task of this group schedules another task for it
+    stateChanged.notify_all();
+#else
+    runTask(task);
+#endif
+}
+
+void ThreadPool::TaskGroup::waitForAll()
+{
+    waitForTasks();
+    // throwing the exception after all tasks are finished makes sure no task accesses any data of the caller anymore
+    if(error)
+    {
+        auto tmp = error;
+        error = nullptr;
+        std::rethrow_exception(tmp);
+    }
+}
+
+void ThreadPool::TaskGroup::waitForTasks()
+{
+#ifdef MULTI_THREADED
+    std::unique_lock<std::mutex> guard(lock);
+    while(numPending != 0)
+    {
+        if(numQueued != 0)
+        {
+            guard.unlock();
+            // help executing the pending tasks of this group
+            pool.tryRunTask(this);
+            guard.lock();
+            continue;
+        }
+        // all remaining tasks of this group are currently executed by other threads
+        stateChanged.wait(guard, [this]() -> bool { return numPending == 0 || numQueued != 0; });
+    }
+#endif
+}
+
+void ThreadPool::TaskGroup::runTask(const std::function<void()>& task)
+{
+    try
+    {
+        task();
+    }
+    catch(const std::exception& e)
+    {
+        logging::error() << "Background worker threw error: " << e.what() << logging::endl;
+        logging::error() << "While running worker task: " << name << logging::endl;
+#ifdef MULTI_THREADED
+        std::lock_guard<std::mutex> guard(lock);
+#endif
+        if(!error)
+            error = std::current_exception();
+    }
+    catch(...)
+    {
+        // anything not derived from std::exception must not escape the worker thread either
+        logging::error() << "Background worker threw unknown error while running worker task: " << name
+                         << logging::endl;
+#ifdef MULTI_THREADED
+        std::lock_guard<std::mutex> guard(lock);
+#endif
+        if(!error)
+            error = std::current_exception();
+    }
+}
+
+ThreadPool::ThreadPool(std::size_t numThreads)
+#ifdef MULTI_THREADED
+    :
+    numQueued(0),
+    nextQueue(0), stopWorkers(false)
+#endif
+{
+#ifdef MULTI_THREADED
+    // we need thread-support, so load the pthread library dynamically (if it is not yet loaded)
+    void* handle = dlopen("libpthread.so.0", RTLD_GLOBAL | RTLD_LAZY);
+    if(handle == nullptr)
+    {
+        throw std::runtime_error(std::string("Error loading pthread library: ") + dlerror());
+    }
+
+    queues.reserve(numThreads);
+    for(std::size_t i = 0; i < numThreads; ++i)
+        queues.emplace_back(new WorkQueue());
+    workers.reserve(numThreads);
+    for(std::size_t i = 0; i < numThreads; ++i)
+        workers.emplace_back(&ThreadPool::runWorker, this, i);
+    CPPLOG_LAZY(logging::Level::DEBUG, log << "Started thread pool with " << numThreads << " workers" << logging::endl);
+#endif
+}
+
+ThreadPool::~ThreadPool()
+{
+#ifdef MULTI_THREADED
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stopWorkers = true;
+    }
+    sleepCondition.notify_all();
+    for(auto& worker : workers)
+    {
+        if(worker.joinable())
+            worker.join();
+    }
+#endif
+}
+
+ThreadPool& ThreadPool::getInstance()
+{
+#ifdef MULTI_THREADED
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+#else
+    static ThreadPool pool(0);
+#endif
+    return pool;
+}
+
+std::size_t ThreadPool::getNumThreads() const
+{
+#ifdef MULTI_THREADED
+    return workers.size();
+#else
+    return 0;
+#endif
+}
+
+#ifdef MULTI_THREADED
+void ThreadPool::push(Task&& task)
+{
+    // tasks scheduled from a worker are nested tasks, so keep them local to that worker
+    std::size_t index = currentWorkerIndex != SIZE_MAX ? currentWorkerIndex : (nextQueue++ % queues.size());
+    {
+        std::lock_guard<std::mutex> guard(queues[index]->lock);
+        queues[index]->tasks.emplace_back(std::move(task));
+        ++numQueued;
+    }
+    {
+        // lock to not miss a worker which is just about to go to sleep
+        std::lock_guard<std::mutex> guard(sleepLock);
+    }
+    sleepCondition.notify_one();
+}
+
+bool ThreadPool::tryRunTask(TaskGroup* group)
+{
+    if(numQueued == 0)
+        return false;
+    Task task{nullptr, nullptr};
+    const std::size_t ownIndex = currentWorkerIndex != SIZE_MAX ? currentWorkerIndex : 0;
+    for(std::size_t i = 0; i < queues.size() && !task.func; ++i)
+    {
+        auto& queue = *queues[(ownIndex + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if(queue.tasks.empty())
+            continue;
+        if(group != nullptr)
+        {
+            // only run the tasks of the group we are waiting for, newest first
+            auto it = std::find_if(
+                queue.tasks.rbegin(), queue.tasks.rend(), [group](const Task& t) -> bool { return t.group == group; });
+            if(it == queue.tasks.rend())
+                continue;
+            task = std::move(*it);
+            queue.tasks.erase(std::next(it).base());
+        }
+        else if(i == 0 && currentWorkerIndex != SIZE_MAX)
+        {
+            // take the newest task from our own queue, it most likely works on data still in the cache
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            // steal the oldest task from the other queues
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        --numQueued;
+    }
+    if(!task.func)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> guard(task.group->lock);
+        --task.group->numQueued;
+    }
+    task.group->runTask(task.func);
+    {
+        std::lock_guard<std::mutex> guard(task.group->lock);
+        --task.group->numPending;
+        if(task.group->numPending == 0)
+            task.group->stateChanged.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::runWorker(std::size_t index)
+{
+    currentWorkerIndex = index;
+    const std::string name = "VC4C worker " + std::to_string(index);
+    prctl(PR_SET_NAME, name.data(), 0, 0, 0);
+    while(true)
+    {
+        if(tryRunTask())
+            continue;
+        std::unique_lock<std::mutex> guard(sleepLock);
+        sleepCondition.wait(guard, [this]() -> bool { return stopWorkers || numQueued != 0; });
+        if(stopWorkers)
+            return;
+    }
+}
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#ifndef VC4C_THREAD_POOL_H
+#define VC4C_THREAD_POOL_H
+
+#include "Optional.h"
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef MULTI_THREADED
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#endif
+
+namespace vc4c
+{
+    /*
+     * Process-wide pool of worker threads executing tasks using work-stealing.
+     *
+     * Every worker thread has its own task queue. Tasks scheduled from within a worker thread are added to the queue of
+     * that worker, tasks scheduled from any other thread are distributed over all queues. A worker takes the newest task
+     * from its own queue and steals the oldest tasks from the other queues if its own queue is empty.
+     *
+     * A thread waiting for a group of tasks executes the pending tasks of that group in the mean time (instead of
+     * blocking). This allows tasks to schedule (and wait for) nested task groups without exhausting the worker threads.
+     * Tasks of other groups are never run by a waiting thread, since they could in turn wait for the group the thread
+     * is already waiting for.
+     *
+     * If MULTI_THREADED is not set, all tasks are executed directly in the scheduling thread.
+     */
+    class ThreadPool : private NonCopyable
+    {
+    public:
+        /*
+         * A group of tasks which is waited for together
+         */
+        class TaskGroup : private NonCopyable
+        {
+        public:
+            explicit TaskGroup(const std::string& name, ThreadPool& pool = ThreadPool::getInstance());
+            TaskGroup(const TaskGroup&) = delete;
+            TaskGroup(TaskGroup&&) = delete;
+            ~TaskGroup();
+
+            TaskGroup& operator=(const TaskGroup&) = delete;
+            TaskGroup& operator=(TaskGroup&&) = delete;
+
+            /*
+             * Schedules the given task to be executed as part of this group
+             */
+            void schedule(std::function<void()>&& task);
+
+            /*
+             * Waits for all tasks of this group to finish, running the pending tasks of this group in the mean time.
+             *
+             * If any of the tasks threw an exception, it is re-thrown here after all tasks have finished.
+             */
+            void waitForAll();
+
+            const std::string name;
+
+        private:
+            ThreadPool& pool;
+            std::exception_ptr error;
+#ifdef MULTI_THREADED
+            // the number of tasks not yet finished
+            std::size_t numPending;
+            // the number of tasks not yet started, i.e. still in the queues of the pool
+            std::size_t numQueued;
+            std::mutex lock;
+            // notified when the last task finished or a new task was queued
+            std::condition_variable stateChanged;
+#endif
+
+            void runTask(const std::function<void()>& task);
+            void waitForTasks();
+
+            friend class ThreadPool;
+        };
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool(ThreadPool&&) = delete;
+        ~ThreadPool();
+
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ThreadPool& operator=(ThreadPool&&) = delete;
+
+        /*
+         * Returns the process-wide thread pool, creating it on the first call
+         */
+        static ThreadPool& getInstance();
+
+        /*
+         * Returns the number of worker threads
+         */
+        std::size_t getNumThreads() const;
+
+    private:
+        explicit ThreadPool(std::size_t numThreads);
+
+#ifdef MULTI_THREADED
+        struct Task
+        {
+            std::function<void()> func;
+            TaskGroup* group;
+        };
+
+        struct WorkQueue
+        {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<WorkQueue>> queues;
+        std::vector<std::thread> workers;
+        // the total number of tasks in all queues, used to determine whether idle workers need to be woken up
+        std::atomic<std::size_t> numQueued;
+        // the queue to push the next task scheduled from a non-worker thread into
+        std::atomic<std::size_t> nextQueue;
+        std::mutex sleepLock;
+        std::condition_variable sleepCondition;
+        bool stopWorkers;
+
+        void push(Task&& task);
+        /*
+         * Runs a single pending task, of the given group only if a group is given
+         */
+        bool tryRunTask(TaskGroup* group = nullptr);
+        void runWorker(std::size_t index);
+#endif
+    };
+} // namespace vc4c
+
+#endif /* VC4C_THREAD_POOL_H */
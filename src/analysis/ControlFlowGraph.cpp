@@ -242,6 +242,105 @@ FastAccessList<ControlFlowLoop> ControlFlowGraph::findLoops()
     return loops;
 }
 
+struct StronglyConnectedComponents
+{
+    // the nodes to search in, edges to all other nodes are ignored
+    const FastSet<const CFGNode*>& nodes;
+    FastMap<const CFGNode*, int> discoveryTimes;
+    FastMap<const CFGNode*, int> lowestReachable;
+    std::vector<const CFGNode*> stack;
+    FastSet<const CFGNode*> nodesOnStack;
+    int time;
+    // the components which form a loop
+    std::vector<FastSet<const CFGNode*>> loops;
+};
+
+/*
+ * Same algorithm as ControlFlowGraph#findLoopsHelper, but restricted to a subset of the nodes and keeping all loops
+ * found
+ */
+static void findStronglyConnectedComponents(StronglyConnectedComponents& scc, const CFGNode* node)
+{
+    scc.discoveryTimes[node] = scc.lowestReachable[node] = ++scc.time;
+    scc.stack.push_back(node);
+    scc.nodesOnStack.emplace(node);
+
+    node->forAllOutgoingEdges([&](const CFGNode& next, const CFGEdge& edge) -> bool {
+        const CFGNode* v = &next;
+        if(scc.nodes.find(v) == scc.nodes.end())
+            return true;
+        if(scc.discoveryTimes.find(v) == scc.discoveryTimes.end())
+        {
+            findStronglyConnectedComponents(scc, v);
+            scc.lowestReachable[node] = std::min(scc.lowestReachable[node], scc.lowestReachable[v]);
+        }
+        else if(scc.nodesOnStack.find(v) != scc.nodesOnStack.end())
+            scc.lowestReachable[node] = std::min(scc.lowestReachable[node], scc.discoveryTimes[v]);
+        return true;
+    });
+
+    if(scc.lowestReachable[node] == scc.discoveryTimes[node])
+    {
+        FastSet<const CFGNode*> component;
+        const CFGNode* member = nullptr;
+        do
+        {
+            member = scc.stack.back();
+            scc.stack.pop_back();
+            scc.nodesOnStack.erase(member);
+            component.emplace(member);
+        } while(member != node);
+        // a single block is only a loop, if it jumps to itself
+        if(component.size() > 1 || node->isAdjacent(node))
+            scc.loops.emplace_back(std::move(component));
+    }
+}
+
+static void findLoopDepths(const FastSet<const CFGNode*>& nodes, const CFGNode* startNode, unsigned depth,
+    FastMap<const BasicBlock*, unsigned>& depths)
+{
+    StronglyConnectedComponents scc{nodes, {}, {}, {}, {}, 0, {}};
+    for(const CFGNode* node : nodes)
+    {
+        if(scc.discoveryTimes.find(node) == scc.discoveryTimes.end())
+            findStronglyConnectedComponents(scc, node);
+    }
+
+    for(const auto& loop : scc.loops)
+    {
+        // the nodes of the loop without the header(s), the nodes the loop can be entered from the outside
+        FastSet<const CFGNode*> innerNodes;
+        for(const CFGNode* node : loop)
+        {
+            depths[node->key] = depth + 1;
+            bool isHeader = node == startNode;
+            node->forAllIncomingEdges([&](const CFGNode& predecessor, const CFGEdge& edge) -> bool {
+                isHeader = isHeader || loop.find(&predecessor) == loop.end();
+                return !isHeader;
+            });
+            if(!isHeader)
+                innerNodes.emplace(node);
+        }
+        // if we cannot determine a header (e.g. for unreachable loops), we cannot distinguish nested loops
+        if(!innerNodes.empty() && innerNodes.size() < loop.size())
+            findLoopDepths(innerNodes, startNode, depth + 1, depths);
+    }
+}
+
+FastMap<const BasicBlock*, unsigned> ControlFlowGraph::findLoopDepths()
+{
+    FastMap<const BasicBlock*, unsigned> depths;
+    if(nodes.empty())
+        return depths;
+    FastSet<const CFGNode*> allNodes;
+    allNodes.reserve(nodes.size());
+    for(auto& pair : nodes)
+        allNodes.emplace(&pair.second);
+
+    ::findLoopDepths(allNodes, &getStartOfControlFlow(), 0, depths);
+    return depths;
+}
+
 void ControlFlowGraph::dumpGraph(const std::string& path) const
 {
 #ifdef DEBUG_MODE
@@ -104,6 +104,14 @@ namespace vc4c
          */
         FastAccessList<ControlFlowLoop> findLoops();
 
+        /*
+         * Determines the loop nesting depth of all basic blocks, blocks not contained in any loop are not listed.
+         *
+         * Other than #findLoops(), this also finds the loops nested within other loops, by recursively searching for
+         * loops in the blocks of a loop without its header block(s).
+         */
+        FastMap<const BasicBlock*, unsigned> findLoopDepths();
+
         /*
          * Dump this graph as dot file
          */
@@ -168,11 +168,9 @@ static void addDependency(Dependency& dependency, DependencyType type, unsigned
 static bool isLocallyLimited(const Local* local, const intermediate::IntermediateInstruction* currentInstr,
     const intermediate::IntermediateInstruction* lastWriter, const intermediate::IntermediateInstruction* lastReader)
 {
-    auto tmp = local->getUsers();
-    tmp.erase(currentInstr);
-    tmp.erase(lastWriter);
-    tmp.erase(lastReader);
-    return tmp.empty();
+    return local->findUser(LocalUse::Type::BOTH, [&](const LocalUser* user) -> bool {
+        return user != currentInstr && user != lastWriter && user != lastReader;
+    }) == nullptr;
 }
 
 static void createLocalDependencies(DependencyGraph& graph, DependencyNode& node,
@@ -230,8 +228,7 @@ static void createFlagDependencies(DependencyGraph& graph, DependencyNode& node,
     const intermediate::IntermediateInstruction* lastSettingOfFlags,
     const intermediate::IntermediateInstruction* lastConditional)
 {
-    if(node.key->hasConditionalExecution() &&
-        (lastSettingOfFlags != nullptr || dynamic_cast<const intermediate::Branch*>(node.key) == nullptr))
+    if(node.key->hasConditionalExecution() && lastSettingOfFlags != nullptr)
     {
         // any conditional execution depends on flags being set previously
         auto& otherNode = graph.assertNode(lastSettingOfFlags);
@@ -255,7 +252,7 @@ static void createR4Dependencies(DependencyGraph& graph, DependencyNode& node,
     const intermediate::IntermediateInstruction* lastTriggerOfR4,
     const intermediate::IntermediateInstruction* lastReadOfR4)
 {
-    if(node.key->readsRegister(REG_SFU_OUT))
+    if(node.key->readsRegister(REG_SFU_OUT) && lastTriggerOfR4 != nullptr)
     {
         // any read of r4 needs to be ordered after the trigger of r4
         auto& otherNode = graph.assertNode(lastTriggerOfR4);
@@ -303,10 +300,12 @@ static void createMutexDependencies(DependencyGraph& graph, DependencyNode& node
     const intermediate::IntermediateInstruction* lastSemaphoreAccess,
     const intermediate::IntermediateInstruction* lastMemFence)
 {
-    if((node.key->hasValueType(ValueType::REGISTER) && node.key->getOutput()->reg().isVertexPipelineMemory()) ||
-        std::any_of(node.key->getArguments().begin(), node.key->getArguments().end(),
-            [](const Value& arg) -> bool { return arg.checkRegister() && arg.reg().isVertexPipelineMemory(); }) ||
-        node.key->writesRegister(REG_MUTEX))
+    // if there is no mutex lock in this block, the mutex was locked in a previous block
+    if(lastMutexLock != nullptr &&
+        ((node.key->hasValueType(ValueType::REGISTER) && node.key->getOutput()->reg().isVertexPipelineMemory()) ||
+            std::any_of(node.key->getArguments().begin(), node.key->getArguments().end(),
+                [](const Value& arg) -> bool { return arg.checkRegister() && arg.reg().isVertexPipelineMemory(); }) ||
+            node.key->writesRegister(REG_MUTEX)))
     {
         // any VPM operation or mutex unlock must be ordered after the corresponding mutex lock
         auto& otherNode = graph.assertNode(lastMutexLock);
@@ -513,14 +512,14 @@ static void createVPMAddressDependencies(DependencyGraph& graph, DependencyNode&
     const intermediate::IntermediateInstruction* lastVPMWriteAddress,
     const intermediate::IntermediateInstruction* lastVPMReadAddress)
 {
-    if(node.key->readsRegister(REG_VPM_DMA_STORE_WAIT))
+    if(node.key->readsRegister(REG_VPM_DMA_STORE_WAIT) && lastVPMWriteAddress != nullptr)
     {
         // the VPM write wait instruction needs to be executed after the setting of the VPM write address
         auto& otherNode = graph.assertNode(lastVPMWriteAddress);
         // XXX correct delay
         addDependency(otherNode.getOrCreateEdge(&node).data, DependencyType::PERIPHERY_ORDER, 10);
     }
-    if(node.key->readsRegister(REG_VPM_DMA_LOAD_WAIT))
+    if(node.key->readsRegister(REG_VPM_DMA_LOAD_WAIT) && lastVPMReadAddress != nullptr)
     {
         // the VPM read wait instruction needs to be executed after the setting of the VPM read address
         auto& otherNode = graph.assertNode(lastVPMReadAddress);
@@ -604,14 +603,14 @@ static void createTMUCoordinateDependencies(DependencyGraph& graph, DependencyNo
     // 8 instructions inserted increase execution time almost not at all (a bit due to instruction fetching), 9+ do
     // noticeably
     const unsigned tmuLoadDelay = 8;
-    if(node.key->signal == SIGNAL_LOAD_TMU0)
+    if(node.key->signal == SIGNAL_LOAD_TMU0 && lastTMU0CoordsWrite != nullptr)
     {
         // triggering of read from the FIFO depends on the memory address being set previously which fills the FIFO from
         // memory (thus taking longer)
         auto& otherNode = graph.assertNode(lastTMU0CoordsWrite);
         addDependency(otherNode.getOrCreateEdge(&node).data, DependencyType::PERIPHERY_ORDER, tmuLoadDelay);
     }
-    if(node.key->signal == SIGNAL_LOAD_TMU1)
+    if(node.key->signal == SIGNAL_LOAD_TMU1 && lastTMU1CoordsWrite != nullptr)
     {
         // triggering of read from the FIFO depends on the memory address being set previously which fills the FIFO from
         // memory (thus taking longer)
@@ -671,23 +670,33 @@ static void createR5Dependencies(DependencyGraph& graph, DependencyNode& node,
     }
 }
 
+/*
+ * Makes the node depend on all nodes created before.
+ *
+ * Since all previous nodes (transitively) precede a node without any outgoing dependency, it is enough to add
+ * dependencies on these nodes, which keeps the number of edges linear in the size of the block.
+ */
+static void addDependenciesOnAllPrevious(DependencyGraph& graph, DependencyNode& node, DependencyType type)
+{
+    std::vector<DependencyNode*> sinks;
+    graph.forAllNodes([&](DependencyNode& otherNode) {
+        if(&node != &otherNode && otherNode.key && !otherNode.hasOutGoingDependencies())
+            sinks.push_back(&otherNode);
+    });
+    for(auto sink : sinks)
+        addDependency(sink->getOrCreateEdge(&node).data, type);
+}
+
 static void createThreadEndDependencies(DependencyGraph& graph, DependencyNode& node,
     const intermediate::IntermediateInstruction* lastHostInterrupt,
     const intermediate::IntermediateInstruction* lastProgramEnd)
 {
     if(node.key->writesRegister(REG_HOST_INTERRUPT))
-    {
         // host interrupt depends on any preceding instruction
-        graph.forAllNodes([&](DependencyNode& otherNode) {
-            if(&node != &otherNode && otherNode.key)
-            {
-                addDependency(otherNode.getOrCreateEdge(&node).data, DependencyType::THREAD_END_ORDER);
-            }
-        });
-    }
+        addDependenciesOnAllPrevious(graph, node, DependencyType::THREAD_END_ORDER);
 
     // program end depends on host interrupt
-    if(node.key->signal == SIGNAL_END_PROGRAM)
+    if(node.key->signal == SIGNAL_END_PROGRAM && lastHostInterrupt != nullptr)
     {
         addDependency(
             graph.assertNode(lastHostInterrupt).getOrCreateEdge(&node).data, DependencyType::THREAD_END_ORDER);
@@ -695,7 +704,8 @@ static void createThreadEndDependencies(DependencyGraph& graph, DependencyNode&
 
     // program end nops depend on program end signal
     if(node.key->signal != SIGNAL_END_PROGRAM && dynamic_cast<const intermediate::Nop*>(node.key) &&
-        dynamic_cast<const intermediate::Nop*>(node.key)->type == intermediate::DelayType::THREAD_END)
+        dynamic_cast<const intermediate::Nop*>(node.key)->type == intermediate::DelayType::THREAD_END &&
+        lastProgramEnd != nullptr)
     {
         addDependency(graph.assertNode(lastProgramEnd).getOrCreateEdge(&node).data, DependencyType::THREAD_END_ORDER);
     }
@@ -734,6 +744,7 @@ std::unique_ptr<DependencyGraph> DependencyGraph::createGraph(const BasicBlock&
     const intermediate::IntermediateInstruction* lastHostInterrupt = nullptr;
     const intermediate::IntermediateInstruction* lastProgramEnd = nullptr;
     const intermediate::IntermediateInstruction* lastMemFence = nullptr;
+    const intermediate::IntermediateInstruction* lastBranch = nullptr;
     FastMap<const Local*, const intermediate::IntermediateInstruction*> lastLocalWrites;
     FastMap<const Local*, const intermediate::IntermediateInstruction*> lastLocalReads;
     // TODO "normal" register dependencies?
@@ -768,12 +779,13 @@ std::unique_ptr<DependencyGraph> DependencyGraph::createGraph(const BasicBlock&
         {
             // branches depend on everything before to make sure they come after everything
             // XXX this disables reordering of conditional branches for now
-            graph->forAllNodes([&](DependencyNode& otherNode) {
-                if(&node != &otherNode && otherNode.key)
-                {
-                    addDependency(otherNode.getOrCreateEdge(&node).data, DependencyType::BRANCH_ORDER);
-                }
-            });
+            addDependenciesOnAllPrevious(*graph.get(), node, DependencyType::BRANCH_ORDER);
+        }
+        else if(lastBranch != nullptr)
+        {
+            // instructions following a (conditional) branch must not be moved before it, since they are only executed
+            // if the branch is not taken
+            addDependency(graph->assertNode(lastBranch).getOrCreateEdge(&node).data, DependencyType::BRANCH_ORDER);
         }
 
         // update the cached values
@@ -854,6 +866,8 @@ std::unique_ptr<DependencyGraph> DependencyGraph::createGraph(const BasicBlock&
             lastProgramEnd = inst.get();
         if(dynamic_cast<const intermediate::MemoryBarrier*>(inst.get()))
             lastMemFence = inst.get();
+        if(branch)
+            lastBranch = inst.get();
         lastInstruction = inst.get();
     }
 
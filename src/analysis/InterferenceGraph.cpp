@@ -28,118 +28,93 @@ FastSet<InterferenceNode*> InterferenceGraph::findOverfullNodes(std::size_t numN
     return results;
 }
 
-std::unique_ptr<InterferenceGraph> InterferenceGraph::createGraph(Method& method)
+/*
+ * Adds the interferences between the locals used together by the given instruction, if the given predicate accepts
+ * any of the two locals
+ */
+template <typename Predicate>
+static void addUsedTogetherInterferences(
+    InterferenceGraph& graph, const intermediate::IntermediateInstruction* inst, const Predicate& isRelevant)
 {
-    // TODO try to optimize
-    PROFILE_START(createInterferenceGraph);
-    std::unique_ptr<InterferenceGraph> graph(new InterferenceGraph(method.getNumLocals()));
-
-    FastMap<BasicBlock*, LivenessAnalysis> livenesses;
-    livenesses.reserve(method.getCFG().getNodes().size());
-    for(auto& block : method)
+    // combined operations can write multiple locals
+    const auto combInstr = dynamic_cast<const intermediate::CombinedOperation*>(inst);
+    if(combInstr && combInstr->op1 && combInstr->op1->hasValueType(ValueType::LOCAL) && combInstr->op2 &&
+        combInstr->op2->hasValueType(ValueType::LOCAL) &&
+        combInstr->op1->getOutput()->local() != combInstr->op2->getOutput()->local() &&
+        (isRelevant(combInstr->op1->getOutput()->local()) || isRelevant(combInstr->op2->getOutput()->local())))
     {
-        auto& blockAnalysis = livenesses[&block];
-        blockAnalysis(block);
+        graph.getOrCreateNode(combInstr->op1->getOutput()->local())
+            .getOrCreateEdge(
+                &graph.getOrCreateNode(combInstr->op2->getOutput()->local()), InterferenceType::USED_TOGETHER)
+            .data = InterferenceType::USED_TOGETHER;
     }
-
-    // tracks local life-ranges stemming from local being used in succeeding blocks (and written in this block or
-    // before)
-    FastMap<const intermediate::IntermediateInstruction*, FastSet<const Local*>> additionalLocals;
-    for(auto& pair : livenesses)
+    // instructions in general can read multiple locals
+    FastSet<Local*> localsRead;
+    // we have a maximum of 4 locals per (combined) instruction
+    localsRead.reserve(4);
+    inst->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+        if(has_flag(type, LocalUse::Type::READER) && !loc->type.isLabelType())
+            localsRead.emplace(const_cast<Local*>(loc));
+    });
+    if(localsRead.size() > 1)
     {
-        if(!pair.second.getStartResult().empty())
+        for(auto locIt = localsRead.begin(); locIt != localsRead.end(); ++locIt)
         {
-            // there are dependencies from other blocks. For each local, walk the CFG back until we meet the write or
-            // until we meet another liveness-range of the local
-            // TODO is there a better/more efficient way? Can't we combine the walking for all locals from start? Since
-            // predecessor blocks are the same
-            for(auto& local : pair.second.getStartResult())
+            auto& firstNode = graph.getOrCreateNode(*locIt);
+            auto locIt2 = locIt;
+            for(++locIt2; locIt2 != localsRead.end(); ++locIt2)
             {
-                FastSet<BasicBlock*> blocksVisited;
-                InstructionVisitor v{[&](InstructionWalker& it) -> InstructionVisitResult {
-                                         // skip the own label itself
-                                         if(it.get() == pair.first->getLabel())
-                                             return InstructionVisitResult::CONTINUE;
-                                         if(it.get<intermediate::BranchLabel>())
-                                         {
-                                             if(it.getBasicBlock()->isStartOfMethod())
-                                                 // do not repeat work-group loop
-                                                 return InstructionVisitResult::STOP_BRANCH;
-                                             if(blocksVisited.find(it.getBasicBlock()) != blocksVisited.end())
-                                                 // loop, abort after one iteration
-                                                 return InstructionVisitResult::STOP_BRANCH;
-                                             blocksVisited.emplace(it.getBasicBlock());
-                                         }
-
-                                         auto addLocalsIt = additionalLocals.find(it.get());
-                                         auto& lives = livenesses.at(it.getBasicBlock()).getResult(it.get());
-                                         if(it->writesLocal(local) || lives.find(local) != lives.end() ||
-                                             (addLocalsIt != additionalLocals.end() &&
-                                                 addLocalsIt->second.find(local) != addLocalsIt->second.end()))
-                                             return InstructionVisitResult::STOP_BRANCH;
-                                         additionalLocals[it.get()].emplace(local);
-                                         return InstructionVisitResult::CONTINUE;
-                                     },
-                    false, true};
-                v.visitReverse(pair.first->walk(), &method.getCFG());
+                if(!isRelevant(*locIt) && !isRelevant(*locIt2))
+                    continue;
+                firstNode.getOrCreateEdge(&graph.getOrCreateNode(*locIt2), InterferenceType::USED_TOGETHER).data =
+                    InterferenceType::USED_TOGETHER;
             }
         }
     }
+}
+
+std::unique_ptr<InterferenceGraph> InterferenceGraph::createGraph(Method& method)
+{
+    // makes sure the successors of the blocks are looked up via the CFG
+    method.getCFG();
+    LivenessAnalysis liveness;
+    liveness(method);
+    return createGraph(method, liveness);
+}
+
+std::unique_ptr<InterferenceGraph> InterferenceGraph::createGraph(Method& method, const LivenessAnalysis& liveness)
+{
+    PROFILE_START(createInterferenceGraph);
+    std::unique_ptr<InterferenceGraph> graph(new InterferenceGraph(method.getNumLocals()));
+
+    // cache for the nodes of the locals by their index in the liveness analysis
+    std::vector<InterferenceNode*> nodeCache;
+    auto getNode = [&](std::size_t index) -> InterferenceNode& {
+        if(index >= nodeCache.size())
+            nodeCache.resize(index + 1, nullptr);
+        if(nodeCache[index] == nullptr)
+            nodeCache[index] = &graph->getOrCreateNode(const_cast<Local*>(liveness.getLocal(index)));
+        return *nodeCache[index];
+    };
+    auto allLocals = [](const Local*) -> bool { return true; };
+    std::vector<std::size_t> liveIndices;
 
     for(auto& block : method)
     {
-        auto& blockAnalysis = livenesses[&block];
-        for(const auto& inst : block)
-        {
-            // combined operations can write multiple locals
-            const auto combInstr = dynamic_cast<const intermediate::CombinedOperation*>(inst.get());
-            if(combInstr && combInstr->op1 && combInstr->op1->hasValueType(ValueType::LOCAL) && combInstr->op2 &&
-                combInstr->op2->hasValueType(ValueType::LOCAL) &&
-                combInstr->op1->getOutput()->local() != combInstr->op2->getOutput()->local())
-            {
-                graph->getOrCreateNode(combInstr->op1->getOutput()->local())
-                    .getOrCreateEdge(
-                        &graph->getOrCreateNode(combInstr->op2->getOutput()->local()), InterferenceType::USED_TOGETHER)
-                    .data = InterferenceType::USED_TOGETHER;
-            }
-            // instructions in general can read multiple locals
-            FastSet<Local*> localsRead;
-            // we have a maximum of 4 locals per (combined) instruction
-            localsRead.reserve(4);
-            inst->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
-                if(has_flag(type, LocalUse::Type::READER) && !loc->type.isLabelType())
-                    localsRead.emplace(const_cast<Local*>(loc));
-            });
-            if(localsRead.size() > 1)
-            {
-                for(auto locIt = localsRead.begin(); locIt != localsRead.end(); ++locIt)
-                {
-                    auto& firstNode = graph->getOrCreateNode(*locIt);
-                    auto locIt2 = locIt;
-                    for(++locIt2; locIt2 != localsRead.end(); ++locIt2)
-                    {
-                        firstNode.getOrCreateEdge(&graph->getOrCreateNode(*locIt2), InterferenceType::USED_TOGETHER)
-                            .data = InterferenceType::USED_TOGETHER;
-                    }
-                }
-            }
-
-            auto blockResults = blockAnalysis.getResult(inst.get());
-            auto addIt = additionalLocals.find(inst.get());
-            if(addIt != additionalLocals.end())
-                blockResults.insert(addIt->second.begin(), addIt->second.end());
+        liveness.forAllInstructions(block,
+            [&](const intermediate::IntermediateInstruction* inst, const LivenessAnalysis::LiveSet& liveLocals) {
+                addUsedTogetherInterferences(*graph, inst, allLocals);
 
-            for(auto locIt = blockResults.begin(); locIt != blockResults.end(); ++locIt)
-            {
-                auto& firstNode = graph->getOrCreateNode(const_cast<Local*>(*locIt));
-                auto locIt2 = locIt;
-                for(++locIt2; locIt2 != blockResults.end(); ++locIt2)
+                // all locals live at the same time interfere with each other
+                liveIndices.clear();
+                liveLocals.forAllSetBits([&](std::size_t index) { liveIndices.push_back(index); });
+                for(auto locIt = liveIndices.begin(); locIt != liveIndices.end(); ++locIt)
                 {
-                    firstNode.getOrCreateEdge(
-                        &graph->getOrCreateNode(const_cast<Local*>(*locIt2)), InterferenceType::USED_SIMULTANEOUSLY);
+                    auto& firstNode = getNode(*locIt);
+                    for(auto locIt2 = locIt + 1; locIt2 != liveIndices.end(); ++locIt2)
+                        firstNode.getOrCreateEdge(&getNode(*locIt2), InterferenceType::USED_SIMULTANEOUSLY);
                 }
-            }
-        }
+            });
     }
 
     PROFILE_END(createInterferenceGraph);
@@ -154,3 +129,49 @@ std::unique_ptr<InterferenceGraph> InterferenceGraph::createGraph(Method& method
 #endif
     return graph;
 }
+
+void InterferenceGraph::updateLocals(const Method& method, const LivenessAnalysis& liveness,
+    const FastSet<const Local*>& locals, const FastSet<const BasicBlock*>& blocks)
+{
+    PROFILE_START(updateInterferenceGraph);
+    std::vector<std::size_t> dirtyIndices;
+    dirtyIndices.reserve(locals.size());
+    for(const Local* loc : locals)
+    {
+        if(auto node = findNode(const_cast<Local*>(loc)))
+            node->removeAllEdges();
+        dirtyIndices.push_back(liveness.getIndex(loc));
+    }
+    auto isDirty = [&](const Local* loc) -> bool { return locals.find(loc) != locals.end(); };
+
+    std::vector<std::size_t> liveIndices;
+    for(const BasicBlock& block : method)
+    {
+        if(blocks.find(&block) == blocks.end() &&
+            std::none_of(dirtyIndices.begin(), dirtyIndices.end(), [&](std::size_t index) -> bool {
+                return liveness.getLiveIn(block).test(index) || liveness.getLiveOut(block).test(index);
+            }))
+            // none of the locals is used or live in this block
+            continue;
+        liveness.forAllInstructions(block,
+            [&](const intermediate::IntermediateInstruction* inst, const LivenessAnalysis::LiveSet& liveLocals) {
+                addUsedTogetherInterferences(*this, inst, isDirty);
+
+                liveIndices.clear();
+                liveLocals.forAllSetBits([&](std::size_t index) { liveIndices.push_back(index); });
+                for(std::size_t dirtyIndex : dirtyIndices)
+                {
+                    if(!liveLocals.test(dirtyIndex))
+                        continue;
+                    auto& dirtyNode = getOrCreateNode(const_cast<Local*>(liveness.getLocal(dirtyIndex)));
+                    for(std::size_t index : liveIndices)
+                    {
+                        if(index != dirtyIndex)
+                            dirtyNode.getOrCreateEdge(&getOrCreateNode(const_cast<Local*>(liveness.getLocal(index))),
+                                InterferenceType::USED_SIMULTANEOUSLY);
+                    }
+                }
+            });
+    }
+    PROFILE_END(updateInterferenceGraph);
+}
@@ -13,11 +13,14 @@
 
 namespace vc4c
 {
+    class BasicBlock;
     class Local;
     class Method;
 
     namespace analysis
     {
+        class LivenessAnalysis;
+
         /*
          * The type of interference between two locals
          */
@@ -52,6 +55,22 @@ namespace vc4c
             FastSet<InterferenceNode*> findOverfullNodes(std::size_t numNeighbors);
 
             static std::unique_ptr<InterferenceGraph> createGraph(Method& method);
+            /*
+             * Creates the interference graph from the given results of the liveness analysis for the given method
+             */
+            static std::unique_ptr<InterferenceGraph> createGraph(Method& method, const LivenessAnalysis& liveness);
+
+            /*
+             * Re-calculates the interferences of the given locals after the method was modified.
+             *
+             * All edges of the given locals are dropped and re-created from the (already updated) liveness analysis.
+             * Only the given blocks as well as the blocks the given locals are live across are visited, so the blocks
+             * containing any (modified) usage of the locals need to be passed in.
+             *
+             * NOTE: Interferences between two locals not in the given set are not modified!
+             */
+            void updateLocals(const Method& method, const LivenessAnalysis& liveness,
+                const FastSet<const Local*>& locals, const FastSet<const BasicBlock*>& blocks);
 
         private:
             explicit InterferenceGraph(std::size_t numLocals) : Graph(numLocals) {}
@@ -6,6 +6,7 @@
 
 #include "LivenessAnalysis.h"
 
+#include "../Method.h"
 #include "../Profiler.h"
 
 #include <sstream>
@@ -13,61 +14,244 @@
 using namespace vc4c;
 using namespace vc4c::analysis;
 
-LivenessAnalysis::LivenessAnalysis() : LocalAnalysis(LivenessAnalysis::analyzeLiveness, LivenessAnalysis::to_string) {}
-
 static bool isIfElseWrite(const FastSet<const LocalUser*>& users)
 {
     // TODO be exact, would need to check whether the SetFlags instruction is the same for both instructions
     return users.size() == 2 && (*users.begin())->conditional.isInversionOf((*(++users.begin()))->conditional);
 }
 
-FastSet<const Local*> LivenessAnalysis::analyzeLiveness(const intermediate::IntermediateInstruction* instr,
-    const FastSet<const Local*>& nextResult,
-    std::pair<FastSet<const Local*>, FastMap<const Local*, ConditionCode>>& cache)
+void LivenessAnalysis::operator()(const Method& method)
 {
     PROFILE_START(LivenessAnalysis);
+    results.clear();
+    externalIndices.clear();
+
+    // assign the indices for all locals used
+    const std::size_t numOwnLocals = method.getLocalIndexLimit();
+    locals.assign(numOwnLocals, nullptr);
+    std::vector<const Local*> externalLocals;
+    method.forAllInstructions([&](const intermediate::IntermediateInstruction* instr) {
+        instr->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+            if(loc->type.isLabelType())
+                return;
+            if(loc->getIndex() < numOwnLocals)
+                locals[loc->getIndex()] = loc;
+            else if(externalIndices.emplace(loc, numOwnLocals + externalLocals.size()).second)
+                externalLocals.push_back(loc);
+        });
+    });
+    locals.insert(locals.end(), externalLocals.begin(), externalLocals.end());
+
+    // calculate the locals generated and killed by the single blocks
+    std::vector<std::pair<const BasicBlock*, std::vector<const BasicBlock*>>> blocks;
+    blocks.reserve(method.size());
+    results.reserve(method.size());
+    for(const BasicBlock& block : method)
+    {
+        BlockResult result{
+            LiveSet(locals.size()), LiveSet(locals.size()), LiveSet(locals.size()), LiveSet(locals.size())};
+        calculateBlockSets(block, result);
+        result.liveIn = result.generated;
+        results.emplace(&block, std::move(result));
+
+        std::vector<const BasicBlock*> successors;
+        block.forSuccessiveBlocks([&](BasicBlock& successor) {
+            // do not repeat the work-group loop
+            if(!successor.isStartOfMethod())
+                successors.push_back(&successor);
+        });
+        blocks.emplace_back(&block, std::move(successors));
+    }
+
+    // propagate the liveness backwards over the block boundaries until the results stabilize. Iterating the blocks in
+    // reverse order converges fast, since most blocks are placed before their successors
+    bool changed = true;
+    LiveSet tmp(locals.size());
+    while(changed)
+    {
+        changed = false;
+        for(auto it = blocks.rbegin(); it != blocks.rend(); ++it)
+        {
+            auto& result = results.at(it->first);
+            for(const BasicBlock* successor : it->second)
+                result.liveOut.merge(results.at(successor).liveIn);
+            tmp = result.liveOut;
+            tmp.subtract(result.killed);
+            changed = result.liveIn.merge(tmp) || changed;
+        }
+    }
+    PROFILE_END(LivenessAnalysis);
+}
+
+const LivenessAnalysis::LiveSet& LivenessAnalysis::getLiveIn(const BasicBlock& block) const
+{
+    return results.at(&block).liveIn;
+}
+
+const LivenessAnalysis::LiveSet& LivenessAnalysis::getLiveOut(const BasicBlock& block) const
+{
+    return results.at(&block).liveOut;
+}
+
+bool LivenessAnalysis::updateBlock(const Method& method, const BasicBlock& block)
+{
+    PROFILE_START(UpdateLivenessAnalysis);
+    // assign indices to the locals created after the analysis was run
+    const std::size_t oldNumLocals = locals.size();
+    for(const auto& inst : block)
+    {
+        if(!inst)
+            continue;
+        inst->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+            if(loc->type.isLabelType())
+                return;
+            bool isKnown = (loc->getIndex() < locals.size() && locals[loc->getIndex()] == loc) ||
+                externalIndices.find(loc) != externalIndices.end();
+            if(!isKnown)
+            {
+                externalIndices.emplace(loc, locals.size());
+                locals.push_back(loc);
+            }
+        });
+    }
+    if(locals.size() != oldNumLocals)
+    {
+        for(auto& pair : results)
+        {
+            pair.second.liveIn.resize(locals.size());
+            pair.second.liveOut.resize(locals.size());
+            pair.second.generated.resize(locals.size());
+            pair.second.killed.resize(locals.size());
+        }
+    }
+
+    auto& result = results.at(&block);
+    result.generated.clear();
+    result.killed.clear();
+    calculateBlockSets(block, result);
+    LiveSet liveIn = result.liveOut;
+    liveIn.subtract(result.killed);
+    liveIn.merge(result.generated);
+    bool unchanged = liveIn == result.liveIn;
+    PROFILE_END(UpdateLivenessAnalysis);
+    if(!unchanged)
+    {
+        // the modification is visible outside of the block, so we need to re-run the whole analysis
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Modification of block " << block.getLabel()->to_string()
+                << " changes the locals live at its start, re-running liveness analysis" << logging::endl);
+        (*this)(method);
+    }
+    return unchanged;
+}
+
+void LivenessAnalysis::forAllInstructions(const BasicBlock& block, const InstructionConsumer& consumer) const
+{
+    walkBlock(block, getLiveOut(block), &consumer);
+}
+
+std::size_t LivenessAnalysis::getIndex(const Local* local) const
+{
+    if(local->getIndex() < locals.size() && locals[local->getIndex()] == local)
+        return local->getIndex();
+    auto it = externalIndices.find(local);
+    if(it == externalIndices.end())
+        throw CompilationError(
+            CompilationStep::GENERAL, "Local is not known to the liveness analysis", local->to_string());
+    return it->second;
+}
+
+const Local* LivenessAnalysis::getLocal(std::size_t index) const
+{
+    return locals.at(index);
+}
+
+FastSet<const Local*> LivenessAnalysis::toLocals(const LiveSet& liveLocals) const
+{
+    FastSet<const Local*> result;
+    result.reserve(liveLocals.count());
+    liveLocals.forAllSetBits([&](std::size_t index) { result.emplace(locals[index]); });
+    return result;
+}
+
+std::string LivenessAnalysis::to_string(const LiveSet& liveLocals) const
+{
+    std::string result;
+    liveLocals.forAllSetBits([&](std::size_t index) {
+        if(!result.empty())
+            result.append(", ");
+        result.append(locals[index]->name);
+    });
+    return result;
+}
+
+void LivenessAnalysis::dumpResults(const Method& method) const
+{
+    logging::logLazy(logging::Level::DEBUG, [&]() {
+        for(const BasicBlock& block : method)
+        {
+            logging::debug() << block.getLabel()->to_string() << " (in) : " << to_string(getLiveIn(block))
+                             << logging::endl;
+            logging::debug() << block.getLabel()->to_string() << " (out) : " << to_string(getLiveOut(block))
+                             << logging::endl;
+        }
+    });
+}
+
+void LivenessAnalysis::analyzeLiveness(const intermediate::IntermediateInstruction* instr, LiveSet& liveLocals,
+    LiveSet& readInBlock, std::pair<FastSet<const Local*>, FastMap<const Local*, ConditionCode>>& cache) const
+{
     auto& conditionalWrites = cache.first;
     auto& conditionalReads = cache.second;
 
-    FastSet<const Local*> result(nextResult);
-
-    if(instr->hasValueType(ValueType::LOCAL) &&
-        !instr->hasDecoration(vc4c::intermediate::InstructionDecorations::ELEMENT_INSERTION))
+    if(instr->hasValueType(ValueType::LOCAL) && !instr->getOutput()->local()->type.isLabelType())
     {
         auto out = instr->getOutput()->local();
-        if(instr->hasConditionalExecution() &&
-            !instr->hasDecoration(intermediate::InstructionDecorations::ELEMENT_INSERTION))
+        auto index = getIndex(out);
+        bool endsLiveness = true;
+        if(instr->hasDecoration(intermediate::InstructionDecorations::ELEMENT_INSERTION))
+            endsLiveness = false;
+        else if(instr->hasConditionalExecution())
         {
             auto condReadIt = conditionalReads.find(out);
             if(condReadIt != conditionalReads.end() && condReadIt->second == instr->conditional &&
                 condReadIt->first->getSingleWriter() == instr)
                 // the local only exists within a conditional block (e.g. temporary within the same flag)
-                result.erase(out);
+                endsLiveness = true;
             else if(conditionalWrites.find(out) != conditionalWrites.end() &&
                 isIfElseWrite(out->getUsers(LocalUse::Type::WRITER)))
                 // the local is written in a select statement (if a then write b otherwise c), which is now complete
                 // (since the other write is already added to conditionalWrites)
                 // NOTE: For conditions (if there are several conditional writes, we need to keep the local)
-                result.erase(out);
+                endsLiveness = true;
             else
+            {
                 conditionalWrites.emplace(out);
+                endsLiveness = false;
+            }
+        }
+        // a local only live because of succeeding blocks is not live before any (partial) write to it in this block
+        if(endsLiveness || !readInBlock.test(index))
+        {
+            liveLocals.reset(index);
+            readInBlock.reset(index);
         }
-        else
-            result.erase(out);
     }
     if(auto combInstr = dynamic_cast<const intermediate::CombinedOperation*>(instr))
     {
         if(combInstr->op1)
-            result = analyzeLiveness(combInstr->op1.get(), result, cache);
+            analyzeLiveness(combInstr->op1.get(), liveLocals, readInBlock, cache);
         if(combInstr->op2)
-            result = analyzeLiveness(combInstr->op2.get(), result, cache);
+            analyzeLiveness(combInstr->op2.get(), liveLocals, readInBlock, cache);
     }
 
     for(const Value& arg : instr->getArguments())
     {
         if(arg.checkLocal() && !arg.local()->type.isLabelType())
         {
-            result.emplace(arg.local());
+            auto index = getIndex(arg.local());
+            liveLocals.set(index);
+            readInBlock.set(index);
             if(instr->hasConditionalExecution())
             {
                 // there exist locals which only exist if a certain condition is met, so check this
@@ -81,21 +265,39 @@ FastSet<const Local*> LivenessAnalysis::analyzeLiveness(const intermediate::Inte
             }
         }
     }
-    PROFILE_END(LivenessAnalysis);
-    return result;
 }
 
-std::string LivenessAnalysis::to_string(const FastSet<const Local*>& liveLocals)
+void LivenessAnalysis::calculateBlockSets(const BasicBlock& block, BlockResult& result) const
 {
-    if(liveLocals.empty())
-        return "";
-    std::stringstream s;
-    auto it = liveLocals.begin();
-    s << (*it)->name;
-    ++it;
-    for(; it != liveLocals.end(); ++it)
-        s << ", " << (*it)->name;
-    return s.str();
+    result.generated = walkBlock(block, LiveSet(locals.size()), nullptr);
+    for(const auto& inst : block)
+    {
+        if(!inst)
+            continue;
+        inst->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+            if(has_flag(type, LocalUse::Type::WRITER) && !loc->type.isLabelType())
+                result.killed.set(getIndex(loc));
+        });
+    }
+}
+
+LivenessAnalysis::LiveSet LivenessAnalysis::walkBlock(
+    const BasicBlock& block, LiveSet liveLocals, const InstructionConsumer* consumer) const
+{
+    std::pair<FastSet<const Local*>, FastMap<const Local*, ConditionCode>> cache;
+    LiveSet readInBlock(liveLocals.size());
+    auto it = block.end();
+    do
+    {
+        --it;
+        if(*it)
+        {
+            analyzeLiveness(it->get(), liveLocals, readInBlock, cache);
+            if(consumer)
+                (*consumer)(it->get(), liveLocals);
+        }
+    } while(it != block.begin());
+    return liveLocals;
 }
 
 LocalUsageAnalysis::LocalUsageAnalysis() :
@@ -7,34 +7,110 @@
 #ifndef VC4C_LIVENESS_ANALYSIS
 #define VC4C_LIVENESS_ANALYSIS
 
+#include "../BitVector.h"
 #include "../performance.h"
 #include "Analysis.h"
 
+#include <vector>
+
 namespace vc4c
 {
     class Local;
+    class Method;
 
     namespace analysis
     {
         /*
-         * Analyses the liveness (the life-time range) of locals within a single basic block
+         * Analyses the liveness (the life-time range) of locals within a whole method
          *
          * In short: A local is "live" if its current value is used in the future!
          *
-         * The liveness analysis provides following information:
-         * - live-range of locals (only for locals not living outside of the basic block)
-         * - getStartResult() returns all locals used within this basic block (more accurate: all locals, where their
-         * previous value is used in this block/which are not overwritten before use)
+         * The locals are identified by their dense per-method index (see Local#getIndex()). Locals not owned by the
+         * method (e.g. parameters, globals) are assigned additional indices behind the ones of the method's locals.
+         * This allows the sets of live locals to be stored as bit-vectors.
+         *
+         * Only the sets of locals live at the start and the end of every basic block are stored. The liveness for the
+         * single instructions is calculated on demand by walking the basic block backwards from the locals live at its
+         * end.
+         *
+         * NOTE: The results are only valid as long as the method is not modified (see #updateBlock())!
          *
          * Also called Live Variable Analysis (https://en.wikipedia.org/wiki/Live_variable_analysis)
          */
-        class LivenessAnalysis : public LocalAnalysis<AnalysisDirection::BACKWARD, FastSet<const Local*>,
-                                     std::pair<FastSet<const Local*>, FastMap<const Local*, ConditionCode>>>
+        class LivenessAnalysis : private NonCopyable
         {
         public:
-            explicit LivenessAnalysis();
+            using LiveSet = BitVector;
+            using InstructionConsumer =
+                std::function<void(const intermediate::IntermediateInstruction*, const LiveSet&)>;
+
+            explicit LivenessAnalysis() = default;
+            LivenessAnalysis(const LivenessAnalysis&) = delete;
+            LivenessAnalysis(LivenessAnalysis&&) = default;
+            ~LivenessAnalysis() = default;
+
+            LivenessAnalysis& operator=(const LivenessAnalysis&) = delete;
+            LivenessAnalysis& operator=(LivenessAnalysis&&) = default;
+
+            /*
+             * Analyses the given method and fills the internal result store
+             */
+            void operator()(const Method& method);
+
+            /*
+             * Returns the locals live at the start of the given block (incl. the locals read before they are written in
+             * the block)
+             */
+            const LiveSet& getLiveIn(const BasicBlock& block) const;
+            /*
+             * Returns the locals live at the end of the given block (e.g. used by one of the succeeding blocks)
+             */
+            const LiveSet& getLiveOut(const BasicBlock& block) const;
+
+            /*
+             * Updates the analysis results after the instructions of the given block were modified.
+             *
+             * If the locals live at the start of the block are not changed by the modification (e.g. only temporaries
+             * used within the block were inserted), only the results for this block are recalculated and true is
+             * returned. Otherwise, the whole method is re-analyzed and false is returned.
+             *
+             * NOTE: The modification must not change the control flow between the blocks!
+             */
+            bool updateBlock(const Method& method, const BasicBlock& block);
+
+            /*
+             * Walks the given block backwards and runs the consumer for every instruction with the set of locals live
+             * directly before the instruction is executed (incl. the locals read by this instruction)
+             */
+            void forAllInstructions(const BasicBlock& block, const InstructionConsumer& consumer) const;
+
+            /*
+             * Returns the index of the given local in the sets of live locals
+             */
+            std::size_t getIndex(const Local* local) const;
+            const Local* getLocal(std::size_t index) const;
+            FastSet<const Local*> toLocals(const LiveSet& liveLocals) const;
+
+            std::string to_string(const LiveSet& liveLocals) const;
+            void dumpResults(const Method& method) const;
 
         private:
+            struct BlockResult
+            {
+                LiveSet liveIn;
+                LiveSet liveOut;
+                // the locals read in this block before being overwritten
+                LiveSet generated;
+                // the locals (conditionally) written in this block
+                LiveSet killed;
+            };
+
+            FastMap<const BasicBlock*, BlockResult> results;
+            // maps the indices to the locals
+            std::vector<const Local*> locals;
+            // the indices for locals not owned by the analyzed method
+            FastMap<const Local*, std::size_t> externalIndices;
+
             /*
              * For an instruction reading a, b and writing c:
              *
@@ -42,11 +118,11 @@ namespace vc4c
              * - a's, b's livenesses begin (they need to be live to be read)
              * - any other live local remains live
              */
-            static FastSet<const Local*> analyzeLiveness(const intermediate::IntermediateInstruction* instr,
-                const FastSet<const Local*>& nextResult,
-                std::pair<FastSet<const Local*>, FastMap<const Local*, ConditionCode>>& cache);
-
-            static std::string to_string(const FastSet<const Local*>& liveLocals);
+            void analyzeLiveness(const intermediate::IntermediateInstruction* instr, LiveSet& liveLocals,
+                LiveSet& readInBlock,
+                std::pair<FastSet<const Local*>, FastMap<const Local*, ConditionCode>>& cache) const;
+            void calculateBlockSets(const BasicBlock& block, BlockResult& result) const;
+            LiveSet walkBlock(const BasicBlock& block, LiveSet liveLocals, const InstructionConsumer* consumer) const;
         };
 
         /*
@@ -10,8 +10,10 @@
 #include "../InstructionWalker.h"
 #include "../Module.h"
 #include "../Profiler.h"
+#include "../Telemetry.h"
 #include "GraphColoring.h"
 #include "KernelInfo.h"
+#include "RegisterSpilling.h"
 #include "log.h"
 
 #include <assert.h>
@@ -76,23 +78,37 @@ const FastAccessList<DecoratedInstruction>& CodeGenerator::generateInstructions(
 #endif
 
     // check and fix possible errors with register-association
-    PROFILE_START(initializeLocalsUses);
-    GraphColoring coloring(method, method.walkAllInstructions());
-    PROFILE_END(initializeLocalsUses);
-    PROFILE_START(colorGraph);
-    std::size_t round = 0;
-    while(round < config.additionalOptions.registerResolverMaxRounds && !coloring.colorGraph())
+    telemetry::PassMeasurement registerAllocation(config, method, "register-allocation");
+    std::unique_ptr<GraphColoring> coloring;
+    RegisterSpiller spiller(method);
+    while(true)
     {
-        if(coloring.fixErrors())
+        PROFILE_START(initializeLocalsUses);
+        coloring.reset(new GraphColoring(method, method.walkAllInstructions(), config));
+        PROFILE_END(initializeLocalsUses);
+        PROFILE_START(colorGraph);
+        std::size_t round = 0;
+        while(round < config.additionalOptions.registerResolverMaxRounds && !coloring->colorGraph())
+        {
+            if(coloring->fixErrors())
+                break;
+            ++round;
+        }
+        PROFILE_END(colorGraph);
+        if(round < config.additionalOptions.registerResolverMaxRounds)
             break;
-        ++round;
-    }
-    if(round >= config.additionalOptions.registerResolverMaxRounds)
-    {
-        logging::warn() << "Register conflict resolver has exceeded its maximum rounds, there might still be errors!"
-                        << logging::endl;
+        // the conflicts cannot be resolved by moving locals around, so reduce the register pressure by spilling some
+        // locals into VPM and start the register allocation anew
+        if(spiller.spillLocals(coloring->getErrors()) == 0)
+        {
+            logging::warn()
+                << "Register conflict resolver has exceeded its maximum rounds and no more locals can be spilled, "
+                   "there might still be errors!"
+                << logging::endl;
+            break;
+        }
     }
-    PROFILE_END(colorGraph);
+    registerAllocation.finish(method);
 
     // create label-map + remove labels
     const auto labelMap = mapLabels(method);
@@ -103,7 +119,7 @@ const FastAccessList<DecoratedInstruction>& CodeGenerator::generateInstructions(
     // map to registers
     PROFILE_START(toRegisterMap);
     PROFILE_START(toRegisterMapGraph);
-    auto registerMapping = coloring.toRegisterMap();
+    auto registerMapping = coloring->toRegisterMap();
     PROFILE_END(toRegisterMapGraph);
     PROFILE_END(toRegisterMap);
 
@@ -178,14 +194,25 @@ std::size_t CodeGenerator::writeOutput(std::ostream& stream)
             CompilationStep::CODE_GENERATION, "Stack-frame has unsupported size of", std::to_string(maxStackSize));
     moduleInfo.setStackFrameSize(Word(Byte(maxStackSize)));
 
+    // the kernels are processed in parallel in arbitrary order, so write them in the order of the module to generate
+    // deterministic output
+    std::vector<std::pair<Method*, const FastAccessList<DecoratedInstruction>&>> kernelInstructions;
+    kernelInstructions.reserve(allInstructions.size());
+    for(const auto& method : module)
+    {
+        auto it = allInstructions.find(method.get());
+        if(it != allInstructions.end())
+            kernelInstructions.emplace_back(it->first, it->second);
+    }
+
     std::size_t numBytes = 0;
     // initial offset is zero
     std::size_t offset = 0;
     if(config.writeKernelInfo)
     {
-        moduleInfo.kernelInfos.reserve(allInstructions.size());
+        moduleInfo.kernelInfos.reserve(kernelInstructions.size());
         // generate kernel-infos
-        for(const auto& pair : allInstructions)
+        for(const auto& pair : kernelInstructions)
         {
             moduleInfo.addKernelInfo(getKernelInfos(*pair.first, offset, pair.second.size()));
             offset += pair.second.size();
@@ -202,7 +229,7 @@ std::size_t CodeGenerator::writeOutput(std::ostream& stream)
     CPPLOG_LAZY(logging::Level::DEBUG, log << "Writing module header..." << logging::endl);
     numBytes += moduleInfo.write(stream, config.outputMode, module.globalData, Byte(maxStackSize)) * sizeof(uint64_t);
 
-    for(const auto& pair : allInstructions)
+    for(const auto& pair : kernelInstructions)
     {
         switch(config.outputMode)
         {
@@ -14,6 +14,7 @@
 #include "log.h"
 
 #include <algorithm>
+#include <cmath>
 
 using namespace vc4c;
 using namespace vc4c::qpu_asm;
@@ -22,7 +23,8 @@ using namespace vc4c::qpu_asm;
 // page 199ff
 
 LocalUsage::LocalUsage(InstructionWalker first, InstructionWalker last) :
-    firstOccurrence(first), lastOccurrence(last), possibleFiles(RegisterFile::ANY), blockedFiles(RegisterFile::NONE)
+    firstOccurrence(first), lastOccurrence(last), possibleFiles(RegisterFile::ANY), blockedFiles(RegisterFile::NONE),
+    accessWeight(0.0f)
 {
     associatedInstructions.insert(first);
     associatedInstructions.insert(last);
@@ -84,6 +86,13 @@ void ColoredNodeBase::takeValues(const ColoredNodeBase& other)
     });
 }
 
+void ColoredNodeBase::resetRegisters()
+{
+    availableA = 0xFFFFFFFFUL;
+    availableB = 0xFFFFFFFFUL;
+    availableAcc = 0x02FUL;
+}
+
 Register ColoredNodeBase::getRegisterFixed() const
 {
     if(possibleFiles == RegisterFile::NONE)
@@ -398,13 +407,21 @@ static void fixLocals(const InstructionWalker it, FastMap<const Local*, LocalUsa
     }
 }
 
-GraphColoring::GraphColoring(Method& method, InstructionWalker it) :
-    method(method), closedSet(), openSet(), interferenceGraph(), localUses()
+GraphColoring::GraphColoring(Method& method, InstructionWalker it, const Configuration& config) :
+    method(method), accumulatorLoopWeight(config.additionalOptions.accumulatorLoopWeight), closedSet(), openSet(),
+    interferenceGraph(), localUses()
 {
     closedSet.reserve(method.getNumLocals());
     openSet.reserve(method.getNumLocals());
     localUses.reserve(method.getNumLocals());
 
+    // the accesses within loops are executed more often, so they are weighted higher
+    FastMap<const BasicBlock*, unsigned> loopDepths;
+    if(accumulatorLoopWeight != 0)
+        loopDepths = method.getCFG().findLoopDepths();
+    const BasicBlock* currentBlock = nullptr;
+    float currentWeight = 1.0f;
+
     const Local* lastWrittenLocal0 = nullptr;
     const Local* lastWrittenLocal1 = nullptr;
     while(!it.isEndOfMethod())
@@ -412,6 +429,14 @@ GraphColoring::GraphColoring(Method& method, InstructionWalker it) :
         if(it.get() != nullptr && !it.get<intermediate::Branch>() && !it.get<intermediate::BranchLabel>() &&
             !it.get<intermediate::MemoryBarrier>())
         {
+            if(it.getBasicBlock() != currentBlock)
+            {
+                currentBlock = it.getBasicBlock();
+                auto depthIt = loopDepths.find(currentBlock);
+                currentWeight = depthIt == loopDepths.end() ?
+                    1.0f :
+                    std::pow(static_cast<float>(accumulatorLoopWeight), static_cast<float>(depthIt->second));
+            }
             // 1) create entry per local
             it->forUsedLocals([this, it](const Local* l, const LocalUse::Type type) -> void {
                 if(localUses.find(l) == localUses.end())
@@ -425,8 +450,9 @@ GraphColoring::GraphColoring(Method& method, InstructionWalker it) :
             // 2) update fixed locals
             PROFILE(fixLocals, it, localUses, lastWrittenLocal0, lastWrittenLocal1);
             // 3) update local usage-ranges as well as assign all locals to closed-set or open-set
-            it->forUsedLocals([this, it](const Local* l, const LocalUse::Type type) -> void {
+            it->forUsedLocals([this, it, currentWeight](const Local* l, const LocalUse::Type type) -> void {
                 auto& range = localUses.at(l);
+                range.accessWeight += currentWeight;
                 range.associatedInstructions.insert(it);
                 range.lastOccurrence = it;
                 if(isFixed(range.possibleFiles))
@@ -456,12 +482,27 @@ GraphColoring::GraphColoring(Method& method, InstructionWalker it) :
 
 void GraphColoring::createGraph()
 {
-    interferenceGraph = analysis::InterferenceGraph::createGraph(method);
+    bool isIncremental = false;
+    if(!interferenceGraph)
+    {
+        // makes sure the successors of the blocks are looked up via the CFG
+        method.getCFG();
+        liveness(method);
+    }
+    else
+        isIncremental = updateInterferences();
+    if(!isIncremental)
+    {
+        graph.clear();
+        interferenceGraph = analysis::InterferenceGraph::createGraph(method, liveness);
+    }
     // 1. iteration: set files and locals used together and map to start/end of range
     PROFILE_START(createColoredNodes);
     for(const auto& pair : localUses)
     {
         auto& node = graph.getOrCreateNode(pair.first);
+        // the node may still contain the registers assigned in the previous round
+        node.resetRegisters();
         node.possibleFiles = pair.second.possibleFiles;
         node.initialFile = pair.second.possibleFiles;
         if(isReplicationUsed ||
@@ -525,19 +566,35 @@ void GraphColoring::createGraph()
             CPPLOG_LAZY(logging::Level::DEBUG, log << "Spill candidate: " << node.first->to_string() << logging::endl);
         PROFILE_COUNTER(vc4c::profiler::COUNTER_BACKEND + 5, "SpillCandidates", node.second.getEdgesSize() >= 32);
         PROFILE_COUNTER(vc4c::profiler::COUNTER_BACKEND + 6, "SpillCandidates (uses)",
-            (node.second.getEdgesSize() >= 32) * node.first->getUsers().size());
+            (node.second.getEdgesSize() >= 32) * node.first->countUsers(LocalUse::Type::BOTH));
     }
     // 2. iteration: associate locals used together
     PROFILE_START(InterferenceToColoredGraph);
-    for(const auto& interferenceNode : interferenceGraph->getNodes())
-    {
-        ColoredNode& node = graph.assertNode(interferenceNode.first);
-        interferenceNode.second.forAllEdges(
+    auto copyEdges = [&](const analysis::InterferenceNode& interferenceNode) {
+        ColoredNode& node = graph.assertNode(interferenceNode.key);
+        interferenceNode.forAllEdges(
             [&](const analysis::InterferenceNode& neighbor, const analysis::Interference& edge) -> bool {
                 node.getOrCreateEdge(&graph.assertNode(neighbor.key)).data = edge.data;
                 return true;
             });
+    };
+    if(isIncremental)
+    {
+        // only the edges of the locals modified by the last round of fixes have changed
+        for(const Local* local : modifiedLocals)
+        {
+            graph.assertNode(local).removeAllEdges();
+            if(auto interferenceNode = interferenceGraph->findNode(const_cast<Local*>(local)))
+                copyEdges(*interferenceNode);
+        }
     }
+    else
+    {
+        for(const auto& interferenceNode : interferenceGraph->getNodes())
+            copyEdges(interferenceNode.second);
+    }
+    modifiedLocals.clear();
+    modifiedBlocks.clear();
     PROFILE_END(InterferenceToColoredGraph);
 
     CPPLOG_LAZY(logging::Level::DEBUG,
@@ -612,6 +669,36 @@ static void processClosedSet(ColoredGraph& graph, FastSet<const Local*>& closedS
     PROFILE_END(processClosedSet);
 }
 
+bool GraphColoring::updateInterferences()
+{
+    PROFILE_START(updateInterferences);
+    for(const BasicBlock* block : modifiedBlocks)
+    {
+        if(!liveness.updateBlock(method, *block))
+        {
+            // the liveness of the whole method was re-calculated, so the whole graph needs to be re-created too
+            PROFILE_END(updateInterferences);
+            return false;
+        }
+    }
+    // the interferences of the modified locals can change in any block they are used in
+    FastSet<const BasicBlock*> blocks(modifiedBlocks);
+    for(const Local* local : modifiedLocals)
+    {
+        auto it = localUses.find(local);
+        if(it == localUses.end())
+            continue;
+        for(InstructionWalker inst : it->second.associatedInstructions)
+            blocks.emplace(inst.getBasicBlock());
+    }
+    interferenceGraph->updateLocals(method, liveness, modifiedLocals, blocks);
+    CPPLOG_LAZY(logging::Level::DEBUG,
+        log << "Updated interferences of " << modifiedLocals.size() << " locals in " << blocks.size() << " blocks"
+            << logging::endl);
+    PROFILE_END(updateInterferences);
+    return true;
+}
+
 bool GraphColoring::colorGraph()
 {
     if(!graph.getNodes().empty())
@@ -623,15 +710,32 @@ bool GraphColoring::colorGraph()
     // process all nodes fixed initially to a register-file
     processClosedSet(graph, closedSet, openSet, errorSet);
 
+    // the accumulators are assigned greedily, so the locals processed first are preferred
+    std::vector<const Local*> openLocals(openSet.begin(), openSet.end());
+    if(accumulatorLoopWeight != 0)
+    {
+        auto getWeight = [this](const Local* loc) -> float {
+            auto it = localUses.find(loc);
+            return it == localUses.end() ? 0.0f : it->second.accessWeight;
+        };
+        std::stable_sort(openLocals.begin(), openLocals.end(),
+            [&](const Local* one, const Local* other) -> bool { return getWeight(one) > getWeight(other); });
+    }
+    auto nextIt = openLocals.begin();
+
     while(!openSet.empty())
     {
+        // skip all locals already assigned to a register-file while processing their neighbors
+        while(nextIt != openLocals.end() && openSet.find(*nextIt) == openSet.end())
+            ++nextIt;
+        const Local* nextLocal = nextIt != openLocals.end() ? *nextIt : *openSet.begin();
         // for every node in the open-set, assign to accumulator if possible, assign to the first available
         // register-file otherwise  and update all neighbors
-        auto node = graph.findNode(*openSet.begin());
+        auto node = graph.findNode(nextLocal);
         if(node == nullptr)
         {
             throw CompilationError(
-                CompilationStep::LABEL_REGISTER_MAPPING, "Error getting local from graph", (*openSet.begin())->name);
+                CompilationStep::LABEL_REGISTER_MAPPING, "Error getting local from graph", nextLocal->name);
         }
         RegisterFile currentFile = RegisterFile::NONE;
         if(has_flag(node->possibleFiles, RegisterFile::ACCUMULATOR))
@@ -676,7 +780,7 @@ static RegisterFile getBlockedInputs(
     return blockedFiles;
 }
 
-static NODISCARD LocalUse checkUser(const SortedMap<const LocalUser*, LocalUse>& users, const InstructionWalker it)
+static NODISCARD LocalUse checkUser(const LocalUsersMap& users, const InstructionWalker it)
 {
     LocalUse use;
     it.forAllInstructions([&users, &use](const intermediate::IntermediateInstruction* instr) {
@@ -690,7 +794,7 @@ static NODISCARD LocalUse checkUser(const SortedMap<const LocalUser*, LocalUse>&
     return use;
 }
 
-static NODISCARD LocalUse assertUser(const SortedMap<const LocalUser*, LocalUse>& users, const InstructionWalker it)
+static NODISCARD LocalUse assertUser(const LocalUsersMap& users, const InstructionWalker it)
 {
     auto use = checkUser(users, it);
     if(!use.readsLocal() && !use.writesLocal())
@@ -724,7 +828,8 @@ static NODISCARD bool reassignNodeToRegister(ColoredGraph& graph, ColoredNode& n
 }
 
 static NODISCARD bool moveLocalToRegisterFile(Method& method, ColoredGraph& graph, ColoredNode& node,
-    FastMap<const Local*, LocalUsage>& localUses, LocalUsage& localUse, const RegisterFile file)
+    FastMap<const Local*, LocalUsage>& localUses, LocalUsage& localUse, const RegisterFile file,
+    FastSet<const Local*>& modifiedLocals, FastSet<const BasicBlock*>& modifiedBlocks)
 {
     bool needNextRound = false;
     const auto& users = node.key->getUsers();
@@ -757,6 +862,9 @@ static NODISCARD bool moveLocalToRegisterFile(Method& method, ColoredGraph& grap
         CPPLOG_LAZY(logging::Level::DEBUG,
             log << "Fixing register-conflict by using temporary as input for: " << it->to_string() << logging::endl);
         it.emplace(new intermediate::MoveOperation(tmp, node.key->createReference()));
+        modifiedLocals.emplace(node.key);
+        modifiedLocals.emplace(tmp.local());
+        modifiedBlocks.emplace(it.getBasicBlock());
         auto& tmpUse = localUses.emplace(tmp.local(), LocalUsage(it, it)).first->second;
         it.nextInBlock();
         it->replaceLocal(node.key, tmp.local(), LocalUse::Type::READER);
@@ -801,7 +909,8 @@ static bool blocksLocal(const ColoredNode* neighbor, LocalRelation relation)
 }
 
 static NODISCARD bool fixSingleError(Method& method, ColoredGraph& graph, ColoredNode& node,
-    FastMap<const Local*, LocalUsage>& localUses, LocalUsage& localUse)
+    FastMap<const Local*, LocalUsage>& localUses, LocalUsage& localUse, FastSet<const Local*>& modifiedLocals,
+    FastSet<const BasicBlock*>& modifiedBlocks)
 {
     /*
      * The following cases can occur:
@@ -837,10 +946,6 @@ static NODISCARD bool fixSingleError(Method& method, ColoredGraph& graph, Colore
      *   - need to make sure, copy is written to when the main local is written!
      */
 
-    // TODO if we only use fixes which do not change the graph (don't insert new locals)
-    // we could skip re-creating the whole graph and simply try to assign a register to the node
-    // by re-checking which registers are not used by any neighbor
-
     const auto& users = node.key->getUsers();
 
     // CASE 1)
@@ -936,7 +1041,8 @@ static NODISCARD bool fixSingleError(Method& method, ColoredGraph& graph, Colore
             // the "easier" solution is to copy the local into an accumulator before each use, where it conflicts with
             // other inputs
             return moveLocalToRegisterFile(method, graph, node, localUses, localUse,
-                fileACouldBeUsed ? RegisterFile::PHYSICAL_A : RegisterFile::PHYSICAL_B);
+                fileACouldBeUsed ? RegisterFile::PHYSICAL_A : RegisterFile::PHYSICAL_B, modifiedLocals,
+                modifiedBlocks);
         }
         else
         {
@@ -999,7 +1105,7 @@ static NODISCARD bool fixSingleError(Method& method, ColoredGraph& graph, Colore
         }
 
         return moveLocalToRegisterFile(method, graph, node, localUses, localUse,
-            moveToFileA ? RegisterFile::PHYSICAL_A : RegisterFile::PHYSICAL_B);
+            moveToFileA ? RegisterFile::PHYSICAL_A : RegisterFile::PHYSICAL_B, modifiedLocals, modifiedBlocks);
     }
     else
         throw CompilationError(
@@ -1030,7 +1136,7 @@ bool GraphColoring::fixErrors()
             });
             s << logging::endl;
         });
-        if(!fixSingleError(method, graph, node, localUses, localUses.at(local)))
+        if(!fixSingleError(method, graph, node, localUses, localUses.at(local), modifiedLocals, modifiedBlocks))
             allFixed = false;
     }
     PROFILE_END(fixRegisterErrors);
@@ -1066,7 +1172,7 @@ void GraphColoring::resetGraph()
     openSet.clear();
     closedSet.clear();
     errorSet.clear();
-    graph.clear();
+    // the graph itself is kept and updated incrementally in #createGraph()
     for(const auto& pair : localUses)
     {
         if(isFixed(pair.second.possibleFiles))
@@ -10,12 +10,15 @@
 #include "../Graph.h"
 #include "../InstructionWalker.h"
 #include "../analysis/InterferenceGraph.h"
+#include "../analysis/LivenessAnalysis.h"
 #include "../performance.h"
 
 #include <bitset>
 
 namespace vc4c
 {
+    struct Configuration;
+
     namespace qpu_asm
     {
         using LocalRelation = analysis::InterferenceType;
@@ -34,6 +37,8 @@ namespace vc4c
             // NOTE: this is the instruction-iterator, so it points to the combined operation not the single operation
             // actually using the local
             FastSet<InstructionWalker> associatedInstructions;
+            // the number of accesses, weighted by the loop depth of the accessing instructions
+            float accessWeight;
 
             LocalUsage(InstructionWalker first, InstructionWalker last);
         };
@@ -59,6 +64,10 @@ namespace vc4c
              * Copied the status of the other node into this
              */
             void takeValues(const ColoredNodeBase& other);
+            /*
+             * Makes all registers available again, e.g. to color the node anew
+             */
+            void resetRegisters();
 
             /*
              * \return The fixed register, this node has
@@ -123,7 +132,7 @@ namespace vc4c
             /*!
              * Initializes all internal data structures with a single iteration over all instructions
              */
-            GraphColoring(Method& method, InstructionWalker it);
+            GraphColoring(Method& method, InstructionWalker it, const Configuration& config);
 
             NODISCARD bool colorGraph();
 
@@ -134,18 +143,38 @@ namespace vc4c
 
             FastMap<const Local*, Register> toRegisterMap() const;
 
+            /*
+             * \return The locals which could not be assigned to any register in the last round
+             */
+            const FastSet<const Local*>& getErrors() const
+            {
+                return errorSet;
+            }
+
         private:
             Method& method;
+            // the factor to weight accesses with per loop depth, zero to not weight the locals
+            const unsigned accumulatorLoopWeight;
             FastSet<const Local*> closedSet;
             FastSet<const Local*> openSet;
+            analysis::LivenessAnalysis liveness;
             std::unique_ptr<analysis::InterferenceGraph> interferenceGraph;
             FastMap<const Local*, LocalUsage> localUses;
             bool isReplicationUsed = false;
 
             ColoredGraph graph;
             FastSet<const Local*> errorSet;
+            // the locals and blocks modified by fixing errors, to be updated in the graphs in the next round
+            FastSet<const Local*> modifiedLocals;
+            FastSet<const BasicBlock*> modifiedBlocks;
 
             void createGraph();
+            /*
+             * Updates the liveness and interferences for the locals and blocks modified by the last round of fixes.
+             *
+             * Returns false, if the liveness of the whole method changed and the graphs need to be re-created
+             */
+            bool updateInterferences();
             void resetGraph();
         };
     } // namespace qpu_asm
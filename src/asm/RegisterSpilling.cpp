@@ -0,0 +1,275 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#include "RegisterSpilling.h"
+
+#include "../Method.h"
+#include "../Profiler.h"
+#include "../analysis/ControlFlowGraph.h"
+#include "../analysis/InterferenceGraph.h"
+#include "../analysis/LivenessAnalysis.h"
+#include "../periphery/VPM.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vc4c;
+using namespace vc4c::qpu_asm;
+
+// the factor an access within a loop is weighted with, per loop the access is nested in
+static constexpr float LOOP_WEIGHT = 8.0f;
+// the minimum number of instructions a local needs to be live (in addition to its accesses) to be spilled. Spilling
+// locals with very short life-times does not reduce the register pressure
+static constexpr std::size_t MIN_LIVE_INSTRUCTIONS = 4;
+
+struct SpillCosts
+{
+    // the number of reads and writes, weighted by the loop depth of the accessing instruction
+    float weightedAccesses = 0.0f;
+    std::size_t numAccesses = 0;
+    // the number of instructions the local is live at
+    std::size_t numLiveInstructions = 0;
+    // whether the local is accessed in a position where we cannot insert any VPM access
+    bool isAccessedWithinVPMAccess = false;
+
+    float getCosts() const
+    {
+        // locals used rarely (or not within loops) over a long life-time are the cheapest to spill
+        return weightedAccesses / static_cast<float>(numLiveInstructions);
+    }
+};
+
+static bool accessesVPMSetup(const intermediate::IntermediateInstruction* inst)
+{
+    return inst->writesRegister(REG_VPM_IN_SETUP) || inst->writesRegister(REG_VPM_OUT_SETUP) ||
+        inst->writesRegister(REG_VPM_DMA_LOAD_ADDR) || inst->writesRegister(REG_VPM_DMA_STORE_ADDR);
+}
+
+static bool finishesVPMAccess(const intermediate::IntermediateInstruction* inst)
+{
+    return inst->readsRegister(REG_VPM_DMA_LOAD_WAIT) || inst->readsRegister(REG_VPM_DMA_STORE_WAIT);
+}
+
+/*
+ * Whether the instruction does not overwrite all elements (or bits) of the given local, in which case the previous
+ * value needs to be loaded before the instruction
+ */
+static bool isPartialWrite(const intermediate::IntermediateInstruction* inst, const Local* local)
+{
+    if(auto combined = dynamic_cast<const intermediate::CombinedOperation*>(inst))
+        return (combined->op1 && combined->op1->writesLocal(local) && isPartialWrite(combined->op1.get(), local)) ||
+            (combined->op2 && combined->op2->writesLocal(local) && isPartialWrite(combined->op2.get(), local));
+    return inst->hasConditionalExecution() || inst->hasPackMode() ||
+        inst->hasDecoration(intermediate::InstructionDecorations::ELEMENT_INSERTION);
+}
+
+RegisterSpiller::RegisterSpiller(Method& method) : method(method), numUsedSlots(0) {}
+
+std::size_t RegisterSpiller::spillLocals(const FastSet<const Local*>& erroneousLocals)
+{
+    PROFILE_START(spillLocals);
+    // 1. determine the loop depth of all blocks
+    const auto loopDepths = method.getCFG().findLoopDepths();
+
+    // 2. determine the spill costs of all locals
+    analysis::LivenessAnalysis liveness;
+    liveness(method);
+    auto interferenceGraph = analysis::InterferenceGraph::createGraph(method, liveness);
+    FastMap<const Local*, SpillCosts> spillCosts;
+    bool isWithinVPMAccess = false;
+    for(const BasicBlock& block : method)
+    {
+        auto depthIt = loopDepths.find(&block);
+        const float weight = std::pow(LOOP_WEIGHT, depthIt == loopDepths.end() ? 0.0f : depthIt->second);
+        for(const auto& inst : block)
+        {
+            if(!inst)
+                continue;
+            // we cannot insert any VPM access (which changes the VPM setup) into a locked block or between setting up
+            // a VPM access and the access itself
+            if(auto mutex = dynamic_cast<const intermediate::MutexLock*>(inst.get()))
+                isWithinVPMAccess = mutex->locksMutex();
+            else if(accessesVPMSetup(inst.get()))
+                isWithinVPMAccess = true;
+            inst->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+                auto& costs = spillCosts[loc];
+                costs.weightedAccesses += weight;
+                ++costs.numAccesses;
+                if(isWithinVPMAccess || inst->readsRegister(REG_VPM_IO) || inst->writesRegister(REG_VPM_IO))
+                    costs.isAccessedWithinVPMAccess = true;
+            });
+            if(finishesVPMAccess(inst.get()))
+                isWithinVPMAccess = false;
+        }
+        liveness.forAllInstructions(block,
+            [&](const intermediate::IntermediateInstruction* inst, const analysis::LivenessAnalysis::LiveSet& live) {
+                live.forAllSetBits(
+                    [&](std::size_t index) { ++spillCosts[liveness.getLocal(index)].numLiveInstructions; });
+            });
+    }
+
+    auto isSpillCandidate = [&](const Local* loc) -> bool {
+        auto costIt = spillCosts.find(loc);
+        return costIt != spillCosts.end() && !loc->type.isLabelType() &&
+            spillTemporaries.find(loc) == spillTemporaries.end() && !costIt->second.isAccessedWithinVPMAccess &&
+            !loc->getUsers(LocalUse::Type::WRITER).empty() &&
+            costIt->second.numLiveInstructions > costIt->second.numAccesses + MIN_LIVE_INSTRUCTIONS;
+    };
+
+    // 3. for every local which could not be assigned, select the cheapest local interfering with it (or itself)
+    std::vector<const Local*> selectedLocals;
+    FastSet<const Local*> selectedSet;
+    for(const Local* erroneous : erroneousLocals)
+    {
+        const Local* cheapest = nullptr;
+        auto checkCandidate = [&](const Local* loc) {
+            if(selectedSet.find(loc) != selectedSet.end() || !isSpillCandidate(loc))
+                return;
+            if(cheapest == nullptr || spillCosts.at(loc).getCosts() < spillCosts.at(cheapest).getCosts())
+                cheapest = loc;
+        };
+        checkCandidate(erroneous);
+        if(auto node = interferenceGraph->findNode(const_cast<Local*>(erroneous)))
+        {
+            node->forAllEdges(
+                [&](const analysis::InterferenceNode& neighbor, const analysis::Interference& edge) -> bool {
+                    checkCandidate(neighbor.key);
+                    return true;
+                });
+        }
+        if(cheapest != nullptr)
+        {
+            selectedLocals.push_back(cheapest);
+            selectedSet.emplace(cheapest);
+        }
+    }
+
+    if(selectedLocals.empty())
+    {
+        PROFILE_END(spillLocals);
+        return 0;
+    }
+
+    // 4. assign the VPM slots, locals not live at the same time can share a slot
+    FastMap<const Local*, unsigned> slots;
+    unsigned numSlots = 0;
+    for(const Local* loc : selectedLocals)
+    {
+        auto node = interferenceGraph->findNode(const_cast<Local*>(loc));
+        unsigned slot = 0;
+        for(; slot < numSlots; ++slot)
+        {
+            bool isSlotFree = std::none_of(slots.begin(), slots.end(), [&](const std::pair<const Local*, unsigned>& p) {
+                return p.second == slot && node != nullptr &&
+                    node->isAdjacent(interferenceGraph->findNode(const_cast<Local*>(p.first)));
+            });
+            if(isSlotFree)
+                break;
+        }
+        slots.emplace(loc, slot);
+        numSlots = std::max(numSlots, slot + 1);
+    }
+
+    // every round reserves only the VPM it needs for its slots, since the slots of previous rounds are still in use
+    const periphery::VPMArea* area = method.vpm->addSpillArea(numSlots);
+    if(area == nullptr)
+    {
+        logging::warn() << "Not enough VPM space left to spill " << selectedLocals.size()
+                        << " more registers for kernel: " << method.name << logging::endl;
+        PROFILE_END(spillLocals);
+        return 0;
+    }
+    const unsigned numAvailableSlots = area->numRows / NUM_QPUS;
+    if(numAvailableSlots < numSlots)
+    {
+        // spill as many locals as fit into the remaining VPM, the next round might find other candidates
+        CPPLOG_LAZY(logging::Level::WARNING,
+            log << "Only " << numAvailableSlots << " of " << numSlots
+                << " required VPM slots for spilling registers are available" << logging::endl);
+        for(auto it = slots.begin(); it != slots.end();)
+        {
+            if(it->second >= numAvailableSlots)
+                it = slots.erase(it);
+            else
+                ++it;
+        }
+        numSlots = numAvailableSlots;
+    }
+    for(const auto& slot : slots)
+    {
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Spilling local " << slot.first->to_string() << " into VPM slot " << slot.second
+                << " (spill costs " << spillCosts.at(slot.first).getCosts() << ")" << logging::endl);
+    }
+    numUsedSlots += numSlots;
+
+    // 5. replace all accesses to the spilled locals with reads from/writes to VPM
+    const std::size_t numInstructionsBefore = method.countInstructions();
+    std::vector<std::pair<const Local*, LocalUse::Type>> spilledUses;
+    auto it = method.walkAllInstructions();
+    while(!it.isEndOfMethod())
+    {
+        if(!it.has())
+        {
+            it.nextInMethod();
+            continue;
+        }
+        spilledUses.clear();
+        it->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+            if(slots.find(loc) == slots.end())
+                return;
+            auto useIt = std::find_if(spilledUses.begin(), spilledUses.end(),
+                [loc](const std::pair<const Local*, LocalUse::Type>& use) -> bool { return use.first == loc; });
+            if(useIt != spilledUses.end())
+                useIt->second = add_flag(useIt->second, type);
+            else
+                spilledUses.emplace_back(loc, type);
+        });
+        std::vector<std::pair<Value, unsigned>> stores;
+        for(const auto& use : spilledUses)
+        {
+            const unsigned slot = slots.at(use.first);
+            const Value tmp = method.addNewLocal(use.first->type, "%spill");
+            spillTemporaries.emplace(tmp.local());
+            if(has_flag(use.second, LocalUse::Type::READER) ||
+                (has_flag(use.second, LocalUse::Type::WRITER) && isPartialWrite(it.get(), use.first)))
+            {
+                // the previous value is read, so we need to load it before the instruction
+                it = method.vpm->insertFillRegister(method, it, tmp, *area, slot);
+                if(it->hasUnpackMode() || it.get<intermediate::VectorRotation>())
+                {
+                    // these instructions cannot read an input written by the previous instruction
+                    it.emplace(new intermediate::Nop(intermediate::DelayType::WAIT_REGISTER));
+                    it.nextInBlock();
+                }
+            }
+            it->replaceLocal(use.first, tmp.local(), use.second);
+            if(has_flag(use.second, LocalUse::Type::WRITER))
+                stores.emplace_back(tmp, slot);
+        }
+        if(!stores.empty())
+        {
+            // write the new values back after the instruction
+            auto storeIt = it.copy().nextInBlock();
+            for(const auto& store : stores)
+                storeIt = method.vpm->insertSpillRegister(method, storeIt, store.first, *area, store.second);
+            // continue with the instruction following the inserted writes
+            it = storeIt.previousInBlock();
+        }
+        it.nextInMethod();
+    }
+    const std::size_t numSpillInstructions = method.countInstructions() - numInstructionsBefore;
+    PROFILE_END(spillLocals);
+
+    CPPLOG_LAZY(logging::Level::INFO,
+        log << "Spilled " << slots.size() << " locals into " << numSlots << " new VPM slots (" << numUsedSlots
+            << " in total) for kernel " << method.name << ", inserting " << numSpillInstructions << " instructions"
+            << logging::endl);
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_BACKEND + 50, "Spilled locals", slots.size());
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_BACKEND + 51, "Spill instructions", numSpillInstructions);
+    return slots.size();
+}
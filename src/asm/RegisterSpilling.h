@@ -0,0 +1,57 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#ifndef REGISTER_SPILLING_H
+#define REGISTER_SPILLING_H
+
+#include "../performance.h"
+#include "Optional.h"
+
+namespace vc4c
+{
+    class Local;
+    class Method;
+
+    namespace qpu_asm
+    {
+        /*
+         * Spills locals which cannot be assigned to any register into the VPM.
+         *
+         * A spilled local is no longer kept in a register for its whole life-time. Instead, its value is written into a
+         * per-QPU slot of the VPM after every write and read back into a new temporary before every read. This splits
+         * the long life-time of the local into many very short ones, which reduces the register pressure.
+         *
+         * The spill candidates are selected by their spill costs, which are the number of accesses (weighted by the
+         * loop depth, since accesses in loops are executed more often) per instruction the local is live. So locals
+         * live for a long time but rarely used (e.g. kernel parameters only read in the last block) are spilled first.
+         */
+        class RegisterSpiller : private NonCopyable
+        {
+        public:
+            explicit RegisterSpiller(Method& method);
+
+            /*
+             * Selects some locals which interfere with the given locals not assigned to any register and spills them.
+             *
+             * Locals spilled in the same round, which do not interfere with each other share the same VPM slot. Every
+             * round reserves only as much VPM as its slots require.
+             *
+             * Returns the number of locals spilled, zero if no more locals could be spilled (e.g. due to no VPM space
+             * left)
+             */
+            std::size_t spillLocals(const FastSet<const Local*>& erroneousLocals);
+
+        private:
+            Method& method;
+            // the number of VPM slots reserved by all rounds so far, every round spills into a new VPM area
+            unsigned numUsedSlots;
+            // the temporaries introduced by spilling, which must not be spilled again
+            FastSet<const Local*> spillTemporaries;
+        };
+    } // namespace qpu_asm
+} // namespace vc4c
+
+#endif /* REGISTER_SPILLING_H */
@@ -5,6 +5,8 @@
  */
 
 #include "IntermediateInstruction.h"
+
+#include "../MemoryArena.h"
 #include "log.h"
 
 using namespace vc4c;
@@ -92,12 +94,22 @@ IntermediateInstruction::IntermediateInstruction(
     Optional<Value>&& output, ConditionCode cond, SetFlag setFlags, Pack packMode) :
     signal(SIGNAL_NONE),
     unpackMode(UNPACK_NOP), packMode(packMode), conditional(cond), setFlags(setFlags), canBeCombined(true),
-    decoration(InstructionDecorations::NONE), output(std::move(output)), arguments()
+    decoration(InstructionDecorations::NONE), optimizationSignature(0), output(std::move(output)), arguments()
 {
     if(this->output)
         addAsUserToValue(this->output.value(), LocalUse::Type::WRITER);
 }
 
+void* IntermediateInstruction::operator new(std::size_t size)
+{
+    return MemoryArena::allocateFromCurrentArena(size);
+}
+
+void IntermediateInstruction::operator delete(void* ptr, std::size_t size)
+{
+    MemoryArena::deallocateToOwningArena(ptr, size);
+}
+
 IntermediateInstruction::~IntermediateInstruction()
 {
     // this can't be in LocalUser
@@ -97,6 +97,13 @@ namespace vc4c
             IntermediateInstruction& operator=(const IntermediateInstruction&) = delete;
             IntermediateInstruction& operator=(IntermediateInstruction&&) = delete;
 
+            /*
+             * Instructions are allocated from the memory arena of the method currently processed by the thread (see
+             * MemoryArena::Scope), if any, and from the heap otherwise.
+             */
+            static void* operator new(std::size_t size);
+            static void operator delete(void* ptr, std::size_t size);
+
             virtual FastMap<const Local*, LocalUse::Type> getUsedLocals() const;
             virtual void forUsedLocals(const std::function<void(const Local*, LocalUse::Type)>& consumer) const;
             virtual bool readsLocal(const Local* local) const;
@@ -237,6 +244,12 @@ namespace vc4c
             SetFlag setFlags;
             bool canBeCombined;
             InstructionDecorations decoration;
+            /*
+             * The signature of this instruction when it was last processed by the single-step optimizations (see
+             * Optimizer.cpp). A value of zero marks the instruction to be processed by the next run of the single
+             * steps.
+             */
+            mutable std::size_t optimizationSignature;
 
         protected:
             Value renameValue(Method& method, const Value& orig, const std::string& prefix) const;
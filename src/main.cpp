@@ -57,6 +57,8 @@ static void printHelp()
               << "\tThe maximum distance between two literal loads to combine" << std::endl;
     std::cout << "\t--faccumulator-threshold=" << defaultConfig.additionalOptions.accumulatorThreshold
               << "\tThe maximum live-range of a local still considered to be mapped to an accumulator" << std::endl;
+    std::cout << "\t--faccumulator-loop-weight=" << defaultConfig.additionalOptions.accumulatorLoopWeight
+              << "\tThe factor to prefer locals accessed in loops for accumulators with, per loop depth" << std::endl;
     std::cout << "\t--freplace-nop-threshold=" << defaultConfig.additionalOptions.replaceNopThreshold
               << "\tThe number of instructions to search for a replacement for NOPs" << std::endl;
     std::cout << "\t--fregister-resolver-rounds=" << defaultConfig.additionalOptions.registerResolverMaxRounds
@@ -65,6 +67,8 @@ static void printHelp()
               << "\tThe maximum depth of nested loops to move constants out of" << std::endl;
     std::cout << "\t--foptimization-iterations=" << defaultConfig.additionalOptions.maxOptimizationIterations
               << "\tThe maximum number of iterations to repeat the optimizations in" << std::endl;
+    std::cout << "\t--fparallel-blocks=" << defaultConfig.additionalOptions.minParallelBlocks
+              << "\tThe minimum number of independent basic blocks to optimize in parallel, 0 to disable" << std::endl;
     std::cout << "\t--fcommon-subexpression-threshold=" << defaultConfig.additionalOptions.maxCommonExpressionDinstance
               << "\tThe maximum distance for two common subexpressions to be combined" << std::endl;
 
@@ -76,6 +80,14 @@ static void printHelp()
     std::cout << "\t--llvm\t\t\tExplicitely use the LLVM-IR front-end" << std::endl;
     std::cout << "\t--verification-error\tAbort if instruction verification failed" << std::endl;
     std::cout << "\t--no-verification-error\tContinue if instruction verification failed" << std::endl;
+    std::cout << "\t--cache-dir=<dir>\tCaches compilation results in the given directory, disabled by default. Inputs "
+                 "including other files are not cached"
+              << std::endl;
+    std::cout << "\t--cache-size=" << defaultConfig.maxCacheSize
+              << "\tThe maximum size (in bytes) of the compilation cache" << std::endl;
+    std::cout << "\t--telemetry=<file>\tWrites the compilation time and instruction counts per kernel and pass as JSON "
+                 "into the given file"
+              << std::endl;
     std::cout << "\tany other option is passed to the pre-compiler" << std::endl;
 
     std::cout << "modes:" << std::endl;
@@ -344,6 +356,14 @@ int main(int argc, char** argv)
     Compiler::compile(*input, output, config, options, inputFile);
     PROFILE_END(Compiler);
 
+    if(!config.cacheDirectory.empty())
+    {
+        const auto cacheStats = getCompilationCacheStatistics();
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Compilation cache: " << cacheStats.hits << " hits, " << cacheStats.misses << " misses, "
+                << cacheStats.stores << " stores, " << cacheStats.evictions << " evictions" << logging::endl);
+    }
+
     PROFILE_RESULTS();
     return 0;
 }
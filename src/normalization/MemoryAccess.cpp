@@ -40,12 +40,105 @@ struct BaseAndOffset
 {
     Optional<Value> base;
     Optional<int32_t> offset;
+    // the part of the offset which is not constant (in bytes, multiplied by the factor), e.g. a dynamic index. Only
+    // accesses with the same dynamic part can be combined
+    const Local* dynamicOffset = nullptr;
+    int32_t dynamicFactor = 0;
 
     explicit BaseAndOffset() : base(NO_VALUE), offset{} {}
 
     BaseAndOffset(const Optional<Value>& base, Optional<int32_t> offset) : base(base), offset(offset) {}
+
+    bool hasSameDynamicOffset(const BaseAndOffset& other) const
+    {
+        return dynamicOffset == other.dynamicOffset && dynamicFactor == other.dynamicFactor;
+    }
+};
+
+/*
+ * A byte offset in the form of dynamicPart * factor + constantPart
+ */
+struct OffsetExpression
+{
+    const Local* dynamicPart;
+    int32_t factor;
+    int32_t constantPart;
 };
 
+// the maximum depth of instructions to follow when determining an offset expression
+static constexpr unsigned MAX_OFFSET_EXPRESSION_DEPTH = 8;
+
+static Optional<OffsetExpression> findOffsetExpression(const Value& val, unsigned depth = 0)
+{
+    if(auto lit = val.getLiteralValue())
+        return OffsetExpression{nullptr, 0, lit->signedInt()};
+    const Local* loc = val.checkLocal();
+    if(loc == nullptr)
+        return {};
+    const auto writers = loc->getUsers(LocalUse::Type::WRITER);
+    if(writers.size() > 1)
+        // the value might change between accesses (e.g. for phi-nodes), so we cannot use it as common dynamic offset
+        return {};
+    const OffsetExpression self{loc, 1, 0};
+    if(writers.empty() || depth >= MAX_OFFSET_EXPRESSION_DEPTH)
+        return self;
+    const IntermediateInstruction* writer = *writers.begin();
+    if(writer->hasConditionalExecution() || writer->hasPackMode() || writer->hasUnpackMode())
+        return self;
+
+    // 1. a move from another value -> follow the move
+    if(auto move = dynamic_cast<const MoveOperation*>(writer))
+    {
+        if(dynamic_cast<const VectorRotation*>(writer) != nullptr)
+            return self;
+        return findOffsetExpression(move->getSource(), depth + 1).value_or(self);
+    }
+    auto op = dynamic_cast<const Operation*>(writer);
+    if(op == nullptr || op->getArguments().size() != 2)
+        return self;
+    const auto& args = op->getArguments();
+    // 2. addition/subtraction of two offsets -> combine, if at most one of them has a dynamic part
+    if(op->op == OP_ADD || op->op == OP_SUB)
+    {
+        auto first = findOffsetExpression(args[0], depth + 1);
+        auto second = findOffsetExpression(args[1], depth + 1);
+        if(!first || !second || (first->dynamicPart != nullptr && second->dynamicPart != nullptr))
+            return self;
+        // calculate in unsigned to not run into undefined behavior on overflow, the addresses wrap around anyway
+        const int32_t sign = op->op == OP_SUB ? -1 : 1;
+        return OffsetExpression{first->dynamicPart != nullptr ? first->dynamicPart : second->dynamicPart,
+            first->dynamicPart != nullptr ? first->factor : sign * second->factor,
+            static_cast<int32_t>(static_cast<uint32_t>(first->constantPart) +
+                static_cast<uint32_t>(sign * second->constantPart))};
+    }
+    // 3. multiplication with a constant (e.g. the scaling of an index to the element size) -> scale both parts
+    Optional<Literal> factor{};
+    Value input = UNDEFINED_VALUE;
+    if(op->op == OP_SHL && args[1].getLiteralValue())
+    {
+        input = args[0];
+        factor = Literal(1u << (args[1].getLiteralValue()->unsignedInt() & 0x1F));
+    }
+    else if(op->op == OP_MUL24)
+    {
+        input = args[0].getLiteralValue() ? args[1] : args[0];
+        factor = args[0].getLiteralValue() ? args[0].getLiteralValue() : args[1].getLiteralValue();
+        // mul24 only multiplies the lower 24 bits, so this only distributes over the parts of the input if the input
+        // fits into 24 bits
+        auto range = analysis::ValueRange::getValueRange(input).getIntRange();
+        if(!factor || factor->unsignedInt() > 0xFFFFFF || !range || range->minValue < 0 || range->maxValue > 0xFFFFFF)
+            return self;
+    }
+    if(!factor)
+        return self;
+    auto inputExpression = findOffsetExpression(input, depth + 1);
+    if(!inputExpression)
+        return self;
+    return OffsetExpression{inputExpression->dynamicPart,
+        static_cast<int32_t>(static_cast<uint32_t>(inputExpression->factor) * factor->unsignedInt()),
+        static_cast<int32_t>(static_cast<uint32_t>(inputExpression->constantPart) * factor->unsignedInt())};
+}
+
 static BaseAndOffset findOffset(const Value& val)
 {
     if(!val.checkLocal())
@@ -120,6 +213,29 @@ static BaseAndOffset findBaseAndOffset(const Value& val)
             return BaseAndOffset(args[0].local()->getBase(false)->createReference(),
                 static_cast<int32_t>(offset1.offset.value() / val.type.getElementType().getPhysicalWidth()));
     }
+    // 4. an addition of a pointer with a dynamic offset -> the pointer is the base and the offset is split into a
+    // dynamic and a constant part (e.g. for p[gid * 4 + 1], p[gid * 4 + 2], ...)
+    if(dynamic_cast<const Operation*>((*writers.begin())) != nullptr &&
+        dynamic_cast<const Operation*>((*writers.begin()))->op == OP_ADD && args.size() == 2 &&
+        std::all_of(args.begin(), args.end(), [](const Value& arg) -> bool { return arg.checkLocal(); }) &&
+        args[0].type.getPointerType() != args[1].type.getPointerType())
+    {
+        const Value& pointer = args[0].type.getPointerType() ? args[0] : args[1];
+        const Value& offset = args[0].type.getPointerType() ? args[1] : args[0];
+        const auto pointerBase = findBaseAndOffset(pointer);
+        const auto offsetExpression = findOffsetExpression(offset);
+        const auto elementWidth = static_cast<int32_t>(val.type.getElementType().getPhysicalWidth());
+        if(pointerBase.base && pointerBase.offset && pointerBase.dynamicOffset == nullptr && offsetExpression &&
+            elementWidth > 0 && offsetExpression->constantPart % elementWidth == 0)
+        {
+            BaseAndOffset result(
+                pointerBase.base, pointerBase.offset.value() + offsetExpression->constantPart / elementWidth);
+            result.dynamicOffset = offsetExpression->dynamicPart;
+            result.dynamicFactor = offsetExpression->factor;
+            return result;
+        }
+    }
+
     /*
         if(writers.size() == 1)
         {
@@ -206,8 +322,8 @@ struct VPMAccessGroup
 static InstructionWalker findGroupOfVPMAccess(
     VPM& vpm, InstructionWalker start, const InstructionWalker end, VPMAccessGroup& group)
 {
-    Optional<Value> baseAddress = NO_VALUE;
-    int32_t nextOffset = -1;
+    Optional<BaseAndOffset> baseAddress;
+    int32_t lastOffset = 0;
     // the number of elements between two entries in memory
     group.stride = 0;
     group.groupType = TYPE_UNKNOWN;
@@ -244,7 +360,12 @@ static InstructionWalker findGroupOfVPMAccess(
         const auto baseAndOffset = findBaseAndOffset(it.get<MoveOperation>()->getSource());
         const bool isVPMWrite = it->writesRegister(REG_VPM_DMA_STORE_ADDR);
         logging::debug() << "Found base address " << baseAndOffset.base.to_string() << " with offset "
-                         << std::to_string(baseAndOffset.offset.value_or(-1L)) << " for "
+                         << std::to_string(baseAndOffset.offset.value_or(-1L))
+                         << (baseAndOffset.dynamicOffset ?
+                                    (" + " + baseAndOffset.dynamicOffset->name + " * " +
+                                        std::to_string(baseAndOffset.dynamicFactor) + " bytes") :
+                                    "")
+                         << " for "
                          << (isVPMWrite ? "writing into" : "reading from") << " memory" << logging::endl;
 
         if(!baseAndOffset.base)
@@ -260,18 +381,20 @@ static InstructionWalker findGroupOfVPMAccess(
         // check if this address is consecutive to the previous one (if any)
         if(baseAddress)
         {
-            if(baseAndOffset.base && baseAddress.value() != baseAndOffset.base.value())
+            if(baseAndOffset.base && baseAddress->base.value() != baseAndOffset.base.value())
                 // a group exists, but the base addresses don't match
                 break;
+            if(!baseAddress->hasSameDynamicOffset(baseAndOffset))
+                // a group exists, but the dynamic parts of the addresses don't match
+                break;
             if(group.addressWrites.size() == 1 && baseAndOffset.offset && group.stride == 0)
             {
                 // special case for first offset - use it to determine stride
-                group.stride = baseAndOffset.offset.value() -
-                    findBaseAndOffset(group.addressWrites[0].get<MoveOperation>()->getSource()).offset.value();
+                group.stride = baseAndOffset.offset.value() - lastOffset;
                 logging::debug() << "Using a stride of " << group.stride
                                  << " elements between consecutive access to memory" << logging::endl;
             }
-            if(!baseAndOffset.offset || baseAndOffset.offset.value() != (nextOffset * group.stride))
+            if(!baseAndOffset.offset || group.stride <= 0 || baseAndOffset.offset.value() != lastOffset + group.stride)
                 // a group exists, but the offsets do not match
                 break;
         }
@@ -317,7 +440,7 @@ static InstructionWalker findGroupOfVPMAccess(
         // all matches so far, add to group (or create a new one)
         group.isVPMWrite = isVPMWrite;
         group.groupType = baseAndOffset.base->type;
-        baseAddress = baseAndOffset.base.value();
+        baseAddress = baseAndOffset;
         group.addressWrites.push_back(it);
         if(dmaSetup)
             // not always given, e.g. for caching in VPM without accessing RAM
@@ -325,7 +448,7 @@ static InstructionWalker findGroupOfVPMAccess(
         if(genericSetup)
             // not always given, e.g. for copying memory without reading/writing into/from QPU
             group.genericSetups.push_back(genericSetup.value());
-        nextOffset = (baseAndOffset.offset.value_or(-1) / (group.stride == 0 ? 1 : group.stride)) + 1;
+        lastOffset = baseAndOffset.offset.value_or(-1);
 
         if(group.isVPMWrite && group.addressWrites.size() >= vpm.getMaxCacheVectors(elementType, true))
         {
@@ -531,6 +654,9 @@ static void groupVPMReads(VPM& vpm, VPMAccessGroup& group)
  * NOTE: Combining VPM accesses merges their mutex-lock blocks which can cause other QPUs to stall for a long time.
  * Also, this optimization currently only supports access memory <-> QPU, data exchange between only memory and VPM are
  * not optimized
+ *
+ * NOTE: Only accesses within a single basic block are combined. Accesses in different blocks or in different iterations
+ * of a loop are not combined, even if their addresses only differ in a constant offset (see doc/TODO.txt).
  */
 static void combineVPMAccess(FastSet<BasicBlock*>& blocks, Method& method)
 {
@@ -147,6 +147,15 @@ static void runNormalizationStep(
 }
 
 void Normalizer::normalize(Module& module) const
+{
+    // 1. run module-wide normalization steps
+    prepareKernels(module);
+    // 2. run other normalization steps on kernel functions
+    const auto f = [&module, this](Method* kernelFunc) -> void { normalizeMethod(module, *kernelFunc); };
+    BackgroundWorker::scheduleAll<Method*>(module.getKernels(), f, "Normalization");
+}
+
+void Normalizer::prepareKernels(Module& module) const
 {
     // 1. eliminate phi on all methods
     for(auto& method : module)
@@ -176,9 +185,6 @@ void Normalizer::normalize(Module& module) const
         PROFILE_COUNTER_WITH_PREV(vc4c::profiler::COUNTER_NORMALIZATION + 5, "Inline (after)",
             kernel.countInstructions(), vc4c::profiler::COUNTER_NORMALIZATION + 4);
     }
-    // 3. run other normalization steps on kernel functions
-    const auto f = [&module, this](Method* kernelFunc) -> void { normalizeMethod(module, *kernelFunc); };
-    BackgroundWorker::scheduleAll<Method*>(module.getKernels(), f, "Normalization");
 }
 
 void Normalizer::adjust(Module& module) const
@@ -54,17 +54,33 @@ namespace vc4c
              */
             void adjust(Module& module) const;
 
-        private:
-            Configuration config;
+            /*
+             * Runs the normalization steps which need to be applied to the whole module (e.g. elimination of phi-nodes
+             * and in-lining of functions into the kernels).
+             *
+             * After this function has returned, all kernels can be processed independently from each other.
+             */
+            void prepareKernels(Module& module) const;
 
             /*
              * Runs all registered normalization steps on the given method.
              *
              * After this function has returned, it is guaranteed, that all remaining instructions within the method are
              * normalized (e.g. return true for #isNormalized()).
+             *
+             * NOTE: The module-wide normalization steps (see #prepareKernels()) need to be run BEFORE
              */
             void normalizeMethod(Module& module, Method& method) const;
+
+            /*
+             * Runs the second batch of normalization steps on the given method
+             *
+             * NOTE: The fix-up needs to be run AFTER the optimizations of this method
+             */
             void adjustMethod(Module& module, Method& method) const;
+
+        private:
+            Configuration config;
         };
     } /* namespace normalization */
 } /* namespace vc4c */
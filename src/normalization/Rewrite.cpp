@@ -23,13 +23,11 @@ static RegisterFile getFixedRegisterFile(const Value& val)
         return RegisterFile::PHYSICAL_B;
     else if(auto local = val.checkLocal())
     {
-        for(const auto& user : local->getUsers())
-        {
-            if(user.second.readsLocal() && user.first->hasUnpackMode())
-                return RegisterFile::PHYSICAL_A;
-            if(user.second.writesLocal() && user.first->hasPackMode())
-                return RegisterFile::PHYSICAL_A;
-        }
+        auto unpacksLocal = [](const LocalUser* user) -> bool { return user->hasUnpackMode(); };
+        auto packsLocal = [](const LocalUser* user) -> bool { return user->hasPackMode(); };
+        if(local->findUser(LocalUse::Type::READER, unpacksLocal) != nullptr ||
+            local->findUser(LocalUse::Type::WRITER, packsLocal) != nullptr)
+            return RegisterFile::PHYSICAL_A;
     }
 
     return RegisterFile::ANY;
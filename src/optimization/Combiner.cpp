@@ -423,6 +423,95 @@ static const std::vector<MergeCondition> mergeConditions = {
         return true;
     }};
 
+/*
+ * Assigns the operations which can be executed on both ALUs to the ALU not used by the other operation
+ */
+static void fixALUAssignment(CombinedOperation* comb)
+{
+    if(comb->getFirstOp()->op.runsOnAddALU() && comb->getFirstOp()->op.runsOnMulALU())
+    {
+        OpCode code = comb->getFirstOp()->op;
+        if(comb->getSecondOP()->op.runsOnAddALU())
+            code.opAdd = 0;
+        else // by default (e.g. both run on both ALUs), map to ADD ALU
+            code.opMul = 0;
+        dynamic_cast<Operation*>(comb->op1.get())->op = code;
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Fixing operation available on both ALUs to " << (code.opAdd == 0 ? "MUL" : "ADD")
+                << " ALU: " << comb->op1->to_string() << logging::endl);
+    }
+    if(comb->getSecondOP()->op.runsOnAddALU() && comb->getSecondOP()->op.runsOnMulALU())
+    {
+        OpCode code = comb->getSecondOP()->op;
+        if(comb->getFirstOp()->op.runsOnMulALU())
+            code.opMul = 0;
+        else // by default (e.g. both run on both ALUs), map to MUL ALU
+            code.opAdd = 0;
+        dynamic_cast<Operation*>(comb->op2.get())->op = code;
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Fixing operation available on both ALUs to " << (code.opAdd == 0 ? "MUL" : "ADD")
+                << " ALU: " << comb->op2->to_string() << logging::endl);
+    }
+}
+
+std::unique_ptr<CombinedOperation> optimizations::combineInstructions(
+    std::unique_ptr<IntermediateInstruction>& first, std::unique_ptr<IntermediateInstruction>& second)
+{
+    Operation* op = dynamic_cast<Operation*>(first.get());
+    MoveOperation* move = dynamic_cast<MoveOperation*>(first.get());
+    Operation* nextOp = dynamic_cast<Operation*>(second.get());
+    MoveOperation* nextMove = dynamic_cast<MoveOperation*>(second.get());
+    if((op == nullptr && move == nullptr) || (nextOp == nullptr && nextMove == nullptr))
+        return nullptr;
+    auto checkCondition = [op, nextOp, move, nextMove](
+                              const MergeCondition& cond) -> bool { return cond(op, nextOp, move, nextMove); };
+    if(!std::all_of(mergeConditions.begin(), mergeConditions.end(), checkCondition))
+        return nullptr;
+
+    // move supports both ADD and MUL ALU
+    // if merge, make "move" to other op-code or x x / v8max x x
+    std::unique_ptr<Operation> firstOp;
+    std::unique_ptr<Operation> secondOp;
+    if(op != nullptr && nextOp != nullptr)
+    {
+        // the operations are taken over as they are
+    }
+    else if(op != nullptr && nextMove != nullptr)
+        secondOp.reset(nextMove->combineWith(op->op));
+    else if(move != nullptr && nextOp != nullptr)
+        firstOp.reset(move->combineWith(nextOp->op));
+    else
+    {
+        bool firstOnMul = (move->packMode.hasEffect() && move->packMode.supportsMulALU()) ||
+            (nextMove->packMode.hasEffect() && !nextMove->packMode.supportsMulALU()) || nextMove->doesSetFlag();
+        firstOp.reset(move->combineWith(firstOnMul ? OP_ADD : OP_MUL24));
+        secondOp.reset(nextMove->combineWith(firstOnMul ? OP_MUL24 : OP_ADD));
+    }
+    if((move != nullptr && !firstOp) || (nextMove != nullptr && !secondOp))
+    {
+        // e.g. a move setting flags cannot be executed on the MUL ALU
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Failed to combine move-operation '" << first->to_string() << "' with: " << second->to_string()
+                << logging::endl);
+        return nullptr;
+    }
+
+    CPPLOG_LAZY(logging::Level::DEBUG,
+        log << "Merging instructions " << first->to_string() << " and " << second->to_string() << logging::endl);
+    // the moves are replaced by the newly created operations, the operations are moved into the combined instruction
+    if(op != nullptr)
+        firstOp.reset(dynamic_cast<Operation*>(first.release()));
+    else
+        first.reset();
+    if(nextOp != nullptr)
+        secondOp.reset(dynamic_cast<Operation*>(second.release()));
+    else
+        second.reset();
+    std::unique_ptr<CombinedOperation> combined(new CombinedOperation(firstOp.release(), secondOp.release()));
+    fixALUAssignment(combined.get());
+    return combined;
+}
+
 bool optimizations::combineOperations(const Module& module, Method& method, const Configuration& config)
 {
     // TODO can combine operation x and y if y is something like (result of x & 0xFF/0xFFFF) -> pack-mode
@@ -463,9 +552,8 @@ bool optimizations::combineOperations(const Module& module, Method& method, cons
                      */
                     // TODO a written-to register MUST not be read in the next instruction (check instruction
                     // before/after combined) (unless within local range)
-                    bool conditionsMet = std::all_of(mergeConditions.begin(), mergeConditions.end(),
-                        [op, nextOp, move, nextMove](
-                            const MergeCondition& cond) -> bool { return cond(op, nextOp, move, nextMove); });
+                    // the conditions on the instructions themselves are checked when combining them
+                    bool conditionsMet = true;
                     if(instr->hasValueType(ValueType::LOCAL) && nextInstr->hasValueType(ValueType::LOCAL))
                     {
                         // extra check, only combine writes to the same local, if local is only used within the next
@@ -532,91 +620,18 @@ bool optimizations::combineOperations(const Module& module, Method& method, cons
 
                     if(conditionsMet)
                     {
-                        hasChanged = true;
-                        // move supports both ADD and MUL ALU
-                        // if merge, make "move" to other op-code or x x / v8max x x
-                        CPPLOG_LAZY(logging::Level::DEBUG,
-                            log << "Merging instructions " << instr->to_string() << " and " << nextInstr->to_string()
-                                << logging::endl);
-                        if(op != nullptr && nextOp != nullptr)
+                        std::unique_ptr<IntermediateInstruction> first(it.release());
+                        std::unique_ptr<IntermediateInstruction> second(nextIt.release());
+                        if(auto combined = combineInstructions(first, second))
                         {
-                            it.reset(new CombinedOperation(
-                                dynamic_cast<Operation*>(it.release()), dynamic_cast<Operation*>(nextIt.release())));
+                            hasChanged = true;
+                            it.reset(combined.release());
                             nextIt.erase();
                         }
-                        else if(op != nullptr && nextMove != nullptr)
-                        {
-                            Operation* newMove = nextMove->combineWith(op->op);
-                            if(newMove != nullptr)
-                            {
-                                it.reset(new CombinedOperation(dynamic_cast<Operation*>(it.release()), newMove));
-                                nextIt.erase();
-                            }
-                            else
-                                logging::warn() << "Error combining move-operation '" << nextMove->to_string()
-                                                << "' with: " << op->to_string() << logging::endl;
-                        }
-                        else if(move != nullptr && nextOp != nullptr)
-                        {
-                            Operation* newMove = move->combineWith(nextOp->op);
-                            if(newMove != nullptr)
-                            {
-                                it.reset(new CombinedOperation(newMove, dynamic_cast<Operation*>(nextIt.release())));
-                                nextIt.erase();
-                            }
-                            else
-                                logging::warn() << "Error combining move-operation '" << move->to_string()
-                                                << "' with: " << nextOp->to_string() << logging::endl;
-                        }
-                        else if(move != nullptr && nextMove != nullptr)
-                        {
-                            bool firstOnMul = (move->packMode.hasEffect() && move->packMode.supportsMulALU()) ||
-                                (nextMove->packMode.hasEffect() && !nextMove->packMode.supportsMulALU()) ||
-                                nextMove->doesSetFlag();
-                            Operation* newMove0 = move->combineWith(firstOnMul ? OP_ADD : OP_MUL24);
-                            Operation* newMove1 = nextMove->combineWith(firstOnMul ? OP_MUL24 : OP_ADD);
-                            if(newMove0 != nullptr && newMove1 != nullptr)
-                            {
-                                it.reset(new CombinedOperation(newMove0, newMove1));
-                                nextIt.erase();
-                            }
-                            else
-                                logging::warn() << "Error combining move-operation '" << move->to_string()
-                                                << "' with: " << nextMove->to_string() << logging::endl;
-                        }
                         else
-                            throw CompilationError(CompilationStep::OPTIMIZER, "Unhandled combination, type",
-                                (instr->to_string() + ", ") + nextInstr->to_string());
-                        if(it.get<CombinedOperation>() != nullptr)
                         {
-                            // move instruction usable on both ALUs to the free ALU
-                            CombinedOperation* comb = it.get<CombinedOperation>();
-                            if(comb->getFirstOp()->op.runsOnAddALU() && comb->getFirstOp()->op.runsOnMulALU())
-                            {
-                                OpCode code = comb->getFirstOp()->op;
-                                if(comb->getSecondOP()->op.runsOnAddALU())
-                                    code.opAdd = 0;
-                                else // by default (e.g. both run on both ALUs), map to ADD ALU
-                                    code.opMul = 0;
-                                dynamic_cast<Operation*>(comb->op1.get())->op = code;
-                                CPPLOG_LAZY(logging::Level::DEBUG,
-                                    log << "Fixing operation available on both ALUs to "
-                                        << (code.opAdd == 0 ? "MUL" : "ADD") << " ALU: " << comb->op1->to_string()
-                                        << logging::endl);
-                            }
-                            if(comb->getSecondOP()->op.runsOnAddALU() && comb->getSecondOP()->op.runsOnMulALU())
-                            {
-                                OpCode code = comb->getSecondOP()->op;
-                                if(comb->getFirstOp()->op.runsOnMulALU())
-                                    code.opMul = 0;
-                                else // by default (e.g. both run on both ALUs), map to MUL ALU
-                                    code.opAdd = 0;
-                                dynamic_cast<Operation*>(comb->op2.get())->op = code;
-                                CPPLOG_LAZY(logging::Level::DEBUG,
-                                    log << "Fixing operation available on both ALUs to "
-                                        << (code.opAdd == 0 ? "MUL" : "ADD") << " ALU: " << comb->op2->to_string()
-                                        << logging::endl);
-                            }
+                            it.reset(first.release());
+                            nextIt.reset(second.release());
                         }
                     }
                 }
@@ -825,71 +840,68 @@ InstructionWalker optimizations::combineSelectionWithZero(
     return it;
 }
 
-bool optimizations::combineVectorRotations(const Module& module, Method& method, const Configuration& config)
+bool optimizations::combineVectorRotations(
+    const Module& module, Method& method, BasicBlock& block, const Configuration& config)
 {
     bool hasChanged = false;
-    for(BasicBlock& block : method)
+    InstructionWalker it = block.walk();
+    while(!it.isEndOfBlock())
     {
-        InstructionWalker it = block.walk();
-        while(!it.isEndOfBlock())
+        if(it.get<VectorRotation>() && !it->hasSideEffects())
         {
-            if(it.get<VectorRotation>() && !it->hasSideEffects())
+            VectorRotation* rot = it.get<VectorRotation>();
+            if(rot->getSource().checkLocal() && rot->getOffset().checkImmediate() &&
+                rot->getOffset().immediate() != VECTOR_ROTATE_R5)
             {
-                VectorRotation* rot = it.get<VectorRotation>();
-                if(rot->getSource().checkLocal() && rot->getOffset().checkImmediate() &&
-                    rot->getOffset().immediate() != VECTOR_ROTATE_R5)
+                if(auto writer = rot->getSource().getSingleWriter())
                 {
-                    if(auto writer = rot->getSource().getSingleWriter())
+                    const VectorRotation* firstRot = dynamic_cast<const VectorRotation*>(writer);
+                    if(firstRot != nullptr && !firstRot->hasSideEffects() && firstRot->getOffset().checkImmediate() &&
+                        firstRot->getOffset().immediate() != VECTOR_ROTATE_R5)
                     {
-                        const VectorRotation* firstRot = dynamic_cast<const VectorRotation*>(writer);
-                        if(firstRot != nullptr && !firstRot->hasSideEffects() &&
-                            firstRot->getOffset().checkImmediate() &&
-                            firstRot->getOffset().immediate() != VECTOR_ROTATE_R5)
+                        auto firstIt = it.getBasicBlock()->findWalkerForInstruction(firstRot, it);
+                        if(firstIt)
                         {
-                            auto firstIt = it.getBasicBlock()->findWalkerForInstruction(firstRot, it);
-                            if(firstIt)
+                            hasChanged = true;
+                            /*
+                             * Can combine the offsets of two rotations,
+                             * - if the only source of a vector rotation is only written once,
+                             * - the source of the input is another vector rotation,
+                             * - both rotations only use immediate offsets and
+                             * - neither rotation has any side effects
+                             */
+                            const uint8_t offset =
+                                (rot->getOffset().immediate().getRotationOffset().value() +
+                                    firstRot->getOffset().immediate().getRotationOffset().value()) %
+                                16;
+                            if(offset == 0)
                             {
-                                hasChanged = true;
-                                /*
-                                 * Can combine the offsets of two rotations,
-                                 * - if the only source of a vector rotation is only written once,
-                                 * - the source of the input is another vector rotation,
-                                 * - both rotations only use immediate offsets and
-                                 * - neither rotation has any side effects
-                                 */
-                                const uint8_t offset =
-                                    (rot->getOffset().immediate().getRotationOffset().value() +
-                                        firstRot->getOffset().immediate().getRotationOffset().value()) %
-                                    16;
-                                if(offset == 0)
-                                {
-                                    CPPLOG_LAZY(logging::Level::DEBUG,
-                                        log << "Replacing unnecessary vector rotations " << firstRot->to_string()
-                                            << " and " << rot->to_string() << " with single move" << logging::endl);
-                                    it.reset((new MoveOperation(rot->getOutput().value(), firstRot->getSource()))
-                                                 ->copyExtrasFrom(rot));
-                                    it->copyExtrasFrom(firstRot);
-                                    firstIt->erase();
-                                }
-                                else
-                                {
-                                    CPPLOG_LAZY(logging::Level::DEBUG,
-                                        log << "Combining vector rotations " << firstRot->to_string() << " and "
-                                            << rot->to_string() << " to a single rotation with offset "
-                                            << static_cast<unsigned>(offset) << logging::endl);
-                                    it.reset((new VectorRotation(rot->getOutput().value(), firstRot->getSource(),
-                                                  Value(SmallImmediate::fromRotationOffset(offset), TYPE_INT8)))
-                                                 ->copyExtrasFrom(rot));
-                                    it->copyExtrasFrom(firstRot);
-                                    firstIt->erase();
-                                }
+                                CPPLOG_LAZY(logging::Level::DEBUG,
+                                    log << "Replacing unnecessary vector rotations " << firstRot->to_string() << " and "
+                                        << rot->to_string() << " with single move" << logging::endl);
+                                it.reset((new MoveOperation(rot->getOutput().value(), firstRot->getSource()))
+                                             ->copyExtrasFrom(rot));
+                                it->copyExtrasFrom(firstRot);
+                                firstIt->erase();
+                            }
+                            else
+                            {
+                                CPPLOG_LAZY(logging::Level::DEBUG,
+                                    log << "Combining vector rotations " << firstRot->to_string() << " and "
+                                        << rot->to_string() << " to a single rotation with offset "
+                                        << static_cast<unsigned>(offset) << logging::endl);
+                                it.reset((new VectorRotation(rot->getOutput().value(), firstRot->getSource(),
+                                              Value(SmallImmediate::fromRotationOffset(offset), TYPE_INT8)))
+                                             ->copyExtrasFrom(rot));
+                                it->copyExtrasFrom(firstRot);
+                                firstIt->erase();
                             }
                         }
                     }
                 }
             }
-            it.nextInBlock();
         }
+        it.nextInBlock();
     }
     return hasChanged;
 }
@@ -7,8 +7,17 @@
 #ifndef COMBINER_H
 #define COMBINER_H
 
+#include <memory>
+
 namespace vc4c
 {
+    namespace intermediate
+    {
+        class IntermediateInstruction;
+        struct CombinedOperation;
+    } // namespace intermediate
+
+    class BasicBlock;
     class Method;
     class Module;
     class InstructionWalker;
@@ -66,6 +75,22 @@ namespace vc4c
          */
         bool combineOperations(const Module& module, Method& method, const Configuration& config);
 
+        /*
+         * Combines the two instructions into a single instruction executing one of them on the ADD and the other one
+         * on the MUL ALU.
+         *
+         * This only checks the restrictions of the instructions themselves (e.g. the ALUs used, the number of inputs
+         * read from the register-files, small immediates, signals, pack-modes and flags), the caller needs to make sure
+         * the instructions do not depend on each other or on the surrounding instructions in a way prohibiting the
+         * combination.
+         *
+         * On success, the combined instruction is returned and the given instructions are consumed. Otherwise, an
+         * empty pointer is returned and the given instructions are not modified.
+         */
+        std::unique_ptr<intermediate::CombinedOperation> combineInstructions(
+            std::unique_ptr<intermediate::IntermediateInstruction>& first,
+            std::unique_ptr<intermediate::IntermediateInstruction>& second);
+
         /*
          * Combines the loading of the same constant value (e.g. literal or constant register) within a small range in a
          * single basic block
@@ -135,8 +160,10 @@ namespace vc4c
          *   %5 = %3 << 8
          *
          * NOTE: This optimization currently only works for constant rotation offsets.
+         * NOTE: This optimization is block-local and processes only the given basic block.
          */
-        bool combineVectorRotations(const Module& module, Method& method, const Configuration& config);
+        bool combineVectorRotations(
+            const Module& module, Method& method, BasicBlock& block, const Configuration& config);
 
         /*
          * Combines arithmetic operations if the result of the first operation is used as the second operation and the
@@ -14,6 +14,7 @@
 #include "../intermediate/TypeConversions.h"
 #include "../intermediate/operators.h"
 #include "../normalization/LiteralValues.h"
+#include "../periphery/TMU.h"
 #include "../periphery/VPM.h"
 #include "./Combiner.h"
 #include "log.h"
@@ -21,6 +22,7 @@
 #include <algorithm>
 #include <cmath>
 #include <numeric>
+#include <set>
 
 using namespace vc4c;
 using namespace vc4c::optimizations;
@@ -188,6 +190,13 @@ struct LoopControlHash : public std::hash<Local*>
     }
 };
 
+static bool isReadByPhiNode(const Local* local)
+{
+    return local->findUser(LocalUse::Type::BOTH, [](const LocalUser* user) -> bool {
+        return user->hasDecoration(intermediate::InstructionDecorations::PHI_NODE);
+    }) != nullptr;
+}
+
 static LoopControl extractLoopControl(const ControlFlowLoop& loop, const DataDependencyGraph& dependencyGraph)
 {
     FastSet<LoopControl, LoopControlHash> availableLoopControls;
@@ -203,12 +212,10 @@ static LoopControl extractLoopControl(const ControlFlowLoop& loop, const DataDep
         LoopControl loopControl;
         loopControl.iterationVariable = local;
 
-        for(const auto& pair : local->getUsers())
-        {
-            const intermediate::IntermediateInstruction* inst = pair.first;
+        local->forUsers(LocalUse::Type::BOTH, [&](const LocalUser* inst) {
             Optional<InstructionWalker> it = loop.findInLoop(inst);
             //"lower" bound: the initial setting of the value outside of the loop
-            if(pair.second.writesLocal() && inst->hasDecoration(intermediate::InstructionDecorations::PHI_NODE) && !it)
+            if(inst->writesLocal(local) && inst->hasDecoration(intermediate::InstructionDecorations::PHI_NODE) && !it)
             {
                 auto tmp = inst->precalculate(4).first;
                 if(tmp && tmp->isLiteralValue())
@@ -220,18 +227,14 @@ static LoopControl extractLoopControl(const ControlFlowLoop& loop, const DataDep
             }
             // iteration step: the instruction inside the loop where the iteration variable is changed
             // XXX this currently only looks for single operations with immediate values (e.g. +1,-1)
-            else if(pair.second.readsLocal() && it)
+            else if(inst->readsLocal(local) && it)
             {
                 if(it->get<intermediate::Operation>() && it.value()->getArguments().size() == 2 &&
                     it.value()->readsLiteral() &&
                     // TODO could here more simply check against output being the local the iteration variable is set to
                     // (in the phi-node inside the loop)
                     it.value()->getOutput().ifPresent([](const Value& val) -> bool {
-                        return val.checkLocal() &&
-                            std::any_of(val.local()->getUsers().begin(), val.local()->getUsers().end(),
-                                [](const auto& pair) -> bool {
-                                    return pair.first->hasDecoration(intermediate::InstructionDecorations::PHI_NODE);
-                                });
+                        return val.checkLocal() && isReadByPhiNode(val.local());
                     }))
                 {
                     CPPLOG_LAZY(logging::Level::DEBUG,
@@ -245,22 +248,15 @@ static LoopControl extractLoopControl(const ControlFlowLoop& loop, const DataDep
                     // second-level checking for loop iteration step (e.g. if loop variable is copied for
                     // use-with-immediate)
                     const Local* stepLocal = it.value()->getOutput()->local();
-                    for(const auto& pair : stepLocal->getUsers())
-                    {
-                        const intermediate::IntermediateInstruction* inst = pair.first;
+                    stepLocal->forUsers(LocalUse::Type::READER, [&](const LocalUser* inst) {
                         Optional<InstructionWalker> it = loop.findInLoop(inst);
                         // iteration step: the instruction inside the loop where the iteration variable is changed
-                        if(pair.second.readsLocal() && it)
+                        if(it)
                         {
                             if(it->get<intermediate::Operation>() && it.value()->getArguments().size() == 2 &&
                                 it.value()->readsLiteral() &&
                                 it.value()->getOutput().ifPresent([](const Value& val) -> bool {
-                                    return val.checkLocal() &&
-                                        std::any_of(val.local()->getUsers().begin(), val.local()->getUsers().end(),
-                                            [](const auto& pair) -> bool {
-                                                return pair.first->hasDecoration(
-                                                    intermediate::InstructionDecorations::PHI_NODE);
-                                            });
+                                    return val.checkLocal() && isReadByPhiNode(val.local());
                                 }))
                             {
                                 CPPLOG_LAZY(logging::Level::DEBUG,
@@ -269,10 +265,10 @@ static LoopControl extractLoopControl(const ControlFlowLoop& loop, const DataDep
                                 loopControl.determineStepKind(it->get<intermediate::Operation>()->op);
                             }
                         }
-                    };
+                    });
                 }
             }
-        };
+        });
 
         loop.front()->forAllOutgoingEdges([&](const CFGNode& neighbor, const CFGEdge& edge) -> bool {
             if(!edge.data.isImplicit(loop.front()->key))
@@ -299,21 +295,19 @@ static LoopControl extractLoopControl(const ControlFlowLoop& loop, const DataDep
             // condition on which the loop is repeated  and select the literal used together with in this condition
 
             // simple case, there exists an instruction, directly mapping the values
-            auto userIt =
-                std::find_if(iterationStep.local()->getUsers().begin(), iterationStep.local()->getUsers().end(),
-                    [&repeatCond](const auto& pair) -> bool { return pair.first->writesLocal(repeatCond.local()); });
-            if(userIt == iterationStep.local()->getUsers().end())
+            const LocalUser* conditionUser = iterationStep.local()->findUser(LocalUse::Type::BOTH,
+                [&repeatCond](const LocalUser* user) -> bool { return user->writesLocal(repeatCond.local()); });
+            if(conditionUser == nullptr)
             {
                 //"default" case, the iteration-variable is compared to something and the result of this comparison is
                 // used to branch  e.g. "- = xor <iteration-variable>, <upper-bound> (setf)"
-                userIt =
-                    std::find_if(iterationStep.local()->getUsers().begin(), iterationStep.local()->getUsers().end(),
-                        [](const auto& pair) -> bool { return pair.first->setFlags == SetFlag::SET_FLAGS; });
-                if(userIt != iterationStep.local()->getUsers().end())
+                conditionUser = iterationStep.local()->findUser(LocalUse::Type::BOTH,
+                    [](const LocalUser* user) -> bool { return user->setFlags == SetFlag::SET_FLAGS; });
+                if(conditionUser != nullptr)
                 {
                     // TODO need to check, whether the comparison result is the one used for branching
-                    // if not, set userIt to loop.end()
-                    auto instIt = loop.findInLoop(userIt->first);
+                    // if not, reset conditionUser
+                    auto instIt = loop.findInLoop(conditionUser);
                     loopControl.comparisonInstruction = instIt;
                     CPPLOG_LAZY(logging::Level::DEBUG,
                         log << "Found loop continue condition: "
@@ -329,10 +323,10 @@ static LoopControl extractLoopControl(const ControlFlowLoop& loop, const DataDep
                 }
             }
 
-            if(userIt != iterationStep.local()->getUsers().end())
+            if(conditionUser != nullptr)
             {
-                // userIt converts the loop-variable to the condition. The comparison value is the upper bound
-                const intermediate::IntermediateInstruction* inst = userIt->first;
+                // conditionUser converts the loop-variable to the condition. The comparison value is the upper bound
+                const intermediate::IntermediateInstruction* inst = conditionUser;
                 if(inst->getArguments().size() != 2)
                 {
                     // TODO error
@@ -1287,6 +1281,372 @@ bool optimizations::removeConstantLoadInLoops(const Module& module, Method& meth
     return hasChanged;
 }
 
+// the maximum number of instructions calculating the address of a pipelined TMU load, to limit the code duplication
+static constexpr std::size_t MAX_PREFETCH_INSTRUCTIONS = 24;
+// the maximum number of loads per loop iteration and TMU to be pipelined. The instruction scheduler may issue the
+// requests for the next iteration before the loads of the current one, so twice this number of requests can be queued
+static constexpr std::size_t MAX_PIPELINED_LOADS = 2;
+
+static bool writesReplication(const IntermediateInstruction* inst)
+{
+    return inst->writesRegister(REG_REPLICATE_ALL) || inst->writesRegister(REG_REPLICATE_QUAD) ||
+        inst->writesRegister(REG_ACC5);
+}
+
+static bool readsReplication(const IntermediateInstruction* inst)
+{
+    return inst->readsRegister(REG_REPLICATE_ALL) || inst->readsRegister(REG_REPLICATE_QUAD) ||
+        inst->readsRegister(REG_ACC5);
+}
+
+/*
+ * Whether the instruction only calculates a value from locals, constants and the element/QPU number without any other
+ * effect and therefore can be copied to calculate the TMU address for the next loop iteration
+ */
+static bool isPrefetchClonable(const IntermediateInstruction* inst, const periphery::TMU& tmu)
+{
+    if(dynamic_cast<const Operation*>(inst) == nullptr && dynamic_cast<const LoadImmediate*>(inst) == nullptr &&
+        (dynamic_cast<const MoveOperation*>(inst) == nullptr || dynamic_cast<const VectorRotation*>(inst) != nullptr))
+        return false;
+    if(inst->signal.hasSideEffects() || !inst->getOutput())
+        return false;
+    const Value& out = inst->getOutput().value();
+    if(out.checkLocal() == nullptr && !out.hasRegister(REG_NOP) && !out.hasRegister(tmu.s_coordinate) &&
+        !writesReplication(inst))
+        return false;
+    return std::all_of(inst->getArguments().begin(), inst->getArguments().end(), [](const Value& arg) -> bool {
+        return arg.checkLocal() != nullptr || arg.isLiteralValue() || arg.checkImmediate() != nullptr ||
+            arg.hasRegister(REG_ELEMENT_NUMBER) || arg.hasRegister(REG_QPU_NUMBER) ||
+            arg.hasRegister(REG_REPLICATE_ALL) || arg.hasRegister(REG_REPLICATE_QUAD) || arg.hasRegister(REG_ACC5);
+    });
+}
+
+/*
+ * Adds the instructions calculating the address written by the instruction at the given index (including the
+ * instruction itself) to the set of instruction indices.
+ *
+ * Returns false if the address calculation cannot be copied, e.g. since it depends on another TMU load or some
+ * hardware register.
+ */
+static bool findAddressCalculation(const std::vector<InstructionWalker>& instructions, std::size_t addressWriteIndex,
+    std::set<std::size_t>& slice, const periphery::TMU& tmu)
+{
+    std::vector<std::size_t> openIndices{addressWriteIndex};
+    while(!openIndices.empty())
+    {
+        const std::size_t index = openIndices.back();
+        openIndices.pop_back();
+        if(!slice.emplace(index).second)
+            continue;
+        if(slice.size() > MAX_PREFETCH_INSTRUCTIONS)
+            return false;
+        const IntermediateInstruction* inst = instructions[index].get();
+        if(!isPrefetchClonable(inst, tmu) ||
+            (index != addressWriteIndex && inst->getOutput()->hasRegister(tmu.s_coordinate)))
+            return false;
+        // the copy is inserted directly before the branches at the end of the loop, so it must not modify the flags
+        // read by the branches. Conditional instructions would also require a copy of the instructions setting their
+        // flags.
+        if(inst->doesSetFlag() || inst->hasConditionalExecution())
+            return false;
+        for(const Value& arg : inst->getArguments())
+        {
+            if(auto loc = arg.checkLocal())
+            {
+                // all writes within the loop preceding this read (writes succeeding it, e.g. the moves for phi-nodes,
+                // are executed before the copy at the end of the loop too)
+                for(std::size_t i = 0; i < index; ++i)
+                {
+                    if(instructions[i]->writesLocal(loc))
+                        openIndices.push_back(i);
+                }
+            }
+        }
+        if(readsReplication(inst))
+        {
+            auto writerIndex = index;
+            while(writerIndex > 0 && !writesReplication(instructions[writerIndex - 1].get()))
+                --writerIndex;
+            if(writerIndex == 0)
+                // the replicated value is set outside of the loop
+                return false;
+            openIndices.push_back(writerIndex - 1);
+        }
+    }
+
+    // all locals written (and the address, which is written to a local too) need to be completely (re-)written by the
+    // first write of the copy, since the copy writes a new local
+    FastSet<const Local*> writtenLocals;
+    for(std::size_t index : slice)
+    {
+        const IntermediateInstruction* inst = instructions[index].get();
+        auto loc = inst->getOutput()->checkLocal();
+        if((loc == nullptr || writtenLocals.emplace(loc).second) &&
+            (inst->hasPackMode() || inst->hasDecoration(InstructionDecorations::ELEMENT_INSERTION)))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Inserts a copy of the given instructions (writing new locals) before the given position.
+ *
+ * The addresses are not written to the TMU, but to new locals, which are added to the given list of addresses in the
+ * order of the original requests.
+ */
+static void insertAddressCalculation(Method& method, InstructionWalker it,
+    const std::vector<InstructionWalker>& instructions, const std::set<std::size_t>& slice, const periphery::TMU& tmu,
+    std::vector<Value>& addresses)
+{
+    FastMap<const Local*, const Local*> renamedLocals;
+    for(std::size_t index : slice)
+    {
+        auto copy = instructions[index]->copyFor(method, "");
+        for(const auto& pair : renamedLocals)
+        {
+            if(copy->readsLocal(pair.first))
+                copy->replaceLocal(pair.first, pair.second, LocalUse::Type::READER);
+        }
+        if(copy->writesRegister(tmu.s_coordinate))
+        {
+            addresses.push_back(method.addNewLocal(TYPE_INT32, "%tmu_address"));
+            copy->setOutput(addresses.back());
+        }
+        else if(auto loc = copy->getOutput()->checkLocal())
+        {
+            auto renamedIt = renamedLocals.find(loc);
+            if(renamedIt == renamedLocals.end())
+                renamedIt = renamedLocals.emplace(loc, method.addNewLocal(loc->type, "%tmu_prefetch").local()).first;
+            copy->replaceLocal(loc, renamedIt->second, LocalUse::Type::WRITER);
+        }
+        it.emplace(copy);
+        it.nextInBlock();
+    }
+}
+
+/*
+ * Returns the position of the branches at the end of the given block
+ */
+static InstructionWalker findTrailingBranches(BasicBlock& block)
+{
+    auto it = block.walkEnd();
+    while(!it.copy().previousInBlock().isStartOfBlock())
+    {
+        auto prev = it.copy().previousInBlock();
+        if(prev.has() && !prev.get<Branch>())
+            break;
+        it = prev;
+    }
+    return it;
+}
+
+/*
+ * Determines the condition for leaving the loop after the current iteration from the branches at the end of the loop.
+ *
+ * Returns the boolean value the branches depend on and the condition code which is met (for the first element of this
+ * value) if the loop is left, or an undefined value if the condition cannot be determined.
+ */
+static std::pair<Value, ConditionCode> findLoopExitCondition(BasicBlock& block)
+{
+    const Local* loopLabel = block.getLabel()->getLabel();
+    const Branch* conditionalExit = nullptr;
+    for(auto it = findTrailingBranches(block); !it.isEndOfBlock(); it.nextInBlock())
+    {
+        const Branch* branch = it.get<Branch>();
+        if(branch == nullptr)
+            continue;
+        if(!branch->isUnconditional() &&
+            (branch->hasDecoration(InstructionDecorations::BRANCH_ON_ALL_ELEMENTS) ||
+                branch->getCondition().type.getElementType() != TYPE_BOOL ||
+                (branch->conditional != COND_ZERO_CLEAR && branch->conditional != COND_ZERO_SET)))
+            // we can only handle branches depending on the first element of a boolean value, see #extendBranches()
+            break;
+        if(branch->getTarget() == loopLabel)
+        {
+            if(!branch->isUnconditional())
+                // e.g. "br.ifzc %loop, %cond" (followed by a branch to or fall-through into the exit block)
+                return std::make_pair(branch->getCondition(), branch->conditional.invert());
+            if(conditionalExit != nullptr)
+                // e.g. "br.ifzs %exit, %cond" followed by "br %loop"
+                return std::make_pair(conditionalExit->getCondition(), conditionalExit->conditional);
+            break;
+        }
+        if(branch->isUnconditional() || conditionalExit != nullptr)
+            break;
+        conditionalExit = branch;
+    }
+    return std::make_pair(UNDEFINED_VALUE, COND_NEVER);
+}
+
+/*
+ * Inserts the TMU requests for the given addresses of the next iteration before the given position.
+ *
+ * If the loop is left after the current iteration, the addresses of the first iteration are requested instead, since
+ * the addresses of the next iteration might be out of bounds. The requests are selected without modifying the flags,
+ * since they are inserted directly before the branches at the end of the loop.
+ */
+static void insertGuardedRequests(Method& method, InstructionWalker it,
+    const std::pair<Value, ConditionCode>& exitCondition, const std::vector<Value>& nextAddresses,
+    const std::vector<Value>& firstAddresses, const periphery::TMU& tmu)
+{
+    // the branches only depend on the first element of the condition
+    auto condition = method.addNewLocal(TYPE_INT32, "%tmu_loop_condition");
+    it = insertReplication(it, exitCondition.first, condition);
+    // booleans are either 0 or 1, so this sets all bits in the mask if the loop is repeated
+    Value mask = UNDEFINED_VALUE;
+    if(exitCondition.second == COND_ZERO_SET)
+        mask = assign(it, TYPE_INT32, "%tmu_loop_mask") = (Value(SmallImmediate(0), TYPE_INT8) - condition);
+    else
+        mask = assign(it, TYPE_INT32, "%tmu_loop_mask") = (condition - Value(SmallImmediate(1), TYPE_INT8));
+    for(std::size_t i = 0; i < nextAddresses.size(); ++i)
+    {
+        // first ^ ((next ^ first) & mask) selects the next address if all bits of the mask are set, the first otherwise
+        Value tmp = assign(it, TYPE_INT32, "%tmu_address") = (nextAddresses[i] ^ firstAddresses[i]);
+        tmp = assign(it, TYPE_INT32, "%tmu_address") = (tmp & mask);
+        assign(it, tmu.getAddress(TYPE_INT32)) = (firstAddresses[i] ^ tmp);
+    }
+}
+
+static bool pipelineLoopTMULoads(Method& method, const CFGNode& loopNode, const periphery::TMU& tmu)
+{
+    // 1. check the structure of the loop
+    const CFGNode* preheader = nullptr;
+    const CFGNode* exit = nullptr;
+    bool isValidLoop = true;
+    loopNode.forAllIncomingEdges([&](const CFGNode& node, const CFGEdge& edge) -> bool {
+        if(&node != &loopNode)
+        {
+            isValidLoop = isValidLoop && preheader == nullptr;
+            preheader = &node;
+        }
+        return true;
+    });
+    loopNode.forAllOutgoingEdges([&](const CFGNode& node, const CFGEdge& edge) -> bool {
+        if(&node != &loopNode)
+        {
+            isValidLoop = isValidLoop && exit == nullptr;
+            exit = &node;
+        }
+        return true;
+    });
+    // the requests for the first iteration are issued in the preheader, the outstanding requests are read in the exit
+    // block, so these blocks must only be executed together with the loop
+    if(!isValidLoop || preheader == nullptr || exit == nullptr || preheader == exit ||
+        preheader->getSingleSuccessor() != &loopNode || exit->getSinglePredecessor() != &loopNode)
+        return false;
+
+    // 2. find the TMU loads and the calculation of their addresses
+    BasicBlock& block = *loopNode.key;
+    std::vector<InstructionWalker> instructions;
+    std::vector<std::size_t> addressWrites;
+    std::size_t numLoads = 0;
+    for(auto it = block.walk().nextInBlock(); !it.isEndOfBlock(); it.nextInBlock())
+    {
+        if(!it.has())
+            continue;
+        if(it->writesRegister(REG_TMU_NOSWAP) || it->writesRegister(tmu.t_coordinate) ||
+            it->writesRegister(tmu.r_border_color) || it->writesRegister(tmu.b_lod_bias))
+            // general-memory lookups only write the s-coordinate, changing the TMU swap would change the TMU used
+            return false;
+        if(it->writesRegister(tmu.s_coordinate))
+        {
+            if(addressWrites.size() != numLoads || it->hasConditionalExecution())
+                // each request needs to be followed by its load before the next request
+                return false;
+            addressWrites.push_back(instructions.size());
+        }
+        if(it->signal == tmu.signal)
+        {
+            if(addressWrites.size() != numLoads + 1)
+                return false;
+            ++numLoads;
+        }
+        instructions.push_back(it);
+    }
+    if(numLoads == 0 || numLoads > MAX_PIPELINED_LOADS || addressWrites.size() != numLoads)
+        return false;
+    std::set<std::size_t> slice;
+    for(std::size_t index : addressWrites)
+    {
+        if(!findAddressCalculation(instructions, index, slice, tmu))
+        {
+            CPPLOG_LAZY(logging::Level::DEBUG,
+                log << "Cannot pipeline TMU load with address calculation: " << instructions[index]->to_string()
+                    << logging::endl);
+            return false;
+        }
+    }
+    for(auto it = preheader->key->walk(); !it.isEndOfBlock(); it.nextInBlock())
+    {
+        // "If TMU_NOSWAP is written, the write must be three instructions before the first TMU write instruction"
+        if(it.has() && it->writesRegister(REG_TMU_NOSWAP))
+            return false;
+    }
+    const auto exitCondition = findLoopExitCondition(block);
+    if(exitCondition.first.isUndefined())
+    {
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Cannot pipeline TMU loads in loop with unknown exit condition: " << block.getLabel()->to_string()
+                << logging::endl);
+        return false;
+    }
+
+    CPPLOG_LAZY(logging::Level::DEBUG,
+        log << "Pipelining " << numLoads << " TMU loads across iterations of loop: " << block.getLabel()->to_string()
+            << logging::endl);
+
+    // 3. request the addresses of the first iteration before the loop and the addresses of the next iteration at the
+    // end of the loop (after the phi-nodes are written, so the copied calculation uses the values of the next
+    // iteration). The last iteration requests the addresses of the first iteration again, since they are known to be
+    // valid.
+    std::vector<Value> firstAddresses;
+    auto it = findTrailingBranches(*preheader->key);
+    insertAddressCalculation(method, it, instructions, slice, tmu, firstAddresses);
+    for(const Value& address : firstAddresses)
+        assign(it, tmu.getAddress(TYPE_INT32)) = address;
+    std::vector<Value> nextAddresses;
+    it = findTrailingBranches(block);
+    insertAddressCalculation(method, it, instructions, slice, tmu, nextAddresses);
+    insertGuardedRequests(method, it, exitCondition, nextAddresses, firstAddresses, tmu);
+
+    // 4. remove the original requests and their calculation, if it is not used otherwise
+    for(auto indexIt = slice.rbegin(); indexIt != slice.rend(); ++indexIt)
+    {
+        InstructionWalker it = instructions[*indexIt];
+        auto loc = it->getOutput()->checkLocal();
+        if(it->writesRegister(tmu.s_coordinate) ||
+            (loc != nullptr && !it->doesSetFlag() && loc->getUsers(LocalUse::Type::READER).empty()))
+            it.erase();
+    }
+
+    // 5. the requests issued in the last iteration are never consumed by the loop, so we need to discard them to not
+    // return their results for the next loads after the loop
+    it = exit->key->walk().nextInBlock();
+    for(std::size_t i = 0; i < numLoads; ++i)
+    {
+        nop(it, DelayType::WAIT_TMU, tmu.signal);
+        assign(it, NOP_REGISTER) = periphery::TMU_READ_REGISTER;
+    }
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_OPTIMIZATION + 340, "TMU loads pipelined", numLoads);
+    return true;
+}
+
+bool optimizations::pipelineTMULoads(const Module& module, Method& method, const Configuration& config)
+{
+    bool hasChanged = false;
+    for(auto& loop : method.getCFG().findLoops())
+    {
+        // only handle loops consisting of a single block, otherwise we would need to know which block executes the
+        // last TMU load of an iteration
+        if(loop.size() != 1)
+            continue;
+        // the TMUs have separate FIFOs, so they can be handled independently
+        hasChanged = pipelineLoopTMULoads(method, *loop.front(), periphery::TMU0) || hasChanged;
+        hasChanged = pipelineLoopTMULoads(method, *loop.front(), periphery::TMU1) || hasChanged;
+    }
+    return hasChanged;
+}
+
 static const Local* findSourceBlock(const Local* label, const FastMap<const Local*, const Local*>& blockMap)
 {
     auto it = blockMap.find(label);
@@ -54,6 +54,60 @@ namespace vc4c
          */
         bool removeConstantLoadInLoops(const Module& module, Method& method, const Configuration& config);
 
+        /*
+         * Pipelines the TMU loads within loops consisting of a single basic block across the loop iterations.
+         *
+         * The memory request for the next iteration is issued at the end of the current iteration (and the request
+         * for the first iteration before the loop), so the memory latency is hidden by the remaining instructions of
+         * the loop and the load at the beginning of the next iteration does not need to wait for the memory access.
+         * The address of the next iteration is calculated by copying the instructions calculating the address after
+         * the phi-nodes of the loop are written, so no explicit knowledge of the loop iteration variable is required.
+         *
+         * Since each TMU can only queue up to 4 requests (and the instruction scheduler may issue the next requests
+         * before loading the current ones), only up to 2 loads per TMU and loop iteration are pipelined. The requests
+         * issued in the last iteration are discarded after the loop.
+         *
+         * To not access memory beyond the last iteration, the requests at the end of the loop select (without
+         * modifying the flags) the addresses of the first iteration if the loop is left. Thus, the address calculation
+         * must not set any flags or be executed conditionally and the loop needs to be repeated depending on a boolean
+         * value.
+         *
+         * NOTE: This pass is only enabled with the full optimization level, since selecting the addresses adds 3
+         * instructions per loop iteration and 3 more per pipelined load.
+         *
+         * Example:
+         *   label: %loop
+         *   %addr = add %base, %offset
+         *   tmu0s = %addr
+         *   nop (load_tmu0)
+         *   %val = r4
+         *   [...]
+         *   %offset = %offset.next
+         *   br.ifzc %loop, %cond
+         *   label: %exit
+         *
+         * is converted to:
+         *   %tmu_address = add %base, %offset
+         *   tmu0s = %tmu_address
+         *   label: %loop
+         *   nop (load_tmu0)
+         *   %val = r4
+         *   [...]
+         *   %offset = %offset.next
+         *   %tmu_address.1 = add %base, %offset
+         *   r5rep = %cond
+         *   %tmu_loop_condition = r5
+         *   %tmu_loop_mask = 0 - %tmu_loop_condition
+         *   %tmu_address.2 = xor %tmu_address.1, %tmu_address
+         *   %tmu_address.3 = and %tmu_address.2, %tmu_loop_mask
+         *   tmu0s = xor %tmu_address, %tmu_address.3
+         *   br.ifzc %loop, %cond
+         *   label: %exit
+         *   nop (load_tmu0)
+         *   - = r4
+         */
+        bool pipelineTMULoads(const Module& module, Method& method, const Configuration& config);
+
         /*
          * Concatenates "adjacent" basic blocks if the preceding block has only one successor and the succeeding block
          * has only one predecessor.
@@ -548,7 +548,8 @@ bool optimizations::propagateMoves(const Module& module, Method& method, const C
     return replaced;
 }
 
-bool optimizations::eliminateRedundantMoves(const Module& module, Method& method, const Configuration& config)
+bool optimizations::eliminateRedundantMoves(
+    const Module& module, Method& method, BasicBlock& block, const Configuration& config)
 {
     /*
      * XXX can be improved to move UNIFORM reads,
@@ -560,8 +561,8 @@ bool optimizations::eliminateRedundantMoves(const Module& module, Method& method
      */
 
     bool flag = false;
-    auto it = method.walkAllInstructions();
-    while(!it.isEndOfMethod())
+    auto it = block.walk();
+    while(!it.isEndOfBlock())
     {
         if(it.get<intermediate::MoveOperation>() &&
             !it->hasDecoration(intermediate::InstructionDecorations::PHI_NODE) && !it->hasPackMode() &&
@@ -689,17 +690,18 @@ bool optimizations::eliminateRedundantMoves(const Module& module, Method& method
                 it.previousInBlock();
             }
         }
-        it.nextInMethod();
+        it.nextInBlock();
     }
 
     return flag;
 }
 
-bool optimizations::eliminateRedundantBitOp(const Module& module, Method& method, const Configuration& config)
+bool optimizations::eliminateRedundantBitOp(
+    const Module& module, Method& method, BasicBlock& block, const Configuration& config)
 {
     bool replaced = false;
-    auto it = method.walkAllInstructions();
-    while(!it.isEndOfMethod())
+    auto it = block.walk();
+    while(!it.isEndOfBlock())
     {
         auto op = it.get<intermediate::Operation>();
         if(op && op->isSimpleOperation())
@@ -793,7 +795,7 @@ bool optimizations::eliminateRedundantBitOp(const Module& module, Method& method
             }
         }
 
-        it.nextInMethod();
+        it.nextInBlock();
     }
 
     return replaced;
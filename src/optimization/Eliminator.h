@@ -9,6 +9,7 @@
 
 namespace vc4c
 {
+    class BasicBlock;
     class Method;
     class Module;
     class InstructionWalker;
@@ -104,8 +105,11 @@ namespace vc4c
          *  %in = move %in
          *
          * remove it
+         *
+         * NOTE: This optimization is block-local and processes only the given basic block.
          */
-        bool eliminateRedundantMoves(const Module& module, Method& method, const Configuration& config);
+        bool eliminateRedundantMoves(
+            const Module& module, Method& method, BasicBlock& block, const Configuration& config);
 
         /*
          * Transform bit ("and" and "or") operations
@@ -141,8 +145,11 @@ namespace vc4c
          * becomes:
          *  %1 = or %2, %3
          *  %4 = %1
+         *
+         * NOTE: This optimization is block-local and processes only the given basic block.
          */
-        bool eliminateRedundantBitOp(const Module& module, Method& method, const Configuration& config);
+        bool eliminateRedundantBitOp(
+            const Module& module, Method& method, BasicBlock& block, const Configuration& config);
 
         /*
          * Propagate source value of move operation in a basic block.
@@ -11,321 +11,477 @@
 #include "../analysis/DependencyGraph.h"
 #include "../intermediate/IntermediateInstruction.h"
 #include "../periphery/VPM.h"
+#include "Combiner.h"
 #include "log.h"
 
+#include <algorithm>
+#include <iterator>
+
 using namespace vc4c;
 using namespace vc4c::optimizations;
 
-struct NodeSorter : public std::less<intermediate::IntermediateInstruction*>
+/*
+ * Rates the static priority of the instruction, used to select between instructions with the same critical path
+ * length. The lower the value, the higher the priority.
+ */
+static int ratePriority(const intermediate::IntermediateInstruction* inst)
 {
-    static int ratePriority(intermediate::IntermediateInstruction* inst)
+    int priority = 0;
+    // prioritizing conditional instructions keeps setting flags and their uses together
+    if(inst->conditional != COND_ALWAYS)
     {
-        int priority = 0;
-        // prioritizing conditional instructions keeps setting flags and their uses together
-        if(inst->conditional != COND_ALWAYS)
-        {
-            priority += 100;
-        }
-        // prioritize setting of TMU_NO_SWAP to make the best of the delays required before loading
-        if(inst->writesRegister(REG_TMU_NOSWAP))
-            priority += 100;
-        // prioritize unlocking mutex to keep critical section as small as possible
-        if(inst->writesRegister(REG_MUTEX))
-            priority += 80;
-        // XXX give reading of work-item info (as well as parameters) a high priority (minimizes their local's
-        // life-time)
-        if(std::any_of(inst->getArguments().begin(), inst->getArguments().end(),
-               [](const Value& val) -> bool { return val.checkLocal() && val.local()->is<Parameter>(); }))
-            priority += 50;
-
-        // writing TMU address gets higher priority, to leave enough space for utilizing the delay to actually read the
-        // value
-        if(inst->writesRegister(REG_TMU0_ADDRESS) || inst->writesRegister(REG_TMU1_ADDRESS))
-            priority += 40;
-
-        // prioritize triggering read of TMU and reading from TMU to be directly scheduled after the delay is up to free
-        // queue space
-        if(inst->signal.triggersReadOfR4() || inst->readsRegister(REG_TMU_OUT))
-            priority += 30;
-
-        // Increasing semaphores gets higher priority, decreasing it lower to reduce stall time
-        auto semaphore = dynamic_cast<const intermediate::SemaphoreAdjustment*>(inst);
-        if(semaphore)
-        {
-            if(semaphore->increase)
-                priority += 20;
-            else
-                priority -= 20;
-        }
+        priority += 100;
+    }
+    // prioritize setting of TMU_NO_SWAP to make the best of the delays required before loading
+    if(inst->writesRegister(REG_TMU_NOSWAP))
+        priority += 100;
+    // prioritize unlocking mutex to keep critical section as small as possible
+    if(inst->writesRegister(REG_MUTEX))
+        priority += 80;
+    // XXX give reading of work-item info (as well as parameters) a high priority (minimizes their local's
+    // life-time)
+    if(std::any_of(inst->getArguments().begin(), inst->getArguments().end(),
+           [](const Value& val) -> bool { return val.checkLocal() && val.local()->is<Parameter>(); }))
+        priority += 50;
 
-        // Triggering of TMU reads gets lower priority to leave enough space between setting address and reading value
-        // to utilize delay
-        if(inst->signal.triggersReadOfR4())
-            priority -= 30;
+    // writing TMU address gets higher priority, to leave enough space for utilizing the delay to actually read the
+    // value
+    if(inst->writesRegister(REG_TMU0_ADDRESS) || inst->writesRegister(REG_TMU1_ADDRESS))
+        priority += 40;
 
-        // give vector rotations lower priority to make the usage-range of the accumulator used smaller
-        if(dynamic_cast<const intermediate::VectorRotation*>(inst))
-            priority -= 50;
+    // prioritize triggering read of TMU and reading from TMU to be directly scheduled after the delay is up to free
+    // queue space
+    if(inst->signal.triggersReadOfR4() || inst->readsRegister(REG_TMU_OUT))
+        priority += 30;
 
-        // for conditional instructions setting flags themselves not preceding the other instructions depending on same
-        // flags
-        if(inst->setFlags == SetFlag::SET_FLAGS)
-            priority -= 60;
+    // Increasing semaphores gets higher priority, decreasing it lower to reduce stall time
+    auto semaphore = dynamic_cast<const intermediate::SemaphoreAdjustment*>(inst);
+    if(semaphore)
+    {
+        if(semaphore->increase)
+            priority += 20;
+        else
+            priority -= 20;
+    }
 
-        // loading/calculation of literals get smaller priority, since they are used mostly locally
-        if(std::all_of(inst->getArguments().begin(), inst->getArguments().end(), [](const Value& val) -> bool {
-               return val.getLiteralValue() || val.hasRegister(REG_ELEMENT_NUMBER) || val.hasRegister(REG_QPU_NUMBER);
-           }))
-            priority -= 80;
+    // Triggering of TMU reads gets lower priority to leave enough space between setting address and reading value
+    // to utilize delay
+    if(inst->signal.triggersReadOfR4())
+        priority -= 30;
 
-        // given branches a lower priority moves them to the end of the block where they belong
-        if(dynamic_cast<const intermediate::Branch*>(inst))
-            priority -= 90;
+    // give vector rotations lower priority to make the usage-range of the accumulator used smaller
+    if(dynamic_cast<const intermediate::VectorRotation*>(inst))
+        priority -= 50;
 
-        // mutex_acquire gets the lowest priority to not extend the critical section
-        if(inst->readsRegister(REG_MUTEX))
-            priority -= 100;
+    // for conditional instructions setting flags themselves not preceding the other instructions depending on same
+    // flags
+    if(inst->setFlags == SetFlag::SET_FLAGS)
+        priority -= 60;
 
-        return -priority;
-    }
+    // loading/calculation of literals get smaller priority, since they are used mostly locally
+    if(std::all_of(inst->getArguments().begin(), inst->getArguments().end(), [](const Value& val) -> bool {
+           return val.getLiteralValue() || val.hasRegister(REG_ELEMENT_NUMBER) || val.hasRegister(REG_QPU_NUMBER);
+       }))
+        priority -= 80;
 
-    bool operator()(intermediate::IntermediateInstruction* x, intermediate::IntermediateInstruction* y)
-    {
-        int prioX;
-        auto it = priorities.find(x);
-        if(it != priorities.end())
-            prioX = it->second;
-        else
-            prioX = priorities[x] = ratePriority(x);
-        int prioY;
-        it = priorities.find(y);
-        if(it != priorities.end())
-            prioY = it->second;
-        else
-            prioY = priorities[y] = ratePriority(y);
-        if(prioX == prioY)
-            return x < y;
-        return prioX < prioY;
-    }
+    // given branches a lower priority moves them to the end of the block where they belong
+    if(dynamic_cast<const intermediate::Branch*>(inst))
+        priority -= 90;
+
+    // mutex_acquire gets the lowest priority to not extend the critical section
+    if(inst->readsRegister(REG_MUTEX))
+        priority -= 100;
+
+    return -priority;
+}
 
-    // caches priorities per instruction, so we do not have to re-calculate them
-    FastMap<intermediate::IntermediateInstruction*, int> priorities;
+/*
+ * The scheduling state of a single instruction of the basic block
+ */
+struct SchedulingNode
+{
+    // the instruction, owned by this node until it is inserted into the basic block again
+    std::unique_ptr<intermediate::IntermediateInstruction> instruction;
+    const DependencyNode* node;
+    // the position within the original order of the block, used to resolve ties deterministically
+    std::size_t originalIndex;
+    // the number of instructions this instruction depends on, which are not yet scheduled
+    unsigned numOpenPredecessors = 0;
+    // the first cycle (relative to the start of the block) at which all mandatory delays are met
+    std::size_t earliestCycle = 0;
+    // the first cycle at which all mandatory and preferred delays are met
+    std::size_t preferredCycle = 0;
+    // the minimum number of cycles between this instruction and the end of the block, for delays required by
+    // instructions in succeeding blocks
+    std::size_t exitDelay = 0;
+    // the length of the longest chain of dependencies (including preferred delays) following this instruction
+    std::size_t criticalPathLength = 0;
+    int priority;
 
-    explicit NodeSorter(std::size_t numEntries)
+    SchedulingNode(
+        std::unique_ptr<intermediate::IntermediateInstruction>&& inst, const DependencyNode* node, std::size_t index) :
+        instruction(std::move(inst)),
+        node(node), originalIndex(index), priority(ratePriority(instruction.get()))
     {
-        priorities.reserve(numEntries);
     }
 };
 
-// TODO OpenSet leaks all pending instructions if exception is thrown
-using OpenSet = SortedSet<intermediate::IntermediateInstruction*, NodeSorter>;
-using DelaysMap = FastMap<const intermediate::IntermediateInstruction*, std::size_t>;
+// the delays for accesses across basic blocks, same as used by the dependency graph within a single block
+static constexpr unsigned SFU_DELAY = 2;
+static constexpr unsigned DMA_LOAD_DELAY = 6;
+static constexpr unsigned DMA_STORE_DELAY = 10;
+static constexpr unsigned REGISTER_DELAY = 1;
 
-static constexpr int DEFAULT_PRIORITY = 1000;
-// needs to be larger then the default priority to disregard in any case
-static constexpr int MIN_PRIORITY = 2000;
-
-static int calculateSchedulingPriority(DependencyEdge& dependency, BasicBlock& block)
+/*
+ * The accesses within (a part of) a basic block which can be counterparts for accesses requiring a delay
+ */
+struct BlockAccesses
 {
-    PROFILE_START(calculateSchedulingPriority);
-    int latencyLeft = static_cast<int>(dependency.data.numDelayCycles);
-    auto it = --block.end();
-    while(it != block.begin() && latencyLeft > 0)
-    {
-        if(it->get() == dependency.getInput().key)
-            // we found the dependent instruction
-            break;
-        if(*it && (*it)->mapsToASMInstruction())
-            --latencyLeft;
-        --it;
-    }
-    if(latencyLeft <= 0 && !dependency.data.isMandatoryDelay)
+    bool triggersR4 = false;
+    bool readsR4 = false;
+    bool writesDMALoadAddress = false;
+    bool waitsForDMALoad = false;
+    bool writesDMAStoreAddress = false;
+    bool waitsForDMAStore = false;
+    FastSet<const Local*> writtenLocals;
+    FastSet<const Local*> readLocals;
+
+    void add(const intermediate::IntermediateInstruction* inst)
     {
-        auto instr = dependency.getOutput().key;
-        // also value instructions freeing resources (e.g. reading periphery/releasing mutex/last read of locals)
-        // and devalue instructions locking resources and using new registers, as well as instructions only depending on
-        // literals
-        if(instr->writesRegister(REG_MUTEX) || instr->writesRegister(REG_VPM_DMA_LOAD_ADDR) ||
-            instr->writesRegister(REG_VPM_DMA_STORE_ADDR))
-            latencyLeft -= 3;
-        if(instr->readsRegister(REG_TMU_OUT) || instr->readsRegister(REG_VPM_IO) ||
-            instr->writesRegister(REG_TMU0_ADDRESS) || instr->writesRegister(REG_TMU1_ADDRESS))
-            latencyLeft -= 4;
-        if(instr->readsRegister(REG_VPM_DMA_LOAD_WAIT) || instr->readsRegister(REG_VPM_DMA_STORE_WAIT) ||
-            instr->readsRegister(REG_MUTEX))
-            latencyLeft += 2;
-        if(std::any_of(instr->getArguments().begin(), instr->getArguments().end(), [&](const Value& arg) -> bool {
-               return arg.checkLocal() && arg.local()->getUsers(LocalUse::Type::READER).size() == 1;
-           }))
-            --latencyLeft;
-        if(instr->hasValueType(ValueType::LOCAL) && instr->getOutput()->getSingleWriter() == instr)
-            latencyLeft += 2;
-        if(std::all_of(instr->getArguments().begin(), instr->getArguments().end(), [&](const Value& arg) -> bool {
-               return arg.getLiteralValue() || arg.hasRegister(REG_QPU_NUMBER) || arg.hasRegister(REG_ELEMENT_NUMBER);
-           }))
-            ++latencyLeft;
+        triggersR4 = triggersR4 || inst->signal.triggersReadOfR4() ||
+            (inst->hasValueType(ValueType::REGISTER) && inst->getOutput()->reg().triggersReadOfR4());
+        readsR4 = readsR4 || inst->readsRegister(REG_SFU_OUT);
+        writesDMALoadAddress = writesDMALoadAddress || inst->writesRegister(REG_VPM_DMA_LOAD_ADDR);
+        waitsForDMALoad = waitsForDMALoad || inst->readsRegister(REG_VPM_DMA_LOAD_WAIT);
+        writesDMAStoreAddress = writesDMAStoreAddress || inst->writesRegister(REG_VPM_DMA_STORE_ADDR);
+        waitsForDMAStore = waitsForDMAStore || inst->readsRegister(REG_VPM_DMA_STORE_WAIT);
+        inst->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+            if(has_flag(type, LocalUse::Type::WRITER))
+                writtenLocals.emplace(loc);
+            if(has_flag(type, LocalUse::Type::READER))
+                readLocals.emplace(loc);
+        });
     }
-    // if variable latency, return remaining latency (to achieving best case)
-    // otherwise, return MIN_PRIORITY
-    PROFILE_END(calculateSchedulingPriority);
-    return (latencyLeft > 0 && dependency.data.isMandatoryDelay) ? MIN_PRIORITY : latencyLeft;
-    // TODO also look into the future and keep some instructions (e.g. vector rotations/arithmetics) close to their
-    // use?? (would need to calculate priority of uses and deduct distance)
-    // or look into the future and calculate the maximum mandatory (+preferred) delay between this instruction and the
-    // end of block (e.g. maximum path for all dependent delays) -> prefer maximum mandatory delay > maximum preferred
-    // delay > any other. Or directly calculate remaining delay into priority mandatory/preferred. Delay "behind"
-    // instruction can be calculated once per instruction?!
-}
-
-static int checkDependenciesMet(DependencyNode& entry, BasicBlock& block, OpenSet& openNodes)
-{
-    if(!entry.hasIncomingDependencies())
-        return true;
-    int schedulingPriority = 0;
-    entry.forAllIncomingEdges([&](DependencyNode& neighbor, DependencyEdge& edge) -> bool {
-        if(openNodes.find(const_cast<intermediate::IntermediateInstruction*>(neighbor.key)) != openNodes.end())
-        {
-            // the dependent instruction was not yet scheduled, cannot schedule
-            schedulingPriority = MIN_PRIORITY;
-            return false;
-        }
-        // at this point, the dependent instruction is already scheduled
-        else if(edge.data.numDelayCycles == 0)
-        {
-            // simple dependency to maintain order, is already given -> check other dependencies
-            return true;
-        }
-        else
-        {
-            int priority = calculateSchedulingPriority(edge, block);
-            if(priority == 0)
-            {
-                // dependency is completely met -> check other dependencies
-                return true;
-            }
-            schedulingPriority += priority;
-        }
-        return true;
-    });
-    return schedulingPriority;
-}
+};
 
-static OpenSet::const_iterator selectInstruction(OpenSet& openNodes, DependencyGraph& graph, BasicBlock& block,
-    const DelaysMap& successiveMandatoryDelays, const DelaysMap& successiveDelays)
+/*
+ * Returns the delay the instruction requires to instructions in preceding basic blocks, if the previous instructions of
+ * its own block do not contain the instruction it needs to wait for
+ */
+static unsigned getEntryDelay(const intermediate::IntermediateInstruction* inst, const BlockAccesses& previous)
 {
-    // iterate open-set until entry with no more dependencies
-    auto it = openNodes.begin();
-    std::pair<OpenSet::const_iterator, int> selected = std::make_pair(openNodes.end(), DEFAULT_PRIORITY);
-    auto lastInstruction = block.walkEnd().previousInBlock();
-    PROFILE_START(SelectInstruction);
-    while(it != openNodes.end())
+    unsigned delay = 0;
+    if(inst->readsRegister(REG_SFU_OUT) && !previous.triggersR4)
+        delay = std::max(delay, SFU_DELAY);
+    if(inst->readsRegister(REG_VPM_DMA_LOAD_WAIT) && !previous.writesDMALoadAddress)
+        delay = std::max(delay, DMA_LOAD_DELAY);
+    if(inst->readsRegister(REG_VPM_DMA_STORE_WAIT) && !previous.writesDMAStoreAddress)
+        delay = std::max(delay, DMA_STORE_DELAY);
+    if(inst->hasUnpackMode() || dynamic_cast<const intermediate::VectorRotation*>(inst) != nullptr)
     {
-        // select first entry (with highest priority) for which all dependencies are fulfilled (with latency)
-        int priority = checkDependenciesMet(graph.assertNode(*it), block, openNodes);
-        if(priority < MIN_PRIORITY)
-            priority -= successiveMandatoryDelays.at(*it);
-        // TODO use preferred delays?
-        // TODO remove adding/removing priorities in calculateSchedulingPriority?
-        // TODO remove extra cases here?
-        // TODO need to combine more instructions!
-        // TODO success rate (i.e. emulation tests) is good, need to optimize performance
-        // TODO is putting too much pressure on mutex lock (15% more than before)
-        if(priority < std::get<1>(selected) ||
-            // keep instructions writing the same local together to be combined more easily
-            // TODO make better/check result
-            (priority == std::get<1>(selected) && lastInstruction->hasValueType(ValueType::LOCAL) &&
-                (*it)->writesLocal(lastInstruction->getOutput()->local())) ||
-            // keep vector rotations close to their use by devaluing them after all other equal-priority instructions
-            (priority == std::get<1>(selected) && lastInstruction.get<intermediate::VectorRotation>() &&
-                dynamic_cast<const intermediate::VectorRotation*>(*it) == nullptr) ||
-            // prefer reading of r4 to free up space in TMU queue/allow other triggers to write to r4
-            (priority == std::get<1>(selected) && (*it)->readsRegister(REG_TMU_OUT)) ||
-            // prefer anything over locking mutex
-            (priority == std::get<1>(selected) && std::get<0>(selected) != openNodes.end() &&
-                (*std::get<0>(selected))->readsRegister(REG_MUTEX)))
-        {
-            std::get<0>(selected) = it;
-            std::get<1>(selected) = priority;
-        }
-        // TODO some more efficient version? E.g. caching priorities, check from lowest, update, take new lowest
-        ++it;
+        // these instructions cannot read a local written in the directly preceding instruction
+        inst->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+            if(has_flag(type, LocalUse::Type::READER) &&
+                previous.writtenLocals.find(loc) == previous.writtenLocals.end())
+                delay = std::max(delay, REGISTER_DELAY);
+        });
     }
-    PROFILE_END(SelectInstruction);
+    return delay;
+}
 
-    if(std::get<0>(selected) != openNodes.end())
+/*
+ * Returns the delay the instruction requires to instructions in succeeding basic blocks, if the following instructions
+ * of its own block do not contain the instruction waiting for it
+ */
+static unsigned getExitDelay(const intermediate::IntermediateInstruction* inst, const BlockAccesses& following)
+{
+    unsigned delay = 0;
+    if(inst->hasValueType(ValueType::REGISTER) && inst->getOutput()->reg().triggersReadOfR4() && !following.readsR4)
+        delay = std::max(delay, SFU_DELAY);
+    if(inst->writesRegister(REG_VPM_DMA_LOAD_ADDR) && !following.waitsForDMALoad)
+        delay = std::max(delay, DMA_LOAD_DELAY);
+    if(inst->writesRegister(REG_VPM_DMA_STORE_ADDR) && !following.waitsForDMAStore)
+        delay = std::max(delay, DMA_STORE_DELAY);
+    if(inst->hasValueType(ValueType::LOCAL) &&
+        following.readLocals.find(inst->getOutput()->local()) == following.readLocals.end())
     {
-        CPPLOG_LAZY(logging::Level::DEBUG,
-            log << "Selected '" << (*std::get<0>(selected))->to_string()
-                << "' as next instruction with remaining latency of " << std::get<1>(selected) << logging::endl);
-        return std::get<0>(selected);
+        // a local written with pack mode or read with unpack mode or by a vector rotation cannot be read in the
+        // directly following instruction
+        bool isRestrictedRead = false;
+        inst->getOutput()->local()->forUsers(LocalUse::Type::READER, [&](const LocalUser* user) {
+            if(user->hasUnpackMode() || dynamic_cast<const intermediate::VectorRotation*>(user) != nullptr)
+                isRestrictedRead = true;
+        });
+        if(inst->hasPackMode() || isRestrictedRead)
+            delay = std::max(delay, REGISTER_DELAY);
     }
+    return delay;
+}
 
-    return openNodes.end();
+/*
+ * Returns whether the instruction can be executed on one of the ALUs in combination with another instruction
+ */
+static bool isCombinable(const intermediate::IntermediateInstruction* inst)
+{
+    return inst->canBeCombined && inst->mapsToASMInstruction() &&
+        (dynamic_cast<const intermediate::Operation*>(inst) != nullptr ||
+            (dynamic_cast<const intermediate::MoveOperation*>(inst) != nullptr &&
+                dynamic_cast<const intermediate::VectorRotation*>(inst) == nullptr));
 }
 
-// FIXME largely extends usage-ranges and increases pressure on registers
-// FIXME increases mutex-ranges!!
-// TODO make sure no more than 4(8?) TMU requests/responds are queued at any time (per TMU?)
-// - Specification documents 8 entries of single row (for general memory query), but does not specify whether one queue
-// or per TMU
-// - Tests show that up to 8 requests per TMU run (whether result is correct not tested!!), 9+ hang QPU
+/*
+ * Returns whether the first candidate is a better choice to be scheduled at the given cycle than the second one.
+ *
+ * Both candidates are expected to have all their mandatory delays met.
+ */
+static bool isBetterCandidate(const SchedulingNode& first, const SchedulingNode& second, std::size_t cycle)
+{
+    // prefer anything over locking the mutex to not extend the critical section
+    bool firstLocksMutex = first.instruction->readsRegister(REG_MUTEX);
+    bool secondLocksMutex = second.instruction->readsRegister(REG_MUTEX);
+    if(firstLocksMutex != secondLocksMutex)
+        return secondLocksMutex;
+    // prefer instructions which do not stall (e.g. by waiting for the TMU to load the value)
+    bool firstStalls = first.preferredCycle > cycle;
+    bool secondStalls = second.preferredCycle > cycle;
+    if(firstStalls != secondStalls)
+        return secondStalls;
+    // prefer instructions on the critical path, since delaying them delays the end of the block
+    if(first.criticalPathLength != second.criticalPathLength)
+        return first.criticalPathLength > second.criticalPathLength;
+    if(first.priority != second.priority)
+        return first.priority < second.priority;
+    return first.originalIndex < second.originalIndex;
+}
 
 /*
- * Select an instruction which does not depend on any instruction (not yet scheduled) anymore and insert it into the
- * basic block
+ * Schedules the instructions of the basic block with a list scheduler and inserts them into the block again.
+ *
+ * For every cycle, all instructions which have no more unscheduled dependencies and whose mandatory delays (e.g. for
+ * SFU results or setting the UNIFORM address) are met are candidates. Of these, the instruction with the longest chain
+ * of dependent instructions (and their delays) is selected, so long latencies (e.g. TMU or DMA accesses) can be covered
+ * by other independent instructions. A NOP is only inserted if no candidate is available.
+ *
+ * Independent ALU instructions (or moves) are packed into a single instruction executing on both the ADD and MUL ALU,
+ * if possible.
+ *
+ * TODO make sure no more than 4(8?) TMU requests/responds are queued at any time (per TMU?)
+ * - Specification documents 8 entries of single row (for general memory query), but does not specify whether one queue
+ * or per TMU
+ * - Tests show that up to 8 requests per TMU run (whether result is correct not tested!!), 9+ hang QPU
  */
-static void selectInstructions(DependencyGraph& graph, BasicBlock& block, const DelaysMap& successiveMandatoryDelays,
-    const DelaysMap& successiveDelays)
+static void scheduleInstructions(
+    DependencyGraph& graph, BasicBlock& block, std::size_t& numNops, std::size_t& numCombined)
 {
     // 1. "empty" basic block without deleting the instructions, skipping the label
+    std::vector<SchedulingNode> nodes;
+    nodes.reserve(block.size());
+    // the cycles (relative to the start of the block) the instructions were originally executed at
+    std::vector<std::size_t> originalCycles;
+    originalCycles.reserve(block.size());
+    std::size_t numOriginalCycles = 0;
+    BlockAccesses previousAccesses;
     auto it = block.walk().nextInBlock();
-    OpenSet openNodes(NodeSorter(block.size()));
     while(!it.isEndOfBlock())
     {
+        const bool takesCycle = it.has() && it->mapsToASMInstruction();
+        // remove all non side-effect NOPs, the required delays within the block are modeled by the dependencies and
+        // the delays across blocks by the entry and exit delays
         if(it.has() &&
             !(it.get<intermediate::Nop>() && !it->hasSideEffects() &&
                 it.get<const intermediate::Nop>()->type != intermediate::DelayType::THREAD_END))
-            // remove all non side-effect NOPs
-            openNodes.emplace(it.release());
+        {
+            const auto* node = graph.findNode(it.get());
+            std::unique_ptr<intermediate::IntermediateInstruction> inst(it.release());
+            nodes.emplace_back(std::move(inst), node, nodes.size());
+            // The dependency graph only covers this block, so an instruction waiting for an instruction in a preceding
+            // block is executed at least as late (relative to the block start) as before, up to the required delay.
+            // This keeps the delays which were previously covered by NOPs at the start of the block.
+            auto& entry = nodes.back();
+            entry.earliestCycle = std::min(
+                numOriginalCycles, static_cast<std::size_t>(getEntryDelay(entry.instruction.get(), previousAccesses)));
+            previousAccesses.add(entry.instruction.get());
+            originalCycles.push_back(numOriginalCycles);
+        }
+        if(takesCycle)
+            ++numOriginalCycles;
         it.erase();
     }
+    // similarly, an instruction waited for by an instruction in a succeeding block keeps at least as many cycles (up to
+    // the required delay) to the end of the block as before, which were previously covered by NOPs at the end
+    BlockAccesses followingAccesses;
+    for(std::size_t i = nodes.size(); i > 0; --i)
+    {
+        auto& entry = nodes[i - 1];
+        const std::size_t originalDistance = numOriginalCycles - originalCycles[i - 1] -
+            (entry.instruction->mapsToASMInstruction() ? 1 : 0);
+        entry.exitDelay = std::min(
+            originalDistance, static_cast<std::size_t>(getExitDelay(entry.instruction.get(), followingAccesses)));
+        followingAccesses.add(entry.instruction.get());
+    }
+
+    FastMap<const intermediate::IntermediateInstruction*, SchedulingNode*> nodesByInstruction;
+    nodesByInstruction.reserve(nodes.size());
+    for(auto& node : nodes)
+        nodesByInstruction.emplace(node.instruction.get(), &node);
+    auto findNode = [&](const DependencyNode& dependency) -> SchedulingNode* {
+        auto nodeIt = nodesByInstruction.find(dependency.key);
+        return nodeIt == nodesByInstruction.end() ? nullptr : nodeIt->second;
+    };
+
+    // 2. calculate the critical path lengths and the number of dependencies. Since dependencies only point forward
+    // within the block, a single backwards pass is enough
+    PROFILE_START(CalculateCriticalPath);
+    for(auto nodeIt = nodes.rbegin(); nodeIt != nodes.rend(); ++nodeIt)
+    {
+        if(nodeIt->node == nullptr)
+            continue;
+        nodeIt->node->forAllOutgoingEdges([&](const DependencyNode& successor, const DependencyEdge& edge) -> bool {
+            if(auto succ = findNode(successor))
+            {
+                nodeIt->criticalPathLength = std::max(nodeIt->criticalPathLength,
+                    1 /* the successor itself */ + edge.data.numDelayCycles + succ->criticalPathLength);
+                ++succ->numOpenPredecessors;
+            }
+            return true;
+        });
+    }
+    PROFILE_END(CalculateCriticalPath);
 
-    // 2. fill again with reordered instructions
-    while(!openNodes.empty())
+    // 3. fill the block again cycle by cycle
+    std::vector<SchedulingNode*> readyNodes;
+    for(auto& node : nodes)
     {
-        auto inst = selectInstruction(openNodes, graph, block, successiveMandatoryDelays, successiveDelays);
-        if(inst == openNodes.end())
+        if(node.numOpenPredecessors == 0)
+            readyNodes.push_back(&node);
+    }
+    std::size_t cycle = 0;
+    std::size_t numScheduled = 0;
+    // the cycle the block needs to end at the earliest, for the exit delays of the scheduled instructions
+    std::size_t endCycle = 0;
+    while(numScheduled < nodes.size())
+    {
+        auto selected = readyNodes.end();
+        for(auto candidate = readyNodes.begin(); candidate != readyNodes.end(); ++candidate)
+        {
+            if((*candidate)->earliestCycle > cycle)
+                continue;
+            if(selected == readyNodes.end() || isBetterCandidate(**candidate, **selected, cycle))
+                selected = candidate;
+        }
+        if(selected == readyNodes.end())
         {
-            // no instruction could be scheduled not violating the fixed latency, insert NOPs
+            if(readyNodes.empty())
+                throw CompilationError(CompilationStep::OPTIMIZER, "Cyclic dependencies within basic block",
+                    block.getLabel()->to_string());
+            // no instruction can be scheduled without violating a mandatory delay, insert NOPs up to the next cycle
+            // any instruction can be scheduled at
+            auto nextCycle = (*std::min_element(readyNodes.begin(), readyNodes.end(),
+                                  [](const SchedulingNode* a, const SchedulingNode* b) -> bool {
+                                      return a->earliestCycle < b->earliestCycle;
+                                  }))
+                                 ->earliestCycle;
             CPPLOG_LAZY(logging::Level::DEBUG,
-                log << "Failed to schedule an instruction, falling back to inserting NOP" << logging::endl);
-            block.walkEnd().emplace(new intermediate::Nop(intermediate::DelayType::WAIT_REGISTER));
+                log << "Failed to schedule an instruction, inserting " << (nextCycle - cycle) << " NOPs"
+                    << logging::endl);
+            for(; cycle < nextCycle; ++cycle, ++numNops)
+                block.walkEnd().emplace(new intermediate::Nop(intermediate::DelayType::WAIT_REGISTER));
+            continue;
         }
-        else
+
+        SchedulingNode& current = **selected;
+        std::swap(*selected, readyNodes.back());
+        readyNodes.pop_back();
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Selected '" << current.instruction->to_string() << "' for cycle " << cycle
+                << " with critical path length of " << current.criticalPathLength << logging::endl);
+        // instructions not mapped to machine code (e.g. memory barriers) do not take a cycle
+        const std::size_t finishCycle = cycle + (current.instruction->mapsToASMInstruction() ? 1 : 0);
+        auto updateSuccessors = [&](const SchedulingNode& entry) {
+            if(entry.node == nullptr)
+                return;
+            entry.node->forAllOutgoingEdges([&](const DependencyNode& successor, const DependencyEdge& edge) -> bool {
+                auto succ = findNode(successor);
+                if(succ == nullptr)
+                    return true;
+                const std::size_t delayedCycle = finishCycle + edge.data.numDelayCycles;
+                if(edge.data.isMandatoryDelay)
+                    succ->earliestCycle = std::max(succ->earliestCycle, delayedCycle);
+                succ->preferredCycle = std::max(succ->preferredCycle, delayedCycle);
+                if(--succ->numOpenPredecessors == 0)
+                    readyNodes.push_back(succ);
+                return true;
+            });
+        };
+
+        // try to fill the other ALU with an independent instruction. Since all candidates are ready, they depend
+        // neither on the selected instruction nor on any other instruction not yet scheduled
+        SchedulingNode* partner = nullptr;
+        std::unique_ptr<intermediate::CombinedOperation> combined;
+        if(finishCycle != cycle && isCombinable(current.instruction.get()))
         {
-            block.walkEnd().emplace(*inst);
-            openNodes.erase(inst);
+            std::vector<SchedulingNode*> candidates;
+            std::copy_if(readyNodes.begin(), readyNodes.end(), std::back_inserter(candidates),
+                [&](const SchedulingNode* candidate) -> bool {
+                    // do not insert instructions which would need to wait for a (preferred) delay
+                    return candidate->preferredCycle <= cycle && isCombinable(candidate->instruction.get());
+                });
+            std::sort(candidates.begin(), candidates.end(),
+                [&](const SchedulingNode* first, const SchedulingNode* second) -> bool {
+                    return isBetterCandidate(*first, *second, cycle);
+                });
+            for(auto candidate : candidates)
+            {
+                combined = combineInstructions(current.instruction, candidate->instruction);
+                if(combined)
+                {
+                    partner = candidate;
+                    break;
+                }
+            }
+        }
+
+        updateSuccessors(current);
+        endCycle = std::max(endCycle, finishCycle + current.exitDelay);
+        if(partner != nullptr)
+        {
+            readyNodes.erase(std::find(readyNodes.begin(), readyNodes.end(), partner));
+            updateSuccessors(*partner);
+            endCycle = std::max(endCycle, finishCycle + partner->exitDelay);
+            block.walkEnd().emplace(combined.release());
+            ++numScheduled;
+            ++numCombined;
         }
+        else
+            block.walkEnd().emplace(current.instruction.release());
+        cycle = finishCycle;
+        ++numScheduled;
+    }
+
+    // 4. pad the end of the block (before the branches) for the exit delays not covered by the scheduled instructions
+    if(cycle < endCycle)
+    {
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Inserting " << (endCycle - cycle) << " NOPs for delays of instructions in succeeding blocks"
+                << logging::endl);
+        auto insertIt = block.walkEnd();
+        while(!insertIt.isStartOfBlock() && insertIt.copy().previousInBlock().get<intermediate::Branch>())
+            insertIt.previousInBlock();
+        for(; cycle < endCycle; ++cycle, ++numNops)
+            insertIt.emplace(new intermediate::Nop(intermediate::DelayType::WAIT_REGISTER));
     }
 }
 
 bool optimizations::reorderInstructions(const Module& module, Method& kernel, const Configuration& config)
 {
+    std::size_t numNops = 0;
+    std::size_t numCombined = 0;
     for(BasicBlock& bb : kernel)
     {
         auto dependencies = DependencyGraph::createGraph(bb);
-        // calculate required and recommended successive delays for all instructions
-        DelaysMap successiveMandatoryDelays;
-        DelaysMap successiveDelays;
-        PROFILE_START(CalculateCriticalPath);
-        for(const auto& node : dependencies->getNodes())
-        {
-            // since we cache all delays (also for all intermediate results), it is only calculated once per node
-            node.second.calculateSucceedingCriticalPathLength(true, &successiveMandatoryDelays);
-            node.second.calculateSucceedingCriticalPathLength(false, &successiveDelays);
-        }
-        PROFILE_END(CalculateCriticalPath);
-        selectInstructions(*dependencies, bb, successiveMandatoryDelays, successiveDelays);
+        scheduleInstructions(*dependencies, bb, numNops, numCombined);
     }
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_OPTIMIZATION + 410, "Scheduler NOP insertions", numNops);
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_OPTIMIZATION + 411, "Scheduler combined instructions", numCombined);
     return false;
 }
@@ -15,8 +15,27 @@ namespace vc4c
 
     namespace optimizations
     {
+        /*
+         * Reorders the instructions within each basic block with a list scheduler, which is based on the dependencies
+         * and the delays (mandatory and preferred) between the instructions calculated in the DependencyGraph.
+         *
+         * Instructions on the longest path of dependencies are scheduled first, so instructions with long latencies
+         * (e.g. writing the TMU address, setting up DMA accesses or SFU calculations) are moved away from the
+         * instructions consuming their results and the gap is filled with independent instructions. All NOPs without
+         * side-effects are removed and only re-inserted where a mandatory delay cannot be filled otherwise.
+         *
+         * The dependencies only cover a single basic block. Instructions waiting for an instruction in another block
+         * (e.g. reading r4 at the start of a block after an SFU call at the end of the preceding block, or waiting for
+         * a DMA access set up in a previous block) keep at least their previous distance to the start or end of the
+         * block, up to the required delay.
+         *
+         * NOTE: This pass is enabled from the medium optimization level. It replaces the #reorderWithinBasicBlocks and
+         * #combineOperations passes, which are only run by default if this pass is disabled.
+         *
+         * NOTE: The register-file assignment is not yet known, so read-after-write conflicts on physical registers are
+         * only modeled via the preferred distance of locals which cannot be mapped to accumulators.
+         */
         bool reorderInstructions(const Module& module, Method& kernel, const Configuration& config);
-
     } /* namespace optimizations */
 } /* namespace vc4c */
 
@@ -0,0 +1,321 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#include "LiveRanges.h"
+
+#include "../InstructionWalker.h"
+#include "../Method.h"
+#include "../Profiler.h"
+#include "../analysis/ControlFlowGraph.h"
+#include "../analysis/LivenessAnalysis.h"
+#include "log.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace vc4c;
+using namespace vc4c::optimizations;
+
+// the maximum number of times the locals are coalesced, since the liveness needs to be re-calculated after every round
+static constexpr unsigned MAX_COALESCING_ROUNDS = 8;
+// the maximum number of locals split per loop, the number of accumulators usable for locals
+static constexpr std::size_t MAX_SPLITS_PER_LOOP = 4;
+
+struct CoalescingCandidate
+{
+    InstructionWalker move;
+    const Local* source;
+    const Local* destination;
+    bool interferes;
+};
+
+/*
+ * Merging two locals also merges the restrictions on the register-files they can be mapped to, which could create
+ * conflicts the register allocation cannot resolve. So we skip all locals with such restrictions.
+ */
+static bool hasRegisterFileRestrictions(const Local* loc)
+{
+    return loc->findUser(LocalUse::Type::BOTH, [](const LocalUser* user) -> bool {
+        return user->hasUnpackMode() || user->hasPackMode() ||
+            dynamic_cast<const intermediate::VectorRotation*>(user) != nullptr ||
+            dynamic_cast<const intermediate::CombinedOperation*>(user) != nullptr;
+    }) != nullptr;
+}
+
+static bool canBeCoalesced(const Local* loc)
+{
+    // only locals owned by the method can be merged, parameters, globals, etc. have a special meaning
+    return loc->getIndex() != Local::INVALID_INDEX && !loc->type.isLabelType() &&
+        loc->hasUsers(LocalUse::Type::WRITER) && !hasRegisterFileRestrictions(loc);
+}
+
+static std::vector<CoalescingCandidate> findCoalescingCandidates(Method& method)
+{
+    std::vector<CoalescingCandidate> candidates;
+    FastSet<const Local*> usedLocals;
+    for(auto it = method.walkAllInstructions(); !it.isEndOfMethod(); it.nextInMethod())
+    {
+        auto move = it.get<intermediate::MoveOperation>();
+        if(move == nullptr || !move->isSimpleMove() || move->hasConditionalExecution() || move->doesSetFlag() ||
+            move->signal != SIGNAL_NONE || !move->hasValueType(ValueType::LOCAL))
+            continue;
+        const Local* src = move->getSource().checkLocal();
+        const Local* dest = move->getOutput()->local();
+        // XXX the types need to be equal, since other instructions (e.g. the reordering) rely on the type of a local
+        if(src == nullptr || src == dest || src->type != dest->type || !canBeCoalesced(src) || !canBeCoalesced(dest))
+            continue;
+        // the memory a pointer refers to would be lost, if the remaining local does not refer to the same memory
+        if(dest->reference.first != nullptr && dest->reference != src->reference)
+            continue;
+        // every local is coalesced at most once per round, since we do not update the liveness
+        if(usedLocals.find(src) != usedLocals.end() || usedLocals.find(dest) != usedLocals.end())
+            continue;
+        usedLocals.emplace(src);
+        usedLocals.emplace(dest);
+        candidates.emplace_back(CoalescingCandidate{it, src, dest, false});
+    }
+    return candidates;
+}
+
+/*
+ * Two locals interfere, if one of them is written while the other one is live afterwards, with the exception of the
+ * move connecting them (since after the move both have the same value).
+ *
+ * This is the more precise definition than used by the register allocation (where two locals interfere if they are
+ * live at the same time), since e.g. a local and its copy being read afterwards are live at the same time, but can
+ * still be assigned to the same register.
+ */
+static void checkInterferences(
+    const Method& method, const analysis::LivenessAnalysis& liveness, std::vector<CoalescingCandidate>& candidates)
+{
+    FastMap<const Local*, CoalescingCandidate*> candidatesByLocal;
+    for(auto& candidate : candidates)
+    {
+        candidatesByLocal.emplace(candidate.source, &candidate);
+        candidatesByLocal.emplace(candidate.destination, &candidate);
+    }
+
+    for(const BasicBlock& block : method)
+    {
+        // since we walk the block backwards, this is the live set after the current instruction
+        analysis::LivenessAnalysis::LiveSet liveAfter = liveness.getLiveOut(block);
+        liveness.forAllInstructions(block,
+            [&](const intermediate::IntermediateInstruction* inst, const analysis::LivenessAnalysis::LiveSet& live) {
+                inst->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+                    if(!has_flag(type, LocalUse::Type::WRITER))
+                        return;
+                    auto candIt = candidatesByLocal.find(loc);
+                    if(candIt == candidatesByLocal.end() || candIt->second->move.get() == inst)
+                        return;
+                    auto candidate = candIt->second;
+                    const Local* other = candidate->source == loc ? candidate->destination : candidate->source;
+                    if(liveAfter.test(liveness.getIndex(other)))
+                        candidate->interferes = true;
+                });
+                liveAfter = live;
+            });
+    }
+}
+
+static std::size_t coalesceLocals(Method& method)
+{
+    std::size_t numCoalesced = 0;
+    for(unsigned round = 0; round < MAX_COALESCING_ROUNDS; ++round)
+    {
+        auto candidates = findCoalescingCandidates(method);
+        if(candidates.empty())
+            break;
+        analysis::LivenessAnalysis liveness;
+        liveness(method);
+        checkInterferences(method, liveness, candidates);
+
+        FastMap<const Local*, const Local*> replacements;
+        for(const auto& candidate : candidates)
+        {
+            if(candidate.interferes)
+                continue;
+            CPPLOG_LAZY(logging::Level::DEBUG,
+                log << "Coalescing local " << candidate.destination->to_string() << " into "
+                    << candidate.source->to_string() << " and removing move: " << candidate.move->to_string()
+                    << logging::endl);
+            replacements.emplace(candidate.destination, candidate.source);
+        }
+        if(replacements.empty())
+            break;
+
+        std::vector<const Local*> replacedLocals;
+        for(auto it = method.walkAllInstructions(); !it.isEndOfMethod(); it.nextInMethod())
+        {
+            if(!it.has())
+                continue;
+            replacedLocals.clear();
+            it->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+                if(replacements.find(loc) != replacements.end())
+                    replacedLocals.push_back(loc);
+            });
+            for(const Local* loc : replacedLocals)
+                it->replaceLocal(loc, replacements.at(loc));
+        }
+        for(auto& candidate : candidates)
+        {
+            // the moves now copy the source into itself
+            if(!candidate.interferes)
+                candidate.move.erase();
+        }
+        numCoalesced += replacements.size();
+    }
+    return numCoalesced;
+}
+
+/*
+ * Returns the single block the given loop is entered from, if any, and if it has the loop header as its only successor
+ */
+static const BasicBlock* findLoopEntry(const ControlFlowLoop& loop)
+{
+    const CFGNode* entry = nullptr;
+    bool hasMultipleEntries = false;
+    for(const CFGNode* node : loop)
+    {
+        node->forAllIncomingEdges([&](const CFGNode& neighbor, const CFGEdge& edge) -> bool {
+            if(std::find(loop.begin(), loop.end(), &neighbor) == loop.end())
+            {
+                hasMultipleEntries = hasMultipleEntries || (entry != nullptr && entry != &neighbor);
+                entry = &neighbor;
+            }
+            return true;
+        });
+    }
+    if(entry == nullptr || hasMultipleEntries || entry->getSingleSuccessor() == nullptr)
+        return nullptr;
+    return entry->key;
+}
+
+static std::size_t splitLiveRangesAtLoops(Method& method)
+{
+    auto& cfg = method.getCFG();
+    auto loops = cfg.findLoops();
+    // handle inner loops first, since they are executed most often
+    std::vector<const ControlFlowLoop*> sortedLoops;
+    for(const auto& loop : loops)
+        sortedLoops.push_back(&loop);
+    std::sort(sortedLoops.begin(), sortedLoops.end(),
+        [](const ControlFlowLoop* one, const ControlFlowLoop* other) -> bool {
+            return one->size() < other->size();
+        });
+
+    analysis::LivenessAnalysis liveness;
+    liveness(method);
+    // every local is split at most once, since the liveness is not updated
+    FastSet<const Local*> splitLocals;
+    std::size_t numSplits = 0;
+    for(const ControlFlowLoop* loop : sortedLoops)
+    {
+        const BasicBlock* entry = findLoopEntry(*loop);
+        if(entry == nullptr)
+            continue;
+
+        FastSet<const BasicBlock*> loopBlocks;
+        FastSet<const BasicBlock*> exitBlocks;
+        for(const CFGNode* node : *loop)
+            loopBlocks.emplace(node->key);
+        for(const CFGNode* node : *loop)
+        {
+            node->forAllOutgoingEdges([&](const CFGNode& neighbor, const CFGEdge& edge) -> bool {
+                if(loopBlocks.find(neighbor.key) == loopBlocks.end())
+                    exitBlocks.emplace(neighbor.key);
+                return true;
+            });
+        }
+
+        // count the reads of all locals and find the locals written within the loop
+        FastMap<const Local*, std::size_t> numReads;
+        FastSet<const Local*> writtenLocals;
+        for(const BasicBlock* block : loopBlocks)
+        {
+            for(const auto& inst : *block)
+            {
+                if(!inst)
+                    continue;
+                inst->forUsedLocals([&](const Local* loc, LocalUse::Type type) {
+                    if(has_flag(type, LocalUse::Type::READER))
+                        ++numReads[loc];
+                    if(has_flag(type, LocalUse::Type::WRITER))
+                        writtenLocals.emplace(loc);
+                });
+            }
+        }
+
+        // the candidates are live before the block entering the loop (so there is a part of the live range to split
+        // off), not modified within the loop and not live after the loop (so the original local dies on entering)
+        std::vector<std::pair<const Local*, std::size_t>> candidates;
+        const auto& liveAtEntry = liveness.getLiveIn(*entry);
+        for(const auto& reads : numReads)
+        {
+            const Local* loc = reads.first;
+            if(loc->getIndex() == Local::INVALID_INDEX || loc->type.isLabelType() ||
+                writtenLocals.find(loc) != writtenLocals.end() || splitLocals.find(loc) != splitLocals.end() ||
+                !liveAtEntry.test(liveness.getIndex(loc)))
+                continue;
+            if(std::any_of(exitBlocks.begin(), exitBlocks.end(), [&](const BasicBlock* exit) -> bool {
+                   return liveness.getLiveIn(*exit).test(liveness.getIndex(loc));
+               }))
+                continue;
+            candidates.emplace_back(loc, reads.second);
+        }
+        if(candidates.empty())
+            continue;
+        // split the locals accessed most often within the loop
+        std::sort(candidates.begin(), candidates.end(),
+            [](const std::pair<const Local*, std::size_t>& one, const std::pair<const Local*, std::size_t>& other)
+                -> bool { return one.second > other.second; });
+        if(candidates.size() > MAX_SPLITS_PER_LOOP)
+            candidates.resize(MAX_SPLITS_PER_LOOP);
+
+        // insert the copies before the branch into the loop
+        auto insertIt = const_cast<BasicBlock*>(entry)->walkEnd();
+        while(!insertIt.isStartOfBlock() && insertIt.copy().previousInBlock().get<intermediate::Branch>())
+            insertIt.previousInBlock();
+        for(const auto& candidate : candidates)
+        {
+            const Local* loc = candidate.first;
+            const Value copy = method.addNewLocal(loc->type, loc->name);
+            CPPLOG_LAZY(logging::Level::DEBUG,
+                log << "Splitting live range of local " << loc->to_string() << " at loop entry "
+                    << entry->getLabel()->to_string() << " into: " << copy.to_string() << logging::endl);
+            insertIt.emplace(new intermediate::MoveOperation(copy, loc->createReference()));
+            insertIt.nextInBlock();
+            for(const BasicBlock* block : loopBlocks)
+            {
+                for(auto& inst : *const_cast<BasicBlock*>(block))
+                {
+                    if(inst && inst->readsLocal(loc))
+                        inst->replaceLocal(loc, copy.local(), LocalUse::Type::READER);
+                }
+            }
+            splitLocals.emplace(loc);
+            ++numSplits;
+        }
+    }
+    return numSplits;
+}
+
+bool optimizations::optimizeLiveRanges(const Module& module, Method& method, const Configuration& config)
+{
+    PROFILE_START(coalesceLocals);
+    const std::size_t numCoalesced = coalesceLocals(method);
+    PROFILE_END(coalesceLocals);
+
+    PROFILE_START(splitLiveRangesAtLoops);
+    const std::size_t numSplits = splitLiveRangesAtLoops(method);
+    PROFILE_END(splitLiveRangesAtLoops);
+
+    CPPLOG_LAZY(logging::Level::DEBUG,
+        log << "Coalesced " << numCoalesced << " locals and split " << numSplits << " live ranges at loop entries"
+            << logging::endl);
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_OPTIMIZATION + 400, "Coalesced locals", numCoalesced);
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_OPTIMIZATION + 401, "Split live ranges", numSplits);
+    return numCoalesced > 0 || numSplits > 0;
+}
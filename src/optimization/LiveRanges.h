@@ -0,0 +1,61 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+#ifndef VC4C_OPTIMIZATION_LIVE_RANGES_H
+#define VC4C_OPTIMIZATION_LIVE_RANGES_H
+
+namespace vc4c
+{
+    class Method;
+    class Module;
+    struct Configuration;
+
+    namespace optimizations
+    {
+        /*
+         * Reshapes the live ranges of locals before the register allocation, to lower the register pressure.
+         *
+         * 1. Locals connected by a move whose live ranges do not interfere are coalesced into a single local and the
+         * move is removed. Other than #eliminateRedundantMoves, this is not restricted to a single basic block or to
+         * locals with a single reader/writer, e.g. this also removes most of the moves introduced for phi-nodes.
+         *
+         * 2. Locals which are defined before a loop and only read within the loop are split at the loop boundary by
+         * copying them into a new local at the end of the block entering the loop. So the part of the live range within
+         * the loop (where the local is accessed often) can be assigned to a different register than the part before
+         * the loop, e.g. an accumulator.
+         *
+         * Example for coalescing (%b is replaced with %a, the move is removed):
+         *   %a = uniform
+         *   %b = %a
+         *   ...
+         *   %c = add %b, %d
+         *
+         * is converted to:
+         *   %a = uniform
+         *   ...
+         *   %c = add %a, %d
+         *
+         * Example for splitting (only the reads within the loop are replaced):
+         *   %a = uniform
+         *   ...
+         *   label: %loop
+         *   %c = add %a, %i
+         *   ...
+         *   br %loop
+         *
+         * is converted to:
+         *   %a = uniform
+         *   ...
+         *   %a.1 = %a
+         *   label: %loop
+         *   %c = add %a.1, %i
+         *   ...
+         *   br %loop
+         */
+        bool optimizeLiveRanges(const Module& module, Method& method, const Configuration& config);
+    } /* namespace optimizations */
+} /* namespace vc4c */
+
+#endif /* VC4C_OPTIMIZATION_LIVE_RANGES_H */
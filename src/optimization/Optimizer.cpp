@@ -9,29 +9,133 @@
 #include "../BackgroundWorker.h"
 #include "../Module.h"
 #include "../Profiler.h"
+#include "../Telemetry.h"
+#include "../ThreadPool.h"
 #include "../intrinsics/Intrinsics.h"
 #include "Combiner.h"
 #include "ControlFlow.h"
 #include "Eliminator.h"
 #include "Flags.h"
 #include "InstructionScheduler.h"
+#include "LiveRanges.h"
 #include "LocalCompression.h"
 #include "Reordering.h"
 #include "log.h"
 
+#include <algorithm>
+#include <atomic>
+#include <typeinfo>
+
 using namespace vc4c;
 using namespace vc4c::optimizations;
 
 OptimizationPass::OptimizationPass(const std::string& name, const std::string& parameterName, const Pass& pass,
     const std::string& description, OptimizationType type) :
     name(name),
-    parameterName(parameterName), description(description), type(type), pass(pass)
+    parameterName(parameterName), description(description), type(type), pass(pass), blockPass()
 {
 }
 
+OptimizationPass::OptimizationPass(const std::string& name, const std::string& parameterName,
+    const BlockPass& pass, const std::string& description, OptimizationType type) :
+    name(name),
+    parameterName(parameterName), description(description), type(type), pass(), blockPass(pass)
+{
+}
+
+/*
+ * Groups the basic blocks of the method into levels of blocks independent of each other.
+ *
+ * Two blocks depend on each other, if they access the same local. Since the block-local passes decide on the users of
+ * the locals accessed (e.g. whether a local has a single reader), this includes two blocks only reading a local. The
+ * level of a block is greater than the levels of all preceding blocks it depends on, so processing the levels in order
+ * and all blocks within a level in any order (or in parallel) has the same effect as processing the blocks in the
+ * order of the method.
+ *
+ * Labels are ignored, since block-local passes do not modify the control flow.
+ */
+static FastAccessList<FastAccessList<BasicBlock*>> groupIndependentBlocks(Method& method)
+{
+    FastAccessList<FastAccessList<BasicBlock*>> levels;
+    // the highest levels the locals are accessed in so far
+    FastMap<const Local*, std::size_t> lastAccessed;
+    FastSet<const Local*> blockLocals;
+    for(BasicBlock& block : method)
+    {
+        blockLocals.clear();
+        for(auto it = block.walk(); !it.isEndOfBlock(); it.nextInBlock())
+        {
+            if(!it.has())
+                continue;
+            it->forUsedLocals([&](const Local* local, LocalUse::Type type) {
+                if(local->type != TYPE_LABEL)
+                    blockLocals.emplace(local);
+            });
+        }
+
+        std::size_t level = 0;
+        for(const Local* local : blockLocals)
+        {
+            auto accessIt = lastAccessed.find(local);
+            if(accessIt != lastAccessed.end())
+                level = std::max(level, accessIt->second + 1);
+        }
+        for(const Local* local : blockLocals)
+            lastAccessed[local] = level;
+
+        if(level >= levels.size())
+            levels.resize(level + 1);
+        levels[level].push_back(&block);
+    }
+    return levels;
+}
+
 bool OptimizationPass::operator()(const Module& module, Method& method, const Configuration& config) const
 {
-    return pass(module, method, config);
+    if(!blockPass)
+        return pass(module, method, config);
+
+    // the locals created by the pass get their indices in method order, independent of whether the blocks are
+    // processed in parallel
+    const std::size_t firstNewLocalIndex = method.getLocalIndexLimit();
+    const std::size_t minParallelBlocks = config.additionalOptions.minParallelBlocks;
+    bool changedMethod = false;
+    if(minParallelBlocks == 0 || method.size() < std::max(minParallelBlocks, std::size_t{2}) ||
+        ThreadPool::getInstance().getNumThreads() < 2)
+    {
+        for(BasicBlock& block : method)
+            changedMethod = blockPass(module, method, block, config) || changedMethod;
+        method.reindexLocals(firstNewLocalIndex);
+        return changedMethod;
+    }
+
+    auto levels = groupIndependentBlocks(method);
+    CPPLOG_LAZY(logging::Level::DEBUG,
+        log << "Running block-local pass '" << name << "' for " << method.size() << " basic blocks in "
+            << levels.size() << " independent steps" << logging::endl);
+    std::atomic<bool> changedAnyBlock{false};
+    const std::function<void(BasicBlock* const&)> runForBlock = [&](BasicBlock* const& block) {
+        if(blockPass(module, method, *block, config))
+            changedAnyBlock = true;
+    };
+    for(const auto& level : levels)
+    {
+        if(level.size() < std::max(minParallelBlocks, std::size_t{2}))
+        {
+            // not worth the overhead of scheduling tasks
+            for(BasicBlock* block : level)
+                runForBlock(block);
+        }
+        else
+            BackgroundWorker::scheduleAll<BasicBlock*, FastAccessList<BasicBlock*>>(level, runForBlock, name);
+    }
+    method.reindexLocals(firstNewLocalIndex);
+    return changedAnyBlock;
+}
+
+bool OptimizationPass::isBlockLocal() const
+{
+    return static_cast<bool>(blockPass);
 }
 
 OptimizationStep::OptimizationStep(const std::string& name, const Step& step) : name(name), step(step) {}
@@ -58,41 +162,207 @@ static const std::vector<OptimizationStep> SINGLE_STEPS = {
     // removes calls to SFU registers with constant input
     OptimizationStep("RewriteConstantSFU", rewriteConstantSFUCall)};
 
-static bool runSingleSteps(const Module& module, Method& method, const Configuration& config)
+using InstructionSet = FastSet<const intermediate::IntermediateInstruction*>;
+
+/*
+ * Calculates a hash over everything the single steps look at when processing the instruction at the given position:
+ * the instruction itself, its predecessor within the block (for the steps combining neighboring instructions), the
+ * single writers of the locals read (for the steps pre-calculating the inputs) and the number of readers of the output.
+ */
+static std::size_t calculateSignature(InstructionWalker it)
 {
-    logging::logLazy(logging::Level::DEBUG, [&](std::wostream& log) {
-        log << "Running steps: ";
-        for(const OptimizationStep& step : SINGLE_STEPS)
-            log << step.name << ", ";
-        log << logging::endl;
+    const intermediate::IntermediateInstruction* inst = it.get();
+    std::size_t signature = typeid(*inst).hash_code();
+    const auto combine = [&signature](std::size_t value) {
+        signature ^= value + 0x9e3779b9 + (signature << 6) + (signature >> 2);
+    };
+    if(auto op = dynamic_cast<const intermediate::Operation*>(inst))
+        combine(std::hash<const void*>{}(op->op.name));
+    if(auto& output = inst->getOutput())
+    {
+        combine(std::hash<Value>{}(output.value()));
+        // some steps only apply to values with a single reader
+        if(auto local = output->checkLocal())
+            combine(local->countUsers(LocalUse::Type::READER));
+    }
+    for(const Value& arg : inst->getArguments())
+    {
+        combine(std::hash<Value>{}(arg));
+        if(auto local = arg.checkLocal())
+            combine(std::hash<const void*>{}(local->getSingleWriter()));
+    }
+    combine(inst->signal.value);
+    combine(inst->unpackMode.value);
+    combine(inst->packMode.value);
+    combine(inst->conditional.value);
+    combine(static_cast<std::size_t>(inst->setFlags));
+    combine(static_cast<std::size_t>(inst->decoration));
+    combine(std::hash<const void*>{}(it.isStartOfBlock() ? nullptr : it.copy().previousInBlock().get()));
+    // zero marks instructions to be processed
+    return signature == 0 ? 1 : signature;
+}
+
+/*
+ * Queues all instructions accessing the given locals, as well as the instructions around the given position.
+ *
+ * The queued instructions of the current block are added to the worklist, all queued instructions are marked to be
+ * processed by the next run of the single steps, since the instructions of other blocks are not processed by this run
+ * anymore.
+ */
+static void addToWorklist(
+    InstructionWalker it, const FastAccessList<const Local*>& accessedLocals, InstructionSet& worklist)
+{
+    const auto queue = [&worklist](const intermediate::IntermediateInstruction* inst) {
+        if(inst == nullptr)
+            return;
+        inst->optimizationSignature = 0;
+        worklist.insert(inst);
+    };
+    for(const Local* local : accessedLocals)
+        local->forUsers(LocalUse::Type::BOTH, queue);
+    // some steps combine neighboring instructions, so re-visit them too
+    if(!it.isStartOfBlock())
+        queue(it.copy().previousInBlock().get());
+    for(unsigned i = 0; i < 2 && !it.isEndOfBlock(); ++i, it.nextInBlock())
+        queue(it.get());
+}
+
+static void collectAccessedLocals(InstructionWalker it, FastAccessList<const Local*>& accessedLocals)
+{
+    accessedLocals.clear();
+    if(it.isEndOfBlock() || !it.has())
+        return;
+    it->forUsedLocals([&accessedLocals](const Local* local, LocalUse::Type type) {
+        if(local->type != TYPE_LABEL)
+            accessedLocals.push_back(local);
     });
+}
 
-    // since an optimization-step can be run on the result of the previous step,
-    // we can't just pass the resulting iterator (pointing behind the optimization result) into the next
-    // optimization-step  but since lists do not reallocate elements at inserting/removing, we can re-use the previous
-    // iterator
-    auto it = method.walkAllInstructions();
-    // this construct with previous iterator is required, because the iterator could be invalidated (if the underlying
-    // node is removed)
-    auto prevIt = it;
-    while(!it.isEndOfMethod())
+/*
+ * Runs all single steps for the instruction at the given position, queuing the instructions affected by any change
+ *
+ * Returns whether any step changed the instructions
+ */
+static bool runSingleStepsForInstruction(const Module& module, Method& method, BasicBlock& block,
+    const Configuration& config, InstructionWalker& it, const InstructionWalker& prevIt, InstructionSet& worklist)
+{
+    bool changedInstructions = false;
+    FastAccessList<const Local*> accessedLocals;
+    collectAccessedLocals(it, accessedLocals);
+    for(const OptimizationStep& step : SINGLE_STEPS)
     {
-        for(const OptimizationStep& step : SINGLE_STEPS)
+        PROFILE_START_DYNAMIC(step.name);
+        const auto instruction = it.isEndOfBlock() ? nullptr : it.get();
+        const auto numInstructions = block.size();
+        auto newIt = step(module, method, it, config);
+        // we can't just test newIt == it here, since if we replace the content of the iterator instead of deleting
+        // it, the iterators are still the same, even if we emplace instructions before
+        bool movedIterator = newIt != it || (!newIt.isStartOfBlock() && newIt.copy().previousInBlock() != prevIt);
+        if(movedIterator || newIt.isStartOfBlock())
+            it = prevIt;
+        if(movedIterator || numInstructions != block.size() || (it.isEndOfBlock() ? nullptr : it.get()) != instruction)
         {
-            PROFILE_START_DYNAMIC(step.name);
-            auto newIt = step(module, method, it, config);
-            // we can't just test newIt == it here, since if we replace the content of the iterator instead of deleting
-            // it, the iterators are still the same, even if we emplace instructions before
-            if(newIt.copy().previousInMethod() != prevIt || newIt != it)
-                it = prevIt;
-            PROFILE_END_DYNAMIC(step.name);
+            // the instructions accessing the same locals as the changed instruction (its users and the instructions
+            // calculating its inputs) might now also be optimized
+            addToWorklist(it, accessedLocals, worklist);
+            collectAccessedLocals(it, accessedLocals);
+            changedInstructions = true;
         }
-        it.nextInMethod();
-        prevIt = it.copy().previousInMethod();
+        PROFILE_END_DYNAMIC(step.name);
     }
+    return changedInstructions;
+}
 
-    // XXX
-    return true;
+/*
+ * Runs the single steps over all instructions of the block marked to be processed (all instructions in the first run)
+ * and afterwards re-visits only the instructions affected by any change until no more changes are made.
+ *
+ * Since the instructions behind any change are re-visited within the same iteration, additional iterations are only
+ * required for instructions in front of a changed instruction (e.g. the instruction calculating its inputs).
+ */
+static bool runSingleStepsForBlock(
+    const Module& module, Method& method, BasicBlock& block, const Configuration& config)
+{
+    bool changedBlock = false;
+    std::size_t numVisited = 0;
+    std::size_t numRevisited = 0;
+    InstructionSet worklist;
+    bool isFirstIteration = true;
+    unsigned iterationsLeft = std::max(1u, config.additionalOptions.maxOptimizationIterations);
+    for(; iterationsLeft > 0 && (isFirstIteration || !worklist.empty()); --iterationsLeft, isFirstIteration = false)
+    {
+        // since an optimization-step can be run on the result of the previous step,
+        // we can't just pass the resulting iterator (pointing behind the optimization result) into the next
+        // optimization-step  but since lists do not reallocate elements at inserting/removing, we can re-use the
+        // previous iterator
+        auto it = block.walk();
+        // this construct with previous iterator is required, because the iterator could be invalidated (if the
+        // underlying node is removed)
+        auto prevIt = it;
+        while(!it.isEndOfBlock())
+        {
+            // in the first iteration, all marked instructions are processed, afterwards only the queued ones
+            bool isQueued = worklist.erase(it.get()) != 0;
+            if((isFirstIteration && (!it.has() || it->optimizationSignature == 0)) || isQueued)
+            {
+                ++numVisited;
+                numRevisited += isFirstIteration ? 0 : 1;
+                changedBlock =
+                    runSingleStepsForInstruction(module, method, block, config, it, prevIt, worklist) || changedBlock;
+            }
+            it.nextInBlock();
+            prevIt = it.copy().previousInBlock();
+        }
+    }
+
+    // remember the state of all instructions to only process the instructions changed until the next run
+    for(auto it = block.walk(); !it.isEndOfBlock(); it.nextInBlock())
+    {
+        if(it.has())
+            it->optimizationSignature = calculateSignature(it);
+    }
+
+    if(numRevisited != 0)
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Re-visited " << numRevisited << " instructions in block " << block.getLabel()->to_string()
+                << logging::endl);
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_OPTIMIZATION + 9000, "SingleSteps re-visited instructions", numRevisited);
+    telemetry::addToCounter(config, method, "SingleSteps visited instructions", numVisited);
+    telemetry::addToCounter(config, method, "SingleSteps re-visited instructions", numRevisited);
+    return changedBlock;
+}
+
+static const OptimizationPass SINGLE_STEPS_FOR_BLOCKS("SingleSteps", "single-steps", runSingleStepsForBlock,
+    "runs all the single-step optimizations for a single basic block", OptimizationType::REPEAT);
+
+/*
+ * Runs the single steps only for the instructions changed since the last run (e.g. by other optimization passes) and
+ * the instructions affected by these changes.
+ *
+ * In the first run, all instructions are processed.
+ */
+static bool runSingleSteps(const Module& module, Method& method, const Configuration& config)
+{
+    FastAccessList<InstructionWalker> changedInstructions;
+    for(BasicBlock& block : method)
+    {
+        for(auto it = block.walk(); !it.isEndOfBlock(); it.nextInBlock())
+        {
+            if(it.has() && it->optimizationSignature != 0 && it->optimizationSignature != calculateSignature(it))
+                changedInstructions.push_back(it);
+        }
+    }
+    InstructionSet queuedInstructions;
+    FastAccessList<const Local*> accessedLocals;
+    for(const InstructionWalker& it : changedInstructions)
+    {
+        collectAccessedLocals(it, accessedLocals);
+        addToWorklist(it, accessedLocals, queuedInstructions);
+    }
+    CPPLOG_LAZY(logging::Level::DEBUG,
+        log << "Running single steps for " << changedInstructions.size()
+            << " instructions changed since the last run and their dependent instructions" << logging::endl);
+    return SINGLE_STEPS_FOR_BLOCKS(module, method, config);
 }
 
 static void addToPasses(const OptimizationPass& pass, std::vector<const OptimizationPass*>& initialPasses,
@@ -117,21 +387,35 @@ static void addToPasses(const OptimizationPass& pass, std::vector<const Optimiza
 Optimizer::Optimizer(const Configuration& config) : config(config)
 {
     auto enabledPasses = getPasses(config.optimizationLevel);
+    auto isDisabled = [&](const std::string& passName) -> bool {
+        return config.additionalDisabledOptimizations.find(passName) != config.additionalDisabledOptimizations.end();
+    };
+    auto isAdditionallyEnabled = [&](const std::string& passName) -> bool {
+        return config.additionalEnabledOptimizations.find(passName) != config.additionalEnabledOptimizations.end();
+    };
+    // the instruction scheduler already fills the delays and combines independent instructions, so the old passes
+    // doing the same are only run by default if the scheduler is disabled. Otherwise they would undo the scheduling.
+    const bool schedulesInstructions = !isDisabled("schedule-instructions") &&
+        (isAdditionallyEnabled("schedule-instructions") ||
+            enabledPasses.find("schedule-instructions") != enabledPasses.end());
+    if(schedulesInstructions)
+    {
+        enabledPasses.erase("reorder");
+        enabledPasses.erase("combine");
+    }
     for(const OptimizationPass& pass : ALL_PASSES)
     {
-        if(config.additionalDisabledOptimizations.find(pass.parameterName) !=
-            config.additionalDisabledOptimizations.end())
+        if(isDisabled(pass.parameterName))
             continue;
-        if(config.additionalEnabledOptimizations.find(pass.parameterName) !=
-            config.additionalEnabledOptimizations.end())
+        if(isAdditionallyEnabled(pass.parameterName))
             addToPasses(pass, initialPasses, repeatingPasses, finalPasses);
-        if(enabledPasses.find(pass.parameterName) != enabledPasses.end())
+        else if(enabledPasses.find(pass.parameterName) != enabledPasses.end())
             addToPasses(pass, initialPasses, repeatingPasses, finalPasses);
     }
 }
 
-static bool runPass(
-    const OptimizationPass& pass, std::size_t index, const Module& module, Method& method, const Configuration& config)
+static bool runPass(const OptimizationPass& pass, std::size_t index, const Module& module, Method& method,
+    const Configuration& config, unsigned iteration = 0)
 {
     logging::logLazy(logging::Level::DEBUG, [&]() {
         logging::debug() << logging::endl;
@@ -139,7 +423,9 @@ static bool runPass(
     });
     PROFILE_COUNTER(vc4c::profiler::COUNTER_OPTIMIZATION + index, pass.name + " (before)", method.countInstructions());
     PROFILE_START_DYNAMIC(pass.name);
+    telemetry::PassMeasurement measurement(config, method, "optimization", pass.name, iteration);
     bool changedMethod = (pass)(module, method, config);
+    measurement.finish(method);
     PROFILE_END_DYNAMIC(pass.name);
     PROFILE_COUNTER_WITH_PREV(vc4c::profiler::COUNTER_OPTIMIZATION + index + 10, pass.name + " (after)",
         method.countInstructions(), vc4c::profiler::COUNTER_OPTIMIZATION + index);
@@ -180,7 +466,8 @@ static void runOptimizationPasses(const Module& module, Method& method, const Co
                 continueLoop = false;
                 break;
             }
-            if(runPass(*pass, index, module, method, config))
+            if(runPass(*pass, index, module, method, config,
+                   config.additionalOptions.maxOptimizationIterations - iterationsLeft + 1))
                 lastChangingOptimization = pass;
             index += 100;
         }
@@ -223,12 +510,15 @@ static void runOptimizationPasses(const Module& module, Method& method, const Co
 
 void Optimizer::optimize(Module& module) const
 {
-    const auto f = [&](Method* kernelFunc) {
-        runOptimizationPasses(module, *kernelFunc, config, initialPasses, repeatingPasses, finalPasses);
-    };
+    const auto f = [&](Method* kernelFunc) { optimizeMethod(module, *kernelFunc); };
     BackgroundWorker::scheduleAll<Method*>(module.getKernels(), f, "Optimizer");
 }
 
+void Optimizer::optimizeMethod(const Module& module, Method& method) const
+{
+    runOptimizationPasses(module, method, config, initialPasses, repeatingPasses, finalPasses);
+}
+
 const std::vector<OptimizationPass> Optimizer::ALL_PASSES = {
     /*
      * The first optimizations run modify the control-flow of the method.
@@ -248,7 +538,8 @@ const std::vector<OptimizationPass> Optimizer::ALL_PASSES = {
     OptimizationPass(
         "VectorizeLoops", "vectorize-loops", vectorizeLoops, "vectorizes loops (WIP)", OptimizationType::INITIAL),
     OptimizationPass("SingleSteps", "single-steps", runSingleSteps,
-        "runs all the single-step optimizations. Combining them results in fewer iterations over the instructions",
+        "runs all the single-step optimizations. Combining them results in fewer iterations over the instructions, "
+        "afterwards (and in later iterations) only the instructions affected by changes are re-visited",
         OptimizationType::REPEAT),
     OptimizationPass("CombineRotations", "combine-rotations", combineVectorRotations,
         "combines duplicate vector rotations, e.g. introduced by vector-shuffle into a single rotation",
@@ -274,6 +565,10 @@ const std::vector<OptimizationPass> Optimizer::ALL_PASSES = {
     // XXX not enabled with any optimization level for now
     OptimizationPass("CompressWorkGroupInfo", "compress-work-group-info", compressWorkGroupLocals,
         "compresses work-group info into single local", OptimizationType::FINAL),
+    OptimizationPass("OptimizeLiveRanges", "optimize-live-ranges", optimizeLiveRanges,
+        "coalesces move-connected locals with non-interfering live ranges and splits the live ranges of locals read "
+        "within loops at the loop entry to lower the register pressure",
+        OptimizationType::FINAL),
     OptimizationPass("SplitReadAfterWrites", "split-read-write", splitReadAfterWrites,
         "splits read-after-writes (except if the local is used only very locally), so the reordering and "
         "register-allocation have an easier job",
@@ -285,8 +580,13 @@ const std::vector<OptimizationPass> Optimizer::ALL_PASSES = {
     OptimizationPass("CacheAcrossWorkGroup", "work-group-cache", cacheWorkGroupDMAAccess,
         "finds memory access across the work-group which can be cached in VPM to combine the DMA operation (WIP)",
         OptimizationType::FINAL),
+    OptimizationPass("PipelineTMULoads", "pipeline-tmu-loads", pipelineTMULoads,
+        "issues the TMU loads of the next loop iteration before loading the result of the current iteration to hide "
+        "the memory latency",
+        OptimizationType::FINAL),
     OptimizationPass("InstructionScheduler", "schedule-instructions", reorderInstructions,
-        "schedule instructions according to their dependencies within basic blocks (WIP, slow)",
+        "schedules instructions within basic blocks along their critical paths to hide the latencies of the SFU, "
+        "TMU and VPM/DMA accesses and to reduce the number of NOPs inserted",
         OptimizationType::FINAL),
     OptimizationPass("ReorderInstructions", "reorder", reorderWithinBasicBlocks,
         "re-order instructions to eliminate more NOPs and stall cycles", OptimizationType::FINAL),
@@ -301,7 +601,7 @@ std::set<std::string> Optimizer::getPasses(OptimizationLevel level)
     case OptimizationLevel::FULL:
         passes.emplace("vectorize-loops");
         passes.emplace("extract-loads-from-loops");
-        passes.emplace("schedule-instructions");
+        passes.emplace("pipeline-tmu-loads");
         passes.emplace("work-group-cache");
         passes.emplace("eliminate-common-subexpressions");
         FALL_THROUGH
@@ -312,6 +612,8 @@ std::set<std::string> Optimizer::getPasses(OptimizationLevel level)
         passes.emplace("eliminate-bit-operations");
         passes.emplace("copy-propagation");
         passes.emplace("combine-loads");
+        passes.emplace("optimize-live-ranges");
+        passes.emplace("schedule-instructions");
         FALL_THROUGH
     case OptimizationLevel::BASIC:
         passes.emplace("reorder-blocks");
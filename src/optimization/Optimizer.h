@@ -16,6 +16,7 @@
 
 namespace vc4c
 {
+    class BasicBlock;
     class Method;
     class Module;
     class InstructionWalker;
@@ -43,7 +44,10 @@ namespace vc4c
         };
 
         /*
-         * An OptimizationPass usually walks over all instructions within a single method
+         * An OptimizationPass usually walks over all instructions within a single method.
+         *
+         * A block-local pass only looks at a single basic block per invocation and is executed for all basic blocks of
+         * the method. Basic blocks which do not depend on each other are processed in parallel.
          */
         struct OptimizationPass
         {
@@ -54,12 +58,27 @@ namespace vc4c
              * thread-safe
              */
             using Pass = std::function<bool(const Module&, Method&, const Configuration&)>;
+            /*
+             * NOTE: Block-local optimizations are run in parallel for independent basic blocks of the same method.
+             * A block-local optimization may only modify the instructions of the given basic block and only inspect
+             * instructions of other basic blocks which access locals accessed in the given block (e.g. via
+             * Local#getSingleWriter()). Blocks accessing the same local are never processed concurrently. It must not
+             * access the CFG or modify the method in any other way than creating new locals.
+             */
+            using BlockPass = std::function<bool(const Module&, Method&, BasicBlock&, const Configuration&)>;
 
             OptimizationPass(const std::string& name, const std::string& parameterName, const Pass& pass,
                 const std::string& description, OptimizationType type);
+            OptimizationPass(const std::string& name, const std::string& parameterName, const BlockPass& pass,
+                const std::string& description, OptimizationType type);
 
             bool operator()(const Module& module, Method& method, const Configuration& config) const;
 
+            /*
+             * Whether this pass only processes a single basic block at a time
+             */
+            bool isBlockLocal() const;
+
             const std::string name;
             const std::string parameterName;
             const std::string description;
@@ -67,6 +86,7 @@ namespace vc4c
 
         private:
             const Pass pass;
+            const BlockPass blockPass;
         };
 
         /*
@@ -101,6 +121,11 @@ namespace vc4c
 
             void optimize(Module& module) const;
 
+            /*
+             * Runs all enabled optimization passes on the given method only
+             */
+            void optimizeMethod(const Module& module, Method& method) const;
+
             /*
              * The complete list of all optimization passes available to be used
              *
@@ -859,26 +859,7 @@ const VPMArea* VPM::addArea(const Local* local, DataType elementType, bool isSta
     if(area != nullptr && area->numRows >= numRows)
         return area;
 
-    // find free consecutive space in VPM with the requested size and return it
-    // to keep the remaining space free for scratch, we start allocating space from the end of the VPM
-    Optional<unsigned> rowOffset;
-    uint8_t numFreeRows = 0;
-    for(auto i = areas.size() - 1; i > 0 /* index 0 is always reserved for scratch */; --i)
-    {
-        if(areas[i])
-        {
-            // row is already reserved
-            numFreeRows = 0;
-            continue;
-        }
-        else
-            ++numFreeRows;
-        if(numFreeRows >= numRows)
-        {
-            rowOffset = static_cast<unsigned>(i);
-            break;
-        }
-    }
+    Optional<unsigned> rowOffset = findFreeRows(numRows);
     if(!rowOffset)
         // no more (big enough) free space on VPM
         return nullptr;
@@ -896,6 +877,34 @@ const VPMArea* VPM::addArea(const Local* local, DataType elementType, bool isSta
     return ptr.get();
 }
 
+const VPMArea* VPM::addSpillArea(unsigned numRegisters)
+{
+    // every QPU needs its own copy of the spilled registers and every register takes up a whole row
+    const unsigned rowsPerRegister = NUM_QPUS;
+    const unsigned maxNumRegisters = std::min(VPM_NUM_ROWS, maximumVPMSize / (VPM_NUM_COLUMNS * VPM_WORD_WIDTH)) /
+        rowsPerRegister;
+    // only reserve the rows actually required, the remaining VPM can still be used for other purposes
+    for(numRegisters = std::min(numRegisters, maxNumRegisters); numRegisters > 0; --numRegisters)
+    {
+        const unsigned numRows = numRegisters * rowsPerRegister;
+        if(auto rowOffset = findFreeRows(numRows))
+        {
+            auto ptr = std::make_shared<VPMArea>(VPMArea{VPMUsage::REGISTER_SPILLING,
+                static_cast<uint8_t>(rowOffset.value()), static_cast<uint8_t>(numRows), nullptr});
+            for(auto i = rowOffset.value(); i < (rowOffset.value() + numRows); ++i)
+                areas[i] = ptr;
+            CPPLOG_LAZY(logging::Level::DEBUG,
+                log << "Allocating " << numRows << " rows (per 64 byte) of VPM cache starting at row "
+                    << rowOffset.value() << " for spilling " << numRegisters << " registers per QPU"
+                    << logging::endl);
+            PROFILE_COUNTER(vc4c::profiler::COUNTER_GENERAL + 91, "VPM spill size",
+                numRows * VPM_NUM_COLUMNS * VPM_WORD_WIDTH);
+            return ptr.get();
+        }
+    }
+    return nullptr;
+}
+
 unsigned VPM::getMaxCacheVectors(DataType type, bool writeAccess) const
 {
     unsigned numFreeRows = 0;
@@ -933,6 +942,71 @@ void VPM::updateScratchSize(unsigned char requestedRows)
     }
 }
 
+/*
+ * The rows of the register-spilling area are interleaved for all QPUs, so the row of a spilled register is:
+ * first row of area + slot * number of QPUs + QPU number
+ *
+ * This way, the per-QPU part of the address can be added without any multiplication.
+ */
+static uint32_t toSpillSlotAddressOffset(const VPMArea& area, unsigned slot)
+{
+    if(area.usageType != VPMUsage::REGISTER_SPILLING)
+        throw CompilationError(CompilationStep::GENERAL, "Cannot spill registers into VPM area", area.to_string());
+    if((slot + 1) * NUM_QPUS > area.numRows)
+        throw CompilationError(
+            CompilationStep::GENERAL, "Register spilling slot exceeds VPM area", std::to_string(slot));
+    return slot * NUM_QPUS;
+}
+
+InstructionWalker VPM::insertSpillRegister(
+    Method& method, InstructionWalker it, const Value& src, const VPMArea& area, unsigned slot)
+{
+    // registers are always stored as a whole, independent of the actual type of the local
+    const VPWSetup genericSetup(area.toWriteSetup(area.getElementType()));
+    const Value setup = method.addNewLocal(TYPE_INT32, "%spill_setup");
+    it.emplace(new LoadImmediate(setup, Literal(genericSetup.value + toSpillSlotAddressOffset(area, slot))));
+    it.nextInBlock();
+    assign(it, VPM_OUT_SETUP_REGISTER) =
+        (setup + Value(REG_QPU_NUMBER, TYPE_INT8), InstructionDecorations::VPM_WRITE_CONFIGURATION);
+    assign(it, VPM_IO_REGISTER) = src;
+    return it;
+}
+
+InstructionWalker VPM::insertFillRegister(
+    Method& method, InstructionWalker it, const Value& dest, const VPMArea& area, unsigned slot)
+{
+    const VPRSetup genericSetup(area.toReadSetup(area.getElementType()));
+    const Value setup = method.addNewLocal(TYPE_INT32, "%spill_setup");
+    it.emplace(new LoadImmediate(setup, Literal(genericSetup.value + toSpillSlotAddressOffset(area, slot))));
+    it.nextInBlock();
+    assign(it, VPM_IN_SETUP_REGISTER) =
+        (setup + Value(REG_QPU_NUMBER, TYPE_INT8), InstructionDecorations::VPM_READ_CONFIGURATION);
+    assign(it, dest) = VPM_IO_REGISTER;
+    return it;
+}
+
+Optional<unsigned> VPM::findFreeRows(unsigned numRows) const
+{
+    // find free consecutive space in VPM with the requested size and return it
+    // to keep the remaining space free for scratch, we start allocating space from the end of the VPM
+    unsigned numFreeRows = 0;
+    for(auto i = areas.size() - 1; i > 0 /* index 0 is always reserved for scratch */; --i)
+    {
+        if(areas[i])
+        {
+            // row is already reserved
+            numFreeRows = 0;
+            continue;
+        }
+        else
+            ++numFreeRows;
+        if(numFreeRows >= numRows)
+            return static_cast<unsigned>(i);
+    }
+    // no more (big enough) free space on VPM
+    return {};
+}
+
 InstructionWalker VPM::insertLockMutex(InstructionWalker it, bool useMutex) const
 {
     if(useMutex)
@@ -770,6 +770,14 @@ namespace vc4c
             const VPMArea* findArea(const Local* local);
             const VPMArea* addArea(
                 const Local* local, DataType elementType, bool isStackArea, unsigned numStacks = NUM_QPUS);
+            /*
+             * Reserves a new area for spilling the given number of registers per QPU.
+             *
+             * If there is not enough VPM left for all registers, the largest area which fits is reserved, so the
+             * number of registers actually available is the number of rows of the area divided by the number of QPUs.
+             * Returns nullptr, if there is not enough VPM left to spill a single register per QPU.
+             */
+            const VPMArea* addSpillArea(unsigned numRegisters);
 
             /*
              * The maximum number of vectors (of the given type) which can be cached in this VPM.
@@ -793,6 +801,23 @@ namespace vc4c
             NODISCARD InstructionWalker insertWriteVPM(Method& method, InstructionWalker it, const Value& src,
                 const VPMArea* area = nullptr, bool useMutex = true, const Value& inAreaOffset = INT_ZERO);
 
+            /*
+             * Inserts a write of the given register into the given slot of the register-spilling area reserved for
+             * the QPU executing the code.
+             *
+             * NOTE: This does not lock the VPM mutex, since every QPU uses its own part of the area!
+             */
+            NODISCARD InstructionWalker insertSpillRegister(
+                Method& method, InstructionWalker it, const Value& src, const VPMArea& area, unsigned slot);
+            /*
+             * Inserts a read of the given slot of the register-spilling area reserved for the QPU executing the code
+             * into the given register.
+             *
+             * NOTE: This does not lock the VPM mutex, since every QPU uses its own part of the area!
+             */
+            NODISCARD InstructionWalker insertFillRegister(
+                Method& method, InstructionWalker it, const Value& dest, const VPMArea& area, unsigned slot);
+
             /*
              * Inserts a read from RAM into VPM via DMA
              */
@@ -833,6 +858,7 @@ namespace vc4c
             const unsigned maximumVPMSize;
             std::vector<std::shared_ptr<VPMArea>> areas;
 
+            Optional<unsigned> findFreeRows(unsigned numRows) const;
             InstructionWalker insertLockMutex(InstructionWalker it, bool useMutex) const;
             InstructionWalker insertUnlockMutex(InstructionWalker it, bool useMutex) const;
         };
@@ -7,23 +7,31 @@
 #include "Emulator.h"
 
 #include "../Profiler.h"
+#include "../ThreadPool.h"
 #include "../asm/ALUInstruction.h"
 #include "../asm/BranchInstruction.h"
 #include "../asm/Instruction.h"
 #include "../asm/KernelInfo.h"
 #include "../asm/LoadInstruction.h"
 #include "../asm/SemaphoreInstruction.h"
+#include "../intrinsics/Operators.h"
 #include "../periphery/VPM.h"
 #include "CompilationError.h"
 #include "Compiler.h"
 
 #include "log.h"
 
+#include <cerrno>
 #include <cmath>
 #include <cstring>
+#include <fcntl.h>
 #include <fstream>
 #include <iomanip>
 #include <numeric>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
 
 using namespace vc4c;
 using namespace vc4c::tools;
@@ -50,6 +58,18 @@ tools::Word EmulationData::calcNumWorkItems() const
 
 tools::Word* Memory::getWordAddress(MemoryAddress address)
 {
+    if(auto paged = VariantNamespace::get_if<PagedMemory>(&data))
+    {
+        if(address >= paged->endAddress)
+        {
+            logging::warn() << "Buffer: [0, " << std::hex << paged->endAddress << std::dec << ")" << logging::endl;
+            throw CompilationError(CompilationStep::GENERAL,
+                "Memory address is out of bounds, consider using larger buffer", std::to_string(address));
+        }
+        // all pages below the end address are mapped
+        return reinterpret_cast<Word*>(
+            paged->pageTable[address >> PAGE_BITS] + (address & ((1u << PAGE_BITS) - sizeof(Word))));
+    }
     if(auto direct = VariantNamespace::get_if<DirectBuffer>(&data))
     {
         if(address >= direct->size() * sizeof(Word))
@@ -89,6 +109,18 @@ tools::Word* Memory::getWordAddress(MemoryAddress address)
 
 const tools::Word* Memory::getWordAddress(MemoryAddress address) const
 {
+    if(auto paged = VariantNamespace::get_if<PagedMemory>(&data))
+    {
+        if(address >= paged->endAddress)
+        {
+            logging::warn() << "Buffer: [0, " << std::hex << paged->endAddress << std::dec << ")" << logging::endl;
+            throw CompilationError(CompilationStep::GENERAL,
+                "Memory address is out of bounds, consider using larger buffer", std::to_string(address));
+        }
+        // all pages below the end address are mapped
+        return reinterpret_cast<const Word*>(
+            paged->pageTable[address >> PAGE_BITS] + (address & ((1u << PAGE_BITS) - sizeof(Word))));
+    }
     if(auto direct = VariantNamespace::get_if<DirectBuffer>(&data))
     {
         if(address >= direct->size() * sizeof(Word))
@@ -143,6 +175,8 @@ MemoryAddress Memory::incrementAddress(MemoryAddress address, DataType typeSize)
 
 MemoryAddress Memory::getMaximumAddress() const
 {
+    if(auto paged = VariantNamespace::get_if<PagedMemory>(&data))
+        return paged->endAddress;
     if(auto direct = VariantNamespace::get_if<DirectBuffer>(&data))
         return static_cast<MemoryAddress>(direct->size() * sizeof(Word));
     return VariantNamespace::get<MappedBuffers>(data).rbegin()->first +
@@ -152,37 +186,130 @@ MemoryAddress Memory::getMaximumAddress() const
 void Memory::setUniforms(const std::vector<Word>& uniforms, MemoryAddress address)
 {
     PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 10, "setUniforms", 1);
-    std::size_t offset = address / sizeof(Word);
-    std::copy_n(uniforms.begin(), uniforms.size(), VariantNamespace::get<DirectBuffer>(data).begin() + offset);
+    if(VariantNamespace::get_if<MappedBuffers>(&data))
+        throw CompilationError(CompilationStep::GENERAL, "Cannot write UNIFORMs into mapped buffers");
+    // the UNIFORMs are written into a single (contiguous) buffer or mapped region
+    std::copy_n(uniforms.begin(), uniforms.size(), getWordAddress(address));
+    markModified(address, uniforms.size() * sizeof(Word));
+}
+
+MemoryAddress Memory::mapFile(const std::string& fileName, std::size_t minimumSize)
+{
+    bool isWritable = true;
+    // only create files with a given size, e.g. for output buffers
+    int fd = open(fileName.c_str(), minimumSize > 0 ? O_RDWR | O_CREAT : O_RDWR, 0644);
+    if(fd < 0 && (errno == EACCES || errno == EROFS) && minimumSize == 0)
+    {
+        // map read-only files copy-on-write, so the kernel can still modify its (private) copy
+        isWritable = false;
+        fd = open(fileName.c_str(), O_RDONLY);
+    }
+    if(fd < 0)
+        throw CompilationError(CompilationStep::GENERAL, "Failed to open file to map into memory",
+            fileName + ": " + std::strerror(errno));
+
+    struct stat fileStats;
+    if(fstat(fd, &fileStats) != 0)
+    {
+        close(fd);
+        throw CompilationError(
+            CompilationStep::GENERAL, "Failed to query size of file to map", fileName + ": " + std::strerror(errno));
+    }
+    auto size = static_cast<std::size_t>(fileStats.st_size);
+    if(size < minimumSize)
+    {
+        if(ftruncate(fd, static_cast<off_t>(minimumSize)) != 0)
+        {
+            close(fd);
+            throw CompilationError(
+                CompilationStep::GENERAL, "Failed to enlarge file to map", fileName + ": " + std::strerror(errno));
+        }
+        size = minimumSize;
+    }
+    if(size == 0)
+    {
+        close(fd);
+        throw CompilationError(CompilationStep::GENERAL, "Cannot map empty file into memory", fileName);
+    }
+
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, isWritable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after closing the file
+    close(fd);
+    if(ptr == MAP_FAILED)
+        throw CompilationError(
+            CompilationStep::GENERAL, "Failed to map file into memory", fileName + ": " + std::strerror(errno));
+    CPPLOG_LAZY(logging::Level::DEBUG,
+        log << "Mapping file '" << fileName << "' with " << size << " bytes" << (isWritable ? "" : " (read-only)")
+            << logging::endl);
+    return addMapping(std::shared_ptr<uint8_t>(static_cast<uint8_t*>(ptr), [size](uint8_t* p) { munmap(p, size); }),
+        size);
+}
+
+MemoryAddress Memory::mapAnonymous(std::size_t size)
+{
+    // the pages are only allocated (and zeroed) by the host on first access
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ptr == MAP_FAILED)
+        throw CompilationError(CompilationStep::GENERAL, "Failed to map anonymous memory", std::strerror(errno));
+    return addMapping(std::shared_ptr<uint8_t>(static_cast<uint8_t*>(ptr), [size](uint8_t* p) { munmap(p, size); }),
+        size);
+}
+
+MemoryAddress Memory::addMapping(std::shared_ptr<uint8_t>&& mapping, std::size_t size)
+{
+    auto paged = VariantNamespace::get_if<PagedMemory>(&data);
+    if(!paged)
+        throw CompilationError(CompilationStep::GENERAL, "Only the paged memory supports mapping regions");
+
+    // the host maps whole (at least 4 KB) pages, so the rest of the last page is accessible too
+    const std::size_t pageSize = std::size_t{1} << PAGE_BITS;
+    const std::size_t numPages = (size + pageSize - 1) / pageSize;
+    if(paged->endAddress + numPages * pageSize > std::numeric_limits<MemoryAddress>::max())
+        throw CompilationError(CompilationStep::GENERAL, "Mapped regions exceed the 32-bit emulated address space",
+            std::to_string(size));
+
+    const MemoryAddress address = paged->endAddress;
+    paged->pageTable.reserve(paged->pageTable.size() + numPages);
+    for(std::size_t i = 0; i < numPages; ++i)
+        paged->pageTable.emplace_back(mapping.get() + i * pageSize);
+    paged->mappings.emplace_back(std::move(mapping));
+    paged->endAddress += static_cast<MemoryAddress>(numPages * pageSize);
+    CPPLOG_LAZY(logging::Level::DEBUG,
+        log << "Mapped " << size << " bytes into emulated memory at 0x" << std::hex << address << std::dec
+            << logging::endl);
+    return address;
 }
 
 bool Mutex::isLocked() const
 {
+    std::lock_guard<std::mutex> lock(guard);
     return locked;
 }
 
-bool Mutex::lock(uint8_t qpu)
+bool Mutex::lock(const QPU& qpu)
 {
-    if(locked && lockOwner == qpu)
+    std::lock_guard<std::mutex> lock(guard);
+    if(locked && lockOwner == &qpu)
         // we need to check for duplicate read in same instruction (e.g. or -, mutex_acq, mutex_acq)
         throw CompilationError(CompilationStep::GENERAL, "Double locked mutex!");
-    if(locked && lockOwner != qpu)
+    if(locked && lockOwner != &qpu)
     {
         // locked by another QPU
         PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 30, "waitOnMutex", 1);
         return false;
     }
     locked = true;
-    lockOwner = qpu;
+    lockOwner = &qpu;
     PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 20, "lockMutex", 1);
     return true;
 }
 
-void Mutex::unlock(uint8_t qpu)
+void Mutex::unlock(const QPU& qpu)
 {
+    std::lock_guard<std::mutex> lock(guard);
     if(!locked)
         throw CompilationError(CompilationStep::GENERAL, "Freeing mutex not previously locked!");
-    if(lockOwner != qpu)
+    if(lockOwner != &qpu)
         throw CompilationError(CompilationStep::GENERAL, "Cannot free mutex locked by another QPU!");
     locked = false;
 }
@@ -257,17 +384,26 @@ void Registers::writeRegister(Register reg, const Value& val, std::bitset<16> el
     else if(reg.num == REG_UNIFORM_ADDRESS.num)
         qpu.uniforms.setUniformAddress(getActualValue(modifiedValue));
     else if(reg.num == REG_VPM_IO.num)
+    {
+        ++qpu.instrumentation[qpu.pc].numVPMAccesses;
         qpu.vpm.writeValue(getActualValue(modifiedValue));
+    }
     else if(reg == REG_VPM_IN_SETUP)
         qpu.vpm.setReadSetup(getActualValue(modifiedValue));
     else if(reg == REG_VPM_OUT_SETUP)
         qpu.vpm.setWriteSetup(getActualValue(modifiedValue));
     else if(reg == REG_VPM_DMA_LOAD_ADDR)
+    {
+        ++qpu.instrumentation[qpu.pc].numDMAAccesses;
         qpu.vpm.setDMAReadAddress(getActualValue(modifiedValue));
+    }
     else if(reg == REG_VPM_DMA_STORE_ADDR)
+    {
+        ++qpu.instrumentation[qpu.pc].numDMAAccesses;
         qpu.vpm.setDMAWriteAddress(getActualValue(modifiedValue));
+    }
     else if(reg.num == REG_MUTEX.num)
-        qpu.mutex.unlock(qpu.ID);
+        qpu.mutex.unlock(qpu);
     else if(reg.num == REG_SFU_RECIP.num)
         qpu.sfu.startRecip(getActualValue(modifiedValue));
     else if(reg.num == REG_SFU_RECIP_SQRT.num)
@@ -335,7 +471,10 @@ std::pair<Value, bool> Registers::readRegister(Register reg)
     if(reg.num == REG_VPM_IO.num)
     {
         if(readCache.find(REG_VPM_IO) == readCache.end())
+        {
+            ++qpu.instrumentation[qpu.pc].numVPMAccesses;
             setReadCache(REG_VPM_IO, qpu.vpm.readValue());
+        }
         // cannot optimize to use iterator here, since we modify the element in cache!
         return std::make_pair(readCache.at(REG_VPM_IO), true);
     }
@@ -346,7 +485,7 @@ std::pair<Value, bool> Registers::readRegister(Register reg)
     if(reg.num == REG_MUTEX.num)
     {
         if(readCache.find(REG_MUTEX) == readCache.end())
-            setReadCache(REG_MUTEX, qpu.mutex.lock(qpu.ID) ? BOOL_TRUE : BOOL_FALSE);
+            setReadCache(REG_MUTEX, qpu.mutex.lock(qpu) ? BOOL_TRUE : BOOL_FALSE);
         // cannot optimize to use iterator here, since we modify the element in cache!
         return std::make_pair(readCache.at(REG_MUTEX), readCache.at(REG_MUTEX).getLiteralValue()->isTrue());
     }
@@ -959,6 +1098,7 @@ void VPM::setDMAWriteAddress(Value&& val)
         memcpy(reinterpret_cast<uint8_t*>(memory.getWordAddress(address)) + address % sizeof(Word),
             reinterpret_cast<uint8_t*>(&cache.at(vpmBaseAddress.first).at(vpmBaseAddress.second)) + byteOffset,
             typeSize * sizes.second);
+        memory.markModified(address, typeSize * sizes.second);
         vpmBaseAddress.first += 1;
         // write stride is end-to-start, so add size of vector
         address += stride + (typeSize * sizes.second);
@@ -1112,112 +1252,24 @@ static ElementFlags generateImmediateFlags(Literal lit)
     return flags;
 }
 
-bool QPU::execute(std::vector<qpu_asm::Instruction>::const_iterator firstInstruction)
+bool QPU::execute(const DecodedProgram& program)
 {
-    const qpu_asm::Instruction* inst = &(*(firstInstruction + pc));
-    ++instrumentation[inst].numExecutions;
+    if(pc >= program.size())
+        throw CompilationError(
+            CompilationStep::GENERAL, "Program counter is outside of the emulated code", std::to_string(pc));
+    const DecodedInstruction& inst = program[pc];
+    currentInstruction = inst.instruction;
+    ++instrumentation[pc].numExecutions;
     CPPLOG_LAZY(logging::Level::INFO,
         log << "QPU " << static_cast<unsigned>(ID) << " (0x" << std::hex << pc << std::dec
-            << "): " << inst->toASMString() << logging::endl);
+            << "): " << inst.instruction->toASMString() << logging::endl);
     ProgramCounter nextPC = pc;
-    if(inst->getSig() == SIGNAL_END_PROGRAM)
+    if(inst.signal == SIGNAL_END_PROGRAM)
         // end program
         return false;
-    if(inst->getSig() == SIGNAL_NONE || executeSignal(inst->getSig()))
-    {
-        if(auto op = inst->as<qpu_asm::ALUInstruction>())
-        {
-            if(executeALU(op))
-                ++nextPC;
-            // otherwise the execution stalled and the PC stays the same
-        }
-        else if(auto br = inst->as<qpu_asm::BranchInstruction>())
-        {
-            if(isConditionMet(br->getBranchCondition()))
-            {
-                ++instrumentation[inst].numBranchTaken;
-                int32_t offset = 4 /* Branch starts at PC + 4 */ +
-                    static_cast<int32_t>(br->getImmediate() / sizeof(uint64_t)) /* immediate offset is in bytes */;
-                if(br->getAddRegister() == BranchReg::BRANCH_REG ||
-                    br->getBranchRelative() == BranchRel::BRANCH_ABSOLUTE)
-                    throw CompilationError(
-                        CompilationStep::GENERAL, "This kind of branch is not yet implemented", br->toASMString());
-                nextPC += offset;
-
-                // see Broadcom specification, page 34
-                registers.writeRegister(toRegister(br->getAddOut(), br->getWriteSwap() == WriteSwap::SWAP),
-                    Value(Literal(pc + 4), TYPE_INT32), std::bitset<16>(0xFFFF));
-                registers.writeRegister(toRegister(br->getMulOut(), br->getWriteSwap() == WriteSwap::DONT_SWAP),
-                    Value(Literal(pc + 4), TYPE_INT32), std::bitset<16>(0xFFFF));
-            }
-            else
-                // simply skip to next PC
-                ++nextPC;
-            PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 160, "branches taken",
-                isConditionMet(br->getBranchCondition()) ? 1 : 0);
-        }
-        else if(auto load = inst->as<qpu_asm::LoadInstruction>())
-        {
-            auto type = load->getType();
-            Value imm(Literal(load->getImmediateInt()), TYPE_INT32);
-            switch(type)
-            {
-            case OpLoad::LOAD_IMM_32:
-                if(load->getPack().hasEffect())
-                    PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 210, "values packed", 1);
-                imm = load->getPack()(imm, generateImmediateFlags(Literal(load->getImmediateInt()))).value();
-                break;
-            case OpLoad::LOAD_SIGNED:
-                imm = Value(ContainerValue(toLoadedValues(imm.getLiteralValue()->unsignedInt(),
-                                vc4c::intermediate::LoadType::PER_ELEMENT_SIGNED)),
-                    imm.type.toVectorType(16));
-                break;
-            case OpLoad::LOAD_UNSIGNED:
-                imm = Value(ContainerValue(toLoadedValues(imm.getLiteralValue()->unsignedInt(),
-                                vc4c::intermediate::LoadType::PER_ELEMENT_UNSIGNED)),
-                    imm.type.toVectorType(16));
-                break;
-            }
-
-            writeConditional(
-                toRegister(load->getAddOut(), load->getWriteSwap() == WriteSwap::SWAP), imm, load->getAddCondition());
-            writeConditional(toRegister(load->getMulOut(), load->getWriteSwap() == WriteSwap::DONT_SWAP), imm,
-                load->getMulCondition());
-            if(load->getSetFlag() == SetFlag::SET_FLAGS)
-                setFlags(imm, load->getAddCondition() != COND_NEVER ? load->getAddCondition() : load->getMulCondition(),
-                    generateImmediateFlags(Literal(load->getImmediateInt())));
-            ++nextPC;
-        }
-        else if(auto semaphore = inst->as<qpu_asm::SemaphoreInstruction>())
-        {
-            bool dontStall = true;
-            Value result = UNDEFINED_VALUE;
-            if(semaphore->getIncrementSemaphore())
-                std::tie(result, dontStall) = semaphores.increment(static_cast<uint8_t>(semaphore->getSemaphore()));
-            else
-                std::tie(result, dontStall) = semaphores.decrement(static_cast<uint8_t>(semaphore->getSemaphore()));
-            if(dontStall)
-            {
-                if(semaphore->getPack().hasEffect())
-                    PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 210, "values packed", 1);
-                result = semaphore->getPack()(result, {}).value();
-                writeConditional(toRegister(semaphore->getAddOut(), semaphore->getWriteSwap() == WriteSwap::SWAP),
-                    result, semaphore->getAddCondition());
-                writeConditional(toRegister(semaphore->getMulOut(), semaphore->getWriteSwap() == WriteSwap::DONT_SWAP),
-                    result, semaphore->getMulCondition());
-                if(semaphore->getSetFlag() == SetFlag::SET_FLAGS)
-                    setFlags(result,
-                        semaphore->getAddCondition() != COND_NEVER ? semaphore->getAddCondition() :
-                                                                     semaphore->getMulCondition(),
-                        {});
-                ++nextPC;
-            }
-            else
-                ++instrumentation[inst].numStalls;
-        }
-        else
-            throw CompilationError(CompilationStep::GENERAL, "Invalid assembler instruction", inst->toASMString());
-    }
+    if(inst.signal == SIGNAL_NONE || executeSignal(inst.signal))
+        nextPC = (this->*inst.handler)(inst);
+    // otherwise the execution stalled and the PC stays the same
 
     // clear cache for registers already read this instruction
     registers.clearReadCache();
@@ -1227,10 +1279,148 @@ bool QPU::execute(std::vector<qpu_asm::Instruction>::const_iterator firstInstruc
     return true;
 }
 
-const qpu_asm::Instruction* QPU::getCurrentInstruction(
-    std::vector<qpu_asm::Instruction>::const_iterator firstInstruction) const
+const qpu_asm::Instruction* QPU::getCurrentInstruction() const
+{
+    return currentInstruction;
+}
+
+DecodedInstruction QPU::decode(const qpu_asm::Instruction& inst, bool useNativeBackend)
+{
+    DecodedInstruction decoded;
+    decoded.instruction = &inst;
+    decoded.signal = inst.getSig();
+    decoded.addOut = toRegister(inst.getAddOut(), inst.getWriteSwap() == WriteSwap::SWAP);
+    decoded.mulOut = toRegister(inst.getMulOut(), inst.getWriteSwap() == WriteSwap::DONT_SWAP);
+
+    if(auto op = inst.as<qpu_asm::ALUInstruction>())
+    {
+        decoded.handler = useNativeBackend ? &QPU::executeNativeALU : &QPU::executeALU;
+        decoded.addCondition = op->getAddCondition();
+        decoded.mulCondition = op->getMulCondition();
+        decoded.setFlags = op->getSetFlag() == SetFlag::SET_FLAGS;
+        decoded.pack = op->getPack();
+        decoded.isMulResultPacked = op->getWriteSwap() == WriteSwap::SWAP;
+        decoded.addCode = &OpCode::toOpCode(op->getAddition(), false);
+        decoded.mulCode = &OpCode::toOpCode(op->getMultiplication(), true);
+        decoded.isAddExecuted = op->getAddCondition() != COND_NEVER && op->getAddition() != OP_NOP.opAdd;
+        decoded.isMulExecuted = op->getMulCondition() != COND_NEVER && op->getMultiplication() != OP_NOP.opMul;
+        decoded.areFlagsSetByMul = isFlagSetByMulALU(op->getAddition(), op->getMultiplication());
+        decoded.addMuxA = op->getAddMultiplexA();
+        decoded.addMuxB = op->getAddMultiplexB();
+        decoded.mulMuxA = op->getMulMultiplexA();
+        decoded.mulMuxB = op->getMulMultiplexB();
+        decoded.inputA = op->getInputA();
+        decoded.inputB = op->getInputB();
+        decoded.isInputBImmediate = op->getSig() == SIGNAL_ALU_IMMEDIATE;
+        decoded.unpack = op->getUnpack();
+    }
+    else if(auto br = inst.as<qpu_asm::BranchInstruction>())
+    {
+        decoded.handler = useNativeBackend ? &QPU::executeNativeBranch : &QPU::executeBranch;
+        decoded.branchCondition = br->getBranchCondition();
+        decoded.branchOffset = 4 /* Branch starts at PC + 4 */ +
+            static_cast<int32_t>(br->getImmediate() / sizeof(uint64_t)) /* immediate offset is in bytes */;
+        decoded.isSupportedBranch =
+            br->getAddRegister() != BranchReg::BRANCH_REG && br->getBranchRelative() != BranchRel::BRANCH_ABSOLUTE;
+    }
+    else if(auto load = inst.as<qpu_asm::LoadInstruction>())
+    {
+        decoded.handler = useNativeBackend ? &QPU::executeNativeLoad : &QPU::executeLoad;
+        decoded.addCondition = load->getAddCondition();
+        decoded.mulCondition = load->getMulCondition();
+        decoded.setFlags = load->getSetFlag() == SetFlag::SET_FLAGS;
+        decoded.pack = load->getPack();
+        decoded.loadType = load->getType();
+        decoded.immediate = load->getImmediateInt();
+    }
+    else if(auto semaphore = inst.as<qpu_asm::SemaphoreInstruction>())
+    {
+        decoded.handler = useNativeBackend ? &QPU::executeNativeSemaphore : &QPU::executeSemaphore;
+        decoded.addCondition = semaphore->getAddCondition();
+        decoded.mulCondition = semaphore->getMulCondition();
+        decoded.setFlags = semaphore->getSetFlag() == SetFlag::SET_FLAGS;
+        decoded.pack = semaphore->getPack();
+        decoded.immediate = static_cast<uint32_t>(semaphore->getSemaphore());
+        decoded.incrementSemaphore = semaphore->getIncrementSemaphore();
+    }
+    else
+        // only fail when the instruction is actually executed
+        decoded.handler = &QPU::executeInvalid;
+    return decoded;
+}
+
+ProgramCounter QPU::executeBranch(const DecodedInstruction& inst)
+{
+    const bool takeBranch = isConditionMet(inst.branchCondition);
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 160, "branches taken", takeBranch ? 1 : 0);
+    if(!takeBranch)
+        // simply skip to next PC
+        return pc + 1;
+    ++instrumentation[pc].numBranchTaken;
+    if(!inst.isSupportedBranch)
+        throw CompilationError(
+            CompilationStep::GENERAL, "This kind of branch is not yet implemented", inst.instruction->toASMString());
+
+    // see Broadcom specification, page 34
+    registers.writeRegister(inst.addOut, Value(Literal(pc + 4), TYPE_INT32), std::bitset<16>(0xFFFF));
+    registers.writeRegister(inst.mulOut, Value(Literal(pc + 4), TYPE_INT32), std::bitset<16>(0xFFFF));
+    return pc + static_cast<ProgramCounter>(inst.branchOffset);
+}
+
+ProgramCounter QPU::executeLoad(const DecodedInstruction& inst)
+{
+    Value imm(Literal(inst.immediate), TYPE_INT32);
+    switch(inst.loadType)
+    {
+    case OpLoad::LOAD_IMM_32:
+        if(inst.pack.hasEffect())
+            PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 210, "values packed", 1);
+        imm = inst.pack(imm, generateImmediateFlags(Literal(inst.immediate))).value();
+        break;
+    case OpLoad::LOAD_SIGNED:
+        imm = Value(ContainerValue(toLoadedValues(inst.immediate, vc4c::intermediate::LoadType::PER_ELEMENT_SIGNED)),
+            imm.type.toVectorType(16));
+        break;
+    case OpLoad::LOAD_UNSIGNED:
+        imm = Value(ContainerValue(toLoadedValues(inst.immediate, vc4c::intermediate::LoadType::PER_ELEMENT_UNSIGNED)),
+            imm.type.toVectorType(16));
+        break;
+    }
+
+    writeConditional(inst.addOut, imm, inst.addCondition);
+    writeConditional(inst.mulOut, imm, inst.mulCondition);
+    if(inst.setFlags)
+        setFlags(imm, inst.addCondition != COND_NEVER ? inst.addCondition : inst.mulCondition,
+            generateImmediateFlags(Literal(inst.immediate)));
+    return pc + 1;
+}
+
+ProgramCounter QPU::executeSemaphore(const DecodedInstruction& inst)
+{
+    bool dontStall = true;
+    Value result = UNDEFINED_VALUE;
+    if(inst.incrementSemaphore)
+        std::tie(result, dontStall) = semaphores.increment(static_cast<uint8_t>(inst.immediate));
+    else
+        std::tie(result, dontStall) = semaphores.decrement(static_cast<uint8_t>(inst.immediate));
+    if(!dontStall)
+    {
+        ++instrumentation[pc].numStalls;
+        return pc;
+    }
+    if(inst.pack.hasEffect())
+        PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 210, "values packed", 1);
+    result = inst.pack(result, {}).value();
+    writeConditional(inst.addOut, result, inst.addCondition);
+    writeConditional(inst.mulOut, result, inst.mulCondition);
+    if(inst.setFlags)
+        setFlags(result, inst.addCondition != COND_NEVER ? inst.addCondition : inst.mulCondition, {});
+    return pc + 1;
+}
+
+ProgramCounter QPU::executeInvalid(const DecodedInstruction& inst)
 {
-    return &(*(firstInstruction + pc));
+    throw CompilationError(CompilationStep::GENERAL, "Invalid assembler instruction", inst.instruction->toASMString());
 }
 
 static std::pair<Value, bool> toInputValue(
@@ -1304,85 +1494,85 @@ static std::pair<Value, bool> applyVectorRotation(std::pair<Value, bool>&& input
     return std::make_pair(result, true);
 }
 
-bool QPU::executeALU(const qpu_asm::ALUInstruction* aluInst)
+ProgramCounter QPU::executeALU(const DecodedInstruction& inst)
 {
     Value addIn0 = UNDEFINED_VALUE;
     Value addIn1 = UNDEFINED_VALUE;
     Value mulIn0 = UNDEFINED_VALUE;
     Value mulIn1 = UNDEFINED_VALUE;
 
-    const OpCode& addCode = OpCode::toOpCode(aluInst->getAddition(), false);
-    const OpCode& mulCode = OpCode::toOpCode(aluInst->getMultiplication(), true);
+    const OpCode& addCode = *inst.addCode;
+    const OpCode& mulCode = *inst.mulCode;
 
     // need to read both input before writing any registers
-    if(aluInst->getAddCondition() != COND_NEVER && aluInst->getAddition() != OP_NOP.opAdd)
+    if(inst.isAddExecuted)
     {
         bool addIn0NotStall = true;
         bool addIn1NotStall = true;
-        std::tie(addIn0, addIn0NotStall) = toInputValue(registers, aluInst->getAddMultiplexA(), aluInst->getInputA(),
-            aluInst->getInputB(), aluInst->getSig() == SIGNAL_ALU_IMMEDIATE);
+        std::tie(addIn0, addIn0NotStall) = toInputValue(registers, inst.addMuxA, inst.inputA,
+            inst.inputB, inst.isInputBImmediate);
         if(addCode.numOperands > 1)
-            std::tie(addIn1, addIn1NotStall) = toInputValue(registers, aluInst->getAddMultiplexB(),
-                aluInst->getInputA(), aluInst->getInputB(), aluInst->getSig() == SIGNAL_ALU_IMMEDIATE);
+            std::tie(addIn1, addIn1NotStall) = toInputValue(registers, inst.addMuxB,
+                inst.inputA, inst.inputB, inst.isInputBImmediate);
 
         if(!addIn0NotStall || !addIn1NotStall)
         {
             // we stall on input, so do not calculate anything
-            ++instrumentation[aluInst].numStalls;
-            return false;
+            ++instrumentation[pc].numStalls;
+            return pc;
         }
     }
 
-    if(aluInst->getMulCondition() != COND_NEVER && aluInst->getMultiplication() != OP_NOP.opMul)
+    if(inst.isMulExecuted)
     {
         bool mulIn0NotStall = true;
         bool mulIn1NotStall = true;
 
         PROFILE_START(EmulateVectorRotation);
         std::tie(mulIn0, mulIn0NotStall) =
-            applyVectorRotation(toInputValue(registers, aluInst->getMulMultiplexA(), aluInst->getInputA(),
-                                    aluInst->getInputB(), aluInst->getSig() == SIGNAL_ALU_IMMEDIATE),
-                aluInst->getSig(), aluInst->getMulMultiplexA(), aluInst->getMulMultiplexB(), aluInst->getInputB(),
+            applyVectorRotation(toInputValue(registers, inst.mulMuxA, inst.inputA,
+                                    inst.inputB, inst.isInputBImmediate),
+                inst.signal, inst.mulMuxA, inst.mulMuxB, inst.inputB,
                 registers);
         if(mulCode.numOperands > 1)
             std::tie(mulIn1, mulIn1NotStall) =
-                applyVectorRotation(toInputValue(registers, aluInst->getMulMultiplexB(), aluInst->getInputA(),
-                                        aluInst->getInputB(), aluInst->getSig() == SIGNAL_ALU_IMMEDIATE),
-                    aluInst->getSig(), aluInst->getMulMultiplexA(), aluInst->getMulMultiplexB(), aluInst->getInputB(),
+                applyVectorRotation(toInputValue(registers, inst.mulMuxB, inst.inputA,
+                                        inst.inputB, inst.isInputBImmediate),
+                    inst.signal, inst.mulMuxA, inst.mulMuxB, inst.inputB,
                     registers);
         PROFILE_END(EmulateVectorRotation);
 
         if(!mulIn0NotStall || !mulIn1NotStall)
         {
             // we stall on input, so do not calculate anything
-            ++instrumentation[aluInst].numStalls;
-            return false;
+            ++instrumentation[pc].numStalls;
+            return pc;
         }
     }
 
-    if(aluInst->getAddCondition() != COND_NEVER && aluInst->getAddition() != OP_NOP.opAdd)
+    if(inst.isAddExecuted)
     {
         if(addIn0.checkContainer() && addIn0.container().isUndefined())
             addIn0 = UNDEFINED_VALUE;
         if(addIn1.checkContainer() && addIn1.container().isUndefined())
             addIn1 = UNDEFINED_VALUE;
 
-        if(aluInst->getUnpack().hasEffect())
+        if(inst.unpack.hasEffect())
         {
             PROFILE_START(EmulateUnpack);
-            if(aluInst->getUnpack().isUnpackFromR4())
+            if(inst.unpack.isUnpackFromR4())
             {
-                if(aluInst->getAddMultiplexA() == InputMultiplex::ACC4)
-                    addIn0 = aluInst->getUnpack()(addIn0).value();
-                if(aluInst->getAddMultiplexB() == InputMultiplex::ACC4)
-                    addIn1 = aluInst->getUnpack()(addIn1).value();
+                if(inst.addMuxA == InputMultiplex::ACC4)
+                    addIn0 = inst.unpack(addIn0).value();
+                if(inst.addMuxB == InputMultiplex::ACC4)
+                    addIn1 = inst.unpack(addIn1).value();
             }
             else
             {
-                if(aluInst->getAddMultiplexA() == InputMultiplex::REGA)
-                    addIn0 = aluInst->getUnpack()(addIn0).value();
-                if(aluInst->getAddMultiplexB() == InputMultiplex::REGA)
-                    addIn1 = aluInst->getUnpack()(addIn1).value();
+                if(inst.addMuxA == InputMultiplex::REGA)
+                    addIn0 = inst.unpack(addIn0).value();
+                if(inst.addMuxB == InputMultiplex::REGA)
+                    addIn1 = inst.unpack(addIn1).value();
             }
             PROFILE_END(EmulateUnpack);
         }
@@ -1408,43 +1598,42 @@ bool QPU::executeALU(const qpu_asm::ALUInstruction* aluInst)
                              << addIn0.to_string(false, true) << " and " << addIn1.to_string(false, true)
                              << logging::endl;
         Value result(std::move(tmp.first).value());
-        if(aluInst->getWriteSwap() == WriteSwap::DONT_SWAP && aluInst->getPack().hasEffect())
+        if(!inst.isMulResultPacked && inst.pack.hasEffect())
         {
             PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 210, "values packed", 1);
-            if(aluInst->getPack().supportsMulALU())
+            if(inst.pack.supportsMulALU())
                 throw CompilationError(CompilationStep::GENERAL, "Cannot apply mul pack mode on add result!");
-            result = aluInst->getPack()(result, tmp.second).value();
+            result = inst.pack(result, tmp.second).value();
         }
 
-        writeConditional(toRegister(aluInst->getAddOut(), aluInst->getWriteSwap() == WriteSwap::SWAP), result,
-            aluInst->getAddCondition(), aluInst, nullptr);
-        if(aluInst->getSetFlag() == SetFlag::SET_FLAGS)
-            setFlags(result, aluInst->getAddCondition(), tmp.second);
+        writeConditional(inst.addOut, result, inst.addCondition, InstrumentedALU::ADD);
+        if(inst.setFlags)
+            setFlags(result, inst.addCondition, tmp.second);
         PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 180, "add instructions", 1);
     }
-    if(aluInst->getMulCondition() != COND_NEVER && aluInst->getMultiplication() != OP_NOP.opMul)
+    if(inst.isMulExecuted)
     {
         if(mulIn0.checkContainer() && mulIn0.container().isUndefined())
             mulIn0 = UNDEFINED_VALUE;
         if(mulIn1.checkContainer() && mulIn1.container().isUndefined())
             mulIn1 = UNDEFINED_VALUE;
 
-        if(aluInst->getUnpack().hasEffect())
+        if(inst.unpack.hasEffect())
         {
             PROFILE_START(EmulateUnpack);
-            if(aluInst->getUnpack().isUnpackFromR4())
+            if(inst.unpack.isUnpackFromR4())
             {
-                if(aluInst->getMulMultiplexA() == InputMultiplex::ACC4)
-                    mulIn0 = aluInst->getUnpack()(mulIn0).value();
-                if(aluInst->getMulMultiplexB() == InputMultiplex::ACC4)
-                    mulIn1 = aluInst->getUnpack()(mulIn1).value();
+                if(inst.mulMuxA == InputMultiplex::ACC4)
+                    mulIn0 = inst.unpack(mulIn0).value();
+                if(inst.mulMuxB == InputMultiplex::ACC4)
+                    mulIn1 = inst.unpack(mulIn1).value();
             }
             else
             {
-                if(aluInst->getMulMultiplexA() == InputMultiplex::REGA)
-                    mulIn0 = aluInst->getUnpack()(mulIn0).value();
-                if(aluInst->getMulMultiplexB() == InputMultiplex::REGA)
-                    mulIn1 = aluInst->getUnpack()(mulIn1).value();
+                if(inst.mulMuxA == InputMultiplex::REGA)
+                    mulIn0 = inst.unpack(mulIn0).value();
+                if(inst.mulMuxB == InputMultiplex::REGA)
+                    mulIn1 = inst.unpack(mulIn1).value();
             }
             PROFILE_END(EmulateUnpack);
         }
@@ -1471,47 +1660,44 @@ bool QPU::executeALU(const qpu_asm::ALUInstruction* aluInst)
                              << mulIn0.to_string(false, true) << " and " << mulIn1.to_string(false, true)
                              << logging::endl;
         Value result(std::move(tmp.first).value());
-        if(aluInst->getWriteSwap() == WriteSwap::SWAP && aluInst->getPack().hasEffect())
+        if(inst.isMulResultPacked && inst.pack.hasEffect())
         {
             PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 210, "values packed", 1);
-            if(!aluInst->getPack().supportsMulALU())
+            if(!inst.pack.supportsMulALU())
                 throw CompilationError(CompilationStep::GENERAL, "Cannot apply add pack mode on mul result!");
-            result = aluInst->getPack()(result, tmp.second).value();
+            result = inst.pack(result, tmp.second).value();
         }
 
         // FIXME these might depend on flags of add ALU set in same instruction (which is wrong)
-        writeConditional(toRegister(aluInst->getMulOut(), aluInst->getWriteSwap() == WriteSwap::DONT_SWAP), result,
-            aluInst->getMulCondition(), nullptr, aluInst);
-        if(aluInst->getSetFlag() == SetFlag::SET_FLAGS &&
-            isFlagSetByMulALU(aluInst->getAddition(), aluInst->getMultiplication()))
-            setFlags(result, aluInst->getMulCondition(), tmp.second);
+        writeConditional(inst.mulOut, result, inst.mulCondition, InstrumentedALU::MUL);
+        if(inst.setFlags && inst.areFlagsSetByMul)
+            setFlags(result, inst.mulCondition, tmp.second);
         PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 190, "mul instructions", 1);
     }
 
-    if(aluInst->getUnpack().hasEffect())
+    if(inst.unpack.hasEffect())
         PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 220, "values unpacked", 1);
 
-    return true;
+    return pc + 1;
 }
 
-void QPU::writeConditional(Register dest, const Value& in, ConditionCode cond, const qpu_asm::ALUInstruction* addInst,
-    const qpu_asm::ALUInstruction* mulInst)
+void QPU::writeConditional(Register dest, const Value& in, ConditionCode cond, InstrumentedALU alu)
 {
     if(cond == COND_ALWAYS)
     {
         registers.writeRegister(dest, in, std::bitset<16>(0xFFFF));
-        if(addInst)
-            ++instrumentation[addInst].numAddALUExecuted;
-        if(mulInst)
-            ++instrumentation[mulInst].numMulALUExecuted;
+        if(alu == InstrumentedALU::ADD)
+            ++instrumentation[pc].numAddALUExecuted;
+        if(alu == InstrumentedALU::MUL)
+            ++instrumentation[pc].numMulALUExecuted;
         return;
     }
     else if(cond == COND_NEVER)
     {
-        if(addInst)
-            ++instrumentation[addInst].numAddALUSkipped;
-        if(mulInst)
-            ++instrumentation[mulInst].numMulALUSkipped;
+        if(alu == InstrumentedALU::ADD)
+            ++instrumentation[pc].numAddALUSkipped;
+        if(alu == InstrumentedALU::MUL)
+            ++instrumentation[pc].numMulALUSkipped;
         return;
     }
     ContainerValue result(NATIVE_VECTOR_SIZE);
@@ -1535,81 +1721,67 @@ void QPU::writeConditional(Register dest, const Value& in, ConditionCode cond, c
 
     registers.writeRegister(dest, Value(std::move(result), in.type), elementMask);
 
-    if(addInst != nullptr)
+    if(alu == InstrumentedALU::ADD)
     {
         if(elementMask.any())
-            ++instrumentation[addInst].numAddALUExecuted;
+            ++instrumentation[pc].numAddALUExecuted;
         else
-            ++instrumentation[addInst].numAddALUSkipped;
+            ++instrumentation[pc].numAddALUSkipped;
     }
-    if(mulInst != nullptr)
+    if(alu == InstrumentedALU::MUL)
     {
         if(elementMask.any())
-            ++instrumentation[mulInst].numMulALUExecuted;
+            ++instrumentation[pc].numMulALUExecuted;
         else
-            ++instrumentation[mulInst].numMulALUSkipped;
+            ++instrumentation[pc].numMulALUSkipped;
     }
 }
 
-bool QPU::isConditionMet(BranchCond cond) const
+/*
+ * Returns the condition each element is checked for and whether all (or any) elements need to match it
+ */
+static std::pair<ConditionCode, bool> toElementCondition(BranchCond cond)
 {
-    ConditionCode singleCond = COND_NEVER;
-    bool checkAll;
     switch(cond)
     {
     case BranchCond::ALL_C_CLEAR:
-        checkAll = true;
-        singleCond = COND_CARRY_CLEAR;
-        break;
+        return std::make_pair(COND_CARRY_CLEAR, true);
     case BranchCond::ALL_C_SET:
-        checkAll = true;
-        singleCond = COND_CARRY_SET;
-        break;
+        return std::make_pair(COND_CARRY_SET, true);
     case BranchCond::ALL_N_CLEAR:
-        checkAll = true;
-        singleCond = COND_NEGATIVE_CLEAR;
-        break;
+        return std::make_pair(COND_NEGATIVE_CLEAR, true);
     case BranchCond::ALL_N_SET:
-        checkAll = true;
-        singleCond = COND_NEGATIVE_SET;
-        break;
+        return std::make_pair(COND_NEGATIVE_SET, true);
     case BranchCond::ALL_Z_CLEAR:
-        checkAll = true;
-        singleCond = COND_ZERO_CLEAR;
-        break;
+        return std::make_pair(COND_ZERO_CLEAR, true);
     case BranchCond::ALL_Z_SET:
-        checkAll = true;
-        singleCond = COND_ZERO_SET;
-        break;
+        return std::make_pair(COND_ZERO_SET, true);
     case BranchCond::ALWAYS:
-        return true;
+        return std::make_pair(COND_ALWAYS, true);
     case BranchCond::ANY_C_CLEAR:
-        checkAll = false;
-        singleCond = COND_CARRY_CLEAR;
-        break;
+        return std::make_pair(COND_CARRY_CLEAR, false);
     case BranchCond::ANY_C_SET:
-        checkAll = false;
-        singleCond = COND_CARRY_SET;
-        break;
+        return std::make_pair(COND_CARRY_SET, false);
     case BranchCond::ANY_N_CLEAR:
-        checkAll = false;
-        singleCond = COND_NEGATIVE_CLEAR;
-        break;
+        return std::make_pair(COND_NEGATIVE_CLEAR, false);
     case BranchCond::ANY_N_SET:
-        checkAll = false;
-        singleCond = COND_NEGATIVE_SET;
-        break;
+        return std::make_pair(COND_NEGATIVE_SET, false);
     case BranchCond::ANY_Z_CLEAR:
-        checkAll = false;
-        singleCond = COND_ZERO_CLEAR;
-        break;
+        return std::make_pair(COND_ZERO_CLEAR, false);
     case BranchCond::ANY_Z_SET:
-        checkAll = false;
-        singleCond = COND_ZERO_SET;
-        break;
+        return std::make_pair(COND_ZERO_SET, false);
     default:
         throw CompilationError(CompilationStep::GENERAL, "Unhandled branch condition", toString(cond));
     }
+}
+
+bool QPU::isConditionMet(BranchCond cond) const
+{
+    if(cond == BranchCond::ALWAYS)
+        return true;
+    ConditionCode singleCond = COND_NEVER;
+    bool checkAll;
+    std::tie(singleCond, checkAll) = toElementCondition(cond);
     if(checkAll)
         return std::all_of(flags.begin(), flags.end(),
             [singleCond](ElementFlags flags) -> bool { return flags.matchesCondition(singleCond); });
@@ -1623,10 +1795,13 @@ bool QPU::executeSignal(Signaling signal)
         signal == SIGNAL_NONE)
         // ignore
         return true;
-    if(signal == SIGNAL_LOAD_TMU0)
-        return tmus.triggerTMURead(0);
-    else if(signal == SIGNAL_LOAD_TMU1)
-        return tmus.triggerTMURead(1);
+    if(signal == SIGNAL_LOAD_TMU0 || signal == SIGNAL_LOAD_TMU1)
+    {
+        if(!tmus.triggerTMURead(signal == SIGNAL_LOAD_TMU0 ? 0 : 1))
+            return false;
+        ++instrumentation[pc].numTMULoads;
+        return true;
+    }
     else
         throw CompilationError(CompilationStep::GENERAL, "Unhandled signal", signal.to_string());
 
@@ -1656,145 +1831,1599 @@ void QPU::setFlags(const Value& output, ConditionCode cond, const VectorFlags& n
     PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 200, "flags set", 1);
 }
 
-std::vector<MemoryAddress> tools::buildUniforms(Memory& memory, MemoryAddress baseAddress,
-    const std::vector<MemoryAddress>& parameter, const WorkGroupConfig& config, MemoryAddress globalData,
-    const KernelUniforms& uniformsUsed)
+/*
+ * Native emulation backend
+ *
+ * Executes the instructions on the NativeRegisters instead of the Values stored in the Registers. The semantics (incl.
+ * the flags set and the quirks of the Value-based emulation) are the same as for the functions above and in
+ * calcLiteral() (see OpCodes.cpp). Any access to a periphery register is converted to a Value and passed on to the
+ * Registers, so the periphery emulation is shared by both backends.
+ */
+
+static constexpr uint16_t ALL_ELEMENTS = 0xFFFF;
+
+bool NativeVector::operator==(const NativeVector& other) const
 {
-    std::vector<MemoryAddress> res;
+    return elements == other.elements && definedMask == other.definedMask && isFloat == other.isFloat;
+}
 
-    Word numQPUs = config.localSizes.at(0) * config.localSizes.at(1) * config.localSizes.at(2);
-    Word numReruns = config.numGroups.at(0) * config.numGroups.at(1) * config.numGroups.at(2);
-    res.reserve(numQPUs);
+/*
+ * Returns the bit-mask of all elements the predicate holds for
+ */
+template <typename Predicate>
+static uint16_t toElementMask(Predicate&& predicate)
+{
+    uint16_t mask = 0;
+    for(uint8_t i = 0; i < NATIVE_VECTOR_SIZE; ++i)
+        mask = static_cast<uint16_t>(mask | (static_cast<unsigned>(predicate(i)) << i));
+    return mask;
+}
 
-    std::array<Word, 3> groupIDs = {0, 0, 0};
+/*
+ * Sets all elements of the result to the value calculated by the given function
+ */
+template <typename Func>
+static void mapElements(NativeResult& result, Func&& func)
+{
+    for(uint8_t i = 0; i < NATIVE_VECTOR_SIZE; ++i)
+        result.value.elements[i] = func(i);
+}
 
-    std::vector<Word> qpuUniforms;
-    qpuUniforms.resize(uniformsUsed.countUniforms() + 1 /* re-run flag */ + parameter.size());
+static float toFloat(tools::Word word)
+{
+    return bit_cast<tools::Word, float>(word);
+}
 
-    for(uint8_t q = 0; q < numQPUs; ++q)
-    {
-        std::array<Word, 3> localIDs = {q % config.localSizes.at(0),
-            (q / config.localSizes.at(0)) % config.localSizes.at(1),
-            (q / config.localSizes.at(0)) / config.localSizes.at(1)};
+static tools::Word toWord(float f)
+{
+    return bit_cast<float, tools::Word>(f);
+}
 
-        for(uint8_t g = 0; g < numReruns; ++g)
+static NativeVector toNativeVector(const Value& val)
+{
+    NativeVector vec;
+    vec.isFloat = val.type.isFloatingType();
+    if(auto container = val.checkContainer())
+    {
+        for(uint8_t i = 0; i < std::min(container->elements.size(), vec.elements.size()); ++i)
         {
-            groupIDs = {g % config.numGroups.at(0), (g / config.numGroups.at(0)) % config.numGroups.at(1),
-                (g / config.numGroups.at(0)) / config.numGroups.at(1)};
-
-            std::size_t i = 0;
-            if(uniformsUsed.getWorkDimensionsUsed())
-                qpuUniforms[i++] = config.dimensions;
-            if(uniformsUsed.getLocalSizesUsed())
-                qpuUniforms[i++] =
-                    (config.localSizes.at(2) << 16) | (config.localSizes.at(1) << 8) | config.localSizes.at(0);
-            if(uniformsUsed.getLocalIDsUsed())
-                qpuUniforms[i++] = (localIDs.at(2) << 16) | (localIDs.at(1) << 8) | localIDs.at(0);
-            if(uniformsUsed.getNumGroupsXUsed())
-                qpuUniforms[i++] = config.numGroups.at(0);
-            if(uniformsUsed.getNumGroupsYUsed())
-                qpuUniforms[i++] = config.numGroups.at(1);
-            if(uniformsUsed.getNumGroupsZUsed())
-                qpuUniforms[i++] = config.numGroups.at(2);
-            if(uniformsUsed.getGroupIDXUsed())
-                qpuUniforms[i++] = groupIDs.at(0);
-            if(uniformsUsed.getGroupIDYUsed())
-                qpuUniforms[i++] = groupIDs.at(1);
-            if(uniformsUsed.getGroupIDZUsed())
-                qpuUniforms[i++] = groupIDs.at(2);
-            if(uniformsUsed.getGlobalOffsetXUsed())
-                qpuUniforms[i++] = config.globalOffsets.at(0);
-            if(uniformsUsed.getGlobalOffsetYUsed())
-                qpuUniforms[i++] = config.globalOffsets.at(1);
-            if(uniformsUsed.getGlobalOffsetZUsed())
-                qpuUniforms[i++] = config.globalOffsets.at(2);
-            if(uniformsUsed.getGlobalDataAddressUsed())
-                qpuUniforms[i++] = globalData;
-            for(auto param : parameter)
+            if(auto lit = container->elements[i].getLiteralValue())
             {
-                qpuUniforms[i++] = param;
+                vec.elements[i] = lit->unsignedInt();
+                vec.definedMask = static_cast<uint16_t>(vec.definedMask | (1u << i));
             }
-            qpuUniforms[i++] = (numReruns - 1) - g;
-
-            memory.setUniforms(qpuUniforms, baseAddress);
-            if(g == 0)
-                res.emplace_back(baseAddress);
-
-            baseAddress += static_cast<Word>(qpuUniforms.size() * sizeof(Word));
         }
     }
+    else if(auto lit = val.getLiteralValue())
+    {
+        vec.elements.fill(lit->unsignedInt());
+        vec.definedMask = ALL_ELEMENTS;
+    }
+    // for any other value (e.g. undefined), all elements stay undefined
+    return vec;
+}
 
-    return res;
+static Value toElementValue(tools::Word element, bool isFloat)
+{
+    Literal lit(element);
+    if(isFloat)
+        lit.type = LiteralType::REAL;
+    return Value(lit, isFloat ? TYPE_FLOAT : TYPE_INT32);
 }
 
-static void emulateStep(std::vector<qpu_asm::Instruction>::const_iterator firstInstruction, std::vector<QPU>& qpus,
-    std::bitset<NATIVE_VECTOR_SIZE>& activeQPUs)
+static Value toValue(const NativeVector& vec)
 {
-    for(unsigned i = 0; i < qpus.size(); ++i)
+    if(vec.definedMask == 0)
+        return UNDEFINED_VALUE;
+    if(vec.definedMask == ALL_ELEMENTS &&
+        std::all_of(vec.elements.begin() + 1, vec.elements.end(),
+            [&](tools::Word element) -> bool { return element == vec.elements[0]; }))
+        return toElementValue(vec.elements[0], vec.isFloat);
+    ContainerValue container(NATIVE_VECTOR_SIZE);
+    for(uint8_t i = 0; i < NATIVE_VECTOR_SIZE; ++i)
+        container.elements.emplace_back(
+            ((vec.definedMask >> i) & 1u) ? toElementValue(vec.elements[i], vec.isFloat) : UNDEFINED_VALUE);
+    return Value(std::move(container), (vec.isFloat ? TYPE_FLOAT : TYPE_INT32).toVectorType(NATIVE_VECTOR_SIZE));
+}
+
+static VectorFlags toVectorFlags(const NativeResult& result)
+{
+    VectorFlags flags;
+    for(uint8_t i = 0; i < NATIVE_VECTOR_SIZE; ++i)
     {
-        if(!activeQPUs.test(i))
+        if(((result.value.definedMask >> i) & 1u) == 0)
             continue;
-        try
-        {
-            bool continueRunning = qpus[i].execute(firstInstruction);
-            if(!continueRunning)
-                // this QPU has finished
-                activeQPUs.reset(i);
-        }
-        catch(const std::exception&)
-        {
-            logging::error() << "Emulation threw exception execution following instruction on QPU " << qpus[i].ID
-                             << ": " << qpus[i].getCurrentInstruction(firstInstruction)->toHexString(true)
-                             << logging::endl;
-            // re-throw error
-            throw;
-        }
+        auto toStatus = [i](uint16_t mask) -> FlagStatus {
+            return ((mask >> i) & 1u) ? FlagStatus::SET : FlagStatus::CLEAR;
+        };
+        flags[i].zero = result.value.elements[i] == 0 ? FlagStatus::SET : FlagStatus::CLEAR;
+        flags[i].negative = (result.value.elements[i] >> 31) ? FlagStatus::SET : FlagStatus::CLEAR;
+        if((result.carryDefined >> i) & 1u)
+            flags[i].carry = toStatus(result.carrySet);
+        if((result.overflowDefined >> i) & 1u)
+            flags[i].overflow = toStatus(result.overflowSet);
     }
+    return flags;
 }
 
-bool tools::emulate(std::vector<qpu_asm::Instruction>::const_iterator firstInstruction, Memory& memory,
-    const std::vector<MemoryAddress>& uniformAddresses, InstrumentationResults& instrumentation, uint32_t maxCycles)
+/*
+ * The pack- and unpack-modes are rarely used, so they are applied via the Value-based implementation
+ */
+static NativeVector packNative(Pack pack, const NativeVector& vec, const VectorFlags& flags)
 {
-    if(uniformAddresses.size() > NUM_QPUS)
-        throw CompilationError(CompilationStep::GENERAL, "Cannot use more than 12 QPUs!");
+    auto result = pack(toValue(vec), flags);
+    if(!result)
+        throw CompilationError(CompilationStep::GENERAL, "Failed to apply pack-mode", pack.to_string());
+    return toNativeVector(*result);
+}
 
-    Mutex mutex;
-    // FIXME is SFU execution per QPU or need SFUs be locked?
-    std::array<SFU, NUM_QPUS> sfus;
-    VPM vpm(memory);
-    Semaphores semaphores;
+static NativeVector unpackNative(Unpack unpack, const NativeVector& vec)
+{
+    auto result = unpack(toValue(vec));
+    if(!result)
+        throw CompilationError(CompilationStep::GENERAL, "Failed to apply unpack-mode", unpack.to_string());
+    return toNativeVector(*result);
+}
 
-    std::vector<QPU> qpus;
-    qpus.reserve(uniformAddresses.size());
-    std::bitset<NATIVE_VECTOR_SIZE> activeQPUs = (1 << uniformAddresses.size()) - 1;
-    uint8_t numQPU = 0;
-    for(MemoryAddress uniformPointer : uniformAddresses)
-    {
-        qpus.emplace_back(numQPU, mutex, sfus.at(numQPU), vpm, semaphores, memory, uniformPointer, instrumentation);
-        ++numQPU;
-    }
+static bool checkNativeMinMaxCarry(tools::Word first, tools::Word second, bool useAbs)
+{
+    // see checkMinMaxCarry() in OpCodes.cpp
+    if(std::isnan(toFloat(first)) && std::isnan(toFloat(second)))
+        return static_cast<int32_t>(first) > static_cast<int32_t>(second);
+    if(std::isnan(toFloat(first)))
+        return true;
+    if(std::isnan(toFloat(second)))
+        return false;
+    return useAbs ? (std::abs(toFloat(first)) > std::abs(toFloat(second))) : (toFloat(first) > toFloat(second));
+}
+
+/*
+ * Calculates a single element of the floating-point minimum/maximum operations, which need special handling of NaN
+ * and infinity values
+ */
+static tools::Word calcNativeMinMax(const OpCode& code, tools::Word first, tools::Word second, bool& isOverflowDefined)
+{
+    const float a = toFloat(first);
+    const float b = toFloat(second);
+    // the special cases do not define the overflow flag
+    isOverflowDefined = false;
+    if(code == OP_FMAX)
+    {
+        if(std::isnan(a))
+            return first;
+        if(std::isnan(b))
+            return second;
+        isOverflowDefined = true;
+        return toWord(std::max(a, b));
+    }
+    if(code == OP_FMAXABS)
+    {
+        if(std::isnan(a))
+            return first;
+        if(std::isnan(b))
+            return second;
+        if(std::isinf(a))
+            return first;
+        if(std::isinf(b))
+            return second;
+        isOverflowDefined = true;
+        return toWord(std::max(std::fabs(a), std::fabs(b)));
+    }
+    if(code == OP_FMIN)
+    {
+        if(std::isnan(a))
+            return second;
+        if(std::isnan(b))
+            return first;
+        isOverflowDefined = true;
+        return toWord(std::min(a, b));
+    }
+    // OP_FMINABS
+    if(std::isnan(a))
+        return second;
+    if(std::isnan(b))
+        return first;
+    isOverflowDefined = true;
+    return toWord(std::min(std::fabs(a), std::fabs(b)));
+}
+
+static tools::Word calcNativeV8(const OpCode& code, tools::Word first, tools::Word second)
+{
+    tools::Word result = 0;
+    for(unsigned shift = 0; shift < 32; shift += 8)
+    {
+        const uint32_t a = (first >> shift) & 0xFF;
+        const uint32_t b = (second >> shift) & 0xFF;
+        uint32_t byte;
+        if(code == OP_V8ADDS)
+            byte = std::min(a + b, 255u);
+        else if(code == OP_V8SUBS)
+            byte = static_cast<uint32_t>(std::max(std::min(static_cast<int32_t>(a - b), 255), 0));
+        else if(code == OP_V8MAX)
+            byte = std::max(a, b);
+        else if(code == OP_V8MIN)
+            byte = std::min(a, b);
+        else
+            byte = (a * b + 127) / 255;
+        result |= (byte & 0xFF) << shift;
+    }
+    return result;
+}
+
+static NativeResult calculateNative(const OpCode& code, const NativeVector& in0, const NativeVector& in1)
+{
+    const auto& a = in0.elements;
+    const auto& b = in1.elements;
+    NativeResult result;
+    const auto& r = result.value.elements;
+    result.value.definedMask =
+        code.numOperands > 1 ? static_cast<uint16_t>(in0.definedMask & in1.definedMask) : in0.definedMask;
+    result.value.isFloat = code.returnsFloat;
+    // the carry is set explicitly by the operations, the overflow is only defined for some of them
+    result.carryDefined = ALL_ELEMENTS;
+    result.overflowDefined = 0;
+
+    if(code == OP_ADD)
+    {
+        mapElements(result, [&](uint8_t i) -> tools::Word { return a[i] + b[i]; });
+        result.carrySet = toElementMask([&](uint8_t i) -> bool { return r[i] < a[i]; });
+        result.overflowSet = toElementMask([&](uint8_t i) -> bool { return ((a[i] ^ r[i]) & (b[i] ^ r[i])) >> 31; });
+        result.overflowDefined = ALL_ELEMENTS;
+    }
+    else if(code == OP_SUB)
+    {
+        mapElements(result, [&](uint8_t i) -> tools::Word { return a[i] - b[i]; });
+        result.carrySet = toElementMask(
+            [&](uint8_t i) -> bool { return static_cast<int32_t>(a[i]) < static_cast<int32_t>(b[i]); });
+        result.overflowSet = toElementMask([&](uint8_t i) -> bool { return ((a[i] ^ b[i]) & (a[i] ^ r[i])) >> 31; });
+        result.overflowDefined = ALL_ELEMENTS;
+    }
+    else if(code == OP_AND || code == OP_OR || code == OP_XOR)
+    {
+        if(code == OP_AND)
+            mapElements(result, [&](uint8_t i) -> tools::Word { return a[i] & b[i]; });
+        else if(code == OP_OR)
+            mapElements(result, [&](uint8_t i) -> tools::Word { return a[i] | b[i]; });
+        else
+            mapElements(result, [&](uint8_t i) -> tools::Word { return a[i] ^ b[i]; });
+        result.overflowDefined = ALL_ELEMENTS;
+    }
+    else if(code == OP_NOT)
+        mapElements(result, [&](uint8_t i) -> tools::Word { return ~a[i]; });
+    else if(code == OP_CLZ)
+    {
+        mapElements(result, [&](uint8_t i) -> tools::Word {
+            return intermediate::clz(TYPE_INT32, Literal(a[i])).unsignedInt();
+        });
+        result.overflowDefined = ALL_ELEMENTS;
+    }
+    else if(code == OP_ASR || code == OP_SHR)
+    {
+        // the hardware only uses the lower 5 bits of the shift offset
+        if(code == OP_ASR)
+            mapElements(result, [&](uint8_t i) -> tools::Word {
+                return static_cast<tools::Word>(static_cast<int32_t>(a[i]) >> (b[i] & 31));
+            });
+        else
+            mapElements(result, [&](uint8_t i) -> tools::Word { return a[i] >> (b[i] & 31); });
+        // carry is set if bits set are shifted out of the register
+        result.carrySet = toElementMask([&](uint8_t i) -> bool { return (a[i] & ((1u << (b[i] & 31)) - 1u)) != 0; });
+        result.overflowDefined = code == OP_ASR ? ALL_ELEMENTS : 0;
+    }
+    else if(code == OP_SHL)
+    {
+        mapElements(result, [&](uint8_t i) -> tools::Word { return a[i] << (b[i] & 31); });
+        result.carrySet = toElementMask(
+            [&](uint8_t i) -> bool { return (static_cast<uint64_t>(a[i]) << (b[i] & 31)) > 0xFFFFFFFFul; });
+    }
+    else if(code == OP_ROR)
+        mapElements(result, [&](uint8_t i) -> tools::Word {
+            const tools::Word offset = b[i] & 31;
+            return offset == 0 ? a[i] : ((a[i] >> offset) | (a[i] << (32 - offset)));
+        });
+    else if(code == OP_MIN || code == OP_MAX)
+    {
+        if(code == OP_MIN)
+            mapElements(result, [&](uint8_t i) -> tools::Word {
+                return static_cast<tools::Word>(std::min(static_cast<int32_t>(a[i]), static_cast<int32_t>(b[i])));
+            });
+        else
+            mapElements(result, [&](uint8_t i) -> tools::Word {
+                return static_cast<tools::Word>(std::max(static_cast<int32_t>(a[i]), static_cast<int32_t>(b[i])));
+            });
+        result.carrySet = toElementMask(
+            [&](uint8_t i) -> bool { return static_cast<int32_t>(a[i]) > static_cast<int32_t>(b[i]); });
+        result.overflowDefined = ALL_ELEMENTS;
+    }
+    else if(code == OP_MUL24)
+    {
+        mapElements(result, [&](uint8_t i) -> tools::Word { return (a[i] & 0xFFFFFF) * (b[i] & 0xFFFFFF); });
+        result.carrySet = toElementMask([&](uint8_t i) -> bool {
+            return static_cast<uint64_t>(a[i] & 0xFFFFFF) * static_cast<uint64_t>(b[i] & 0xFFFFFF) > 0xFFFFFFFFul;
+        });
+    }
+    else if(code == OP_FADD || code == OP_FSUB)
+    {
+        if(code == OP_FADD)
+            mapElements(result, [&](uint8_t i) -> tools::Word { return toWord(toFloat(a[i]) + toFloat(b[i])); });
+        else
+            mapElements(result, [&](uint8_t i) -> tools::Word { return toWord(toFloat(a[i]) - toFloat(b[i])); });
+        result.carrySet = toElementMask([&](uint8_t i) -> bool { return toFloat(r[i]) > 0.0f; });
+    }
+    else if(code == OP_FMUL)
+    {
+        mapElements(result, [&](uint8_t i) -> tools::Word { return toWord(toFloat(a[i]) * toFloat(b[i])); });
+        result.carryDefined = 0;
+    }
+    else if(code == OP_FMAX || code == OP_FMAXABS || code == OP_FMIN || code == OP_FMINABS)
+    {
+        const bool useAbs = code == OP_FMAXABS || code == OP_FMINABS;
+        for(uint8_t i = 0; i < NATIVE_VECTOR_SIZE; ++i)
+        {
+            bool isOverflowDefined = false;
+            result.value.elements[i] = calcNativeMinMax(code, a[i], b[i], isOverflowDefined);
+            result.overflowDefined = static_cast<uint16_t>(result.overflowDefined | (isOverflowDefined << i));
+        }
+        result.carrySet = toElementMask([&](uint8_t i) -> bool { return checkNativeMinMaxCarry(a[i], b[i], useAbs); });
+    }
+    else if(code == OP_FTOI)
+    {
+        auto isConvertible = [&](uint8_t i) -> bool {
+            const float f = toFloat(a[i]);
+            return !std::isnan(f) && !std::isinf(f) &&
+                std::abs(static_cast<int64_t>(f)) <= std::numeric_limits<int32_t>::max();
+        };
+        mapElements(result, [&](uint8_t i) -> tools::Word {
+            return isConvertible(i) ? static_cast<tools::Word>(static_cast<int32_t>(toFloat(a[i]))) : 0u;
+        });
+        result.carryDefined = toElementMask(isConvertible);
+    }
+    else if(code == OP_ITOF)
+        mapElements(result, [&](uint8_t i) -> tools::Word {
+            return toWord(static_cast<float>(static_cast<int32_t>(a[i])));
+        });
+    else if(code == OP_V8ADDS || code == OP_V8SUBS || code == OP_V8MAX || code == OP_V8MIN || code == OP_V8MULD)
+    {
+        mapElements(result, [&](uint8_t i) -> tools::Word { return calcNativeV8(code, a[i], b[i]); });
+        result.carryDefined = 0;
+    }
+    else
+        throw CompilationError(CompilationStep::GENERAL, "Failed to emulate ALU operation", code.name);
+
+    // no flags are set for undefined elements
+    result.carrySet &= result.value.definedMask;
+    result.carryDefined &= result.value.definedMask;
+    result.overflowSet &= result.value.definedMask;
+    result.overflowDefined &= result.value.definedMask;
+    return result;
+}
+
+static std::pair<NativeVector, bool> applyNativeVectorRotation(std::pair<NativeVector, bool>&& input, Signaling sig,
+    InputMultiplex mux1, InputMultiplex mux2, Address regB, const NativeVector& r5)
+{
+    if(!input.second)
+        // if we stall, do not rotate
+        return std::move(input);
+    if(sig != SIGNAL_ALU_IMMEDIATE)
+        // no rotation set
+        return std::move(input);
+    SmallImmediate offset(regB);
+    if(!offset.isVectorRotation())
+        return std::move(input);
+    if(mux1 == InputMultiplex::REGB || mux2 == InputMultiplex::REGB)
+        throw CompilationError(CompilationStep::GENERAL, "Cannot read vector rotation offset", offset.to_string());
+
+    unsigned distance;
+    if(offset == VECTOR_ROTATE_R5)
+    {
+        //"Mul output vector rotation is taken from accumulator r5, element 0, bits [3:0]"
+        // - Broadcom Specification, page 30
+        if((r5.definedMask & 1u) == 0)
+            throw CompilationError(CompilationStep::GENERAL, "Cannot rotate vector by undefined offset in r5");
+        distance = r5.elements[0] & 0xF;
+    }
+    else
+        distance = offset.getRotationOffset().value();
+
+    const NativeVector& in = input.first;
+    NativeVector result = in;
+    for(uint8_t i = 0; i < NATIVE_VECTOR_SIZE; ++i)
+        result.elements[(i + distance) % NATIVE_VECTOR_SIZE] = in.elements[i];
+    result.definedMask = static_cast<uint16_t>((in.definedMask << distance) | (in.definedMask >> (16 - distance)));
+
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 170, "vector rotations", 1);
+    return std::make_pair(result, true);
+}
+
+static const NativeVector& readNativeStorageRegister(const NativeVector& storage, Register reg)
+{
+    if(storage.definedMask == 0)
+        logging::warn() << "Reading from register not previously defined: " << reg.to_string() << logging::endl;
+    CPPLOG_LAZY(logging::Level::DEBUG,
+        log << "Reading from register '" << reg.to_string(true, true)
+            << "': " << toValue(storage).to_string(true, true) << logging::endl);
+    return storage;
+}
+
+ProgramCounter QPU::executeNativeBranch(const DecodedInstruction& inst)
+{
+    const bool takeBranch = isNativeConditionMet(inst.branchCondition);
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 160, "branches taken", takeBranch ? 1 : 0);
+    if(!takeBranch)
+        // simply skip to next PC
+        return pc + 1;
+    ++instrumentation[pc].numBranchTaken;
+    if(!inst.isSupportedBranch)
+        throw CompilationError(
+            CompilationStep::GENERAL, "This kind of branch is not yet implemented", inst.instruction->toASMString());
+
+    // see Broadcom specification, page 34
+    NativeVector link;
+    link.elements.fill(pc + 4);
+    link.definedMask = ALL_ELEMENTS;
+    writeNativeRegister(inst.addOut, link, ALL_ELEMENTS);
+    writeNativeRegister(inst.mulOut, link, ALL_ELEMENTS);
+    return pc + static_cast<ProgramCounter>(inst.branchOffset);
+}
+
+ProgramCounter QPU::executeNativeALU(const DecodedInstruction& inst)
+{
+    NativeVector addIn0;
+    NativeVector addIn1;
+    NativeVector mulIn0;
+    NativeVector mulIn1;
+
+    const OpCode& addCode = *inst.addCode;
+    const OpCode& mulCode = *inst.mulCode;
+
+    // need to read both input before writing any registers
+    if(inst.isAddExecuted)
+    {
+        bool addIn0NotStall = true;
+        bool addIn1NotStall = true;
+        std::tie(addIn0, addIn0NotStall) =
+            readNativeInput(inst.addMuxA, inst.inputA, inst.inputB, inst.isInputBImmediate);
+        if(addCode.numOperands > 1)
+            std::tie(addIn1, addIn1NotStall) =
+                readNativeInput(inst.addMuxB, inst.inputA, inst.inputB, inst.isInputBImmediate);
+
+        if(!addIn0NotStall || !addIn1NotStall)
+        {
+            // we stall on input, so do not calculate anything
+            ++instrumentation[pc].numStalls;
+            return pc;
+        }
+    }
+
+    if(inst.isMulExecuted)
+    {
+        bool mulIn0NotStall = true;
+        bool mulIn1NotStall = true;
+        const NativeVector& r5 = nativeRegisters->accumulators[REG_ACC5.num - REG_ACC0.num];
+
+        std::tie(mulIn0, mulIn0NotStall) =
+            applyNativeVectorRotation(readNativeInput(inst.mulMuxA, inst.inputA, inst.inputB, inst.isInputBImmediate),
+                inst.signal, inst.mulMuxA, inst.mulMuxB, inst.inputB, r5);
+        if(mulCode.numOperands > 1)
+            std::tie(mulIn1, mulIn1NotStall) = applyNativeVectorRotation(
+                readNativeInput(inst.mulMuxB, inst.inputA, inst.inputB, inst.isInputBImmediate), inst.signal,
+                inst.mulMuxA, inst.mulMuxB, inst.inputB, r5);
+
+        if(!mulIn0NotStall || !mulIn1NotStall)
+        {
+            // we stall on input, so do not calculate anything
+            ++instrumentation[pc].numStalls;
+            return pc;
+        }
+    }
+
+    const Unpack unpack = inst.unpack;
+    const InputMultiplex unpackSource = unpack.isUnpackFromR4() ? InputMultiplex::ACC4 : InputMultiplex::REGA;
+    if(inst.isAddExecuted)
+    {
+        if(unpack.hasEffect())
+        {
+            if(inst.addMuxA == unpackSource)
+                addIn0 = unpackNative(unpack, addIn0);
+            if(inst.addMuxB == unpackSource)
+                addIn1 = unpackNative(unpack, addIn1);
+        }
+
+        PROFILE_START(EmulateNativeOpcode);
+        NativeResult result = calculateNative(addCode, addIn0, addIn1);
+        PROFILE_END(EmulateNativeOpcode);
+        if(addCode == OP_OR && addIn0 == addIn1)
+            // move leaves original types
+            result.value.isFloat = addIn0.isFloat;
+        if(!inst.isMulResultPacked && inst.pack.hasEffect())
+        {
+            PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 210, "values packed", 1);
+            if(inst.pack.supportsMulALU())
+                throw CompilationError(CompilationStep::GENERAL, "Cannot apply mul pack mode on add result!");
+            result.value = packNative(inst.pack, result.value, toVectorFlags(result));
+        }
+
+        writeNativeConditional(inst.addOut, result.value, inst.addCondition, InstrumentedALU::ADD);
+        if(inst.setFlags)
+            setNativeFlags(result, inst.addCondition);
+        PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 180, "add instructions", 1);
+    }
+    if(inst.isMulExecuted)
+    {
+        if(unpack.hasEffect())
+        {
+            if(inst.mulMuxA == unpackSource)
+                mulIn0 = unpackNative(unpack, mulIn0);
+            if(inst.mulMuxB == unpackSource)
+                mulIn1 = unpackNative(unpack, mulIn1);
+        }
+
+        PROFILE_START(EmulateNativeOpcode);
+        NativeResult result = calculateNative(mulCode, mulIn0, mulIn1);
+        PROFILE_END(EmulateNativeOpcode);
+        // same as for the Value-based emulation, this checks the inputs of the add ALU
+        if((mulCode == OP_V8MIN || mulCode == OP_V8MAX) && addIn0 == addIn1)
+            // move leaves original types
+            result.value.isFloat = mulIn0.isFloat;
+        if(inst.isMulResultPacked && inst.pack.hasEffect())
+        {
+            PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 210, "values packed", 1);
+            if(!inst.pack.supportsMulALU())
+                throw CompilationError(CompilationStep::GENERAL, "Cannot apply add pack mode on mul result!");
+            result.value = packNative(inst.pack, result.value, toVectorFlags(result));
+        }
+
+        writeNativeConditional(inst.mulOut, result.value, inst.mulCondition, InstrumentedALU::MUL);
+        if(inst.setFlags && inst.areFlagsSetByMul)
+            setNativeFlags(result, inst.mulCondition);
+        PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 190, "mul instructions", 1);
+    }
+
+    if(unpack.hasEffect())
+        PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 220, "values unpacked", 1);
+
+    return pc + 1;
+}
+
+ProgramCounter QPU::executeNativeLoad(const DecodedInstruction& inst)
+{
+    const tools::Word immediate = inst.immediate;
+    NativeVector result;
+    result.definedMask = ALL_ELEMENTS;
+    switch(inst.loadType)
+    {
+    case OpLoad::LOAD_IMM_32:
+        result.elements.fill(immediate);
+        if(inst.pack.hasEffect())
+        {
+            PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 210, "values packed", 1);
+            result = packNative(inst.pack, result, generateImmediateFlags(Literal(immediate)));
+        }
+        break;
+    case OpLoad::LOAD_SIGNED:
+        for(uint8_t i = 0; i < NATIVE_VECTOR_SIZE; ++i)
+            result.elements[i] = static_cast<tools::Word>(
+                static_cast<int32_t>((immediate >> (i + 16)) & 1u) * -2 + static_cast<int32_t>((immediate >> i) & 1u));
+        break;
+    case OpLoad::LOAD_UNSIGNED:
+        for(uint8_t i = 0; i < NATIVE_VECTOR_SIZE; ++i)
+            result.elements[i] = ((immediate >> (i + 16)) & 1u) * 2u + ((immediate >> i) & 1u);
+        break;
+    }
+
+    writeNativeConditional(inst.addOut, result, inst.addCondition);
+    writeNativeConditional(inst.mulOut, result, inst.mulCondition);
+    if(inst.setFlags)
+    {
+        // same as generateImmediateFlags(), the flags are calculated from the (not unpacked) immediate value
+        NativeResult immediateFlags;
+        immediateFlags.value.elements.fill(immediate);
+        immediateFlags.value.definedMask = ALL_ELEMENTS;
+        immediateFlags.carryDefined = ALL_ELEMENTS;
+        setNativeFlags(immediateFlags, inst.addCondition != COND_NEVER ? inst.addCondition : inst.mulCondition);
+    }
+    return pc + 1;
+}
+
+ProgramCounter QPU::executeNativeSemaphore(const DecodedInstruction& inst)
+{
+    bool dontStall = true;
+    Value result = UNDEFINED_VALUE;
+    if(inst.incrementSemaphore)
+        std::tie(result, dontStall) = semaphores.increment(static_cast<uint8_t>(inst.immediate));
+    else
+        std::tie(result, dontStall) = semaphores.decrement(static_cast<uint8_t>(inst.immediate));
+    if(!dontStall)
+    {
+        ++instrumentation[pc].numStalls;
+        return pc;
+    }
+    if(inst.pack.hasEffect())
+        PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 210, "values packed", 1);
+    const NativeVector vec = toNativeVector(inst.pack(result, {}).value());
+    writeNativeConditional(inst.addOut, vec, inst.addCondition);
+    writeNativeConditional(inst.mulOut, vec, inst.mulCondition);
+    if(inst.setFlags)
+        // the semaphore instruction does not define any flags
+        setNativeFlags(NativeResult{}, inst.addCondition != COND_NEVER ? inst.addCondition : inst.mulCondition);
+    return pc + 1;
+}
+
+std::pair<NativeVector, bool> QPU::readNativeInput(
+    InputMultiplex mux, Address addressA, Address addressB, bool regBIsImmediate)
+{
+    auto& accumulators = nativeRegisters->accumulators;
+    switch(mux)
+    {
+    case InputMultiplex::ACC0:
+        return std::make_pair(readNativeStorageRegister(accumulators[0], REG_ACC0), true);
+    case InputMultiplex::ACC1:
+        return std::make_pair(readNativeStorageRegister(accumulators[1], REG_ACC1), true);
+    case InputMultiplex::ACC2:
+        return std::make_pair(readNativeStorageRegister(accumulators[2], REG_ACC2), true);
+    case InputMultiplex::ACC3:
+        return std::make_pair(readNativeStorageRegister(accumulators[3], REG_ACC3), true);
+    case InputMultiplex::ACC4:
+    {
+        auto result = registers.readRegister(REG_SFU_OUT);
+        return std::make_pair(toNativeVector(result.first), result.second);
+    }
+    case InputMultiplex::ACC5:
+        return std::make_pair(readNativeStorageRegister(accumulators[5], REG_ACC5), true);
+    case InputMultiplex::REGA:
+    {
+        const Register reg{RegisterFile::PHYSICAL_A, addressA};
+        if(reg.isGeneralPurpose())
+            return std::make_pair(readNativeStorageRegister(nativeRegisters->fileA[addressA], reg), true);
+        auto result = registers.readRegister(reg);
+        return std::make_pair(toNativeVector(result.first), result.second);
+    }
+    case InputMultiplex::REGB:
+    {
+        if(regBIsImmediate)
+        {
+            SmallImmediate imm(addressB);
+            return std::make_pair(toNativeVector(Value(imm, imm.getFloatingValue() ? TYPE_FLOAT : TYPE_INT32)), true);
+        }
+        const Register reg{RegisterFile::PHYSICAL_B, addressB};
+        if(reg.isGeneralPurpose())
+            return std::make_pair(readNativeStorageRegister(nativeRegisters->fileB[addressB], reg), true);
+        auto result = registers.readRegister(reg);
+        return std::make_pair(toNativeVector(result.first), result.second);
+    }
+    }
+    throw CompilationError(CompilationStep::GENERAL, "Unhandled ALU input");
+}
+
+void QPU::writeNativeRegister(Register dest, const NativeVector& in, uint16_t elementMask)
+{
+    NativeVector* storage = nullptr;
+    if(dest.num == REG_NOP.num)
+        return;
+    else if(dest.isGeneralPurpose())
+        storage = &(dest.file == RegisterFile::PHYSICAL_B ? nativeRegisters->fileB : nativeRegisters->fileA)[dest.num];
+    else if(dest.isAccumulator() && dest.num != REG_TMU_NOSWAP.num && dest.num != REG_REPLICATE_ALL.num)
+        storage = &nativeRegisters->accumulators[dest.num - REG_ACC0.num];
+    else if(dest.isAccumulator() && dest.num == REG_REPLICATE_ALL.num)
+    {
+        CPPLOG_LAZY(logging::Level::DEBUG,
+            log << "Writing into register '" << dest.to_string(true, false)
+                << "': " << toRegisterWriteString(toValue(in), std::bitset<16>(elementMask)) << logging::endl);
+        if(elementMask == 0)
+            return;
+        // is not actually stored in the physical file A or B, same as for the Value-based registers, the
+        // replication ignores the element mask
+        NativeVector& r5 = nativeRegisters->accumulators[REG_ACC5.num - REG_ACC0.num];
+        if(dest.file == RegisterFile::PHYSICAL_A)
+        {
+            // per-quad replication
+            for(uint8_t i = 0; i < NATIVE_VECTOR_SIZE; ++i)
+                r5.elements[i] = in.elements[i & ~3u];
+            r5.definedMask = toElementMask([&](uint8_t i) -> bool { return (in.definedMask >> (i & ~3u)) & 1u; });
+        }
+        else if(dest.file == RegisterFile::PHYSICAL_B)
+        {
+            // across all elements replication
+            r5.elements.fill(in.elements[0]);
+            r5.definedMask = (in.definedMask & 1u) ? ALL_ELEMENTS : 0;
+        }
+        else
+            throw CompilationError(CompilationStep::GENERAL,
+                "Failed to determine register-file for replication register", dest.to_string());
+        r5.isFloat = in.isFloat;
+        return;
+    }
+    else
+    {
+        // periphery registers are handled by the Value-based registers
+        registers.writeRegister(dest, toValue(in), std::bitset<16>(elementMask));
+        return;
+    }
+
+    CPPLOG_LAZY(logging::Level::DEBUG,
+        log << "Writing into register '" << dest.to_string(true, false)
+            << "': " << toRegisterWriteString(toValue(in), std::bitset<16>(elementMask)) << logging::endl);
+    if(storage->definedMask == 0)
+    {
+        // same as for the Value-based registers, the first write to a register writes all elements
+        *storage = in;
+        return;
+    }
+    for(uint8_t i = 0; i < NATIVE_VECTOR_SIZE; ++i)
+    {
+        const tools::Word select = 0u - ((elementMask >> i) & 1u);
+        storage->elements[i] = (in.elements[i] & select) | (storage->elements[i] & ~select);
+    }
+    storage->definedMask =
+        static_cast<uint16_t>((in.definedMask & elementMask) | (storage->definedMask & ~elementMask));
+    if(elementMask != 0)
+        storage->isFloat = in.isFloat;
+}
+
+void QPU::writeNativeConditional(Register dest, const NativeVector& in, ConditionCode cond, InstrumentedALU alu)
+{
+    const uint16_t elementMask = getNativeConditionMask(cond);
+    if(cond != COND_NEVER)
+        writeNativeRegister(dest, in, elementMask);
+
+    if(alu == InstrumentedALU::ADD)
+    {
+        if(elementMask != 0)
+            ++instrumentation[pc].numAddALUExecuted;
+        else
+            ++instrumentation[pc].numAddALUSkipped;
+    }
+    if(alu == InstrumentedALU::MUL)
+    {
+        if(elementMask != 0)
+            ++instrumentation[pc].numMulALUExecuted;
+        else
+            ++instrumentation[pc].numMulALUSkipped;
+    }
+}
+
+/*
+ * Returns the bit-masks of the elements matching the given condition and of the elements the flags checked by the
+ * condition are defined for
+ */
+static std::pair<uint16_t, uint16_t> toNativeConditionMasks(const NativeFlags& flags, ConditionCode cond)
+{
+    switch(cond.value)
+    {
+    case COND_ALWAYS.value:
+        return std::make_pair(ALL_ELEMENTS, ALL_ELEMENTS);
+    case COND_CARRY_CLEAR.value:
+        return std::make_pair(static_cast<uint16_t>(~flags.carrySet), flags.carryDefined);
+    case COND_CARRY_SET.value:
+        return std::make_pair(flags.carrySet, flags.carryDefined);
+    case COND_NEGATIVE_CLEAR.value:
+        return std::make_pair(static_cast<uint16_t>(~flags.negativeSet), flags.negativeDefined);
+    case COND_NEGATIVE_SET.value:
+        return std::make_pair(flags.negativeSet, flags.negativeDefined);
+    case COND_NEVER.value:
+        return std::make_pair(uint16_t{0}, ALL_ELEMENTS);
+    case COND_ZERO_CLEAR.value:
+        return std::make_pair(static_cast<uint16_t>(~flags.zeroSet), flags.zeroDefined);
+    case COND_ZERO_SET.value:
+        return std::make_pair(flags.zeroSet, flags.zeroDefined);
+    }
+    throw CompilationError(CompilationStep::GENERAL, "Unhandled condition code", cond.to_string());
+}
+
+uint16_t QPU::getNativeConditionMask(ConditionCode cond) const
+{
+    const auto masks = toNativeConditionMasks(nativeRegisters->flags, cond);
+    if(masks.second != ALL_ELEMENTS)
+        throw CompilationError(CompilationStep::GENERAL, "Reading undefined flags for condition", cond.to_string());
+    return masks.first;
+}
+
+bool QPU::isNativeConditionMet(BranchCond cond) const
+{
+    if(cond == BranchCond::ALWAYS)
+        return true;
+    ConditionCode singleCond = COND_NEVER;
+    bool checkAll;
+    std::tie(singleCond, checkAll) = toElementCondition(cond);
+    const auto masks = toNativeConditionMasks(nativeRegisters->flags, singleCond);
+    // same as std::all_of/std::any_of for the Value-based flags, the elements after the first one deciding the result
+    // are not checked for undefined flags
+    for(uint8_t i = 0; i < NATIVE_VECTOR_SIZE; ++i)
+    {
+        if(((masks.second >> i) & 1u) == 0)
+            throw CompilationError(
+                CompilationStep::GENERAL, "Reading undefined flags for condition", singleCond.to_string());
+        const bool matches = (masks.first >> i) & 1u;
+        if(matches != checkAll)
+            return matches;
+    }
+    return checkAll;
+}
+
+void QPU::setNativeFlags(const NativeResult& result, ConditionCode cond)
+{
+    // only update flags for elements we actually write (where we actually calculate a result)
+    const uint16_t mask = getNativeConditionMask(cond);
+    const auto& elements = result.value.elements;
+    const uint16_t zero = toElementMask([&](uint8_t i) -> bool { return elements[i] == 0; });
+    const uint16_t negative = toElementMask([&](uint8_t i) -> bool { return elements[i] >> 31; });
+    auto update = [mask](uint16_t& flag, uint16_t newFlag) {
+        flag = static_cast<uint16_t>((flag & ~mask) | (newFlag & mask));
+    };
+    NativeFlags& flags = nativeRegisters->flags;
+    update(flags.zeroSet, zero);
+    update(flags.zeroDefined, result.value.definedMask);
+    update(flags.negativeSet, negative);
+    update(flags.negativeDefined, result.value.definedMask);
+    update(flags.carrySet, result.carrySet);
+    update(flags.carryDefined, result.carryDefined);
+    // the overflow flag is not stored, it is only valid for the one instruction
+
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 200, "flags set", 1);
+}
+
+std::vector<MemoryAddress> tools::buildUniforms(Memory& memory, MemoryAddress baseAddress,
+    const std::vector<MemoryAddress>& parameter, const WorkGroupConfig& config, MemoryAddress globalData,
+    const KernelUniforms& uniformsUsed, Word firstGroup, Word lastGroup)
+{
+    std::vector<MemoryAddress> res;
+
+    Word numQPUs = config.localSizes.at(0) * config.localSizes.at(1) * config.localSizes.at(2);
+    lastGroup = std::min(lastGroup, config.numGroups.at(0) * config.numGroups.at(1) * config.numGroups.at(2));
+    res.reserve(numQPUs);
+
+    std::array<Word, 3> groupIDs = {0, 0, 0};
+
+    std::vector<Word> qpuUniforms;
+    qpuUniforms.resize(uniformsUsed.countUniforms() + 1 /* re-run flag */ + parameter.size());
+
+    for(uint8_t q = 0; q < numQPUs; ++q)
+    {
+        std::array<Word, 3> localIDs = {q % config.localSizes.at(0),
+            (q / config.localSizes.at(0)) % config.localSizes.at(1),
+            (q / config.localSizes.at(0)) / config.localSizes.at(1)};
+
+        for(Word g = firstGroup; g < lastGroup; ++g)
+        {
+            groupIDs = {g % config.numGroups.at(0), (g / config.numGroups.at(0)) % config.numGroups.at(1),
+                (g / config.numGroups.at(0)) / config.numGroups.at(1)};
+
+            std::size_t i = 0;
+            if(uniformsUsed.getWorkDimensionsUsed())
+                qpuUniforms[i++] = config.dimensions;
+            if(uniformsUsed.getLocalSizesUsed())
+                qpuUniforms[i++] =
+                    (config.localSizes.at(2) << 16) | (config.localSizes.at(1) << 8) | config.localSizes.at(0);
+            if(uniformsUsed.getLocalIDsUsed())
+                qpuUniforms[i++] = (localIDs.at(2) << 16) | (localIDs.at(1) << 8) | localIDs.at(0);
+            if(uniformsUsed.getNumGroupsXUsed())
+                qpuUniforms[i++] = config.numGroups.at(0);
+            if(uniformsUsed.getNumGroupsYUsed())
+                qpuUniforms[i++] = config.numGroups.at(1);
+            if(uniformsUsed.getNumGroupsZUsed())
+                qpuUniforms[i++] = config.numGroups.at(2);
+            if(uniformsUsed.getGroupIDXUsed())
+                qpuUniforms[i++] = groupIDs.at(0);
+            if(uniformsUsed.getGroupIDYUsed())
+                qpuUniforms[i++] = groupIDs.at(1);
+            if(uniformsUsed.getGroupIDZUsed())
+                qpuUniforms[i++] = groupIDs.at(2);
+            if(uniformsUsed.getGlobalOffsetXUsed())
+                qpuUniforms[i++] = config.globalOffsets.at(0);
+            if(uniformsUsed.getGlobalOffsetYUsed())
+                qpuUniforms[i++] = config.globalOffsets.at(1);
+            if(uniformsUsed.getGlobalOffsetZUsed())
+                qpuUniforms[i++] = config.globalOffsets.at(2);
+            if(uniformsUsed.getGlobalDataAddressUsed())
+                qpuUniforms[i++] = globalData;
+            for(auto param : parameter)
+            {
+                qpuUniforms[i++] = param;
+            }
+            qpuUniforms[i++] = (lastGroup - 1) - g;
+
+            memory.setUniforms(qpuUniforms, baseAddress);
+            if(g == firstGroup)
+                res.emplace_back(baseAddress);
+
+            baseAddress += static_cast<Word>(qpuUniforms.size() * sizeof(Word));
+        }
+    }
+
+    return res;
+}
+
+/*
+ * Snapshots
+ *
+ * All values are stored in the byte order of the host, so a snapshot can only be resumed on a host with the same
+ * endianness.
+ */
+static const std::string SNAPSHOT_MAGIC = "VC4CSNAP";
+static constexpr uint32_t SNAPSHOT_VERSION = 1;
+// the owner stored for a mutex not owned by any QPU
+static constexpr uint8_t NO_QPU = 0xFF;
+
+// the kinds of Values stored in a snapshot
+enum class SnapshotValue : uint8_t
+{
+    UNDEFINED,
+    LITERAL,
+    CONTAINER
+};
+
+template <typename T>
+static void writeBinary(std::ostream& out, T val)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be written directly");
+    out.write(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+template <typename T>
+static T readBinary(std::istream& in)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be read directly");
+    T val{};
+    if(!in.read(reinterpret_cast<char*>(&val), sizeof(T)))
+        throw CompilationError(CompilationStep::GENERAL, "Unexpected end of emulator snapshot");
+    return val;
+}
+
+static void writeString(std::ostream& out, const std::string& s)
+{
+    writeBinary(out, static_cast<uint32_t>(s.size()));
+    out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+static std::string readString(std::istream& in)
+{
+    std::string s(readBinary<uint32_t>(in), '\0');
+    if(!in.read(&s[0], static_cast<std::streamsize>(s.size())))
+        throw CompilationError(CompilationStep::GENERAL, "Unexpected end of emulator snapshot");
+    return s;
+}
+
+static void writeType(std::ostream& out, DataType type)
+{
+    // the scalar bit-count of the unknown type (of undefined values) is not its actual bit-width. Complex types (e.g.
+    // pointers) are stored as integers of the same bit-width, since the emulation only depends on the bits
+    writeBinary<uint8_t>(out, type.isUnknown() ? static_cast<uint8_t>(DataType::UNKNOWN) : type.getScalarBitCount());
+    writeBinary<uint8_t>(out, type.getVectorWidth());
+    writeBinary<uint8_t>(out, type.isFloatingType());
+}
+
+static DataType readType(std::istream& in)
+{
+    const auto bitWidth = readBinary<uint8_t>(in);
+    const auto vectorWidth = readBinary<uint8_t>(in);
+    const bool isFloat = readBinary<uint8_t>(in) != 0;
+    return DataType(bitWidth, vectorWidth, isFloat);
+}
+
+static void writeValue(std::ostream& out, const Value& val)
+{
+    writeType(out, val.type);
+    if(auto container = val.checkContainer())
+    {
+        writeBinary(out, SnapshotValue::CONTAINER);
+        writeBinary(out, static_cast<uint32_t>(container->elements.size()));
+        for(const Value& element : container->elements)
+            writeValue(out, element);
+    }
+    else if(auto lit = val.getLiteralValue())
+    {
+        writeBinary(out, SnapshotValue::LITERAL);
+        writeBinary(out, lit->type);
+        writeBinary(out, lit->unsignedInt());
+    }
+    else if(val.isUndefined())
+        writeBinary(out, SnapshotValue::UNDEFINED);
+    else
+        throw CompilationError(CompilationStep::GENERAL, "Cannot store value in emulator snapshot", val.to_string());
+}
+
+static Value readValue(std::istream& in)
+{
+    const DataType type = readType(in);
+    switch(readBinary<SnapshotValue>(in))
+    {
+    case SnapshotValue::UNDEFINED:
+        return Value(type);
+    case SnapshotValue::LITERAL:
+    {
+        const auto literalType = readBinary<LiteralType>(in);
+        const auto bits = readBinary<uint32_t>(in);
+        if(literalType == LiteralType::REAL)
+            return Value(Literal(bit_cast<uint32_t, float>(bits)), type);
+        if(literalType == LiteralType::BOOL)
+            return Value(Literal(bits != 0), type);
+        return Value(Literal(bits), type);
+    }
+    case SnapshotValue::CONTAINER:
+    {
+        const auto numElements = readBinary<uint32_t>(in);
+        ContainerValue container(numElements);
+        for(uint32_t i = 0; i < numElements; ++i)
+            container.elements.emplace_back(readValue(in));
+        return Value(std::move(container), type);
+    }
+    }
+    throw CompilationError(CompilationStep::GENERAL, "Invalid value in emulator snapshot");
+}
+
+static void writeOptionalValue(std::ostream& out, const Optional<Value>& val)
+{
+    writeBinary<uint8_t>(out, val.has_value());
+    if(val)
+        writeValue(out, *val);
+}
+
+static Optional<Value> readOptionalValue(std::istream& in)
+{
+    if(readBinary<uint8_t>(in) == 0)
+        return NO_VALUE;
+    return readValue(in);
+}
+
+static void writeNativeVector(std::ostream& out, const NativeVector& vec)
+{
+    for(tools::Word element : vec.elements)
+        writeBinary(out, element);
+    writeBinary(out, vec.definedMask);
+    writeBinary<uint8_t>(out, vec.isFloat);
+}
+
+static void readNativeVector(std::istream& in, NativeVector& vec)
+{
+    for(tools::Word& element : vec.elements)
+        element = readBinary<tools::Word>(in);
+    vec.definedMask = readBinary<uint16_t>(in);
+    vec.isFloat = readBinary<uint8_t>(in) != 0;
+}
+
+std::size_t Memory::getNumPages() const
+{
+    const std::size_t pageSize = std::size_t{1} << PAGE_BITS;
+    return (static_cast<std::size_t>(getMaximumAddress()) + pageSize - 1) / pageSize;
+}
+
+std::pair<uint8_t*, std::size_t> Memory::getPage(std::size_t index)
+{
+    const std::size_t pageSize = std::size_t{1} << PAGE_BITS;
+    if(auto paged = VariantNamespace::get_if<PagedMemory>(&data))
+        return std::make_pair(paged->pageTable.at(index), pageSize);
+    if(auto direct = VariantNamespace::get_if<DirectBuffer>(&data))
+    {
+        // the last page of a direct buffer might only be partially used
+        const std::size_t offset = index * pageSize;
+        return std::make_pair(reinterpret_cast<uint8_t*>(direct->data()) + offset,
+            std::min(pageSize, direct->size() * sizeof(Word) - offset));
+    }
+    throw CompilationError(CompilationStep::GENERAL, "Snapshots of mapped buffers are not supported");
+}
+
+void Memory::markModified(MemoryAddress address, std::size_t numBytes)
+{
+    // before the first snapshot, all pages are written anyway
+    if(modifiedPages.empty() || numBytes == 0)
+        return;
+    const std::size_t lastPage = std::min((address + numBytes - 1) >> PAGE_BITS, modifiedPages.size() - 1);
+    for(std::size_t page = address >> PAGE_BITS; page <= lastPage; ++page)
+        modifiedPages[page] = true;
+}
+
+void Memory::writePages(std::ostream& out)
+{
+    if(VariantNamespace::get_if<MappedBuffers>(&data))
+        throw CompilationError(CompilationStep::GENERAL, "Snapshots of mapped buffers are not supported");
+    const std::size_t numPages = getNumPages();
+    std::vector<uint32_t> pages;
+    for(std::size_t i = 0; i < numPages; ++i)
+    {
+        if(modifiedPages.empty() || modifiedPages[i])
+            pages.emplace_back(static_cast<uint32_t>(i));
+    }
+
+    writeBinary(out, getMaximumAddress());
+    writeBinary(out, static_cast<uint32_t>(pages.size()));
+    for(uint32_t index : pages)
+    {
+        auto page = getPage(index);
+        const bool isZeroPage =
+            std::all_of(page.first, page.first + page.second, [](uint8_t byte) -> bool { return byte == 0; });
+        writeBinary(out, index);
+        writeBinary<uint8_t>(out, isZeroPage);
+        if(!isZeroPage)
+            out.write(reinterpret_cast<const char*>(page.first), static_cast<std::streamsize>(page.second));
+    }
+    CPPLOG_LAZY(logging::Level::DEBUG,
+        log << "Wrote " << pages.size() << " of " << numPages << " memory pages into snapshot" << logging::endl);
+    PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 300, "snapshot pages written", pages.size());
+    modifiedPages.assign(numPages, false);
+}
+
+void Memory::readPages(std::istream& in)
+{
+    if(VariantNamespace::get_if<MappedBuffers>(&data))
+        throw CompilationError(CompilationStep::GENERAL, "Snapshots of mapped buffers are not supported");
+    const auto size = readBinary<MemoryAddress>(in);
+    if(size != getMaximumAddress())
+        throw CompilationError(CompilationStep::GENERAL, "Memory size of emulator snapshot does not match",
+            std::to_string(size) + " and " + std::to_string(getMaximumAddress()));
+    const std::size_t numPages = getNumPages();
+    const auto numStoredPages = readBinary<uint32_t>(in);
+    for(uint32_t i = 0; i < numStoredPages; ++i)
+    {
+        const auto index = readBinary<uint32_t>(in);
+        if(index >= numPages)
+            throw CompilationError(
+                CompilationStep::GENERAL, "Memory page of emulator snapshot is out of bounds", std::to_string(index));
+        auto page = getPage(index);
+        if(readBinary<uint8_t>(in) != 0)
+            std::fill_n(page.first, page.second, 0);
+        else if(!in.read(reinterpret_cast<char*>(page.first), static_cast<std::streamsize>(page.second)))
+            throw CompilationError(CompilationStep::GENERAL, "Unexpected end of emulator snapshot");
+    }
+    // the next snapshot only needs to contain the pages modified after this one
+    modifiedPages.assign(numPages, false);
+}
+
+void Mutex::writeState(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(guard);
+    writeBinary<uint8_t>(out, locked);
+    // the owner is stored as its index, since the QPUs are re-created on resuming
+    writeBinary<uint8_t>(out, lockOwner ? lockOwner->ID : NO_QPU);
+}
+
+void Mutex::readState(std::istream& in, const std::vector<QPU>& qpus)
+{
+    std::lock_guard<std::mutex> lock(guard);
+    locked = readBinary<uint8_t>(in) != 0;
+    const auto owner = readBinary<uint8_t>(in);
+    lockOwner = owner < qpus.size() ? &qpus[owner] : nullptr;
+}
+
+void Registers::writeState(std::ostream& out) const
+{
+    writeBinary(out, static_cast<uint32_t>(storageRegisters.size()));
+    for(const auto& reg : storageRegisters)
+    {
+        writeBinary(out, reg.first.file);
+        writeBinary(out, reg.first.num);
+        writeValue(out, reg.second);
+    }
+    writeOptionalValue(out, hostInterrupt);
+    // the read cache is cleared after every instruction, so it is always empty between two cycles
+}
+
+void Registers::readState(std::istream& in)
+{
+    storageRegisters.clear();
+    const auto numRegisters = readBinary<uint32_t>(in);
+    for(uint32_t i = 0; i < numRegisters; ++i)
+    {
+        const auto file = readBinary<RegisterFile>(in);
+        const auto num = readBinary<unsigned char>(in);
+        storageRegisters.emplace(Register{file, num}, readValue(in));
+    }
+    hostInterrupt = readOptionalValue(in);
+    readCache.clear();
+}
+
+void UniformCache::writeState(std::ostream& out) const
+{
+    writeBinary(out, uniformAddress);
+    writeBinary(out, lastAddressSetCycle);
+}
+
+void UniformCache::readState(std::istream& in)
+{
+    uniformAddress = readBinary<MemoryAddress>(in);
+    lastAddressSetCycle = readBinary<uint32_t>(in);
+}
+
+static void writeTMUQueue(std::ostream& out, std::queue<std::pair<Value, uint32_t>> queue)
+{
+    writeBinary(out, static_cast<uint32_t>(queue.size()));
+    for(; !queue.empty(); queue.pop())
+    {
+        writeValue(out, queue.front().first);
+        writeBinary(out, queue.front().second);
+    }
+}
+
+static void readTMUQueue(std::istream& in, std::queue<std::pair<Value, uint32_t>>& queue)
+{
+    std::queue<std::pair<Value, uint32_t>>().swap(queue);
+    const auto numEntries = readBinary<uint32_t>(in);
+    for(uint32_t i = 0; i < numEntries; ++i)
+    {
+        Value val = readValue(in);
+        queue.emplace(std::move(val), readBinary<uint32_t>(in));
+    }
+}
+
+void TMUs::writeState(std::ostream& out) const
+{
+    writeBinary<uint8_t>(out, tmuNoSwap);
+    writeBinary(out, lastTMUNoSwap);
+    writeTMUQueue(out, tmu0RequestQueue);
+    writeTMUQueue(out, tmu0ResponseQueue);
+    writeTMUQueue(out, tmu1RequestQueue);
+    writeTMUQueue(out, tmu1ResponseQueue);
+}
+
+void TMUs::readState(std::istream& in)
+{
+    tmuNoSwap = readBinary<uint8_t>(in) != 0;
+    lastTMUNoSwap = readBinary<uint32_t>(in);
+    readTMUQueue(in, tmu0RequestQueue);
+    readTMUQueue(in, tmu0ResponseQueue);
+    readTMUQueue(in, tmu1RequestQueue);
+    readTMUQueue(in, tmu1ResponseQueue);
+}
+
+void SFU::writeState(std::ostream& out) const
+{
+    writeBinary(out, lastSFUWrite);
+    writeBinary(out, currentCycle);
+    writeOptionalValue(out, sfuResult);
+}
+
+void SFU::readState(std::istream& in)
+{
+    lastSFUWrite = readBinary<uint32_t>(in);
+    currentCycle = readBinary<uint32_t>(in);
+    sfuResult = readOptionalValue(in);
+}
+
+void VPM::writeState(std::ostream& out) const
+{
+    writeBinary(out, vpmReadSetup);
+    writeBinary(out, vpmWriteSetup);
+    writeBinary(out, dmaReadSetup);
+    writeBinary(out, dmaWriteSetup);
+    writeBinary(out, readStrideSetup);
+    writeBinary(out, writeStrideSetup);
+    writeBinary(out, lastDMAReadTrigger);
+    writeBinary(out, lastDMAWriteTrigger);
+    writeBinary(out, currentCycle);
+    writeBinary(out, cache);
+}
+
+void VPM::readState(std::istream& in)
+{
+    vpmReadSetup = readBinary<uint32_t>(in);
+    vpmWriteSetup = readBinary<uint32_t>(in);
+    dmaReadSetup = readBinary<uint32_t>(in);
+    dmaWriteSetup = readBinary<uint32_t>(in);
+    readStrideSetup = readBinary<uint32_t>(in);
+    writeStrideSetup = readBinary<uint32_t>(in);
+    lastDMAReadTrigger = readBinary<uint32_t>(in);
+    lastDMAWriteTrigger = readBinary<uint32_t>(in);
+    currentCycle = readBinary<uint32_t>(in);
+    cache = readBinary<decltype(cache)>(in);
+}
+
+void Semaphores::writeState(std::ostream& out) const
+{
+    writeBinary(out, counter);
+}
+
+void Semaphores::readState(std::istream& in)
+{
+    counter = readBinary<decltype(counter)>(in);
+}
+
+void QPU::writeState(std::ostream& out) const
+{
+    writeBinary(out, currentCycle);
+    writeBinary(out, pc);
+    for(const ElementFlags& elementFlags : flags)
+        writeBinary(out, elementFlags);
+    writeBinary<uint8_t>(out, nativeRegisters != nullptr);
+    if(nativeRegisters)
+    {
+        for(const NativeVector& vec : nativeRegisters->fileA)
+            writeNativeVector(out, vec);
+        for(const NativeVector& vec : nativeRegisters->fileB)
+            writeNativeVector(out, vec);
+        for(const NativeVector& vec : nativeRegisters->accumulators)
+            writeNativeVector(out, vec);
+        writeBinary(out, nativeRegisters->flags);
+    }
+    registers.writeState(out);
+    uniforms.writeState(out);
+    tmus.writeState(out);
+}
+
+void QPU::readState(std::istream& in, const DecodedProgram& program)
+{
+    currentCycle = readBinary<uint32_t>(in);
+    pc = readBinary<ProgramCounter>(in);
+    if(pc >= program.size())
+        throw CompilationError(CompilationStep::GENERAL,
+            "Program counter of emulator snapshot is outside of the emulated code", std::to_string(pc));
+    // the instruction is only used for logging, e.g. if the emulation times out before this QPU executes again
+    currentInstruction = program[pc].instruction;
+    for(ElementFlags& elementFlags : flags)
+        elementFlags = readBinary<ElementFlags>(in);
+    if((readBinary<uint8_t>(in) != 0) != (nativeRegisters != nullptr))
+        throw CompilationError(
+            CompilationStep::GENERAL, "Emulator snapshot was written with another emulation backend");
+    if(nativeRegisters)
+    {
+        for(NativeVector& vec : nativeRegisters->fileA)
+            readNativeVector(in, vec);
+        for(NativeVector& vec : nativeRegisters->fileB)
+            readNativeVector(in, vec);
+        for(NativeVector& vec : nativeRegisters->accumulators)
+            readNativeVector(in, vec);
+        nativeRegisters->flags = readBinary<NativeFlags>(in);
+    }
+    registers.readState(in);
+    uniforms.readState(in);
+    tmus.readState(in);
+}
+
+/*
+ * References to the state of an emulation shared by all QPUs, which is written into and read from snapshots together
+ * with the state of the single QPUs
+ */
+struct EmulationState
+{
+    uint32_t& cycle;
+    std::bitset<NATIVE_VECTOR_SIZE>& activeQPUs;
+    std::vector<QPU>& qpus;
+    std::array<SFU, NUM_QPUS>& sfus;
+    VPM& vpm;
+    Semaphores& semaphores;
+    Mutex& mutex;
+    Memory& memory;
+    InstrumentationResults& instrumentation;
+};
+
+/*
+ * Calculates a (FNV-1a style) checksum over the emulated code, to reject snapshots written for another kernel
+ */
+static uint64_t calculateChecksum(const DecodedProgram& program)
+{
+    uint64_t checksum = 0xcbf29ce484222325;
+    for(const DecodedInstruction& inst : program)
+    {
+        checksum ^= inst.instruction->toBinaryCode();
+        checksum *= 0x100000001b3;
+    }
+    return checksum;
+}
+
+/*
+ * Writes a snapshot of the state after the current cycle into the given file.
+ *
+ * Snapshot format:
+ * - header: magic number, format version, cycle, code checksum, number of QPUs, file name of the base snapshot
+ * - memory: the pages modified since the base snapshot (or all pages, if there is no base snapshot)
+ * - state: the active QPUs, the state of every QPU and of the SFUs, VPM, semaphores and mutex
+ * - the instrumentation results up to the current cycle
+ */
+static void writeSnapshot(
+    const std::string& fileName, const std::string& baseFile, const EmulationState& state, uint64_t checksum)
+{
+    PROFILE_START(WriteSnapshot);
+    std::ofstream out(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!out)
+        throw CompilationError(CompilationStep::GENERAL, "Failed to open emulator snapshot for writing", fileName);
+    out.write(SNAPSHOT_MAGIC.data(), static_cast<std::streamsize>(SNAPSHOT_MAGIC.size()));
+    writeBinary(out, SNAPSHOT_VERSION);
+    writeBinary(out, state.cycle);
+    writeBinary(out, checksum);
+    writeBinary(out, static_cast<uint8_t>(state.qpus.size()));
+    writeString(out, baseFile);
+
+    state.memory.writePages(out);
+
+    writeBinary(out, static_cast<uint16_t>(state.activeQPUs.to_ulong()));
+    for(const QPU& qpu : state.qpus)
+        qpu.writeState(out);
+    for(const SFU& sfu : state.sfus)
+        sfu.writeState(out);
+    state.vpm.writeState(out);
+    state.semaphores.writeState(out);
+    state.mutex.writeState(out);
+
+    writeBinary(out, static_cast<uint32_t>(state.instrumentation.size()));
+    for(const InstrumentationResult& result : state.instrumentation)
+        writeBinary(out, result);
+    if(!out)
+        throw CompilationError(CompilationStep::GENERAL, "Failed to write emulator snapshot", fileName);
+    PROFILE_END(WriteSnapshot);
+    CPPLOG_LAZY(logging::Level::INFO,
+        log << "Wrote snapshot of emulation cycle " << state.cycle << " into: " << fileName << logging::endl);
+}
+
+/*
+ * Reads and checks the header of the given snapshot and returns the file name of its base snapshot
+ */
+static std::string readSnapshotHeader(
+    std::istream& in, const std::string& fileName, const EmulationState& state, uint64_t checksum)
+{
+    std::string magic(SNAPSHOT_MAGIC.size(), '\0');
+    if(!in.read(&magic[0], static_cast<std::streamsize>(magic.size())) || magic != SNAPSHOT_MAGIC ||
+        readBinary<uint32_t>(in) != SNAPSHOT_VERSION)
+        throw CompilationError(CompilationStep::GENERAL, "Invalid or unsupported emulator snapshot", fileName);
+    state.cycle = readBinary<uint32_t>(in);
+    if(readBinary<uint64_t>(in) != checksum || readBinary<uint8_t>(in) != state.qpus.size())
+        throw CompilationError(CompilationStep::GENERAL,
+            "Emulator snapshot was written for another kernel or number of QPUs", fileName);
+    return readString(in);
+}
+
+/*
+ * Restores the state of the emulation from the given snapshot file
+ */
+static void readSnapshot(
+    const std::string& fileName, const EmulationState& state, const DecodedProgram& program, uint64_t checksum)
+{
+    PROFILE_START(ReadSnapshot);
+    // a snapshot only contains the memory pages modified since its base snapshot, so we need to apply the memory of
+    // all snapshots the given one is based on, starting with the oldest one
+    std::vector<std::string> snapshotFiles{fileName};
+    while(true)
+    {
+        std::ifstream in(snapshotFiles.back(), std::ios::in | std::ios::binary);
+        if(!in)
+            throw CompilationError(CompilationStep::GENERAL, "Failed to open emulator snapshot", snapshotFiles.back());
+        auto baseFile = readSnapshotHeader(in, snapshotFiles.back(), state, checksum);
+        if(baseFile.empty())
+            break;
+        if(std::find(snapshotFiles.begin(), snapshotFiles.end(), baseFile) != snapshotFiles.end())
+            throw CompilationError(CompilationStep::GENERAL, "Cyclic reference of emulator snapshots", baseFile);
+        snapshotFiles.emplace_back(std::move(baseFile));
+    }
+
+    std::ifstream in;
+    for(auto it = snapshotFiles.rbegin(); it != snapshotFiles.rend(); ++it)
+    {
+        in.close();
+        in.clear();
+        in.open(*it, std::ios::in | std::ios::binary);
+        if(!in)
+            throw CompilationError(CompilationStep::GENERAL, "Failed to open emulator snapshot", *it);
+        readSnapshotHeader(in, *it, state, checksum);
+        state.memory.readPages(in);
+    }
+
+    // the stream is now positioned after the memory of the snapshot to resume
+    state.activeQPUs = std::bitset<NATIVE_VECTOR_SIZE>(readBinary<uint16_t>(in));
+    for(QPU& qpu : state.qpus)
+        qpu.readState(in, program);
+    for(SFU& sfu : state.sfus)
+        sfu.readState(in);
+    state.vpm.readState(in);
+    state.semaphores.readState(in);
+    state.mutex.readState(in, state.qpus);
+
+    if(readBinary<uint32_t>(in) != state.instrumentation.size())
+        throw CompilationError(
+            CompilationStep::GENERAL, "Emulator snapshot was written for code of another size", fileName);
+    for(InstrumentationResult& result : state.instrumentation)
+        result = readBinary<InstrumentationResult>(in);
+    PROFILE_END(ReadSnapshot);
+    CPPLOG_LAZY(logging::Level::INFO,
+        log << "Resuming emulation at cycle " << state.cycle << " from snapshot " << fileName << " (based on "
+            << (snapshotFiles.size() - 1) << " other snapshots)" << logging::endl);
+}
+
+static void emulateStep(
+    const DecodedProgram& program, std::vector<QPU>& qpus, std::bitset<NATIVE_VECTOR_SIZE>& activeQPUs)
+{
+    for(unsigned i = 0; i < qpus.size(); ++i)
+    {
+        if(!activeQPUs.test(i))
+            continue;
+        try
+        {
+            bool continueRunning = qpus[i].execute(program);
+            if(!continueRunning)
+                // this QPU has finished
+                activeQPUs.reset(i);
+        }
+        catch(const std::exception&)
+        {
+            logging::error() << "Emulation threw exception execution following instruction on QPU " << qpus[i].ID
+                             << ": " << qpus[i].getCurrentInstruction()->toHexString(true)
+                             << logging::endl;
+            // re-throw error
+            throw;
+        }
+    }
+}
+
+DecodedProgram tools::decodeProgram(std::vector<qpu_asm::Instruction>::const_iterator firstInstruction,
+    std::vector<qpu_asm::Instruction>::const_iterator lastInstruction, bool useNativeBackend)
+{
+    DecodedProgram program;
+    program.reserve(static_cast<std::size_t>(std::distance(firstInstruction, lastInstruction)));
+    for(auto it = firstInstruction; it != lastInstruction; ++it)
+        program.emplace_back(QPU::decode(*it, useNativeBackend));
+    return program;
+}
+
+bool tools::emulate(std::vector<qpu_asm::Instruction>::const_iterator firstInstruction,
+    std::vector<qpu_asm::Instruction>::const_iterator lastInstruction, Memory& memory,
+    const std::vector<MemoryAddress>& uniformAddresses, InstrumentationResults& instrumentation, uint32_t maxCycles,
+    uint32_t* numCycles, bool useNativeBackend, Mutex* sharedMutex, const SnapshotConfig* snapshots)
+{
+    if(uniformAddresses.size() > NUM_QPUS)
+        throw CompilationError(CompilationStep::GENERAL, "Cannot use more than 12 QPUs!");
+
+    // decode all instructions once up front instead of in every cycle
+    PROFILE_START(DecodeProgram);
+    const DecodedProgram program = decodeProgram(firstInstruction, lastInstruction, useNativeBackend);
+    PROFILE_END(DecodeProgram);
+    if(program.empty())
+        throw CompilationError(CompilationStep::GENERAL, "Cannot emulate an empty program!");
+    instrumentation.assign(program.size(), InstrumentationResult{});
+
+    Mutex localMutex;
+    Mutex& mutex = sharedMutex ? *sharedMutex : localMutex;
+    // FIXME is SFU execution per QPU or need SFUs be locked?
+    std::array<SFU, NUM_QPUS> sfus;
+    VPM vpm(memory);
+    Semaphores semaphores;
+
+    std::vector<QPU> qpus;
+    qpus.reserve(uniformAddresses.size());
+    std::bitset<NATIVE_VECTOR_SIZE> activeQPUs = (1 << uniformAddresses.size()) - 1;
+    uint8_t numQPU = 0;
+    for(MemoryAddress uniformPointer : uniformAddresses)
+    {
+        qpus.emplace_back(numQPU, mutex, sfus.at(numQPU), vpm, semaphores, memory, uniformPointer, instrumentation,
+            useNativeBackend);
+        ++numQPU;
+    }
+
+    uint32_t cycle = 0;
+    bool success = true;
+    const EmulationState state{cycle, activeQPUs, qpus, sfus, vpm, semaphores, mutex, memory, instrumentation};
+    const uint64_t checksum = snapshots ? calculateChecksum(program) : 0;
+    // the snapshot the next snapshot written is based on
+    std::string lastSnapshot;
+    if(snapshots && !snapshots->resumeFile.empty())
+    {
+        readSnapshot(snapshots->resumeFile, state, program, checksum);
+        lastSnapshot = snapshots->resumeFile;
+    }
 
-    uint32_t cycle = 0;
-    bool success = true;
     PROFILE_START(Emulation);
     while(activeQPUs.any())
     {
         CPPLOG_LAZY(logging::Level::DEBUG, log << "Emulating cycle: " << cycle << logging::endl);
         PROFILE_COUNTER(vc4c::profiler::COUNTER_EMULATOR + 250, "emulation cycles (utilization)", qpus.size());
-        emulateStep(firstInstruction, qpus, activeQPUs);
+        emulateStep(program, qpus, activeQPUs);
         for(SFU& sfu : sfus)
             sfu.incrementCycle();
         vpm.incrementCycle();
 
         ++cycle;
 
-        if(cycle == maxCycles)
+        // also write a snapshot when running into the cycle limit, so the emulation can be resumed with a higher limit
+        if(snapshots && snapshots->interval != 0 && (cycle % snapshots->interval == 0 || cycle >= maxCycles) &&
+            activeQPUs.any())
+        {
+            auto fileName = snapshots->filePrefix + "." + std::to_string(cycle) + ".snapshot";
+            writeSnapshot(fileName, lastSnapshot, state, checksum);
+            lastSnapshot = std::move(fileName);
+        }
+
+        if(cycle >= maxCycles)
         {
             logging::error() << "After the maximum number of execution cycles, following QPUs are still running: "
                              << logging::endl;
             for(const QPU& qpu : qpus)
                 logging::error() << "QPU " << static_cast<unsigned>(qpu.ID) << ": "
-                                 << qpu.getCurrentInstruction(firstInstruction)->toASMString() << logging::endl;
+                                 << qpu.getCurrentInstruction()->toASMString() << logging::endl;
             success = false;
             break;
         }
@@ -1805,14 +3434,16 @@ bool tools::emulate(std::vector<qpu_asm::Instruction>::const_iterator firstInstr
         log << "Emulation " << (success ? "finished" : "timed out") << " for " << uniformAddresses.size()
             << " QPUs after " << cycle << " cycles" << logging::endl);
 
+    if(numCycles != nullptr)
+        *numCycles = cycle;
     vpm.dumpContents();
     return success;
 }
 
 bool tools::emulateTask(std::vector<qpu_asm::Instruction>::const_iterator firstInstruction,
-    const std::vector<MemoryAddress>& parameter, Memory& memory, MemoryAddress uniformBaseAddress,
-    MemoryAddress globalData, const KernelUniforms& uniformsUsed, InstrumentationResults& instrumentation,
-    uint32_t maxCycles)
+    std::vector<qpu_asm::Instruction>::const_iterator lastInstruction, const std::vector<MemoryAddress>& parameter,
+    Memory& memory, MemoryAddress uniformBaseAddress, MemoryAddress globalData, const KernelUniforms& uniformsUsed,
+    InstrumentationResults& instrumentation, uint32_t maxCycles, bool useNativeBackend)
 {
     WorkGroupConfig config;
     config.dimensions = 1;
@@ -1821,7 +3452,8 @@ bool tools::emulateTask(std::vector<qpu_asm::Instruction>::const_iterator firstI
     config.numGroups = {1, 1, 1};
     const auto uniformAddresses =
         buildUniforms(memory, uniformBaseAddress, parameter, config, globalData, uniformsUsed);
-    return emulate(firstInstruction, memory, uniformAddresses, instrumentation, maxCycles);
+    return emulate(firstInstruction, lastInstruction, memory, uniformAddresses, instrumentation, maxCycles, nullptr,
+        useNativeBackend);
 }
 
 static Memory fillMemory(const StableList<Global>& globalData, const EmulationData& settings,
@@ -1837,7 +3469,11 @@ static Memory fillMemory(const StableList<Global>& globalData, const EmulationDa
     while((size % 8) != 0)
         ++size;
     size += settings.calcNumWorkItems() * (16 + settings.parameter.size());
-    Memory mem(size);
+    // if any file is mapped, the global data, the copied parameters and the UNIFORMs are placed in an anonymous region
+    // at the start of the paged memory and the files are mapped behind it
+    Memory mem = settings.mappedParameters.empty() ? Memory(size) : Memory();
+    if(!settings.mappedParameters.empty())
+        mem.mapAnonymous(size * sizeof(tools::Word));
 
     MemoryAddress currentAddress = 0;
     globalDataAddressOut = currentAddress;
@@ -1855,10 +3491,14 @@ static Memory fillMemory(const StableList<Global>& globalData, const EmulationDa
     }
 
     parameterAddressesOut.reserve(settings.parameter.size());
-    for(const auto& pair : settings.parameter)
+    for(std::size_t i = 0; i < settings.parameter.size(); ++i)
     {
+        const auto& pair = settings.parameter[i];
         tools::Word* addr = mem.getWordAddress(currentAddress);
-        if(pair.second)
+        auto mappedIt = settings.mappedParameters.find(i);
+        if(mappedIt != settings.mappedParameters.end())
+            parameterAddressesOut.emplace_back(mem.mapFile(mappedIt->second.fileName, mappedIt->second.minimumSize));
+        else if(pair.second)
         {
             parameterAddressesOut.emplace_back(currentAddress);
             std::copy_n(pair.second->data(), pair.second->size(), addr);
@@ -1904,6 +3544,21 @@ static void dumpMemory(const Memory& memory, const std::string& fileName, Memory
         log << std::dec << "Dumped " << addr << " words of memory into " << fileName << logging::endl);
 }
 
+InstrumentationResult& InstrumentationResult::operator+=(const InstrumentationResult& other)
+{
+    numAddALUExecuted += other.numAddALUExecuted;
+    numAddALUSkipped += other.numAddALUSkipped;
+    numMulALUExecuted += other.numMulALUExecuted;
+    numMulALUSkipped += other.numMulALUSkipped;
+    numBranchTaken += other.numBranchTaken;
+    numStalls += other.numStalls;
+    numExecutions += other.numExecutions;
+    numTMULoads += other.numTMULoads;
+    numVPMAccesses += other.numVPMAccesses;
+    numDMAAccesses += other.numDMAAccesses;
+    return *this;
+}
+
 std::string InstrumentationResult::to_string() const
 {
     std::vector<std::string> parts;
@@ -1937,10 +3592,39 @@ std::string InstrumentationResult::to_string() const
         parts.emplace_back(tmp.str());
         tmp.str("");
     }
+    if(numTMULoads > 0)
+    {
+        tmp << "tmu: " << numTMULoads;
+        parts.emplace_back(tmp.str());
+        tmp.str("");
+    }
+    if(numVPMAccesses > 0)
+    {
+        tmp << "vpm: " << numVPMAccesses;
+        parts.emplace_back(tmp.str());
+        tmp.str("");
+    }
+    if(numDMAAccesses > 0)
+    {
+        tmp << "dma: " << numDMAAccesses;
+        parts.emplace_back(tmp.str());
+        tmp.str("");
+    }
 
     return vc4c::to_string<std::string>(parts);
 }
 
+/*
+ * A range of work-groups emulated by its own set of QPUs
+ */
+struct WorkGroupPartition
+{
+    std::vector<MemoryAddress> uniformAddresses;
+    InstrumentationResults instrumentation;
+    uint32_t numCycles = 0;
+    bool success = false;
+};
+
 EmulationResult tools::emulate(const EmulationData& data)
 {
     qpu_asm::ModuleInfo module;
@@ -1974,28 +3658,74 @@ EmulationResult tools::emulate(const EmulationData& data)
     std::vector<MemoryAddress> paramAddresses;
     Memory mem(fillMemory(globals, data, uniformAddress, globalDataAddress, paramAddresses));
 
-    auto uniformAddresses =
-        buildUniforms(mem, uniformAddress, paramAddresses, data.workGroup, globalDataAddress, kernelInfo->uniformsUsed);
+    // split the work-groups into consecutive ranges, each emulated with its own set of QPUs in a separate host thread
+    const Word numGroups = data.workGroup.numGroups[0] * data.workGroup.numGroups[1] * data.workGroup.numGroups[2];
+    const Word numQPUs = data.workGroup.localSizes[0] * data.workGroup.localSizes[1] * data.workGroup.localSizes[2];
+    const Word numPartitions = std::max(1u, std::min(data.numThreads, numGroups));
+    if(numPartitions > 1 && (data.snapshots.interval != 0 || !data.snapshots.resumeFile.empty()))
+        throw CompilationError(
+            CompilationStep::GENERAL, "Emulator snapshots are only supported for emulations in a single host thread");
+    const auto uniformBlockSize = static_cast<MemoryAddress>(
+        (kernelInfo->uniformsUsed.countUniforms() + 1 /* re-run flag */ + paramAddresses.size()) * sizeof(Word));
+    std::vector<WorkGroupPartition> partitions(numPartitions);
+    for(Word p = 0; p < numPartitions; ++p)
+    {
+        const Word firstGroup = (p * numGroups) / numPartitions;
+        const Word lastGroup = ((p + 1) * numGroups) / numPartitions;
+        partitions[p].uniformAddresses = buildUniforms(mem, uniformAddress + firstGroup * numQPUs * uniformBlockSize,
+            paramAddresses, data.workGroup, globalDataAddress, kernelInfo->uniformsUsed, firstGroup, lastGroup);
+    }
 
     if(!data.memoryDump.empty())
         dumpMemory(mem, data.memoryDump, uniformAddress, true);
 
-    InstrumentationResults instrumentation;
-    bool status =
-        emulate(instructions.begin() + (kernelInfo->getOffset() - module.kernelInfos.front().getOffset()).getValue(),
-            mem, uniformAddresses, instrumentation, data.maxEmulationCycles);
+    const auto firstInstruction =
+        instructions.begin() + (kernelInfo->getOffset() - module.kernelInfos.front().getOffset()).getValue();
+    // the mutex is shared by all partitions to keep atomic operations across work-groups working
+    Mutex mutex;
+    auto runPartition = [&](WorkGroupPartition& partition) {
+        partition.success = emulate(firstInstruction, instructions.end(), mem, partition.uniformAddresses,
+            partition.instrumentation, data.maxEmulationCycles, &partition.numCycles, data.useNativeBackend, &mutex,
+            &data.snapshots);
+    };
+    if(partitions.size() == 1)
+        runPartition(partitions.front());
+    else
+    {
+        PROFILE_START(EmulateWorkGroupsParallel);
+        ThreadPool::TaskGroup group("Emulation");
+        for(auto& partition : partitions)
+            group.schedule([&runPartition, &partition]() { runPartition(partition); });
+        group.waitForAll();
+        PROFILE_END(EmulateWorkGroupsParallel);
+    }
+
+    bool status = std::all_of(partitions.begin(), partitions.end(),
+        [](const WorkGroupPartition& partition) -> bool { return partition.success; });
+    uint32_t numCycles = 0;
+    InstrumentationResults instrumentation = std::move(partitions.front().instrumentation);
+    for(const auto& partition : partitions)
+    {
+        numCycles = std::max(numCycles, partition.numCycles);
+        if(&partition == &partitions.front())
+            continue;
+        for(std::size_t i = 0; i < instrumentation.size(); ++i)
+            instrumentation[i] += partition.instrumentation[i];
+    }
 
     if(!data.memoryDump.empty())
         dumpMemory(mem, data.memoryDump, uniformAddress, false);
 
     EmulationResult result{data};
     result.executionSuccessful = status;
+    result.numCycles = numCycles;
 
     result.results.reserve(data.parameter.size());
     for(std::size_t i = 0; i < data.parameter.size(); ++i)
     {
-        if(!data.parameter[i].second)
-            result.results.emplace_back(std::make_pair(data.parameter[i].first, Optional<std::vector<uint32_t>>{}));
+        if(!data.parameter[i].second || data.mappedParameters.find(i) != data.mappedParameters.end())
+            // direct values and mapped files are not read back
+            result.results.emplace_back(std::make_pair(paramAddresses[i], Optional<std::vector<uint32_t>>{}));
         else
         {
             result.results.emplace_back(std::make_pair(paramAddresses[i], std::vector<uint32_t>{}));
@@ -2008,17 +3738,19 @@ EmulationResult tools::emulate(const EmulationData& data)
     std::unique_ptr<std::ofstream> dumpInstrumentation;
     if(!data.instrumentationDump.empty())
         dumpInstrumentation.reset(new std::ofstream(data.instrumentationDump));
-    auto it = instructions.begin() + (kernelInfo->getOffset() - module.kernelInfos.front().getOffset()).getValue();
+    auto it = firstInstruction;
+    auto counters = instrumentation.begin();
     result.instrumentation.reserve(kernelInfo->getLength().getValue());
     while(true)
     {
-        result.instrumentation.emplace_back(instrumentation[&(*it)]);
+        result.instrumentation.emplace_back(*counters);
         if(dumpInstrumentation)
-            *dumpInstrumentation << std::left << std::setw(80) << it->toASMString() << "//"
-                                 << instrumentation[&(*it)].to_string() << std::endl;
+            *dumpInstrumentation << std::left << std::setw(80) << it->toASMString() << "//" << counters->to_string()
+                                 << std::endl;
         if(it->getSig() == SIGNAL_END_PROGRAM)
             break;
         ++it;
+        ++counters;
     }
 
     return result;
@@ -2049,26 +3781,31 @@ LowLevelEmulationResult tools::emulate(const LowLevelEmulationData& data)
     Memory mem(data.buffers);
 
     InstrumentationResults instrumentation;
-    bool status = emulate(instructions.begin(), mem, data.uniformAddresses, instrumentation, data.maxEmulationCycles);
+    uint32_t numCycles = 0;
+    bool status = emulate(instructions.begin(), instructions.end(), mem, data.uniformAddresses, instrumentation,
+        data.maxEmulationCycles, &numCycles, data.useNativeBackend);
 
     LowLevelEmulationResult result{data};
     result.executionSuccessful = status;
+    result.numCycles = numCycles;
 
     // Map and dump instrumentation results
     std::unique_ptr<std::ofstream> dumpInstrumentation;
     if(!data.instrumentationDump.empty())
         dumpInstrumentation.reset(new std::ofstream(data.instrumentationDump));
     auto it = instructions.begin();
+    auto counters = instrumentation.begin();
     result.instrumentation.reserve(data.numInstructions);
     while(true)
     {
-        result.instrumentation.emplace_back(instrumentation[&(*it)]);
+        result.instrumentation.emplace_back(*counters);
         if(dumpInstrumentation)
-            *dumpInstrumentation << std::left << std::setw(80) << it->toASMString() << "//"
-                                 << instrumentation[&(*it)].to_string() << std::endl;
+            *dumpInstrumentation << std::left << std::setw(80) << it->toASMString() << "//" << counters->to_string()
+                                 << std::endl;
         if(it->getSig() == SIGNAL_END_PROGRAM)
             break;
         ++it;
+        ++counters;
     }
 
     return result;
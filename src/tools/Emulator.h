@@ -15,6 +15,8 @@
 
 #include <bitset>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <queue>
 
 namespace vc4c
@@ -25,6 +27,8 @@ namespace vc4c
     {
         class Instruction;
         class ALUInstruction;
+        class LoadInstruction;
+        class SemaphoreInstruction;
     } // namespace qpu_asm
 
     namespace tools
@@ -34,6 +38,13 @@ namespace vc4c
         using MemoryAddress = uint32_t;
         using Word = uint32_t;
 
+        /*
+         * The memory accessible to the emulated QPUs.
+         *
+         * The memory is allocated (or mapped) completely on construction and never resized afterwards, so concurrent
+         * accesses to non-overlapping bytes (e.g. by work-groups emulated in different host threads, see
+         * EmulationData#numThreads) are safe without any synchronization.
+         */
         class Memory : private NonCopyable
         {
         public:
@@ -51,6 +62,26 @@ namespace vc4c
                 data(MappedBuffers(buffers))
             {
             }
+            /*
+             * Use a flat address space composed of memory-mapped regions, see #mapFile() and #mapAnonymous().
+             *
+             * Other than for the mapping of existing buffers, an address is translated to the host memory with a single
+             * look-up into a page table.
+             */
+            explicit Memory() : data(PagedMemory{}) {}
+
+            /*
+             * Maps the given file into the (paged) emulated address space and returns the address it is mapped to.
+             *
+             * The file is mapped shared, so its contents are neither loaded nor copied and all modifications are
+             * directly written back into the file. If the file is smaller than the given minimum size, it is enlarged.
+             */
+            MemoryAddress mapFile(const std::string& fileName, std::size_t minimumSize = 0);
+            /*
+             * Maps a new zero-initialized region of the given size into the (paged) emulated address space and returns
+             * the address it is mapped to
+             */
+            MemoryAddress mapAnonymous(std::size_t size);
 
             Word* getWordAddress(MemoryAddress address);
             const Word* getWordAddress(MemoryAddress address) const;
@@ -61,24 +92,69 @@ namespace vc4c
             MemoryAddress getMaximumAddress() const;
             void setUniforms(const std::vector<Word>& uniforms, MemoryAddress address);
 
+            /*
+             * Marks the given range as modified, so its pages are contained in the next snapshot written
+             */
+            void markModified(MemoryAddress address, std::size_t numBytes);
+            /*
+             * Writes the contents of all pages modified since the previous call into the given snapshot stream. On the
+             * first call, all pages are written.
+             *
+             * Pages only containing zeroes are stored without their contents.
+             */
+            void writePages(std::ostream& out);
+            /*
+             * Overwrites the pages stored in the given snapshot stream, see #writePages()
+             */
+            void readPages(std::istream& in);
+
         private:
+            // the size of a page of the paged memory is 4 KB
+            static constexpr unsigned PAGE_BITS = 12;
+
+            struct PagedMemory
+            {
+                // the host address every page of the emulated address space is mapped to
+                std::vector<uint8_t*> pageTable;
+                // the memory mappings backing the pages, unmapped when the last reference is dropped
+                std::vector<std::shared_ptr<uint8_t>> mappings;
+                // the end of the mapped part of the emulated address space
+                MemoryAddress endAddress = 0;
+            };
+
             using DirectBuffer = std::vector<Word>;
             using MappedBuffers = std::map<uint32_t, std::reference_wrapper<std::vector<uint8_t>>>;
-            Variant<DirectBuffer, MappedBuffers> data;
+            Variant<DirectBuffer, MappedBuffers, PagedMemory> data;
+            // the pages modified since the last snapshot, empty if no snapshot was written (or read) yet
+            std::vector<bool> modifiedPages;
+
+            MemoryAddress addMapping(std::shared_ptr<uint8_t>&& mapping, std::size_t size);
+            std::pair<uint8_t*, std::size_t> getPage(std::size_t index);
+            std::size_t getNumPages() const;
         };
 
+        /*
+         * The hardware mutex.
+         *
+         * Since the mutex is shared by the QPUs of all work-groups emulated in parallel host threads (to keep atomic
+         * operations on global memory working across work-groups), all accesses to it are synchronized.
+         */
         class Mutex : private NonCopyable
         {
         public:
-            explicit Mutex() : locked(false), lockOwner(255) {}
+            explicit Mutex() : locked(false), lockOwner(nullptr) {}
 
             bool isLocked() const;
-            NODISCARD bool lock(uint8_t qpu);
-            void unlock(uint8_t qpu);
+            NODISCARD bool lock(const QPU& qpu);
+            void unlock(const QPU& qpu);
+
+            void writeState(std::ostream& out) const;
+            void readState(std::istream& in, const std::vector<QPU>& qpus);
 
         private:
+            mutable std::mutex guard;
             bool locked;
-            uint8_t lockOwner;
+            const QPU* lockOwner;
         };
 
         class Registers : private NonCopyable
@@ -93,6 +169,9 @@ namespace vc4c
 
             void clearReadCache();
 
+            void writeState(std::ostream& out) const;
+            void readState(std::istream& in);
+
         private:
             QPU& qpu;
             FastMap<Register, Value> storageRegisters;
@@ -117,6 +196,9 @@ namespace vc4c
             Value readUniform();
             void setUniformAddress(const Value& val);
 
+            void writeState(std::ostream& out) const;
+            void readState(std::istream& in);
+
         private:
             QPU& qpu;
             Memory& memory;
@@ -140,6 +222,9 @@ namespace vc4c
 
             NODISCARD bool triggerTMURead(uint8_t tmu);
 
+            void writeState(std::ostream& out) const;
+            void readState(std::istream& in);
+
         private:
             QPU& qpu;
             bool tmuNoSwap;
@@ -170,6 +255,9 @@ namespace vc4c
 
             void incrementCycle();
 
+            void writeState(std::ostream& out) const;
+            void readState(std::istream& in);
+
         private:
             // FIXME is SFU calculation per QPU? Or do QPUs need to lock the SFU access?
             // XXX per QPU cycle??
@@ -204,6 +292,9 @@ namespace vc4c
 
             void dumpContents() const;
 
+            void writeState(std::ostream& out) const;
+            void readState(std::istream& in);
+
         private:
             Memory& memory;
             uint32_t vpmReadSetup;
@@ -230,22 +321,150 @@ namespace vc4c
             std::pair<Value, bool> increment(uint8_t index);
             std::pair<Value, bool> decrement(uint8_t index);
 
+            void writeState(std::ostream& out) const;
+            void readState(std::istream& in);
+
         private:
             std::array<uint8_t, 16> counter;
         };
 
+        /*
+         * The contents of a single register (or ALU operand) in the native emulation backend.
+         *
+         * Other than a Value, which stores vectors as containers of per-element Values, the elements are stored as
+         * plain 32-bit words. This allows to calculate the ALU operations in simple loops over all elements without
+         * any allocation or type dispatch.
+         */
+        struct NativeVector
+        {
+            std::array<Word, NATIVE_VECTOR_SIZE> elements{};
+            // the bit-mask of the elements holding a defined value
+            uint16_t definedMask = 0;
+            // whether the elements are floating-point values, only of interest for pack- and unpack-modes
+            bool isFloat = false;
+
+            bool operator==(const NativeVector& other) const;
+        };
+
+        /*
+         * The result of an ALU operation in the native emulation backend, with the per-element carry and overflow
+         * flags as bit-masks. The zero and negative flags are derived from the result itself.
+         */
+        struct NativeResult
+        {
+            NativeVector value;
+            uint16_t carrySet = 0;
+            uint16_t carryDefined = 0;
+            uint16_t overflowSet = 0;
+            uint16_t overflowDefined = 0;
+        };
+
+        /*
+         * The flags of all elements of a QPU in the native emulation backend, as bit-masks of the elements the flag is
+         * set for and the elements the flag is defined for.
+         */
+        struct NativeFlags
+        {
+            uint16_t zeroSet = 0;
+            uint16_t zeroDefined = 0;
+            uint16_t negativeSet = 0;
+            uint16_t negativeDefined = 0;
+            uint16_t carrySet = 0;
+            uint16_t carryDefined = 0;
+        };
+
+        /*
+         * The architectural state of a QPU in the native emulation backend.
+         *
+         * Only the physical register-files, the accumulators and the flags are stored here, all periphery registers
+         * are still accessed via the Registers, so the emulation of the periphery is shared by both backends.
+         */
+        struct NativeRegisters
+        {
+            std::array<NativeVector, 32> fileA;
+            std::array<NativeVector, 32> fileB;
+            // indexed by the register number - 32, r4 is never stored, since it is always read from the TMU or SFU
+            std::array<NativeVector, 6> accumulators;
+            NativeFlags flags;
+        };
+
         using ProgramCounter = uint32_t;
 
-        using InstrumentationResults = FastMap<const qpu_asm::Instruction*, InstrumentationResult>;
+        /*
+         * A machine-code instruction decoded once before the emulation starts.
+         *
+         * All bit-fields required to execute the instruction are extracted and resolved up front (e.g. the output
+         * registers are already swapped according to the write-swap bit, the op-codes are looked up and the branch
+         * offset is converted to instructions), so executing an instruction only reads plain members and calls the
+         * handler selected for the instruction type and emulation backend.
+         */
+        struct DecodedInstruction
+        {
+            // executes the instruction on the QPU and returns the program counter of the next instruction
+            using Handler = ProgramCounter (QPU::*)(const DecodedInstruction& inst);
+
+            // the original instruction, only used for logging
+            const qpu_asm::Instruction* instruction = nullptr;
+            Handler handler = nullptr;
+            Signaling signal = SIGNAL_NONE;
+
+            // the output registers, already swapped according to the write-swap bit
+            Register addOut = REG_NOP;
+            Register mulOut = REG_NOP;
+            ConditionCode addCondition = COND_NEVER;
+            ConditionCode mulCondition = COND_NEVER;
+            bool setFlags = false;
+            Pack pack = PACK_NOP;
+            // whether the pack-mode of an ALU instruction is applied to the result of the mul ALU
+            bool isMulResultPacked = false;
+
+            /* ALU instructions */
+            const OpCode* addCode = nullptr;
+            const OpCode* mulCode = nullptr;
+            // whether the ALU executes an operation, i.e. has neither a nop nor the "never" condition
+            bool isAddExecuted = false;
+            bool isMulExecuted = false;
+            // whether the flags are set by the mul ALU instead of the add ALU
+            bool areFlagsSetByMul = false;
+            InputMultiplex addMuxA = InputMultiplex::REGA;
+            InputMultiplex addMuxB = InputMultiplex::REGA;
+            InputMultiplex mulMuxA = InputMultiplex::REGA;
+            InputMultiplex mulMuxB = InputMultiplex::REGA;
+            Address inputA = 0;
+            Address inputB = 0;
+            bool isInputBImmediate = false;
+            Unpack unpack = UNPACK_NOP;
+
+            /* branch instructions */
+            BranchCond branchCondition = BranchCond::ALWAYS;
+            // the offset of the branch target to the program counter of the branch
+            int32_t branchOffset = 0;
+            // register and absolute branches are not (yet) supported
+            bool isSupportedBranch = true;
+
+            /* load immediate and semaphore instructions */
+            OpLoad loadType = OpLoad::LOAD_IMM_32;
+            // the immediate value loaded or the index of the semaphore accessed
+            uint32_t immediate = 0;
+            bool incrementSemaphore = false;
+        };
+
+        using DecodedProgram = std::vector<DecodedInstruction>;
+
+        /*
+         * The instrumentation results of all instructions, indexed by the program counter of the instruction
+         */
+        using InstrumentationResults = std::vector<InstrumentationResult>;
 
         class QPU : private NonCopyable
         {
         public:
             QPU(uint8_t id, Mutex& mutex, SFU& sfu, VPM& vpm, Semaphores& semaphores, Memory& memory,
-                MemoryAddress uniformAddress, InstrumentationResults& instrumentation) :
+                MemoryAddress uniformAddress, InstrumentationResults& instrumentation, bool useNativeBackend = false) :
                 ID(id),
                 mutex(mutex), registers(*this), uniforms(*this, memory, uniformAddress), tmus(*this, memory), sfu(sfu),
-                vpm(vpm), semaphores(semaphores), currentCycle(0), pc(0), instrumentation(instrumentation)
+                vpm(vpm), semaphores(semaphores), currentCycle(0), pc(0), instrumentation(instrumentation),
+                currentInstruction(nullptr), nativeRegisters(useNativeBackend ? new NativeRegisters() : nullptr)
             {
             }
 
@@ -254,10 +473,21 @@ namespace vc4c
             uint32_t getCurrentCycle() const;
             std::pair<Value, bool> readR4();
 
-            NODISCARD bool execute(std::vector<qpu_asm::Instruction>::const_iterator firstInstruction);
+            NODISCARD bool execute(const DecodedProgram& program);
 
-            const qpu_asm::Instruction* getCurrentInstruction(
-                std::vector<qpu_asm::Instruction>::const_iterator firstInstruction) const;
+            const qpu_asm::Instruction* getCurrentInstruction() const;
+
+            /*
+             * Writes the state of this QPU (and its registers, UNIFORM cache and TMUs) into the given snapshot stream
+             */
+            void writeState(std::ostream& out) const;
+            void readState(std::istream& in, const DecodedProgram& program);
+
+            /*
+             * Decodes the given instruction and selects the handler executing it with the Value-based or the native
+             * emulation backend
+             */
+            static DecodedInstruction decode(const qpu_asm::Instruction& inst, bool useNativeBackend);
 
         private:
             Mutex& mutex;
@@ -271,6 +501,10 @@ namespace vc4c
             std::array<ElementFlags, vc4c::NATIVE_VECTOR_SIZE> flags;
             ProgramCounter pc;
             InstrumentationResults& instrumentation;
+            // the instruction currently executed, only used for logging
+            const qpu_asm::Instruction* currentInstruction;
+            // the register and flag state of the native emulation backend, if used
+            std::unique_ptr<NativeRegisters> nativeRegisters;
 
             friend class Registers;
             friend class UniformCache;
@@ -278,24 +512,73 @@ namespace vc4c
             friend class SFU;
             friend class VPM;
 
-            NODISCARD bool executeALU(const qpu_asm::ALUInstruction* aluInst);
-            void writeConditional(Register dest, const Value& in, ConditionCode cond,
-                const qpu_asm::ALUInstruction* addInst = nullptr, const qpu_asm::ALUInstruction* mulInst = nullptr);
+            // the ALU a conditional write is counted for in the instrumentation
+            enum class InstrumentedALU : unsigned char
+            {
+                NONE,
+                ADD,
+                MUL
+            };
+
+            ProgramCounter executeALU(const DecodedInstruction& inst);
+            ProgramCounter executeBranch(const DecodedInstruction& inst);
+            ProgramCounter executeLoad(const DecodedInstruction& inst);
+            ProgramCounter executeSemaphore(const DecodedInstruction& inst);
+            ProgramCounter executeInvalid(const DecodedInstruction& inst);
+            void writeConditional(
+                Register dest, const Value& in, ConditionCode cond, InstrumentedALU alu = InstrumentedALU::NONE);
             bool isConditionMet(BranchCond cond) const;
             NODISCARD bool executeSignal(Signaling signal);
             void setFlags(const Value& output, ConditionCode cond, const VectorFlags& newFlags);
+
+            ProgramCounter executeNativeALU(const DecodedInstruction& inst);
+            ProgramCounter executeNativeBranch(const DecodedInstruction& inst);
+            ProgramCounter executeNativeLoad(const DecodedInstruction& inst);
+            ProgramCounter executeNativeSemaphore(const DecodedInstruction& inst);
+            std::pair<NativeVector, bool> readNativeInput(
+                InputMultiplex mux, Address addressA, Address addressB, bool regBIsImmediate);
+            void writeNativeRegister(Register dest, const NativeVector& in, uint16_t elementMask);
+            void writeNativeConditional(Register dest, const NativeVector& in, ConditionCode cond,
+                InstrumentedALU alu = InstrumentedALU::NONE);
+            uint16_t getNativeConditionMask(ConditionCode cond) const;
+            bool isNativeConditionMet(BranchCond cond) const;
+            void setNativeFlags(const NativeResult& result, ConditionCode cond);
         };
 
+        /*
+         * Writes the UNIFORMs for all QPUs running the work-groups [firstGroup, lastGroup) (with the work-groups
+         * linearized in x, y, z order) of the given configuration into the memory, starting at the given base address.
+         *
+         * Returns the addresses of the UNIFORMs of the first work-group for every QPU.
+         */
         std::vector<MemoryAddress> buildUniforms(Memory& memory, MemoryAddress baseAddress,
             const std::vector<MemoryAddress>& parameter, const WorkGroupConfig& config, MemoryAddress globalData,
-            const KernelUniforms& uniformsUsed);
-        bool emulate(std::vector<qpu_asm::Instruction>::const_iterator firstInstruction, Memory& memory,
+            const KernelUniforms& uniformsUsed, Word firstGroup = 0, Word lastGroup = std::numeric_limits<Word>::max());
+        /*
+         * Decodes the instructions in the range [firstInstruction, lastInstruction) for the given emulation backend
+         */
+        DecodedProgram decodeProgram(std::vector<qpu_asm::Instruction>::const_iterator firstInstruction,
+            std::vector<qpu_asm::Instruction>::const_iterator lastInstruction, bool useNativeBackend);
+        /*
+         * Emulates the given code on one QPU per UNIFORM address.
+         *
+         * If a mutex is given, it is used as the hardware mutex instead of a new one. This allows to share the mutex
+         * with other emulations of the same kernel running in parallel on the same memory.
+         *
+         * If a snapshot configuration is given, snapshots of the emulator state are written in the configured interval
+         * and/or the emulation is resumed from the configured snapshot. Since the state of other emulations sharing
+         * the memory (and mutex) is not contained in the snapshots, this emulation needs to be the only one running.
+         */
+        bool emulate(std::vector<qpu_asm::Instruction>::const_iterator firstInstruction,
+            std::vector<qpu_asm::Instruction>::const_iterator lastInstruction, Memory& memory,
             const std::vector<MemoryAddress>& uniformAddresses, InstrumentationResults& instrumentation,
-            uint32_t maxCycles = std::numeric_limits<uint32_t>::max());
+            uint32_t maxCycles = std::numeric_limits<uint32_t>::max(), uint32_t* numCycles = nullptr,
+            bool useNativeBackend = false, Mutex* sharedMutex = nullptr, const SnapshotConfig* snapshots = nullptr);
         bool emulateTask(std::vector<qpu_asm::Instruction>::const_iterator firstInstruction,
+            std::vector<qpu_asm::Instruction>::const_iterator lastInstruction,
             const std::vector<MemoryAddress>& parameter, Memory& memory, MemoryAddress uniformBaseAddress,
             MemoryAddress globalData, const KernelUniforms& uniformsUsed, InstrumentationResults& instrumentation,
-            uint32_t maxCycles = std::numeric_limits<uint32_t>::max());
+            uint32_t maxCycles = std::numeric_limits<uint32_t>::max(), bool useNativeBackend = false);
     } // namespace tools
 } // namespace vc4c
 
@@ -140,6 +140,31 @@ bool tools::parseConfigurationParameter(Configuration& config, const std::string
         return true;
     }
 
+    if(arg.find("--cache-dir=") == 0)
+    {
+        config.cacheDirectory = arg.substr(std::string("--cache-dir=").size());
+        return true;
+    }
+    if(arg.find("--cache-size=") == 0)
+    {
+        const std::string value = arg.substr(std::string("--cache-size=").size());
+        try
+        {
+            config.maxCacheSize = std::stoull(value);
+        }
+        catch(std::exception& e)
+        {
+            std::cerr << "Error converting compilation cache size '" << value << "': " << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+    if(arg.find("--telemetry=") == 0)
+    {
+        config.telemetryFile = arg.substr(std::string("--telemetry=").size());
+        return true;
+    }
+
     std::string passName;
     if(arg.find("--fno-") == 0)
     {
@@ -177,6 +202,8 @@ bool tools::parseConfigurationParameter(Configuration& config, const std::string
                 config.additionalOptions.combineLoadThreshold = static_cast<unsigned>(intValue);
             else if(paramName == "accumulator-threshold")
                 config.additionalOptions.accumulatorThreshold = static_cast<unsigned>(intValue);
+            else if(paramName == "accumulator-loop-weight")
+                config.additionalOptions.accumulatorLoopWeight = static_cast<unsigned>(intValue);
             else if(paramName == "replace-nop-threshold")
                 config.additionalOptions.replaceNopThreshold = static_cast<unsigned>(intValue);
             else if(paramName == "register-resolver-rounds")
@@ -185,6 +212,8 @@ bool tools::parseConfigurationParameter(Configuration& config, const std::string
                 config.additionalOptions.moveConstantsDepth = intValue;
             else if(paramName == "optimization-iterations")
                 config.additionalOptions.maxOptimizationIterations = static_cast<unsigned>(intValue);
+            else if(paramName == "parallel-blocks")
+                config.additionalOptions.minParallelBlocks = static_cast<unsigned>(intValue);
             else if(paramName == "common-subexpression-threshold")
                 config.additionalOptions.maxCommonExpressionDinstance = static_cast<unsigned>(intValue);
             else
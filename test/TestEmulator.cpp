@@ -15,6 +15,7 @@
 
 #include "test_cases.h"
 
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <sstream>
@@ -47,6 +48,11 @@ TestEmulator::TestEmulator(const vc4c::Configuration& config) : config(config),
         TEST_ADD_TWO_ARGUMENTS(TestEmulator::testFloatEmulations, i, vc4c::test::floatTests.at(i).first.kernelName);
     }
     TEST_ADD(TestEmulator::testPartialMD5);
+    TEST_ADD(TestEmulator::testNativeBackend);
+    TEST_ADD(TestEmulator::testParallelWorkGroups);
+    TEST_ADD(TestEmulator::testMappedMemory);
+    TEST_ADD(TestEmulator::testSnapshots);
+    TEST_ADD(TestEmulator::testRegisterSpilling);
     TEST_ADD(TestEmulator::printProfilingInfo);
 }
 
@@ -94,6 +100,17 @@ void TestEmulator::testHelloWorld()
     const auto result = emulate(data);
     TEST_ASSERT(result.executionSuccessful);
     TEST_ASSERT_EQUALS(1u, result.results.size());
+    TEST_ASSERT(result.numCycles > 0);
+    // the result is written to memory via VPM and DMA
+    unsigned numVPMAccesses = 0;
+    unsigned numDMAAccesses = 0;
+    for(const auto& instrumentation : result.instrumentation)
+    {
+        numVPMAccesses += instrumentation.numVPMAccesses;
+        numDMAAccesses += instrumentation.numDMAAccesses;
+    }
+    TEST_ASSERT(numVPMAccesses > 0);
+    TEST_ASSERT(numDMAAccesses > 0);
 
     const auto& out = *result.results.front().second;
 
@@ -509,6 +526,286 @@ void TestEmulator::testPartialMD5()
     }
 }
 
+void TestEmulator::testNativeBackend()
+{
+    // the native backend needs to produce the same results in the same number of cycles as the Value-based emulation
+    auto checkSameResults = [this](EmulationData& data, std::stringstream& buffer) {
+        data.useNativeBackend = false;
+        const auto valueResult = emulate(data);
+        buffer.clear();
+        buffer.seekg(0);
+        data.useNativeBackend = true;
+        const auto nativeResult = emulate(data);
+
+        TEST_ASSERT(valueResult.executionSuccessful);
+        TEST_ASSERT(nativeResult.executionSuccessful);
+        TEST_ASSERT_EQUALS(valueResult.numCycles, nativeResult.numCycles);
+        TEST_ASSERT_EQUALS(valueResult.results.size(), nativeResult.results.size());
+        for(std::size_t i = 0; i < std::min(valueResult.results.size(), nativeResult.results.size()); ++i)
+        {
+            TEST_ASSERT_EQUALS(valueResult.results[i].first, nativeResult.results[i].first);
+            if(valueResult.results[i].second && nativeResult.results[i].second)
+                TEST_ASSERT(*valueResult.results[i].second == *nativeResult.results[i].second);
+        }
+        TEST_ASSERT_EQUALS(valueResult.instrumentation.size(), nativeResult.instrumentation.size());
+        for(std::size_t i = 0; i < std::min(valueResult.instrumentation.size(), nativeResult.instrumentation.size());
+            ++i)
+        {
+            const auto& valueInstrumentation = valueResult.instrumentation[i];
+            const auto& nativeInstrumentation = nativeResult.instrumentation[i];
+            TEST_ASSERT_EQUALS(valueInstrumentation.numExecutions, nativeInstrumentation.numExecutions);
+            TEST_ASSERT_EQUALS(valueInstrumentation.numStalls, nativeInstrumentation.numStalls);
+            TEST_ASSERT_EQUALS(valueInstrumentation.numBranchTaken, nativeInstrumentation.numBranchTaken);
+            TEST_ASSERT_EQUALS(valueInstrumentation.numAddALUExecuted, nativeInstrumentation.numAddALUExecuted);
+            TEST_ASSERT_EQUALS(valueInstrumentation.numAddALUSkipped, nativeInstrumentation.numAddALUSkipped);
+            TEST_ASSERT_EQUALS(valueInstrumentation.numMulALUExecuted, nativeInstrumentation.numMulALUExecuted);
+            TEST_ASSERT_EQUALS(valueInstrumentation.numMulALUSkipped, nativeInstrumentation.numMulALUSkipped);
+            TEST_ASSERT_EQUALS(valueInstrumentation.numTMULoads, nativeInstrumentation.numTMULoads);
+            TEST_ASSERT_EQUALS(valueInstrumentation.numVPMAccesses, nativeInstrumentation.numVPMAccesses);
+            TEST_ASSERT_EQUALS(valueInstrumentation.numDMAAccesses, nativeInstrumentation.numDMAAccesses);
+        }
+    };
+
+    // all integer and floating-point test kernels, to cover the different ALU operations, pack and unpack modes
+    for(auto tests : {&vc4c::test::integerTests, &vc4c::test::floatTests})
+    {
+        for(const auto& testCase : *tests)
+        {
+            EmulationData data = testCase.first;
+            std::stringstream buffer;
+            compileFile(buffer, data.module.first, "", cachePrecompilation);
+            data.module.second = &buffer;
+
+            checkSameResults(data, buffer);
+        }
+    }
+
+    {
+        const std::string sample("Hello World!");
+        std::stringstream buffer;
+        compileFile(buffer, "./example/md5.cl", "", cachePrecompilation);
+
+        EmulationData data;
+        data.kernelName = "sha1_crypt_kernel";
+        data.maxEmulationCycles = vc4c::test::maxExecutionCycles;
+        data.module = std::make_pair("", &buffer);
+        data.parameter.emplace_back(0, std::vector<uint32_t>{0 /* padding*/, 1 /* number of keys */});
+        data.parameter.emplace_back(0, std::vector<uint32_t>(24));
+        data.parameter.emplace_back(0, std::vector<uint32_t>(sample.size() / sizeof(uint32_t)));
+        memcpy(data.parameter.back().second->data(), sample.data(), sample.size());
+        data.parameter.emplace_back(0, std::vector<uint32_t>(8));
+
+        checkSameResults(data, buffer);
+    }
+    {
+        // uses multiple QPUs, which synchronize via semaphores
+        std::stringstream buffer;
+        compileFile(buffer, "./testing/test_barrier.cl", "", cachePrecompilation);
+
+        EmulationData data;
+        data.kernelName = "test_barrier";
+        data.maxEmulationCycles = vc4c::test::maxExecutionCycles;
+        data.module = std::make_pair("", &buffer);
+        data.workGroup.localSizes = {8, 1, 1};
+        data.workGroup.numGroups = {2, 1, 1};
+        data.parameter.emplace_back(0u, std::vector<uint32_t>(12 * data.calcNumWorkItems()));
+
+        checkSameResults(data, buffer);
+    }
+}
+
+void TestEmulator::testParallelWorkGroups()
+{
+    std::stringstream buffer;
+    compileFile(buffer, "./testing/test_work_item.cl", "", cachePrecompilation);
+
+    EmulationData data;
+    data.kernelName = "test_work_item";
+    data.maxEmulationCycles = vc4c::test::maxExecutionCycles;
+    data.module = std::make_pair("", &buffer);
+    data.workGroup.dimensions = 3;
+    data.workGroup.localSizes = {8, 1, 1};
+    data.workGroup.numGroups = {4, 1, 1};
+    data.parameter.emplace_back(0, std::vector<uint32_t>(24 * data.calcNumWorkItems()));
+
+    data.numThreads = 1;
+    const auto serialResult = emulate(data);
+    buffer.clear();
+    buffer.seekg(0);
+    // does not divide the number of work-groups evenly
+    data.numThreads = 3;
+    const auto parallelResult = emulate(data);
+
+    TEST_ASSERT(serialResult.executionSuccessful);
+    TEST_ASSERT(parallelResult.executionSuccessful);
+    TEST_ASSERT_EQUALS(1u, serialResult.results.size());
+    TEST_ASSERT_EQUALS(serialResult.results.size(), parallelResult.results.size());
+    for(std::size_t i = 0; i < std::min(serialResult.results.size(), parallelResult.results.size()); ++i)
+    {
+        TEST_ASSERT_EQUALS(serialResult.results[i].first, parallelResult.results[i].first);
+        TEST_ASSERT_EQUALS(serialResult.results[i].second.has_value(), parallelResult.results[i].second.has_value());
+        if(serialResult.results[i].second && parallelResult.results[i].second)
+            TEST_ASSERT(*serialResult.results[i].second == *parallelResult.results[i].second);
+    }
+    // the instructions are executed the same way, only the number of stalls (e.g. waiting for the mutex) differs,
+    // since less QPUs compete for the locks. A stalled instruction is re-executed, so only the completed executions
+    // are compared.
+    TEST_ASSERT_EQUALS(serialResult.instrumentation.size(), parallelResult.instrumentation.size());
+    for(std::size_t i = 0;
+        i < std::min(serialResult.instrumentation.size(), parallelResult.instrumentation.size()); ++i)
+    {
+        const auto& serialInstrumentation = serialResult.instrumentation[i];
+        const auto& parallelInstrumentation = parallelResult.instrumentation[i];
+        TEST_ASSERT_EQUALS(serialInstrumentation.numExecutions - serialInstrumentation.numStalls,
+            parallelInstrumentation.numExecutions - parallelInstrumentation.numStalls);
+        TEST_ASSERT_EQUALS(serialInstrumentation.numBranchTaken, parallelInstrumentation.numBranchTaken);
+        TEST_ASSERT_EQUALS(serialInstrumentation.numAddALUExecuted, parallelInstrumentation.numAddALUExecuted);
+        TEST_ASSERT_EQUALS(serialInstrumentation.numAddALUSkipped, parallelInstrumentation.numAddALUSkipped);
+        TEST_ASSERT_EQUALS(serialInstrumentation.numMulALUExecuted, parallelInstrumentation.numMulALUExecuted);
+        TEST_ASSERT_EQUALS(serialInstrumentation.numMulALUSkipped, parallelInstrumentation.numMulALUSkipped);
+        TEST_ASSERT_EQUALS(serialInstrumentation.numTMULoads, parallelInstrumentation.numTMULoads);
+        TEST_ASSERT_EQUALS(serialInstrumentation.numVPMAccesses, parallelInstrumentation.numVPMAccesses);
+        TEST_ASSERT_EQUALS(serialInstrumentation.numDMAAccesses, parallelInstrumentation.numDMAAccesses);
+    }
+}
+
+void TestEmulator::testMappedMemory()
+{
+    std::stringstream buffer;
+    compileFile(buffer, "./example/hello_world.cl", "", cachePrecompilation);
+    // the temporary file is empty, so it is enlarged by the mapping
+    TemporaryFile outputFile;
+
+    EmulationData data;
+    data.kernelName = "hello_world";
+    data.maxEmulationCycles = vc4c::test::maxExecutionCycles;
+    data.module = std::make_pair("", &buffer);
+    data.workGroup.localSizes = {8, 1, 1};
+    data.workGroup.numGroups = {1, 1, 1};
+    // 16 characters per WI
+    data.mappedParameters.emplace(0, MappedFile{outputFile.fileName, data.calcNumWorkItems() * 16});
+    data.parameter.emplace_back(0u, Optional<std::vector<uint32_t>>{});
+
+    const auto result = emulate(data);
+    TEST_ASSERT(result.executionSuccessful);
+    TEST_ASSERT_EQUALS(1u, result.results.size());
+    // the mapped buffer is not read back, the kernel wrote directly into the file
+    TEST_ASSERT(!result.results.front().second);
+
+    std::ifstream f(outputFile.fileName, std::ios::in | std::ios::binary);
+    std::vector<char> out(data.calcNumWorkItems() * 16);
+    f.read(out.data(), static_cast<std::streamsize>(out.size()));
+    TEST_ASSERT_EQUALS(out.size(), static_cast<std::size_t>(f.gcount()));
+    for(std::size_t i = 0; i < data.calcNumWorkItems(); ++i)
+        TEST_ASSERT_EQUALS(0, strncmp("Hello World!", out.data() + i * 16, 16));
+}
+
+void TestEmulator::testSnapshots()
+{
+    std::stringstream buffer;
+    compileFile(buffer, "./testing/test_work_item.cl", "", cachePrecompilation);
+    // the snapshots are written next to the (empty) temporary file
+    TemporaryFile snapshotPrefix;
+
+    EmulationData data;
+    data.kernelName = "test_work_item";
+    data.maxEmulationCycles = vc4c::test::maxExecutionCycles;
+    data.module = std::make_pair("", &buffer);
+    data.workGroup.dimensions = 3;
+    data.workGroup.localSizes = {8, 1, 1};
+    data.workGroup.numGroups = {2, 1, 1};
+    data.parameter.emplace_back(0, std::vector<uint32_t>(24 * data.calcNumWorkItems()));
+
+    const auto fullResult = emulate(data);
+    TEST_ASSERT(fullResult.executionSuccessful);
+
+    // write a snapshot after every third of the emulation and resume from the second one
+    const uint32_t interval = fullResult.numCycles / 3;
+    buffer.clear();
+    buffer.seekg(0);
+    data.snapshots.interval = interval;
+    data.snapshots.filePrefix = snapshotPrefix.fileName;
+    const auto snapshotResult = emulate(data);
+    buffer.clear();
+    buffer.seekg(0);
+    data.snapshots.interval = 0;
+    data.snapshots.resumeFile = snapshotPrefix.fileName + "." + std::to_string(2 * interval) + ".snapshot";
+    const auto resumedResult = emulate(data);
+    for(uint32_t i = 1; i <= 3; ++i)
+        std::remove((snapshotPrefix.fileName + "." + std::to_string(i * interval) + ".snapshot").data());
+
+    TEST_ASSERT(snapshotResult.executionSuccessful);
+    TEST_ASSERT(resumedResult.executionSuccessful);
+    // writing snapshots does not change the emulation and the resumed emulation continues with the cycle, memory and
+    // instrumentation of the snapshot, so the replay is identical to the full emulation
+    auto checkSameEmulation = [this](const EmulationResult& expected, const EmulationResult& result) {
+        TEST_ASSERT_EQUALS(expected.numCycles, result.numCycles);
+        TEST_ASSERT_EQUALS(expected.results.size(), result.results.size());
+        for(std::size_t i = 0; i < std::min(expected.results.size(), result.results.size()); ++i)
+        {
+            TEST_ASSERT_EQUALS(expected.results[i].first, result.results[i].first);
+            TEST_ASSERT_EQUALS(expected.results[i].second.has_value(), result.results[i].second.has_value());
+            if(expected.results[i].second && result.results[i].second)
+                TEST_ASSERT(*expected.results[i].second == *result.results[i].second);
+        }
+        TEST_ASSERT_EQUALS(expected.instrumentation.size(), result.instrumentation.size());
+        for(std::size_t i = 0; i < std::min(expected.instrumentation.size(), result.instrumentation.size()); ++i)
+        {
+            const auto& expectedInstrumentation = expected.instrumentation[i];
+            const auto& instrumentation = result.instrumentation[i];
+            TEST_ASSERT_EQUALS(expectedInstrumentation.numExecutions, instrumentation.numExecutions);
+            TEST_ASSERT_EQUALS(expectedInstrumentation.numStalls, instrumentation.numStalls);
+            TEST_ASSERT_EQUALS(expectedInstrumentation.numBranchTaken, instrumentation.numBranchTaken);
+            TEST_ASSERT_EQUALS(expectedInstrumentation.numAddALUExecuted, instrumentation.numAddALUExecuted);
+            TEST_ASSERT_EQUALS(expectedInstrumentation.numAddALUSkipped, instrumentation.numAddALUSkipped);
+            TEST_ASSERT_EQUALS(expectedInstrumentation.numMulALUExecuted, instrumentation.numMulALUExecuted);
+            TEST_ASSERT_EQUALS(expectedInstrumentation.numMulALUSkipped, instrumentation.numMulALUSkipped);
+            TEST_ASSERT_EQUALS(expectedInstrumentation.numTMULoads, instrumentation.numTMULoads);
+            TEST_ASSERT_EQUALS(expectedInstrumentation.numVPMAccesses, instrumentation.numVPMAccesses);
+            TEST_ASSERT_EQUALS(expectedInstrumentation.numDMAAccesses, instrumentation.numDMAAccesses);
+        }
+    };
+    checkSameEmulation(fullResult, snapshotResult);
+    checkSameEmulation(fullResult, resumedResult);
+}
+
+void TestEmulator::testRegisterSpilling()
+{
+    // the kernel keeps more vectors live than there are registers, so it can only be compiled by spilling some of them
+    std::stringstream buffer;
+    compileFile(buffer, "./testing/test_register_spilling.cl", "", cachePrecompilation);
+
+    const uint32_t numVectors = 68;
+    EmulationData data;
+    data.kernelName = "test_register_spilling";
+    data.maxEmulationCycles = vc4c::test::maxExecutionCycles;
+    data.module = std::make_pair("", &buffer);
+    // several work-items, since every QPU has its own slots in the spill area
+    data.workGroup.localSizes = {4, 1, 1};
+    data.workGroup.numGroups = {1, 1, 1};
+    std::vector<uint32_t> input(data.calcNumWorkItems() * numVectors * 16);
+    for(std::size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<uint32_t>(i * 7 + 13);
+    data.parameter.emplace_back(0u, input);
+    data.parameter.emplace_back(0u, std::vector<uint32_t>(data.calcNumWorkItems() * 16));
+
+    const auto result = emulate(data);
+    TEST_ASSERT(result.executionSuccessful);
+    TEST_ASSERT_EQUALS(2u, result.results.size());
+
+    const auto& out = *result.results.back().second;
+    for(std::size_t item = 0; item < data.calcNumWorkItems(); ++item)
+    {
+        for(std::size_t elem = 0; elem < 16; ++elem)
+        {
+            uint32_t expected = 0;
+            for(uint32_t vector = numVectors; vector > 0; --vector)
+                expected = expected * 3u + input[(item * numVectors + vector - 1) * 16 + elem] * vector;
+            TEST_ASSERT_EQUALS(expected, out[item * 16 + elem]);
+        }
+    }
+}
+
 void TestEmulator::printProfilingInfo()
 {
 #if DEBUG_MODE
@@ -40,6 +40,11 @@ public:
 	void testIntegerEmulations(std::size_t index, std::string name);
 	void testFloatEmulations(std::size_t index, std::string name);
 	void testPartialMD5();
+	void testNativeBackend();
+	void testParallelWorkGroups();
+	void testMappedMemory();
+	void testSnapshots();
+	void testRegisterSpilling();
 	
 	void printProfilingInfo();
 
@@ -6,6 +6,7 @@
 
 #include "TestFrontends.h"
 
+#include "CompilationCache.h"
 #include "VC4C.h"
 #include "spirv/SPIRVHelper.h"
 #include "tools.h"
@@ -15,9 +16,12 @@
 using namespace vc4c::spirv2qasm;
 #endif
 
+#include <dirent.h>
 #include <fstream>
+#include <iterator>
 #include <memory>
 #include <sstream>
+#include <unistd.h>
 
 using namespace vc4c;
 
@@ -25,6 +29,8 @@ TestFrontends::TestFrontends()
 {
     TEST_ADD(TestFrontends::testSPIRVCapabilitiesSupport);
     TEST_ADD(TestFrontends::testLinking);
+    TEST_ADD(TestFrontends::testCompilationCache);
+    TEST_ADD(TestFrontends::testTelemetry);
 }
 
 TestFrontends::~TestFrontends()
@@ -85,4 +91,106 @@ void TestFrontends::testLinking()
 
     TEST_ASSERT(res.executionSuccessful);
     TEST_ASSERT_EQUALS(res.results[0].second->at(0), res.results[1].second->at(0));
-}
\ No newline at end of file
+}
+
+void TestFrontends::testCompilationCache()
+{
+    TemporaryFile cacheDir;
+    // we need a directory, not a file
+    remove(cacheDir.fileName.data());
+
+    Configuration config;
+    config.cacheDirectory = cacheDir.fileName;
+    config.outputMode = OutputMode::HEX;
+
+    std::ifstream input("./example/fibonacci.cl");
+    std::stringstream firstOutput;
+    auto firstResult = Compiler::compile(input, firstOutput, config, "", std::string("./example/fibonacci.cl"));
+    auto stats = getCompilationCacheStatistics();
+    const auto initialHits = stats.hits;
+    TEST_ASSERT(stats.stores > 0);
+
+    input.clear();
+    input.seekg(0);
+    std::stringstream secondOutput;
+    auto secondResult = Compiler::compile(input, secondOutput, config, "", std::string("./example/fibonacci.cl"));
+    stats = getCompilationCacheStatistics();
+    TEST_ASSERT_EQUALS(initialHits + 1, stats.hits);
+    TEST_ASSERT_EQUALS(firstResult, secondResult);
+    TEST_ASSERT_EQUALS(firstOutput.str(), secondOutput.str());
+
+    // different options need to result in a different cache entry
+    input.clear();
+    input.seekg(0);
+    std::stringstream thirdOutput;
+    Compiler::compile(input, thirdOutput, config, "-DSOME_MACRO=1", std::string("./example/fibonacci.cl"));
+    TEST_ASSERT_EQUALS(initialHits + 1, getCompilationCacheStatistics().hits);
+
+    // exceeding the maximum cache size evicts the least recently used entries, here all of them
+    const auto initialEvictions = getCompilationCacheStatistics().evictions;
+    config.maxCacheSize = 1;
+    input.clear();
+    input.seekg(0);
+    std::stringstream fourthOutput;
+    Compiler::compile(input, fourthOutput, config, "-DOTHER_MACRO=1", std::string("./example/fibonacci.cl"));
+    stats = getCompilationCacheStatistics();
+    TEST_ASSERT_EQUALS(initialEvictions + 3, stats.evictions);
+
+    // so the first entry is no longer found in the cache
+    config.maxCacheSize = 64 * 1024 * 1024;
+    input.clear();
+    input.seekg(0);
+    std::stringstream fifthOutput;
+    Compiler::compile(input, fifthOutput, config, "", std::string("./example/fibonacci.cl"));
+    TEST_ASSERT_EQUALS(initialHits + 1, getCompilationCacheStatistics().hits);
+    TEST_ASSERT_EQUALS(firstOutput.str(), fifthOutput.str());
+
+    // inputs including other files are never cached, since the included files are not part of the key
+    TEST_ASSERT(!CompilationCache::isCacheable("#include \"foo.h\"\n__kernel void foo() {}", ""));
+    TEST_ASSERT(!CompilationCache::isCacheable("#  include <foo.h>\n__kernel void foo() {}", ""));
+    TEST_ASSERT(!CompilationCache::isCacheable("__kernel void foo() {}", "-I /some/directory"));
+    TEST_ASSERT(!CompilationCache::isCacheable("__kernel void foo() {}", "-DFOO=1 -include foo.h"));
+    TEST_ASSERT(CompilationCache::isCacheable("#define FOO 1\n__kernel void foo() {}", "-DBAR=2"));
+
+    const auto initialStores = getCompilationCacheStatistics().stores;
+    std::istringstream includingInput("#include \"fibonacci.cl\"\n");
+    std::stringstream sixthOutput;
+    Compiler::compile(includingInput, sixthOutput, config, "-I ./example");
+    stats = getCompilationCacheStatistics();
+    TEST_ASSERT_EQUALS(initialStores, stats.stores);
+    TEST_ASSERT_EQUALS(initialHits + 1, stats.hits);
+
+    // clean up cache directory
+    if(auto dir = opendir(cacheDir.fileName.data()))
+    {
+        while(auto entry = readdir(dir))
+            remove((cacheDir.fileName + "/" + entry->d_name).data());
+        closedir(dir);
+    }
+    rmdir(cacheDir.fileName.data());
+}
+
+void TestFrontends::testTelemetry()
+{
+    TemporaryFile telemetryFile;
+
+    Configuration config;
+    config.telemetryFile = telemetryFile.fileName;
+    config.outputMode = OutputMode::HEX;
+
+    std::ifstream input("./example/fibonacci.cl");
+    std::stringstream output;
+    Compiler::compile(input, output, config, "", std::string("./example/fibonacci.cl"));
+
+    std::ifstream telemetry(telemetryFile.fileName);
+    const std::string content{std::istreambuf_iterator<char>(telemetry), std::istreambuf_iterator<char>()};
+    TEST_ASSERT(content.find("\"name\": \"fibonacci\"") != std::string::npos);
+    TEST_ASSERT(content.find("\"stage\": \"parse\"") != std::string::npos);
+    TEST_ASSERT(content.find("\"stage\": \"code-generation\"") != std::string::npos);
+    TEST_ASSERT(content.find("\"stage\": \"register-allocation\"") != std::string::npos);
+    TEST_ASSERT(content.find("\"pass\": \"SingleSteps\"") != std::string::npos);
+    TEST_ASSERT(content.find("\"cpuTimeUs\"") != std::string::npos);
+    TEST_ASSERT(content.find("\"SingleSteps visited instructions\"") != std::string::npos);
+    TEST_ASSERT(content.find("\"Arena allocations\"") != std::string::npos);
+    TEST_ASSERT(content.find("\"Arena heap allocations\"") != std::string::npos);
+}
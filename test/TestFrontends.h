@@ -17,6 +17,8 @@ public:
 
 	void testSPIRVCapabilitiesSupport();
 	void testLinking();
+	void testCompilationCache();
+	void testTelemetry();
 };
 
 #endif /* TEST_SPIRVFRONTEND_H */
@@ -7,6 +7,14 @@
 #include "TestGraph.h"
 
 #include "Graph.h"
+#include "InstructionWalker.h"
+#include "Method.h"
+#include "Module.h"
+#include "analysis/ControlFlowGraph.h"
+#include "analysis/InterferenceGraph.h"
+#include "analysis/LivenessAnalysis.h"
+#include "asm/OpCodes.h"
+#include "intermediate/IntermediateInstruction.h"
 
 using namespace vc4c;
 
@@ -42,6 +50,9 @@ TestGraph::TestGraph()
 
     TEST_ADD(TestGraph::testEdgeNodes);
     TEST_ADD(TestGraph::testDirection);
+
+    TEST_ADD(TestGraph::testLivenessAnalysis);
+    TEST_ADD(TestGraph::testLoopDepths);
 }
 
 void TestGraph::testAssertNode()
@@ -252,4 +263,111 @@ void TestGraph::testDirection()
 
     e->addInput(m);
     TEST_ASSERT_EQUALS(Direction::BOTH, e->getDirection());
-}
\ No newline at end of file
+}
+
+void TestGraph::testLivenessAnalysis()
+{
+    Module mod{{}};
+    Method method{mod};
+    auto a = method.addNewLocal(TYPE_INT32, "%a");
+    auto b = method.addNewLocal(TYPE_INT32, "%b");
+    auto c = method.addNewLocal(TYPE_INT32, "%c");
+    auto d = method.addNewLocal(TYPE_INT32, "%d");
+
+    // first block writes a and b, the second block reads them
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%first").local()));
+    method.appendToEnd(new intermediate::MoveOperation(a, INT_ONE));
+    method.appendToEnd(new intermediate::MoveOperation(b, INT_ZERO));
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%second").local()));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, c, a, b));
+    method.appendToEnd(new intermediate::MoveOperation(d, c));
+
+    const BasicBlock& first = *method.begin();
+    const BasicBlock& second = *(++method.begin());
+
+    analysis::LivenessAnalysis liveness;
+    liveness(method);
+    TEST_ASSERT(!liveness.getLiveIn(first).any());
+    TEST_ASSERT_EQUALS(2u, liveness.getLiveOut(first).count());
+    TEST_ASSERT(liveness.getLiveOut(first).test(liveness.getIndex(a.local())));
+    TEST_ASSERT(liveness.getLiveOut(first).test(liveness.getIndex(b.local())));
+    TEST_ASSERT(liveness.getLiveOut(first) == liveness.getLiveIn(second));
+    TEST_ASSERT(!liveness.getLiveOut(second).any());
+
+    std::vector<FastSet<const Local*>> instructionResults;
+    liveness.forAllInstructions(second,
+        [&](const intermediate::IntermediateInstruction* instr, const analysis::LivenessAnalysis::LiveSet& live) {
+            instructionResults.emplace_back(liveness.toLocals(live));
+        });
+    // label, add, move in reverse order
+    TEST_ASSERT_EQUALS(3u, instructionResults.size());
+    TEST_ASSERT_EQUALS(1u, instructionResults[0].size());
+    TEST_ASSERT_EQUALS(1u, instructionResults[0].count(c.local()));
+    TEST_ASSERT_EQUALS(2u, instructionResults[1].size());
+    TEST_ASSERT_EQUALS(2u, instructionResults[2].size());
+
+    auto graph = analysis::InterferenceGraph::createGraph(method);
+    auto nodeA = graph->findNode(a.local());
+    auto nodeB = graph->findNode(b.local());
+    auto nodeC = graph->findNode(c.local());
+    TEST_ASSERT(nodeA != nullptr);
+    TEST_ASSERT(nodeB != nullptr);
+    TEST_ASSERT(nodeC != nullptr);
+    TEST_ASSERT(nodeA->isAdjacent(nodeB));
+    TEST_ASSERT(!nodeA->isAdjacent(nodeC));
+    TEST_ASSERT(!nodeB->isAdjacent(nodeC));
+
+    // copy a into a temporary before it is read, which does not change the locals live across the blocks
+    auto tmp = method.addNewLocal(TYPE_INT32, "%tmp");
+    auto it = (++method.begin())->walk().nextInBlock();
+    it.emplace(new intermediate::MoveOperation(tmp, a));
+    it.nextInBlock();
+    it->replaceLocal(a.local(), tmp.local(), LocalUse::Type::READER);
+    TEST_ASSERT(liveness.updateBlock(method, second));
+    TEST_ASSERT(liveness.getLiveOut(first) == liveness.getLiveIn(second));
+    graph->updateLocals(method, liveness, {a.local(), tmp.local()}, {&second});
+    auto nodeTmp = graph->findNode(tmp.local());
+    TEST_ASSERT(nodeTmp != nullptr);
+    TEST_ASSERT(nodeTmp->isAdjacent(nodeB));
+    TEST_ASSERT(nodeA->isAdjacent(nodeB));
+    TEST_ASSERT(!nodeA->isAdjacent(nodeTmp));
+    TEST_ASSERT(!nodeTmp->isAdjacent(nodeC));
+}
+
+void TestGraph::testLoopDepths()
+{
+    Module mod{{}};
+    Method method{mod};
+    auto a = method.addNewLocal(TYPE_INT32, "%a");
+    auto b = method.addNewLocal(TYPE_INT32, "%b");
+    auto startLabel = method.addNewLocal(TYPE_LABEL, "%start").local();
+    auto outerLabel = method.addNewLocal(TYPE_LABEL, "%outer").local();
+    auto innerLabel = method.addNewLocal(TYPE_LABEL, "%inner").local();
+    auto latchLabel = method.addNewLocal(TYPE_LABEL, "%latch").local();
+    auto endLabel = method.addNewLocal(TYPE_LABEL, "%end").local();
+
+    // the inner block loops to itself, the latch block jumps back to the header of the outer loop
+    method.appendToEnd(new intermediate::BranchLabel(*startLabel));
+    method.appendToEnd(new intermediate::MoveOperation(a, INT_ONE));
+    method.appendToEnd(new intermediate::BranchLabel(*outerLabel));
+    method.appendToEnd(new intermediate::MoveOperation(b, a));
+    method.appendToEnd(new intermediate::BranchLabel(*innerLabel));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, b, b, INT_ONE));
+    method.appendToEnd(new intermediate::Branch(innerLabel, COND_ZERO_CLEAR, b));
+    method.appendToEnd(new intermediate::BranchLabel(*latchLabel));
+    method.appendToEnd(new intermediate::Branch(outerLabel, COND_ZERO_CLEAR, a));
+    method.appendToEnd(new intermediate::BranchLabel(*endLabel));
+    method.appendToEnd(new intermediate::MoveOperation(a, b));
+
+    auto depths = method.getCFG().findLoopDepths();
+    auto getDepth = [&](const Local* label) -> unsigned {
+        auto block = method.findBasicBlock(label);
+        auto it = depths.find(block);
+        return it == depths.end() ? 0 : it->second;
+    };
+    TEST_ASSERT_EQUALS(0u, getDepth(startLabel));
+    TEST_ASSERT_EQUALS(1u, getDepth(outerLabel));
+    TEST_ASSERT_EQUALS(2u, getDepth(innerLabel));
+    TEST_ASSERT_EQUALS(1u, getDepth(latchLabel));
+    TEST_ASSERT_EQUALS(0u, getDepth(endLabel));
+}
@@ -32,6 +32,9 @@ public:
 
     void testEdgeNodes();
     void testDirection();
+
+    void testLivenessAnalysis();
+    void testLoopDepths();
 };
 
 #endif /* VC4C_TEST_GRAPH */
@@ -8,8 +8,17 @@
 
 #include "Bitfield.h"
 #include "HalfType.h"
+#include "InstructionList.h"
+#include "Locals.h"
+#include "MemoryArena.h"
+#include "Method.h"
+#include "Module.h"
 #include "Values.h"
 #include "asm/OpCodes.h"
+#include "intermediate/IntermediateInstruction.h"
+
+#include <map>
+#include <vector>
 
 using namespace vc4c;
 
@@ -24,6 +33,8 @@ TestInstructions::TestInstructions()
     TEST_ADD(TestInstructions::testOpCodeProperties);
     TEST_ADD(TestInstructions::testHalfFloat);
     TEST_ADD(TestInstructions::testOpCodeFlags);
+    TEST_ADD(TestInstructions::testInstructionList);
+    TEST_ADD(TestInstructions::testLocalUsersMap);
 }
 
 TestInstructions::~TestInstructions()
@@ -640,4 +651,190 @@ void TestInstructions::testOpCodeFlags()
     TEST_ASSERT(checkFlagSet(OP_XOR(INT_ONE, INT_MINUS_ONE).second, FlagsMask::NEGATIVE));
 
     // TODO v8ops
-}
\ No newline at end of file
+}
+
+static int32_t getMarker(const intermediate::IL& instr)
+{
+    return instr->getArgument(0)->getLiteralValue()->signedInt();
+}
+
+static std::vector<int32_t> getMarkers(const intermediate::InstructionList& list)
+{
+    std::vector<int32_t> markers;
+    for(const auto& instr : list)
+        markers.push_back(getMarker(instr));
+    return markers;
+}
+
+void TestInstructions::testInstructionList()
+{
+    // enough instructions to span several slabs of growing size
+    const int32_t numInstructions = 2000;
+    MemoryArena arena;
+    intermediate::InstructionList list(&arena);
+    auto createInstruction = [](int32_t marker) -> intermediate::IntermediateInstruction* {
+        return new intermediate::MoveOperation(NOP_REGISTER, Value(Literal(marker), TYPE_INT32));
+    };
+
+    for(int32_t i = 0; i < numInstructions; ++i)
+        list.emplace_back(createInstruction(i));
+    TEST_ASSERT_EQUALS(static_cast<std::size_t>(numInstructions), list.size());
+    // the slabs are served by the arena, not by the heap
+    TEST_ASSERT_EQUALS(std::size_t{0}, arena.getStatistics().numHeapAllocations);
+
+    // forward and backward iteration visit all elements across the slab boundaries
+    std::vector<int32_t> expected;
+    for(int32_t i = 0; i < numInstructions; ++i)
+        expected.push_back(i);
+    TEST_ASSERT(expected == getMarkers(list));
+    int32_t marker = numInstructions;
+    for(auto it = list.end(); it != list.begin();)
+    {
+        --it;
+        TEST_ASSERT_EQUALS(--marker, getMarker(*it));
+    }
+    TEST_ASSERT_EQUALS(0, marker);
+
+    // iterators to elements stay valid when other elements (in other slabs) are erased
+    auto front = list.begin();
+    auto middle = std::next(list.begin(), numInstructions / 2);
+    auto back = std::prev(list.end(), 2);
+    for(auto it = std::next(list.begin()); it != list.end();)
+    {
+        // erase every odd element
+        it = list.erase(it);
+        if(it != list.end())
+            ++it;
+    }
+    expected.clear();
+    for(int32_t i = 0; i < numInstructions; i += 2)
+        expected.push_back(i);
+    TEST_ASSERT_EQUALS(static_cast<std::size_t>(numInstructions / 2), list.size());
+    TEST_ASSERT(expected == getMarkers(list));
+    TEST_ASSERT_EQUALS(0, getMarker(*front));
+    TEST_ASSERT_EQUALS(numInstructions / 2, getMarker(*middle));
+    TEST_ASSERT_EQUALS(numInstructions - 2, getMarker(*back));
+
+    // re-inserting reuses the erased nodes and keeps the order
+    const auto statsBefore = arena.getStatistics();
+    for(auto it = std::next(list.begin()); it != list.end(); ++it)
+    {
+        auto inserted = list.emplace(it, createInstruction(getMarker(*it) - 1));
+        TEST_ASSERT_EQUALS(getMarker(*it) - 1, getMarker(*inserted));
+    }
+    list.emplace_back(createInstruction(numInstructions - 1));
+    TEST_ASSERT_EQUALS(statsBefore.numPooledAllocations, arena.getStatistics().numPooledAllocations);
+    expected.clear();
+    for(int32_t i = 0; i < numInstructions; ++i)
+        expected.push_back(i);
+    TEST_ASSERT_EQUALS(static_cast<std::size_t>(numInstructions), list.size());
+    TEST_ASSERT(expected == getMarkers(list));
+
+    list.clear();
+    TEST_ASSERT(list.empty());
+    TEST_ASSERT(list.begin() == list.end());
+}
+
+static bool checkUsers(const LocalUsersMap& users, const std::map<const LocalUser*, uint32_t>& expected)
+{
+    if(users.size() != expected.size())
+        return false;
+    for(const auto& entry : expected)
+    {
+        auto it = users.find(entry.first);
+        if(it == users.end() || it->first != entry.first || it->second.numReads != entry.second)
+            return false;
+    }
+    // every entry is visited exactly once by the iteration
+    std::map<const LocalUser*, uint32_t> visited;
+    for(const auto& user : users)
+        visited.emplace(user.first, user.second.numReads);
+    return visited == expected;
+}
+
+void TestInstructions::testLocalUsersMap()
+{
+    // the map switches from linear search to a hash index above 16 users, so go well beyond that
+    const std::size_t numUsers = 40;
+    std::vector<std::unique_ptr<intermediate::IntermediateInstruction>> instructions;
+    for(std::size_t i = 0; i < numUsers + 1; ++i)
+        instructions.emplace_back(new intermediate::Nop(intermediate::DelayType::WAIT_REGISTER));
+    const LocalUser* unknownUser = instructions.back().get();
+
+    MemoryArena arena;
+    LocalUsersMap users(&arena);
+    std::map<const LocalUser*, uint32_t> expected;
+    TEST_ASSERT(users.empty());
+    TEST_ASSERT(users.find(unknownUser) == users.end());
+
+    // add users one by one across the threshold, checking all lookups before and after the index is built
+    for(std::size_t i = 0; i < numUsers; ++i)
+    {
+        const LocalUser* user = instructions[i].get();
+        users[user].numReads = static_cast<uint32_t>(i + 1);
+        expected[user] = static_cast<uint32_t>(i + 1);
+        TEST_ASSERT(checkUsers(users, expected));
+        TEST_ASSERT(users.find(unknownUser) == users.end());
+    }
+
+    // accessing an existing user does not insert it again
+    ++users[instructions.front().get()].numReads;
+    ++expected[instructions.front().get()];
+    TEST_ASSERT(checkUsers(users, expected));
+
+    // erasing unknown users does nothing
+    TEST_ASSERT_EQUALS(0u, users.erase(unknownUser));
+    TEST_ASSERT(checkUsers(users, expected));
+
+    // erase from the middle (moving the last entry into the gap) and from the back
+    for(std::size_t i = 0; i < numUsers; i += 3)
+    {
+        TEST_ASSERT_EQUALS(1u, users.erase(instructions[i].get()));
+        expected.erase(instructions[i].get());
+        TEST_ASSERT(checkUsers(users, expected));
+        TEST_ASSERT(users.find(instructions[i].get()) == users.end());
+    }
+    TEST_ASSERT_EQUALS(0u, users.erase(instructions.front().get()));
+
+    // shrink below the threshold via the iterator overload and grow again
+    while(users.size() > 4)
+    {
+        expected.erase(users.begin()->first);
+        users.erase(users.begin());
+        TEST_ASSERT(checkUsers(users, expected));
+    }
+    for(std::size_t i = 0; i < numUsers; ++i)
+    {
+        const LocalUser* user = instructions[i].get();
+        if(expected.find(user) == expected.end())
+        {
+            users[user].numReads = 42;
+            expected[user] = 42;
+            TEST_ASSERT(checkUsers(users, expected));
+        }
+    }
+    TEST_ASSERT_EQUALS(numUsers, users.size());
+
+    // the Local interface on top of the map
+    Module module{{}};
+    Method method{module};
+    Local& local = *method.addNewLocal(TYPE_INT32, "%local").local();
+    for(std::size_t i = 0; i < numUsers; ++i)
+    {
+        local.addUser(*instructions[i], LocalUse::Type::READER);
+        if(i % 2 == 0)
+            local.addUser(*instructions[i], LocalUse::Type::WRITER);
+    }
+    TEST_ASSERT_EQUALS(numUsers, local.countUsers(LocalUse::Type::READER));
+    TEST_ASSERT_EQUALS(numUsers / 2, local.countUsers(LocalUse::Type::WRITER));
+    TEST_ASSERT_EQUALS(numUsers, local.getUsers().size());
+    for(std::size_t i = 0; i < numUsers; i += 2)
+        local.removeUser(*instructions[i], LocalUse::Type::READER);
+    TEST_ASSERT_EQUALS(numUsers / 2, local.countUsers(LocalUse::Type::READER));
+    TEST_ASSERT_EQUALS(numUsers / 2, local.countUsers(LocalUse::Type::WRITER));
+    TEST_ASSERT_EQUALS(numUsers, local.getUsers().size());
+    for(std::size_t i = 0; i < numUsers; i += 2)
+        local.removeUser(*instructions[i], LocalUse::Type::WRITER);
+    TEST_ASSERT_EQUALS(numUsers / 2, local.getUsers().size());
+    TEST_ASSERT(local.getUsers(LocalUse::Type::WRITER).empty());
+}
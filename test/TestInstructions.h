@@ -24,6 +24,8 @@ public:
 	void testOpCodeProperties();
 	void testHalfFloat();
 	void testOpCodeFlags();
+	void testInstructionList();
+	void testLocalUsersMap();
 };
 
 #endif /* TEST_INSTRUCTIONS_H */
@@ -9,6 +9,10 @@
 #include "emulation_helper.h"
 #include "test_cases.h"
 
+#include "VC4C.h"
+
+#include <sstream>
+
 using namespace vc4c;
 using namespace vc4c::tools;
 
@@ -96,6 +100,8 @@ TestMemoryAccess::TestMemoryAccess(const Configuration& config) : TestEmulator(f
 
     TEST_ADD(TestMemoryAccess::testVPMWrites);
     TEST_ADD(TestMemoryAccess::testVPMReads);
+    TEST_ADD(TestMemoryAccess::testVPMDynamicOffsetGrouping);
+    TEST_ADD(TestMemoryAccess::testVPMInitialOffsetGrouping);
 
     TEST_ADD(TestMemoryAccess::testVectorLoadStoreCharPrivate);
     TEST_ADD(TestMemoryAccess::testVectorLoadStoreCharLocal);
@@ -352,6 +358,100 @@ void TestMemoryAccess::testVPMReads()
     }
 }
 
+/*
+ * Counts the number of instructions in the disassembled kernel code which write the given DMA address register
+ */
+static unsigned countDMAAddressWrites(const std::string& binary, const std::string& registerName)
+{
+    std::istringstream input(binary);
+    std::stringstream assembler;
+    disassembleModule(input, assembler, OutputMode::ASSEMBLER);
+
+    unsigned count = 0;
+    std::string line;
+    while(std::getline(assembler, line))
+    {
+        if(line.find(registerName) != std::string::npos)
+            ++count;
+    }
+    return count;
+}
+
+void TestMemoryAccess::testVPMDynamicOffsetGrouping()
+{
+    std::stringstream buffer;
+    compileFile(buffer, "./testing/test_vpm_grouping.cl");
+
+    // the 4 stores of the first kernel and the 4 stores of the second kernel are combined within their kernels
+    TEST_ASSERT(countDMAAddressWrites(buffer.str(), "vpw_addr") < 8u);
+
+    EmulationData data;
+    data.kernelName = "test_vpm_dynamic_offset";
+    data.maxEmulationCycles = vc4c::test::maxExecutionCycles;
+    data.module = std::make_pair("", &buffer);
+    data.workGroup.dimensions = 3;
+    data.workGroup.globalOffsets = {0, 0, 0};
+    data.workGroup.localSizes = {4, 1, 1};
+    data.workGroup.numGroups = {2, 1, 1};
+
+    // parameter 0 is the input, one int4 vector per work-item
+    data.parameter.emplace_back(0, std::vector<uint32_t>(8 * 4));
+    for(unsigned i = 0; i < data.parameter.back().second->size(); ++i)
+        data.parameter.back().second->at(i) = i * 7;
+    // parameter 1 is the output, four int4 vectors per work-item
+    data.parameter.emplace_back(0, std::vector<uint32_t>(8 * 4 * 4));
+
+    const auto result = emulate(data);
+    TEST_ASSERT(result.executionSuccessful);
+    TEST_ASSERT_EQUALS(2u, result.results.size());
+
+    auto& src = data.parameter[0].second.value();
+    auto& res = result.results[1].second.value();
+
+    for(unsigned gid = 0; gid < 8; ++gid)
+    {
+        for(unsigned k = 0; k < 4; ++k)
+        {
+            for(unsigned e = 0; e < 4; ++e)
+                TEST_ASSERT_EQUALS(src.at(gid * 4 + e) + k, res.at((gid * 4 + k) * 4 + e));
+        }
+    }
+}
+
+void TestMemoryAccess::testVPMInitialOffsetGrouping()
+{
+    std::stringstream buffer;
+    compileFile(buffer, "./testing/test_vpm_grouping.cl");
+
+    // the 4 strided reads starting at an offset are combined into a single DMA load
+    TEST_ASSERT(countDMAAddressWrites(buffer.str(), "vpr_addr") < 4u);
+
+    EmulationData data;
+    data.kernelName = "test_vpm_initial_offset";
+    data.maxEmulationCycles = vc4c::test::maxExecutionCycles;
+    data.module = std::make_pair("", &buffer);
+
+    // parameters 0 and 1 are both input/output
+    data.parameter.emplace_back(0, std::vector<unsigned>(4 * 6));
+    data.parameter.emplace_back(0, std::vector<unsigned>(4 * 10 + 4));
+
+    for(unsigned i = 0; i < data.parameter[1].second->size(); ++i)
+        data.parameter[1].second->at(i) = i;
+
+    const auto result = emulate(data);
+    TEST_ASSERT(result.executionSuccessful);
+    TEST_ASSERT_EQUALS(2u, result.results.size());
+
+    auto& v1 = result.results[0].second.value();
+
+    // the first two vectors of v1 are not written
+    for(unsigned i = 0; i < 2 * 4; ++i)
+        TEST_ASSERT_EQUALS(0u, v1.at(i));
+    // we copy (with stride and offset) from v2 to v1
+    for(unsigned i = 0; i < 4 * 4; ++i)
+        TEST_ASSERT_EQUALS((1 + (i / 4) * 3) * 4 /* (offset + index * stride) * elements */ + (i % 4), v1.at(8 + i));
+}
+
 void TestMemoryAccess::testVectorLoadStoreCharPrivate()
 {
     testPrivateLocalFunction<char>(config, "-DTYPE=char -DSTORAGE=__private",
@@ -21,6 +21,8 @@ public:
 
     void testVPMWrites();
     void testVPMReads();
+    void testVPMDynamicOffsetGrouping();
+    void testVPMInitialOffsetGrouping();
 
     // general vload/vstore tests are in TestVectorFunctions, this is to test optimizations
     void testVectorLoadStoreCharPrivate();
@@ -9,11 +9,27 @@
 #include "InstructionWalker.h"
 #include "Method.h"
 #include "Module.h"
+#include "asm/ALUInstruction.h"
+#include "asm/KernelInfo.h"
 #include "intermediate/IntermediateInstruction.h"
+#include "optimization/Combiner.h"
+#include "optimization/ControlFlow.h"
+#include "optimization/InstructionScheduler.h"
+#include "optimization/LiveRanges.h"
 #include "optimization/Optimizer.h"
+#include "periphery/TMU.h"
+#include "test_cases.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <sstream>
 
 using namespace vc4c;
 
+extern void extractBinary(std::istream& binary, qpu_asm::ModuleInfo& moduleInfo, StableList<Global>& globals,
+    std::vector<qpu_asm::Instruction>& instructions);
+
 TestOptimizations::TestOptimizations() : TestEmulator(true)
 {
     // test once all functions without optimizations enabled
@@ -57,6 +73,17 @@ TestOptimizations::TestOptimizations() : TestEmulator(true)
         TEST_ADD_WITH_STRING(TestOptimizations::testClamp, pass.parameterName);
         TEST_ADD_WITH_STRING(TestOptimizations::testCross, pass.parameterName);
     }
+    TEST_ADD(TestOptimizations::testParallelBlocks);
+    TEST_ADD(TestOptimizations::testLiveRangeCoalescing);
+    TEST_ADD(TestOptimizations::testLiveRangeSplitting);
+    TEST_ADD(TestOptimizations::testSchedulingDelaysAcrossBlocks);
+    TEST_ADD(TestOptimizations::testSchedulingDelaysWithinBlock);
+    TEST_ADD(TestOptimizations::testCombineInstructions);
+    TEST_ADD(TestOptimizations::testSchedulingPacksInstructions);
+    TEST_ADD(TestOptimizations::testSchedulingEmulation);
+    TEST_ADD(TestOptimizations::testSchedulingPairsInstructions);
+    TEST_ADD(TestOptimizations::testPipelineTMULoads);
+    TEST_ADD(TestOptimizations::testTMUPipeliningEmulation);
     // TODO the profiling info is wrong, since all optimization counters get merged!
     // TEST_ADD(TestEmulator::printProfilingInfo);
     // TODO the test failures are not printed anymore for some reason (neither is the summary line), iff no other test
@@ -236,4 +263,692 @@ void TestOptimizations::testCross(std::string passParamName)
     config.optimizationLevel = OptimizationLevel::NONE;
 
     TestEmulator::testFloatEmulations(11, "test_cross");
-}
\ No newline at end of file
+}
+void TestOptimizations::testParallelBlocks()
+{
+    // the block-local passes need to generate the same code, independent of whether they run in parallel
+    config.additionalEnabledOptimizations = {};
+    config.optimizationLevel = OptimizationLevel::FULL;
+
+    config.additionalOptions.minParallelBlocks = 0;
+    std::stringstream serialBuffer;
+    compileFile(serialBuffer, "./example/md5.cl", "", cachePrecompilation);
+
+    config.additionalOptions.minParallelBlocks = 2;
+    std::stringstream parallelBuffer;
+    compileFile(parallelBuffer, "./example/md5.cl", "", cachePrecompilation);
+
+    TEST_ASSERT(!serialBuffer.str().empty());
+    TEST_ASSERT(serialBuffer.str() == parallelBuffer.str());
+}
+
+static bool hasMove(Method& method, const Value& dest, const Value& src)
+{
+    for(auto it = method.walkAllInstructions(); !it.isEndOfMethod(); it.nextInMethod())
+    {
+        auto move = it.get<intermediate::MoveOperation>();
+        if(move && move->getOutput() == dest && move->getSource() == src)
+            return true;
+    }
+    return false;
+}
+
+void TestOptimizations::testLiveRangeCoalescing()
+{
+    Module mod{{}};
+    Method method{mod};
+    // coalesced: the move connects the locals across blocks and they do not interfere
+    auto a = method.addNewLocal(TYPE_INT32, "%a");
+    auto b = method.addNewLocal(TYPE_INT32, "%b");
+    auto c = method.addNewLocal(TYPE_INT32, "%c");
+    // rejected: the source is overwritten while the copy is still live
+    auto x = method.addNewLocal(TYPE_INT32, "%x");
+    auto y = method.addNewLocal(TYPE_INT32, "%y");
+    auto z = method.addNewLocal(TYPE_INT32, "%z");
+    // rejected: the types differ
+    auto u = method.addNewLocal(TYPE_INT32, "%u");
+    auto v = method.addNewLocal(TYPE_INT16, "%v");
+    // rejected: the source has restrictions on its register-file (pack mode)
+    auto p = method.addNewLocal(TYPE_INT32, "%p");
+    auto q = method.addNewLocal(TYPE_INT32, "%q");
+
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%first").local()));
+    method.appendToEnd(new intermediate::MoveOperation(a, INT_ONE));
+    method.appendToEnd(new intermediate::MoveOperation(b, a));
+    method.appendToEnd(new intermediate::MoveOperation(x, INT_ONE));
+    method.appendToEnd(new intermediate::MoveOperation(y, x));
+    method.appendToEnd(new intermediate::MoveOperation(x, INT_ZERO));
+    method.appendToEnd(new intermediate::MoveOperation(u, INT_ONE));
+    method.appendToEnd(new intermediate::MoveOperation(v, u));
+    method.appendToEnd((new intermediate::MoveOperation(p, INT_ONE))->setPackMode(PACK_INT_TO_SHORT_TRUNCATE));
+    method.appendToEnd(new intermediate::MoveOperation(q, p));
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%second").local()));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, c, b, b));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, z, x, y));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, z, z, v));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, z, z, q));
+    const auto numInstructions = method.countInstructions();
+
+    TEST_ASSERT(optimizations::optimizeLiveRanges(mod, method, {}));
+    TEST_ASSERT_EQUALS(numInstructions - 1, method.countInstructions());
+    TEST_ASSERT(!hasMove(method, b, a));
+    TEST_ASSERT(b.local()->getUsers().empty());
+    auto add = (++method.begin())->walk().nextInBlock().get<intermediate::Operation>();
+    TEST_ASSERT(add != nullptr);
+    TEST_ASSERT(add && add->getFirstArg() == a && add->assertArgument(1) == a);
+
+    TEST_ASSERT(hasMove(method, y, x));
+    TEST_ASSERT(hasMove(method, v, u));
+    TEST_ASSERT(hasMove(method, q, p));
+
+    // nothing left to coalesce
+    TEST_ASSERT(!optimizations::optimizeLiveRanges(mod, method, {}));
+}
+
+void TestOptimizations::testLiveRangeSplitting()
+{
+    Module mod{{}};
+    Method method{mod};
+    // split: defined before the loop, only read within the loop
+    auto a = method.addNewLocal(TYPE_INT32, "%a");
+    // rejected: written within the loop
+    auto k = method.addNewLocal(TYPE_INT32, "%k");
+    // rejected: still live after the loop
+    auto m = method.addNewLocal(TYPE_INT32, "%m");
+    auto i = method.addNewLocal(TYPE_INT32, "%i");
+    auto c = method.addNewLocal(TYPE_INT32, "%c");
+    auto out = method.addNewLocal(TYPE_INT32, "%out");
+    auto loopLabel = method.addNewLocal(TYPE_LABEL, "%loop");
+
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%start").local()));
+    method.appendToEnd(new intermediate::MoveOperation(a, INT_ONE));
+    method.appendToEnd(new intermediate::MoveOperation(k, INT_ONE));
+    method.appendToEnd(new intermediate::MoveOperation(m, INT_ONE));
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%entry").local()));
+    method.appendToEnd(new intermediate::MoveOperation(i, INT_ZERO));
+    method.appendToEnd(new intermediate::BranchLabel(*loopLabel.local()));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, c, a, i));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, k, k, m));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, c, c, k));
+    method.appendToEnd((new intermediate::Operation(OP_SUB, i, i, INT_ONE))->setSetFlags(SetFlag::SET_FLAGS));
+    method.appendToEnd(new intermediate::Branch(loopLabel.local(), COND_ZERO_CLEAR, i));
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%exit").local()));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, out, c, m));
+    const auto numLocals = method.getLocalIndexLimit();
+
+    TEST_ASSERT(optimizations::optimizeLiveRanges(mod, method, {}));
+
+    // the copy of %a is inserted at the end of the block entering the loop
+    const BasicBlock& entry = *(++method.begin());
+    auto copy = (--entry.end())->get();
+    auto move = dynamic_cast<const intermediate::MoveOperation*>(copy);
+    TEST_ASSERT(move != nullptr);
+    TEST_ASSERT(move && move->getSource() == a && move->getOutput()->local() != a.local());
+
+    // only the copy is read within the loop
+    const BasicBlock& loop = *(++(++method.begin()));
+    auto add = (++loop.begin())->get();
+    TEST_ASSERT(!add->readsLocal(a.local()));
+    TEST_ASSERT(move && add->readsLocal(move->getOutput()->local()));
+    TEST_ASSERT_EQUALS(1u, a.local()->getUsers(LocalUse::Type::READER).size());
+
+    // the other locals are not split
+    TEST_ASSERT_EQUALS(2u, k.local()->getUsers(LocalUse::Type::READER).size());
+    TEST_ASSERT_EQUALS(2u, m.local()->getUsers(LocalUse::Type::READER).size());
+    TEST_ASSERT_EQUALS(numLocals + 1, method.getLocalIndexLimit());
+}
+
+/*
+ * Returns the cycle (relative to the start of the block) of the first instruction matching the predicate, or the number
+ * of cycles of the block, if no instruction matches
+ */
+static std::size_t findCycle(
+    const BasicBlock& block, const std::function<bool(const intermediate::IntermediateInstruction*)>& predicate)
+{
+    std::size_t cycle = 0;
+    for(const auto& inst : block)
+    {
+        auto combined = dynamic_cast<const intermediate::CombinedOperation*>(inst.get());
+        if(predicate(inst.get()) || (combined && combined->op1 && predicate(combined->op1.get())) ||
+            (combined && combined->op2 && predicate(combined->op2.get())))
+            return cycle;
+        if(inst->mapsToASMInstruction())
+            ++cycle;
+    }
+    return cycle;
+}
+
+static std::size_t countCycles(const BasicBlock& block)
+{
+    return findCycle(block, [](const intermediate::IntermediateInstruction* inst) -> bool { return false; });
+}
+
+static std::size_t countNops(const BasicBlock& block)
+{
+    return static_cast<std::size_t>(std::count_if(block.begin(), block.end(),
+        [](const intermediate::IL& inst) -> bool { return dynamic_cast<const intermediate::Nop*>(inst.get()); }));
+}
+
+static bool writesSFU(const intermediate::IntermediateInstruction* inst)
+{
+    return inst->writesRegister(REG_SFU_RECIP);
+}
+
+static bool readsSFU(const intermediate::IntermediateInstruction* inst)
+{
+    return inst->readsRegister(REG_SFU_OUT);
+}
+
+void TestOptimizations::testSchedulingDelaysAcrossBlocks()
+{
+    Module mod{{}};
+    Method method{mod};
+    auto a = method.addNewLocal(TYPE_FLOAT, "%a");
+    auto b = method.addNewLocal(TYPE_FLOAT, "%b");
+    auto c = method.addNewLocal(TYPE_FLOAT, "%c");
+    auto d = method.addNewLocal(TYPE_INT32, "%d");
+    auto e = method.addNewLocal(TYPE_INT32, "%e");
+
+    // the SFU call is at the end of the block, the result is read at the start of the next block
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%first").local()));
+    method.appendToEnd(new intermediate::MoveOperation(a, FLOAT_ONE));
+    method.appendToEnd(new intermediate::MoveOperation(Value(REG_SFU_RECIP, TYPE_FLOAT), a));
+    method.appendToEnd(new intermediate::Nop(intermediate::DelayType::WAIT_SFU));
+    method.appendToEnd(new intermediate::Nop(intermediate::DelayType::WAIT_SFU));
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%second").local()));
+    method.appendToEnd(new intermediate::MoveOperation(b, Value(REG_SFU_OUT, TYPE_FLOAT)));
+    method.appendToEnd(new intermediate::Operation(OP_FADD, c, b, FLOAT_ONE));
+    // the DMA load is set up in a previous block, the wait is preceded by NOPs
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%third").local()));
+    for(unsigned i = 0; i < 6; ++i)
+        method.appendToEnd(new intermediate::Nop(intermediate::DelayType::WAIT_VPM));
+    method.appendToEnd(new intermediate::MoveOperation(NOP_REGISTER, Value(REG_VPM_DMA_LOAD_WAIT, TYPE_INT32)));
+    method.appendToEnd(new intermediate::MoveOperation(d, INT_ONE));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, e, d, INT_ONE));
+
+    optimizations::reorderInstructions(mod, method, {});
+
+    auto blockIt = method.begin();
+    const BasicBlock& first = *blockIt;
+    const BasicBlock& second = *(++blockIt);
+    const BasicBlock& third = *(++blockIt);
+
+    // the delay slots of the SFU call are kept at the end of the first block
+    TEST_ASSERT(findCycle(first, writesSFU) + 2 < countCycles(first));
+    TEST_ASSERT_EQUALS(0u, findCycle(second, readsSFU));
+    // the wait for the DMA load is executed as late as before, but the NOPs are replaced with the other instructions
+    TEST_ASSERT(findCycle(third, [](const intermediate::IntermediateInstruction* inst) -> bool {
+        return inst->readsRegister(REG_VPM_DMA_LOAD_WAIT);
+    }) >= 6u);
+    TEST_ASSERT(countNops(third) < 6u);
+}
+
+void TestOptimizations::testSchedulingDelaysWithinBlock()
+{
+    Module mod{{}};
+    Method method{mod};
+    auto a = method.addNewLocal(TYPE_FLOAT, "%a");
+    auto b = method.addNewLocal(TYPE_FLOAT, "%b");
+    auto c = method.addNewLocal(TYPE_INT32, "%c");
+    auto d = method.addNewLocal(TYPE_INT32, "%d");
+    auto e = method.addNewLocal(TYPE_INT32, "%e");
+
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%first").local()));
+    method.appendToEnd(new intermediate::MoveOperation(a, FLOAT_ONE));
+    method.appendToEnd(new intermediate::MoveOperation(Value(REG_SFU_RECIP, TYPE_FLOAT), a));
+    method.appendToEnd(new intermediate::Nop(intermediate::DelayType::WAIT_SFU));
+    method.appendToEnd(new intermediate::Nop(intermediate::DelayType::WAIT_SFU));
+    method.appendToEnd(new intermediate::MoveOperation(b, Value(REG_SFU_OUT, TYPE_FLOAT)));
+    // independent instructions which can fill the delay
+    method.appendToEnd(new intermediate::MoveOperation(c, INT_ONE));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, d, c, INT_ONE));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, e, d, INT_ONE));
+
+    optimizations::reorderInstructions(mod, method, {});
+
+    const BasicBlock& block = *method.begin();
+    // the SFU delay is still met, but (some of) the NOPs are replaced by independent instructions
+    TEST_ASSERT(findCycle(block, writesSFU) + 2 < findCycle(block, readsSFU));
+    TEST_ASSERT(countNops(block) < 2u);
+    TEST_ASSERT(findCycle(block, readsSFU) < countCycles(block));
+}
+
+/*
+ * Returns whether the instruction is a combined instruction of the two instructions matching the predicates
+ */
+static bool isCombinationOf(const intermediate::IntermediateInstruction* inst,
+    const std::function<bool(const intermediate::IntermediateInstruction*)>& first,
+    const std::function<bool(const intermediate::IntermediateInstruction*)>& second)
+{
+    auto combined = dynamic_cast<const intermediate::CombinedOperation*>(inst);
+    return combined && combined->op1 && combined->op2 &&
+        ((first(combined->op1.get()) && second(combined->op2.get())) ||
+            (first(combined->op2.get()) && second(combined->op1.get())));
+}
+
+static bool runsOnDifferentALUs(const intermediate::CombinedOperation& combined)
+{
+    const OpCode& first = combined.getFirstOp()->op;
+    const OpCode& second = combined.getSecondOP()->op;
+    // each operation is assigned to exactly one ALU
+    return first.runsOnAddALU() != first.runsOnMulALU() && second.runsOnAddALU() != second.runsOnMulALU() &&
+        first.runsOnAddALU() != second.runsOnAddALU();
+}
+
+void TestOptimizations::testCombineInstructions()
+{
+    Module mod{{}};
+    Method method{mod};
+    auto a = method.addNewLocal(TYPE_INT32, "%a");
+    auto b = method.addNewLocal(TYPE_INT32, "%b");
+    auto c = method.addNewLocal(TYPE_INT32, "%c");
+    auto d = method.addNewLocal(TYPE_INT32, "%d");
+    auto e = method.addNewLocal(TYPE_INT32, "%e");
+
+    auto combine = [&](intermediate::IntermediateInstruction* first, intermediate::IntermediateInstruction* second)
+        -> std::unique_ptr<intermediate::CombinedOperation> {
+        std::unique_ptr<intermediate::IntermediateInstruction> firstPtr(first);
+        std::unique_ptr<intermediate::IntermediateInstruction> secondPtr(second);
+        auto combined = optimizations::combineInstructions(firstPtr, secondPtr);
+        if(combined)
+        {
+            // both instructions are consumed
+            TEST_ASSERT(!firstPtr);
+            TEST_ASSERT(!secondPtr);
+            TEST_ASSERT(runsOnDifferentALUs(*combined));
+        }
+        else
+        {
+            // the instructions are not modified
+            TEST_ASSERT(firstPtr.get() == first);
+            TEST_ASSERT(secondPtr.get() == second);
+        }
+        return combined;
+    };
+
+    // ADD and MUL operations are taken over as they are
+    auto combined = combine(
+        new intermediate::Operation(OP_ADD, c, a, b), new intermediate::Operation(OP_MUL24, d, a, b));
+    TEST_ASSERT(!!combined);
+    if(combined)
+    {
+        TEST_ASSERT_EQUALS(OP_ADD, combined->getFirstOp()->op);
+        TEST_ASSERT_EQUALS(OP_MUL24, combined->getSecondOP()->op);
+    }
+    combined = combine(
+        new intermediate::Operation(OP_MUL24, c, a, b), new intermediate::Operation(OP_SUB, d, b, a));
+    TEST_ASSERT(!!combined);
+    // the move is converted to the ALU not used by the other operation
+    combined = combine(new intermediate::Operation(OP_ADD, c, a, b), new intermediate::MoveOperation(d, a));
+    TEST_ASSERT(!!combined);
+    if(combined)
+        TEST_ASSERT(combined->getSecondOP()->op.runsOnMulALU());
+    combined = combine(new intermediate::MoveOperation(c, b), new intermediate::Operation(OP_MUL24, d, a, b));
+    TEST_ASSERT(!!combined);
+    if(combined)
+        TEST_ASSERT(combined->getFirstOp()->op.runsOnAddALU());
+    combined = combine(new intermediate::MoveOperation(c, a), new intermediate::MoveOperation(d, b));
+    TEST_ASSERT(!!combined);
+    // the same signal can be fired by both instructions
+    combined = combine(new intermediate::Operation(OP_ADD, c, a, b),
+        (new intermediate::Operation(OP_MUL24, d, a, b))->setSignaling(SIGNAL_LOAD_TMU0));
+    TEST_ASSERT(!!combined);
+    // the same immediate value can be used by both instructions
+    combined = combine(
+        new intermediate::Operation(OP_ADD, c, a, INT_ONE), new intermediate::Operation(OP_MUL24, d, a, INT_ONE));
+    TEST_ASSERT(!!combined);
+
+    // both operations run on the same ALU
+    TEST_ASSERT(!combine(new intermediate::Operation(OP_ADD, c, a, b), new intermediate::Operation(OP_SUB, d, a, b)));
+    TEST_ASSERT(
+        !combine(new intermediate::Operation(OP_MUL24, c, a, b), new intermediate::Operation(OP_FMUL, d, a, b)));
+    // the second instruction reads the output of the first
+    TEST_ASSERT(!combine(new intermediate::Operation(OP_ADD, c, a, b), new intermediate::Operation(OP_MUL24, d, c, b)));
+    // both instructions write the same output without inverted conditions
+    TEST_ASSERT(!combine(new intermediate::Operation(OP_ADD, c, a, b), new intermediate::Operation(OP_MUL24, c, a, b)));
+
+    // signal conflicts: different signals, a signal and a small immediate
+    TEST_ASSERT(!combine((new intermediate::Operation(OP_ADD, c, a, b))->setSignaling(SIGNAL_LOAD_TMU0),
+        (new intermediate::Operation(OP_MUL24, d, a, b))->setSignaling(SIGNAL_LOAD_TMU1)));
+    TEST_ASSERT(!combine(new intermediate::Operation(OP_ADD, c, a, INT_ONE),
+        (new intermediate::Operation(OP_MUL24, d, a, b))->setSignaling(SIGNAL_LOAD_TMU0)));
+    // two different immediate values
+    TEST_ASSERT(!combine(new intermediate::Operation(OP_ADD, c, a, Value(SmallImmediate(1), TYPE_INT8)),
+        new intermediate::Operation(OP_MUL24, d, a, Value(SmallImmediate(2), TYPE_INT8))));
+
+    // register-file conflicts: more than two inputs, reads from or writes to registers
+    TEST_ASSERT(!combine(new intermediate::Operation(OP_ADD, c, a, b), new intermediate::Operation(OP_MUL24, d, a, e)));
+    TEST_ASSERT(!combine(new intermediate::MoveOperation(c, a), new intermediate::Operation(OP_MUL24, d, b, e)));
+    TEST_ASSERT(!combine(new intermediate::Operation(OP_ADD, c, a, b),
+        new intermediate::MoveOperation(d, Value(REG_ELEMENT_NUMBER, TYPE_INT8))));
+    TEST_ASSERT(!combine(new intermediate::Operation(OP_ADD, c, a, b),
+        new intermediate::MoveOperation(Value(REG_SFU_RECIP, TYPE_INT32), a)));
+
+    // pack conflicts: only one of the instructions packs its output, unpack modes
+    TEST_ASSERT(!combine((new intermediate::Operation(OP_ADD, c, a, b))->setPackMode(PACK_INT_TO_SHORT_TRUNCATE),
+        new intermediate::Operation(OP_MUL24, d, a, b)));
+    TEST_ASSERT(!combine(new intermediate::MoveOperation(c, a),
+        (new intermediate::MoveOperation(d, b))->setPackMode(PACK_INT_TO_SHORT_TRUNCATE)));
+    auto unpacked = new intermediate::Operation(OP_ADD, c, a, b);
+    unpacked->unpackMode = UNPACK_16A_32;
+    TEST_ASSERT(!combine(unpacked, new intermediate::Operation(OP_MUL24, d, a, b)));
+
+    // flag conflicts: the MUL ALU sets flags, the second instruction depends on the flags set by the first
+    TEST_ASSERT(!combine(new intermediate::Operation(OP_ADD, c, a, b),
+        (new intermediate::Operation(OP_MUL24, d, a, b))->setSetFlags(SetFlag::SET_FLAGS)));
+    TEST_ASSERT(!combine((new intermediate::Operation(OP_ADD, c, a, b))->setSetFlags(SetFlag::SET_FLAGS),
+        (new intermediate::Operation(OP_MUL24, d, a, b))->setCondition(COND_ZERO_SET)));
+    // a move setting flags cannot be executed on the MUL ALU
+    TEST_ASSERT(!combine(new intermediate::Operation(OP_ADD, c, a, b),
+        (new intermediate::MoveOperation(d, a))->setSetFlags(SetFlag::SET_FLAGS)));
+}
+
+void TestOptimizations::testSchedulingPacksInstructions()
+{
+    Module mod{{}};
+    Method method{mod};
+    auto a = method.addNewLocal(TYPE_INT32, "%a");
+    auto b = method.addNewLocal(TYPE_INT32, "%b");
+    auto c = method.addNewLocal(TYPE_INT32, "%c");
+    auto d = method.addNewLocal(TYPE_INT32, "%d");
+    auto e = method.addNewLocal(TYPE_INT32, "%e");
+    auto f = method.addNewLocal(TYPE_INT32, "%f");
+    auto g = method.addNewLocal(TYPE_INT32, "%g");
+
+    auto isAdd = [&](const intermediate::IntermediateInstruction* inst) -> bool {
+        return inst->writesLocal(c.local());
+    };
+    auto isMul = [&](const intermediate::IntermediateInstruction* inst) -> bool {
+        return inst->writesLocal(d.local());
+    };
+
+    // the MUL operation is packed with one of the independent ADD operations
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%independent").local()));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, c, a, b));
+    method.appendToEnd(new intermediate::Operation(OP_SUB, e, a, b));
+    method.appendToEnd(new intermediate::Operation(OP_MUL24, d, a, b));
+    // the MUL operation depends on the result of the ADD operation
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%dependent").local()));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, c, a, b));
+    method.appendToEnd(new intermediate::Operation(OP_MUL24, d, c, b));
+    // the operations run on the same ALU
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%sameALU").local()));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, f, a, b));
+    method.appendToEnd(new intermediate::Operation(OP_SUB, g, a, b));
+
+    optimizations::reorderInstructions(mod, method, {});
+
+    auto blockIt = method.begin();
+    const BasicBlock& independent = *blockIt;
+    const BasicBlock& dependent = *(++blockIt);
+    const BasicBlock& sameALU = *(++blockIt);
+
+    auto isCombined = [](const intermediate::IL& inst) -> bool {
+        return dynamic_cast<const intermediate::CombinedOperation*>(inst.get()) != nullptr;
+    };
+    auto isAddALU = [&](const intermediate::IntermediateInstruction* inst) -> bool {
+        return inst->writesLocal(c.local()) || inst->writesLocal(e.local());
+    };
+    TEST_ASSERT(std::any_of(independent.begin(), independent.end(),
+        [&](const intermediate::IL& inst) -> bool { return isCombinationOf(inst.get(), isAddALU, isMul); }));
+    TEST_ASSERT_EQUALS(2u, countCycles(independent));
+    TEST_ASSERT(std::none_of(dependent.begin(), dependent.end(), isCombined));
+    TEST_ASSERT(findCycle(dependent, isAdd) < findCycle(dependent, isMul));
+    TEST_ASSERT(std::none_of(sameALU.begin(), sameALU.end(), isCombined));
+    TEST_ASSERT_EQUALS(2u, countCycles(sameALU));
+}
+
+/*
+ * Creates a loop loading a value per iteration via TMU0 and repeating depending on the loaded value
+ */
+static void createTMULoop(Method& method, bool addressSetsFlags)
+{
+    auto base = method.addNewLocal(TYPE_INT32, "%base");
+    auto offset = method.addNewLocal(TYPE_INT32, "%offset");
+    auto step = method.addNewLocal(TYPE_INT32, "%step");
+    auto addr = method.addNewLocal(TYPE_INT32, "%addr");
+    auto val = method.addNewLocal(TYPE_INT32, "%val");
+    auto sum = method.addNewLocal(TYPE_INT32, "%sum");
+    auto cond = method.addNewLocal(TYPE_BOOL, "%cond");
+    auto loopLabel = method.addNewLocal(TYPE_LABEL, "%loop").local();
+
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%start").local()));
+    method.appendToEnd(new intermediate::MoveOperation(offset, Value(SmallImmediate(0), TYPE_INT8)));
+    method.appendToEnd(new intermediate::MoveOperation(sum, Value(SmallImmediate(0), TYPE_INT8)));
+    method.appendToEnd(new intermediate::BranchLabel(*loopLabel));
+    method.appendToEnd((new intermediate::Operation(OP_ADD, addr, base, offset))
+                           ->setSetFlags(addressSetsFlags ? SetFlag::SET_FLAGS : SetFlag::DONT_SET));
+    method.appendToEnd(new intermediate::MoveOperation(periphery::TMU0.getAddress(TYPE_INT32), addr));
+    method.appendToEnd((new intermediate::Nop(intermediate::DelayType::WAIT_TMU))->setSignaling(SIGNAL_LOAD_TMU0));
+    method.appendToEnd(new intermediate::MoveOperation(val, periphery::TMU_READ_REGISTER));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, sum, sum, val));
+    method.appendToEnd(new intermediate::Operation(OP_AND, cond, val, Value(SmallImmediate(1), TYPE_INT8)));
+    method.appendToEnd(new intermediate::Operation(OP_ADD, offset, offset, step));
+    method.appendToEnd(new intermediate::Branch(loopLabel, COND_ZERO_CLEAR, cond));
+    method.appendToEnd(new intermediate::BranchLabel(*method.addNewLocal(TYPE_LABEL, "%exit").local()));
+    method.appendToEnd(new intermediate::MoveOperation(NOP_REGISTER, sum));
+}
+
+static bool writesTMUAddress(const intermediate::IntermediateInstruction* inst)
+{
+    return inst->writesRegister(periphery::TMU0.s_coordinate);
+}
+
+static bool loadsTMU(const intermediate::IntermediateInstruction* inst)
+{
+    return inst->signal == SIGNAL_LOAD_TMU0;
+}
+
+void TestOptimizations::testPipelineTMULoads()
+{
+    {
+        Module mod{{}};
+        Method method{mod};
+        createTMULoop(method, false);
+
+        TEST_ASSERT(optimizations::pipelineTMULoads(mod, method, {}));
+
+        auto blockIt = method.begin();
+        const BasicBlock& preheader = *blockIt;
+        const BasicBlock& loop = *(++blockIt);
+        const BasicBlock& exit = *(++blockIt);
+        // the request for the first iteration is issued before the loop
+        TEST_ASSERT(findCycle(preheader, writesTMUAddress) < countCycles(preheader));
+        // the request for the next iteration is issued after the load, directly before the branch
+        TEST_ASSERT(findCycle(loop, loadsTMU) < findCycle(loop, writesTMUAddress));
+        TEST_ASSERT_EQUALS(countCycles(loop) - 2, findCycle(loop, writesTMUAddress));
+        // the address is selected depending on the loop condition without modifying the flags read by the branch
+        TEST_ASSERT(findCycle(loop, [](const intermediate::IntermediateInstruction* inst) -> bool {
+            return inst->writesRegister(REG_REPLICATE_ALL);
+        }) < countCycles(loop));
+        TEST_ASSERT(std::none_of(
+            loop.begin(), loop.end(), [](const intermediate::IL& inst) -> bool { return inst->doesSetFlag(); }));
+        // the request issued by the last iteration is discarded after the loop
+        TEST_ASSERT_EQUALS(0u, findCycle(exit, loadsTMU));
+    }
+
+    {
+        // the copy of the address calculation would overwrite the flags for the branch
+        Module mod{{}};
+        Method method{mod};
+        createTMULoop(method, true);
+
+        TEST_ASSERT(!optimizations::pipelineTMULoads(mod, method, {}));
+        const BasicBlock& preheader = *method.begin();
+        TEST_ASSERT_EQUALS(countCycles(preheader), findCycle(preheader, writesTMUAddress));
+    }
+}
+
+void TestOptimizations::testTMUPipeliningEmulation()
+{
+    // the input buffer is mapped behind all other memory and fills exactly one page, so any access beyond the last
+    // vector is out of bounds
+    const uint32_t numVectors = 64;
+    std::vector<uint32_t> input(numVectors * 16);
+    for(std::size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<uint32_t>(i * 3 + 1);
+    // the loop is left after the last vector
+    input[(numVectors - 1) * 16] = 0;
+    TemporaryFile inputFile;
+    {
+        std::ofstream f(inputFile.fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+        f.write(reinterpret_cast<const char*>(input.data()),
+            static_cast<std::streamsize>(input.size() * sizeof(uint32_t)));
+    }
+
+    // returns the number of emulated cycles and the result
+    auto runKernel = [&](bool pipelineLoads) -> std::pair<uint32_t, std::vector<uint32_t>> {
+        config.optimizationLevel = OptimizationLevel::FULL;
+        config.additionalEnabledOptimizations.clear();
+        config.additionalDisabledOptimizations.clear();
+        if(!pipelineLoads)
+            config.additionalDisabledOptimizations.emplace("pipeline-tmu-loads");
+        std::stringstream buffer;
+        compileFile(buffer, "./testing/test_tmu_pipelining.cl", "", cachePrecompilation);
+
+        tools::EmulationData data;
+        data.kernelName = "test_tmu_pipelining";
+        data.maxEmulationCycles = test::maxExecutionCycles;
+        data.module = std::make_pair("", &buffer);
+        data.workGroup.localSizes = {1, 1, 1};
+        data.workGroup.numGroups = {1, 1, 1};
+        data.mappedParameters.emplace(0, tools::MappedFile{inputFile.fileName, 0});
+        data.parameter.emplace_back(0u, Optional<std::vector<uint32_t>>{});
+        data.parameter.emplace_back(0u, std::vector<uint32_t>(16));
+
+        const auto result = tools::emulate(data);
+        TEST_ASSERT(result.executionSuccessful);
+        TEST_ASSERT_EQUALS(2u, result.results.size());
+        if(result.results.size() != 2 || !result.results.back().second)
+            return std::make_pair(result.numCycles, std::vector<uint32_t>{});
+        return std::make_pair(result.numCycles, *result.results.back().second);
+    };
+
+    const auto unpipelined = runKernel(false);
+    const auto pipelined = runKernel(true);
+    config.additionalDisabledOptimizations.clear();
+    TEST_ASSERT_EQUALS(16u, pipelined.second.size());
+    TEST_ASSERT(unpipelined.second == pipelined.second);
+    for(std::size_t elem = 0; elem < std::min(pipelined.second.size(), std::size_t{16}); ++elem)
+    {
+        uint32_t expected = 0;
+        for(std::size_t vector = 0; vector < numVectors; ++vector)
+            expected += input[vector * 16 + elem];
+        TEST_ASSERT_EQUALS(expected, pipelined.second[elem]);
+    }
+    // the memory latency of the loads is hidden behind the previous loop iteration
+    TEST_ASSERT(pipelined.first < unpipelined.first);
+}
+
+void TestOptimizations::testSchedulingEmulation()
+{
+    // emulates the kernels with the default passes of the medium optimization level, once with the instruction
+    // scheduler and once with the old reorder and combine passes run instead
+    auto runKernel = [&](tools::EmulationData data, bool scheduleInstructions) -> tools::EmulationResult {
+        config.optimizationLevel = OptimizationLevel::MEDIUM;
+        config.additionalEnabledOptimizations.clear();
+        config.additionalDisabledOptimizations.clear();
+        if(!scheduleInstructions)
+            config.additionalDisabledOptimizations.emplace("schedule-instructions");
+        std::stringstream buffer;
+        compileFile(buffer, data.module.first, "", cachePrecompilation);
+        data.module.second = &buffer;
+        return tools::emulate(data);
+    };
+
+    std::vector<tools::EmulationData> kernels;
+    for(std::size_t index : {0u, 3u, 14u})
+        kernels.push_back(test::integerTests.at(index).first);
+    for(std::size_t index : {1u, 4u, 5u, 11u})
+        kernels.push_back(test::floatTests.at(index).first);
+
+    uint64_t totalUnscheduledCycles = 0;
+    uint64_t totalScheduledCycles = 0;
+    for(const auto& kernel : kernels)
+    {
+        const auto unscheduled = runKernel(kernel, false);
+        const auto scheduled = runKernel(kernel, true);
+        TEST_ASSERT(unscheduled.executionSuccessful);
+        TEST_ASSERT(scheduled.executionSuccessful);
+        TEST_ASSERT_EQUALS(unscheduled.results.size(), scheduled.results.size());
+        for(std::size_t i = 0; i < std::min(unscheduled.results.size(), scheduled.results.size()); ++i)
+        {
+            const auto& expected = unscheduled.results[i].second;
+            const auto& result = scheduled.results[i].second;
+            TEST_ASSERT_EQUALS(expected.has_value(), result.has_value());
+            if(expected && result)
+                TEST_ASSERT(*expected == *result);
+        }
+        // the scheduled code is never slower
+        TEST_ASSERT(scheduled.numCycles <= unscheduled.numCycles);
+        if(scheduled.numCycles > unscheduled.numCycles)
+        {
+            TEST_ASSERT_EQUALS(kernel.kernelName + ": " + std::to_string(unscheduled.numCycles),
+                kernel.kernelName + ": " + std::to_string(scheduled.numCycles));
+        }
+        totalUnscheduledCycles += unscheduled.numCycles;
+        totalScheduledCycles += scheduled.numCycles;
+    }
+    // and in total faster
+    TEST_ASSERT(totalScheduledCycles < totalUnscheduledCycles);
+
+    config.additionalDisabledOptimizations.clear();
+}
+
+/*
+ * Returns the number of instructions in the compiled module executing operations on both the ADD and the MUL ALU
+ */
+static std::size_t countPairedInstructions(std::istream& binary)
+{
+    qpu_asm::ModuleInfo moduleInfo;
+    StableList<Global> globals;
+    std::vector<qpu_asm::Instruction> instructions;
+    extractBinary(binary, moduleInfo, globals, instructions);
+    return static_cast<std::size_t>(
+        std::count_if(instructions.begin(), instructions.end(), [](const qpu_asm::Instruction& inst) -> bool {
+            auto op = inst.as<qpu_asm::ALUInstruction>();
+            return op && op->getAddition() != OP_NOP.opAdd && op->getMultiplication() != OP_NOP.opMul;
+        }));
+}
+
+void TestOptimizations::testSchedulingPairsInstructions()
+{
+    // compiles the kernels with the default passes of the medium optimization level, once packing the instructions
+    // while scheduling and once with the combine peep-hole optimization instead and compares the number of
+    // instructions using both ALUs
+    auto countPairs = [&](const std::string& fileName, bool scheduleInstructions) -> std::size_t {
+        config.optimizationLevel = OptimizationLevel::MEDIUM;
+        config.additionalEnabledOptimizations.clear();
+        config.additionalDisabledOptimizations.clear();
+        if(!scheduleInstructions)
+            config.additionalDisabledOptimizations.emplace("schedule-instructions");
+        std::stringstream buffer;
+        compileFile(buffer, fileName, "", cachePrecompilation);
+        return countPairedInstructions(buffer);
+    };
+
+    std::vector<std::string> files;
+    for(std::size_t index : {0u, 3u, 14u})
+        files.push_back(test::integerTests.at(index).first.module.first);
+    for(std::size_t index : {1u, 4u, 5u, 11u})
+        files.push_back(test::floatTests.at(index).first.module.first);
+
+    std::size_t totalCombined = 0;
+    std::size_t totalPacked = 0;
+    for(const auto& file : files)
+    {
+        const auto numCombined = countPairs(file, false);
+        const auto numPacked = countPairs(file, true);
+        // the packing searches all ready instructions, not only the next one, so it finds at least as many pairs
+        TEST_ASSERT(numPacked >= numCombined);
+        if(numPacked < numCombined)
+        {
+            TEST_ASSERT_EQUALS(file + ": " + std::to_string(numCombined), file + ": " + std::to_string(numPacked));
+        }
+        totalCombined += numCombined;
+        totalPacked += numPacked;
+    }
+    TEST_ASSERT(totalPacked > totalCombined);
+
+    config.additionalDisabledOptimizations.clear();
+}
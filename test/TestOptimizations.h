@@ -39,6 +39,18 @@ public:
     void testArithmetic(std::string passParamName);
     void testClamp(std::string passParamName);
     void testCross(std::string passParamName);
+
+    void testParallelBlocks();
+    void testLiveRangeCoalescing();
+    void testLiveRangeSplitting();
+    void testSchedulingDelaysAcrossBlocks();
+    void testSchedulingDelaysWithinBlock();
+    void testCombineInstructions();
+    void testSchedulingPacksInstructions();
+    void testSchedulingEmulation();
+    void testSchedulingPairsInstructions();
+    void testPipelineTMULoads();
+    void testTMUPipeliningEmulation();
 };
 
 #endif /* VC4C_TEST_OPTIMIZATIONS_H */
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#include "TestThreadPool.h"
+
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <stdexcept>
+
+using namespace vc4c;
+
+TestThreadPool::TestThreadPool()
+{
+    TEST_ADD(TestThreadPool::testRunTasks);
+    TEST_ADD(TestThreadPool::testNestedGroups);
+    TEST_ADD(TestThreadPool::testRethrowErrors);
+    TEST_ADD(TestThreadPool::testRethrowUnknownErrors);
+}
+
+void TestThreadPool::testRunTasks()
+{
+    std::atomic<unsigned> counter{0};
+    ThreadPool::TaskGroup group("TestRunTasks");
+    for(unsigned i = 0; i < 100; ++i)
+        group.schedule([&counter]() { ++counter; });
+    group.waitForAll();
+    TEST_ASSERT_EQUALS(100u, counter.load());
+
+    // the group can be reused after waiting
+    group.schedule([&counter]() { ++counter; });
+    group.waitForAll();
+    TEST_ASSERT_EQUALS(101u, counter.load());
+}
+
+void TestThreadPool::testNestedGroups()
+{
+    // schedule more outer tasks than there are worker threads, each waiting for its own nested group. This can only
+    // finish if the waiting threads run the tasks of the group they are waiting for
+    const unsigned numOuterTasks = static_cast<unsigned>(ThreadPool::getInstance().getNumThreads()) * 2 + 1;
+    std::atomic<unsigned> counter{0};
+    ThreadPool::TaskGroup outer("TestNestedOuter");
+    for(unsigned i = 0; i < numOuterTasks; ++i)
+    {
+        outer.schedule([&counter]() {
+            ThreadPool::TaskGroup inner("TestNestedInner");
+            for(unsigned k = 0; k < 10; ++k)
+                inner.schedule([&counter]() { ++counter; });
+            inner.waitForAll();
+        });
+    }
+    outer.waitForAll();
+    TEST_ASSERT_EQUALS(numOuterTasks * 10, counter.load());
+}
+
+void TestThreadPool::testRethrowErrors()
+{
+    std::atomic<unsigned> counter{0};
+    ThreadPool::TaskGroup group("TestRethrowErrors");
+    for(unsigned i = 0; i < 10; ++i)
+    {
+        group.schedule([&counter, i]() {
+            if(i == 5)
+                throw std::runtime_error("Test error");
+            ++counter;
+        });
+    }
+    TEST_THROWS(group.waitForAll(), std::runtime_error);
+    // all other tasks still finished before the error is re-thrown
+    TEST_ASSERT_EQUALS(9u, counter.load());
+}
+
+void TestThreadPool::testRethrowUnknownErrors()
+{
+    ThreadPool::TaskGroup group("TestRethrowUnknownErrors");
+    // errors not derived from std::exception must not terminate the worker thread either
+    group.schedule([]() { throw 42; });
+    TEST_THROWS(group.waitForAll(), int);
+}
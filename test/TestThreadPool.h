@@ -0,0 +1,23 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+#ifndef VC4C_TEST_THREAD_POOL
+#define VC4C_TEST_THREAD_POOL
+
+#include "cpptest.h"
+
+class TestThreadPool : public Test::Suite
+{
+public:
+    TestThreadPool();
+
+    void testRunTasks();
+    void testNestedGroups();
+    void testRethrowErrors();
+    void testRethrowUnknownErrors();
+};
+
+#endif /* VC4C_TEST_THREAD_POOL */
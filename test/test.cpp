@@ -25,6 +25,7 @@
 #include "TestMemoryAccess.h"
 #include "TestConversionFunctions.h"
 #include "TestOptimizations.h"
+#include "TestThreadPool.h"
 
 #include "tools.h"
 #include "../lib/cpplog/include/logger.h"
@@ -130,6 +131,7 @@ int main(int argc, char** argv)
     Test::registerSuite(newEmulatorTest, "test-emulator", "Runs selected code-samples through the emulator");
     Test::registerSuite(newMathFunctionsTest, "emulate-math", "Runs emulation tests for the OpenCL standard-library math functions");
     Test::registerSuite(Test::newInstance<TestGraph>, "test-graph", "Runs basic test for the graph data structure");
+    Test::registerSuite(Test::newInstance<TestThreadPool>, "test-thread-pool", "Runs basic tests for the thread pool executing background tasks");
     Test::registerSuite(newArithmeticTest, "emulate-arithmetic", "Runs emulation tests for various kind of operations");
     Test::registerSuite(newIntegerFunctionsTest, "emulate-integer", "Runs emulation tests for the OpenCL standard-library integer functions");
     Test::registerSuite(newCommonFunctionsTest, "emulate-common", "Runs emulation tests for the OpenCL standard-library common functions");
@@ -0,0 +1,50 @@
+
+/*
+ * Keeps more vectors live at the same time than there are registers, so some of them need to be spilled into the VPM
+ */
+#define NUM_VECTORS 68
+#define LOAD(i) uint16 v##i = in[i] * (uint16)(i + 1);
+#define ACCUMULATE(i) result = result * (uint16)3 + v##i;
+
+__kernel void test_register_spilling(const __global uint16* input, __global uint16* output)
+{
+	const __global uint16* in = input + mul24(get_global_id(0), (uint)NUM_VECTORS);
+	LOAD(0) LOAD(1) LOAD(2) LOAD(3)
+	LOAD(4) LOAD(5) LOAD(6) LOAD(7)
+	LOAD(8) LOAD(9) LOAD(10) LOAD(11)
+	LOAD(12) LOAD(13) LOAD(14) LOAD(15)
+	LOAD(16) LOAD(17) LOAD(18) LOAD(19)
+	LOAD(20) LOAD(21) LOAD(22) LOAD(23)
+	LOAD(24) LOAD(25) LOAD(26) LOAD(27)
+	LOAD(28) LOAD(29) LOAD(30) LOAD(31)
+	LOAD(32) LOAD(33) LOAD(34) LOAD(35)
+	LOAD(36) LOAD(37) LOAD(38) LOAD(39)
+	LOAD(40) LOAD(41) LOAD(42) LOAD(43)
+	LOAD(44) LOAD(45) LOAD(46) LOAD(47)
+	LOAD(48) LOAD(49) LOAD(50) LOAD(51)
+	LOAD(52) LOAD(53) LOAD(54) LOAD(55)
+	LOAD(56) LOAD(57) LOAD(58) LOAD(59)
+	LOAD(60) LOAD(61) LOAD(62) LOAD(63)
+	LOAD(64) LOAD(65) LOAD(66) LOAD(67)
+
+	// accumulate in reverse order, so all vectors are live until here
+	uint16 result = 0;
+	ACCUMULATE(67) ACCUMULATE(66) ACCUMULATE(65) ACCUMULATE(64)
+	ACCUMULATE(63) ACCUMULATE(62) ACCUMULATE(61) ACCUMULATE(60)
+	ACCUMULATE(59) ACCUMULATE(58) ACCUMULATE(57) ACCUMULATE(56)
+	ACCUMULATE(55) ACCUMULATE(54) ACCUMULATE(53) ACCUMULATE(52)
+	ACCUMULATE(51) ACCUMULATE(50) ACCUMULATE(49) ACCUMULATE(48)
+	ACCUMULATE(47) ACCUMULATE(46) ACCUMULATE(45) ACCUMULATE(44)
+	ACCUMULATE(43) ACCUMULATE(42) ACCUMULATE(41) ACCUMULATE(40)
+	ACCUMULATE(39) ACCUMULATE(38) ACCUMULATE(37) ACCUMULATE(36)
+	ACCUMULATE(35) ACCUMULATE(34) ACCUMULATE(33) ACCUMULATE(32)
+	ACCUMULATE(31) ACCUMULATE(30) ACCUMULATE(29) ACCUMULATE(28)
+	ACCUMULATE(27) ACCUMULATE(26) ACCUMULATE(25) ACCUMULATE(24)
+	ACCUMULATE(23) ACCUMULATE(22) ACCUMULATE(21) ACCUMULATE(20)
+	ACCUMULATE(19) ACCUMULATE(18) ACCUMULATE(17) ACCUMULATE(16)
+	ACCUMULATE(15) ACCUMULATE(14) ACCUMULATE(13) ACCUMULATE(12)
+	ACCUMULATE(11) ACCUMULATE(10) ACCUMULATE(9) ACCUMULATE(8)
+	ACCUMULATE(7) ACCUMULATE(6) ACCUMULATE(5) ACCUMULATE(4)
+	ACCUMULATE(3) ACCUMULATE(2) ACCUMULATE(1) ACCUMULATE(0)
+	output[get_global_id(0)] = result;
+}
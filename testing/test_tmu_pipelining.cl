@@ -0,0 +1,19 @@
+
+/*
+ * Sums up all vectors up to (and including) the first vector with a zero first element.
+ * The loop reads the vectors via the TMU and exits depending on the loaded values, so the kernel can not know in
+ * advance which vector is the last one read.
+ */
+__kernel void test_tmu_pipelining(const __global int16* in, __global int16* out)
+{
+	int16 sum = 0;
+	int16 val;
+	uint i = 0;
+	do
+	{
+		val = in[i];
+		sum += val;
+		++i;
+	} while(val.s0 != 0);
+	out[0] = sum;
+}
@@ -0,0 +1,28 @@
+__kernel void test_vpm_dynamic_offset(const __global int4* in, __global int4* out)
+{
+	//the stores only differ in the constant part of the offset and can be combined
+	size_t base = get_global_id(0) * 4;
+	int4 val = in[get_global_id(0)];
+
+	out[base + 0] = val;
+	out[base + 1] = val + 1;
+	out[base + 2] = val + 2;
+	out[base + 3] = val + 3;
+}
+
+__kernel void test_vpm_initial_offset(__global int4* inout1, __global int4* inout2)
+{
+	int4 a, b, c, d;
+	//read blocks with stride, not starting at the beginning of the buffer
+	int easyStride = 3;
+	a = inout2[1 + 0 * easyStride];
+	b = inout2[1 + 1 * easyStride];
+	c = inout2[1 + 2 * easyStride];
+	d = inout2[1 + 3 * easyStride];
+
+	//write consecutive blocks, not starting at the beginning of the buffer
+	inout1[2] = a;
+	inout1[3] = b;
+	inout1[4] = c;
+	inout1[5] = d;
+}
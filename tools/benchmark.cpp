@@ -0,0 +1,572 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+/*
+ * Compile-time benchmark over the kernel corpus listed in testing/benchmark_corpus.txt.
+ *
+ * Every corpus file is compiled in a separate child process for every selected optimization level, which allows to
+ * measure the peak memory usage of a single compilation. The times of the single compilation stages are taken from
+ * the compilation telemetry (see src/Telemetry.h).
+ *
+ * The results can be written to a CSV file and compared against a previous result (the baseline) to detect
+ * regressions in compilation time, memory usage or generated code size.
+ *
+ * NOTE: No pre-generated LLVM IR or SPIR-V modules are checked into the repository, since they depend on the CLang and
+ * VC4CLStdLib versions they are generated with. So unless they are generated locally with --generate, every corpus
+ * file is compiled from its OpenCL C source and the benchmark cannot run without the OpenCL C front-end.
+ */
+
+#include "CompilationError.h"
+#include "Compiler.h"
+#include "Precompiler.h"
+#include "Telemetry.h"
+#include "config.h"
+#include "tools.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace vc4c;
+
+using Clock = std::chrono::steady_clock;
+
+// compilations faster than this are not checked for time regressions, since their times are dominated by noise
+static constexpr uint64_t MIN_COMPARED_TIME_US = 1000;
+
+// the file extensions of the pre-generated inputs, in order of preference
+static const std::vector<std::string> PRECOMPILED_EXTENSIONS = {".ir", ".spv", ".bc"};
+
+struct CorpusEntry
+{
+    std::string sourceFile;
+    std::string options;
+};
+
+struct BenchmarkResult
+{
+    std::string file;
+    std::string level;
+    bool passed = false;
+    uint64_t precompileUs = 0;
+    uint64_t parseUs = 0;
+    uint64_t normalizeUs = 0;
+    uint64_t optimizeUs = 0;
+    uint64_t registerAllocationUs = 0;
+    uint64_t codegenUs = 0;
+    uint64_t totalUs = 0;
+    uint64_t peakRSSKb = 0;
+    uint64_t instructions = 0;
+    uint64_t bytes = 0;
+    // the allocations requested from the memory arenas of all kernels, i.e. the heap allocations without the arenas
+    uint64_t arenaAllocations = 0;
+    // the heap allocations actually done by the memory arenas of all kernels
+    uint64_t heapAllocations = 0;
+};
+
+static const std::string CSV_HEADER = "file,level,status,precompileUs,parseUs,normalizeUs,optimizeUs,"
+                                      "registerAllocationUs,codegenUs,totalUs,peakRSSKb,instructions,bytes,"
+                                      "arenaAllocations,heapAllocations";
+
+static void printHelp()
+{
+    std::cout << "Usage: vc4c_benchmark [options] [<corpus file>]" << std::endl;
+    std::cout << "Compiles all kernels listed in the corpus file (defaults to testing/benchmark_corpus.txt) and "
+                 "reports the compilation times"
+              << std::endl;
+    std::cout << "options:" << std::endl;
+    std::cout << "\t-h, --help\t\tPrints this help message and exits" << std::endl;
+    std::cout << "\t-O1,-O2,-O3\t\tSelects the optimization level(s) to benchmark, defaults to all three" << std::endl;
+    std::cout << "\t--offline\t\tOnly benchmark files with pre-generated LLVM IR or SPIR-V modules, skip all others"
+              << std::endl;
+    std::cout << "\t--generate\t\tGenerates the LLVM IR or SPIR-V modules for all corpus files and exits" << std::endl;
+    std::cout << "\t--filter=<text>\t\tOnly benchmark the corpus files containing the given text" << std::endl;
+    std::cout << "\t--repeat=<count>\tCompiles every file the given times and uses the fastest run, defaults to 1"
+              << std::endl;
+    std::cout << "\t--output=<file>\t\tWrites the results as CSV into the given file" << std::endl;
+    std::cout << "\t--baseline=<file>\tCompares the results against the CSV results in the given file" << std::endl;
+    std::cout << "\t--threshold=<percent>\tThe maximum increase over the baseline not considered a regression, "
+                 "defaults to 10"
+              << std::endl;
+    std::cout << "\t--verbose\t\tEnables verbose compiler log output" << std::endl;
+}
+
+static std::vector<CorpusEntry> readCorpus(const std::string& fileName, const std::string& filter)
+{
+    std::ifstream in(fileName);
+    if(!in.is_open())
+        throw CompilationError(CompilationStep::GENERAL, "Failed to open benchmark corpus", fileName);
+    std::vector<CorpusEntry> entries;
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(line.empty() || line[0] == '#')
+            continue;
+        auto pos = line.find(' ');
+        CorpusEntry entry{line.substr(0, pos), pos == std::string::npos ? "" : line.substr(pos + 1)};
+        if(filter.empty() || entry.sourceFile.find(filter) != std::string::npos)
+            entries.emplace_back(std::move(entry));
+    }
+    return entries;
+}
+
+static bool fileExists(const std::string& fileName)
+{
+    return access(fileName.data(), R_OK) == 0;
+}
+
+static std::string findPrecompiledFile(const std::string& sourceFile)
+{
+    for(const auto& extension : PRECOMPILED_EXTENSIONS)
+    {
+        if(fileExists(sourceFile + extension))
+            return sourceFile + extension;
+    }
+    return "";
+}
+
+static void generatePrecompiledFile(const CorpusEntry& entry)
+{
+    std::ifstream input(entry.sourceFile);
+    if(!input.is_open())
+        throw CompilationError(CompilationStep::PRECOMPILATION, "Failed to open corpus file", entry.sourceFile);
+    TemporaryFile tmpFile;
+    std::unique_ptr<std::istream> out;
+    Precompiler::precompile(input, out, Configuration{}, entry.options, entry.sourceFile, tmpFile.fileName);
+    tmpFile.openInputStream(out);
+
+    std::string extension;
+    switch(Precompiler::getSourceType(*out))
+    {
+    case SourceType::LLVM_IR_TEXT:
+        extension = ".ir";
+        break;
+    case SourceType::SPIRV_BIN:
+        extension = ".spv";
+        break;
+    case SourceType::LLVM_IR_BIN:
+        extension = ".bc";
+        break;
+    default:
+        throw CompilationError(CompilationStep::PRECOMPILATION, "Unexpected pre-compilation output type");
+    }
+    std::ofstream file(entry.sourceFile + extension, std::ios_base::out | std::ios_base::trunc);
+    file << out->rdbuf();
+    std::cout << "Generated: " << entry.sourceFile << extension << std::endl;
+}
+
+static uint64_t toMicroseconds(Clock::duration duration)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+}
+
+/*
+ * Runs a single compilation and writes the measured values into the given file descriptor.
+ *
+ * NOTE: This runs in the forked child process!
+ */
+static int runCompilation(int fd, const std::string& inputFile, const std::string& options, OptimizationLevel level)
+{
+    std::ifstream input(inputFile);
+    if(!input.is_open())
+        return 1;
+
+    Configuration config;
+    config.optimizationLevel = level;
+    // enables the telemetry, the records are collected directly and the file is never written
+    config.telemetryFile = "/dev/null";
+
+    BenchmarkResult result;
+    auto start = Clock::now();
+    TemporaryFile tmpFile;
+    std::unique_ptr<std::istream> in;
+    Precompiler::precompile(input, in, config, options, inputFile, tmpFile.fileName);
+    if(in == nullptr ||
+        (dynamic_cast<std::istringstream*>(in.get()) != nullptr &&
+            dynamic_cast<std::istringstream*>(in.get())->str().empty()))
+        tmpFile.openInputStream(in);
+    result.precompileUs = toMicroseconds(Clock::now() - start);
+
+    start = Clock::now();
+    std::ostringstream output;
+    Compiler compiler(*in, output);
+    compiler.getConfiguration() = config;
+    result.bytes = compiler.convert();
+    result.totalUs = toMicroseconds(Clock::now() - start);
+
+    // the stages of the different kernels might run in parallel, so these are the summed up times of all kernels
+    for(const auto& record : telemetry::collectRecords())
+    {
+        if(!record.passName.empty())
+            continue;
+        const auto time = static_cast<uint64_t>(record.wallTime.count());
+        if(record.stage == "parse")
+            result.parseUs += time;
+        else if(record.stage == "normalization" || record.stage == "adjustment")
+            result.normalizeUs += time;
+        else if(record.stage == "optimization")
+            result.optimizeUs += time;
+        else if(record.stage == "register-allocation")
+            result.registerAllocationUs += time;
+        else if(record.stage == "code-generation")
+        {
+            result.codegenUs += time;
+            result.instructions += record.instructionsAfter;
+        }
+    }
+    // the register-allocation is part of the code-generation stage
+    result.codegenUs -= std::min(result.codegenUs, result.registerAllocationUs);
+    for(const auto& counter : telemetry::collectCounters())
+    {
+        if(counter.name == "Arena allocations")
+            result.arenaAllocations += counter.value;
+        else if(counter.name == "Arena heap allocations")
+            result.heapAllocations += counter.value;
+    }
+
+    std::stringstream ss;
+    ss << result.precompileUs << ' ' << result.parseUs << ' ' << result.normalizeUs << ' ' << result.optimizeUs << ' '
+       << result.registerAllocationUs << ' ' << result.codegenUs << ' ' << result.totalUs << ' '
+       << result.instructions << ' ' << result.bytes << ' ' << result.arenaAllocations << ' '
+       << result.heapAllocations;
+    const auto data = ss.str();
+    return write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()) ? 0 : 1;
+}
+
+/*
+ * Compiles the given input in a child process to be able to measure the memory usage of this single compilation.
+ *
+ * NOTE: The benchmark process itself never compiles anything, so there are no compiler worker threads which could be
+ * left in an inconsistent state by forking.
+ */
+static BenchmarkResult runChild(const std::string& inputFile, const std::string& options, OptimizationLevel level)
+{
+    BenchmarkResult result;
+    int fds[2];
+    if(pipe(fds) != 0)
+        throw CompilationError(CompilationStep::GENERAL, "Failed to create pipe", strerror(errno));
+    pid_t pid = fork();
+    if(pid < 0)
+        throw CompilationError(CompilationStep::GENERAL, "Failed to fork benchmark process", strerror(errno));
+    if(pid == 0)
+    {
+        close(fds[0]);
+        int status = 1;
+        try
+        {
+            status = runCompilation(fds[1], inputFile, options, level);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << "Compilation of '" << inputFile << "' failed: " << e.what() << std::endl;
+        }
+        close(fds[1]);
+        // skip any clean-up, this is the copy of the parent process
+        _exit(status);
+    }
+
+    close(fds[1]);
+    std::string data;
+    std::array<char, 256> buffer;
+    ssize_t numRead;
+    while((numRead = read(fds[0], buffer.data(), buffer.size())) > 0)
+        data.append(buffer.data(), static_cast<std::size_t>(numRead));
+    close(fds[0]);
+
+    int status = 0;
+    struct rusage usage;
+    if(wait4(pid, &status, 0, &usage) != pid)
+        throw CompilationError(CompilationStep::GENERAL, "Failed to wait for benchmark process", strerror(errno));
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return result;
+
+    std::stringstream ss(data);
+    ss >> result.precompileUs >> result.parseUs >> result.normalizeUs >> result.optimizeUs >>
+        result.registerAllocationUs >> result.codegenUs >> result.totalUs >> result.instructions >> result.bytes >>
+        result.arenaAllocations >> result.heapAllocations;
+    result.passed = !ss.fail();
+    // on Linux, this is given in kilobytes
+    result.peakRSSKb = static_cast<uint64_t>(usage.ru_maxrss);
+    return result;
+}
+
+static void takeMinimum(BenchmarkResult& result, const BenchmarkResult& other)
+{
+    result.precompileUs = std::min(result.precompileUs, other.precompileUs);
+    result.parseUs = std::min(result.parseUs, other.parseUs);
+    result.normalizeUs = std::min(result.normalizeUs, other.normalizeUs);
+    result.optimizeUs = std::min(result.optimizeUs, other.optimizeUs);
+    result.registerAllocationUs = std::min(result.registerAllocationUs, other.registerAllocationUs);
+    result.codegenUs = std::min(result.codegenUs, other.codegenUs);
+    result.totalUs = std::min(result.totalUs, other.totalUs);
+    result.peakRSSKb = std::min(result.peakRSSKb, other.peakRSSKb);
+}
+
+static std::string toCSV(const BenchmarkResult& result)
+{
+    std::stringstream ss;
+    ss << result.file << ',' << result.level << ',' << (result.passed ? "ok" : "failed") << ','
+       << result.precompileUs << ',' << result.parseUs << ',' << result.normalizeUs << ',' << result.optimizeUs << ','
+       << result.registerAllocationUs << ',' << result.codegenUs << ',' << result.totalUs << ',' << result.peakRSSKb
+       << ',' << result.instructions << ',' << result.bytes << ',' << result.arenaAllocations << ','
+       << result.heapAllocations;
+    return ss.str();
+}
+
+static std::map<std::string, BenchmarkResult> readBaseline(const std::string& fileName)
+{
+    std::map<std::string, BenchmarkResult> results;
+    std::ifstream in(fileName);
+    if(!in.is_open())
+        throw CompilationError(CompilationStep::GENERAL, "Failed to open benchmark baseline", fileName);
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(line.empty() || line == CSV_HEADER)
+            continue;
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::stringstream ss(line);
+        BenchmarkResult result;
+        std::string status;
+        ss >> result.file >> result.level >> status >> result.precompileUs >> result.parseUs >> result.normalizeUs >>
+            result.optimizeUs >> result.registerAllocationUs >> result.codegenUs >> result.totalUs >>
+            result.peakRSSKb >> result.instructions >> result.bytes;
+        if(ss.fail())
+            throw CompilationError(CompilationStep::GENERAL, "Invalid baseline line", line);
+        // the allocation counts are missing in baselines written by older versions
+        ss >> result.arenaAllocations >> result.heapAllocations;
+        result.passed = status == "ok";
+        results.emplace(result.file + "@" + result.level, result);
+    }
+    return results;
+}
+
+static bool isRegression(uint64_t baseline, uint64_t current, double threshold)
+{
+    return static_cast<double>(current) > static_cast<double>(baseline) * (1.0 + threshold / 100.0);
+}
+
+/*
+ * Compares the result against the baseline, prints all regressions and returns whether there are any
+ */
+static bool checkRegression(const BenchmarkResult& baseline, const BenchmarkResult& current, double threshold)
+{
+    std::vector<std::string> regressions;
+    if(baseline.passed && !current.passed)
+        regressions.emplace_back("compilation failed");
+    else if(baseline.passed)
+    {
+        if(baseline.totalUs >= MIN_COMPARED_TIME_US && isRegression(baseline.totalUs, current.totalUs, threshold))
+            regressions.emplace_back(
+                "time " + std::to_string(baseline.totalUs) + "us -> " + std::to_string(current.totalUs) + "us");
+        if(isRegression(baseline.peakRSSKb, current.peakRSSKb, threshold))
+            regressions.emplace_back("peak RSS " + std::to_string(baseline.peakRSSKb) + "kB -> " +
+                std::to_string(current.peakRSSKb) + "kB");
+        if(isRegression(baseline.instructions, current.instructions, threshold))
+            regressions.emplace_back("instructions " + std::to_string(baseline.instructions) + " -> " +
+                std::to_string(current.instructions));
+        if(baseline.heapAllocations != 0 && isRegression(baseline.heapAllocations, current.heapAllocations, threshold))
+            regressions.emplace_back("heap allocations " + std::to_string(baseline.heapAllocations) + " -> " +
+                std::to_string(current.heapAllocations));
+    }
+    for(const auto& regression : regressions)
+        std::cout << "REGRESSION " << current.file << " (" << current.level << "): " << regression << std::endl;
+    return !regressions.empty();
+}
+
+int main(int argc, char** argv)
+{
+    std::string corpusFile = "testing/benchmark_corpus.txt";
+    std::string outputFile;
+    std::string baselineFile;
+    std::string filter;
+    double threshold = 10.0;
+    unsigned numRepetitions = 1;
+    bool offline = false;
+    bool generate = false;
+    LogLevel logLevel = LogLevel::ERROR;
+    std::vector<std::pair<std::string, OptimizationLevel>> levels;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if(arg == "--help" || arg == "-h")
+        {
+            printHelp();
+            return 0;
+        }
+        else if(arg == "-O1")
+            levels.emplace_back("O1", OptimizationLevel::BASIC);
+        else if(arg == "-O2")
+            levels.emplace_back("O2", OptimizationLevel::MEDIUM);
+        else if(arg == "-O3")
+            levels.emplace_back("O3", OptimizationLevel::FULL);
+        else if(arg == "--offline")
+            offline = true;
+        else if(arg == "--generate")
+            generate = true;
+        else if(arg == "--verbose")
+            logLevel = LogLevel::DEBUG;
+        else if(arg.find("--filter=") == 0)
+            filter = arg.substr(arg.find('=') + 1);
+        else if(arg.find("--repeat=") == 0)
+            numRepetitions = std::max(1u, static_cast<unsigned>(std::stoul(arg.substr(arg.find('=') + 1))));
+        else if(arg.find("--output=") == 0)
+            outputFile = arg.substr(arg.find('=') + 1);
+        else if(arg.find("--baseline=") == 0)
+            baselineFile = arg.substr(arg.find('=') + 1);
+        else if(arg.find("--threshold=") == 0)
+            threshold = std::stod(arg.substr(arg.find('=') + 1));
+        else if(arg[0] != '-')
+            corpusFile = arg;
+        else
+        {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printHelp();
+            return 2;
+        }
+    }
+    if(levels.empty())
+        levels = {{"O1", OptimizationLevel::BASIC}, {"O2", OptimizationLevel::MEDIUM}, {"O3", OptimizationLevel::FULL}};
+    setLogger(std::wcerr, true, logLevel);
+
+    const auto corpus = readCorpus(corpusFile, filter);
+
+    if(generate)
+    {
+        for(const auto& entry : corpus)
+            generatePrecompiledFile(entry);
+        return 0;
+    }
+
+    const auto baseline = baselineFile.empty() ? std::map<std::string, BenchmarkResult>{} : readBaseline(baselineFile);
+
+    std::unique_ptr<std::ofstream> csv;
+    if(!outputFile.empty())
+    {
+        csv.reset(new std::ofstream(outputFile, std::ios_base::out | std::ios_base::trunc));
+        *csv << CSV_HEADER << std::endl;
+    }
+
+    std::cout << std::left << std::setw(60) << "file" << std::right << std::setw(4) << "opt" << std::setw(10)
+              << "parse" << std::setw(10) << "normalize" << std::setw(10) << "optimize" << std::setw(10) << "regalloc"
+              << std::setw(10) << "codegen" << std::setw(10) << "total" << std::setw(10) << "RSS (kB)" << std::setw(8)
+              << "instr." << std::endl;
+
+    unsigned numSkipped = 0;
+    unsigned numFromSource = 0;
+    unsigned numFailed = 0;
+    unsigned numRegressions = 0;
+    unsigned numCompared = 0;
+    uint64_t totalArenaAllocations = 0;
+    uint64_t totalHeapAllocations = 0;
+    // the logarithmic sum of the time ratios against the baseline per optimization level for the geometric mean
+    std::map<std::string, std::pair<double, unsigned>> baselineRatios;
+    for(const auto& entry : corpus)
+    {
+        std::string inputFile = findPrecompiledFile(entry.sourceFile);
+        if(inputFile.empty())
+        {
+            if(offline)
+            {
+                ++numSkipped;
+                continue;
+            }
+            inputFile = entry.sourceFile;
+            ++numFromSource;
+        }
+
+        for(const auto& level : levels)
+        {
+            BenchmarkResult result = runChild(inputFile, entry.options, level.second);
+            for(unsigned i = 1; i < numRepetitions && result.passed; ++i)
+                takeMinimum(result, runChild(inputFile, entry.options, level.second));
+            result.file = entry.sourceFile;
+            result.level = level.first;
+
+            if(result.passed)
+            {
+                totalArenaAllocations += result.arenaAllocations;
+                totalHeapAllocations += result.heapAllocations;
+                std::cout << std::left << std::setw(60) << result.file << std::right << std::setw(4) << result.level
+                          << std::setw(10) << result.parseUs << std::setw(10) << result.normalizeUs << std::setw(10)
+                          << result.optimizeUs << std::setw(10) << result.registerAllocationUs << std::setw(10)
+                          << result.codegenUs << std::setw(10) << result.totalUs << std::setw(10) << result.peakRSSKb
+                          << std::setw(8) << result.instructions << std::endl;
+            }
+            else
+            {
+                std::cout << std::left << std::setw(60) << result.file << std::right << std::setw(4) << result.level
+                          << "    FAILED" << std::endl;
+                ++numFailed;
+            }
+            if(csv)
+                *csv << toCSV(result) << std::endl;
+
+            auto it = baseline.find(result.file + "@" + result.level);
+            if(it != baseline.end())
+            {
+                ++numCompared;
+                if(checkRegression(it->second, result, threshold))
+                    ++numRegressions;
+                if(it->second.passed && result.passed && it->second.totalUs != 0 && result.totalUs != 0)
+                {
+                    auto& ratio = baselineRatios[result.level];
+                    ratio.first +=
+                        std::log(static_cast<double>(result.totalUs) / static_cast<double>(it->second.totalUs));
+                    ++ratio.second;
+                }
+            }
+        }
+    }
+
+    std::cout << std::endl << "Benchmarked " << corpus.size() - numSkipped << " files (" << numSkipped
+              << " skipped without pre-generated input), " << numFailed << " compilations failed" << std::endl;
+    if(numFromSource != 0)
+        std::cout << numFromSource << " files compiled from OpenCL C source without pre-generated module"
+                  << " (see --generate)" << std::endl;
+    if(totalArenaAllocations != 0)
+        std::cout << "Memory arenas served " << totalArenaAllocations << " allocations with " << totalHeapAllocations
+                  << " heap allocations (" << std::fixed << std::setprecision(1)
+                  << 100.0 * static_cast<double>(totalHeapAllocations) / static_cast<double>(totalArenaAllocations)
+                  << "%)" << std::endl;
+    for(const auto& ratio : baselineRatios)
+        std::cout << "Compilation time relative to baseline (" << ratio.first << ", geometric mean): " << std::fixed
+                  << std::setprecision(3) << std::exp(ratio.second.first / ratio.second.second) << std::endl;
+    if(numSkipped == corpus.size())
+    {
+        std::cerr << "No corpus file has a pre-generated module, nothing was benchmarked" << std::endl;
+        return 1;
+    }
+    if(!baselineFile.empty())
+    {
+        std::cout << numRegressions << " regressions over the threshold of " << threshold << "%" << std::endl;
+        if(numCompared == 0)
+        {
+            // otherwise a stale or unrelated baseline silently disables the regression check
+            std::cerr << "No benchmarked file is contained in the baseline '" << baselineFile << "'" << std::endl;
+            return 1;
+        }
+    }
+    return numRegressions == 0 ? 0 : 1;
+}
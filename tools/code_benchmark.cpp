@@ -0,0 +1,357 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+/*
+ * Benchmark of the quality of the generated code.
+ *
+ * Compiles the kernels of the emulator test-cases (see test/test_cases.h), runs them in the emulator with their fixed
+ * inputs and records the number of emulated cycles, stall cycles, instructions and accesses to the periphery.
+ *
+ * Unlike the compile-time benchmark, all measured values are deterministic, so the results can be compared against a
+ * previous result (the baseline) with a tight threshold to detect compiler changes making the generated code slower.
+ */
+
+#include "CompilationError.h"
+#include "Compiler.h"
+#include "Precompiler.h"
+#include "config.h"
+#include "tools.h"
+
+#include "../test/test_cases.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace vc4c;
+using namespace vc4c::tools;
+
+// the file extensions of the pre-generated inputs, in order of preference
+static const std::vector<std::string> PRECOMPILED_EXTENSIONS = {".ir", ".spv", ".bc"};
+
+struct CodeBenchmarkCase
+{
+    std::string name;
+    EmulationData data;
+    std::map<uint32_t, std::vector<uint32_t>> expectedResults;
+    bool isFloatingPoint;
+};
+
+struct CodeBenchmarkResult
+{
+    std::string name;
+    std::string level;
+    // "ok", "failed" (compilation or emulation failed) or "wrong" (the kernel produced wrong results)
+    std::string status;
+    uint64_t cycles = 0;
+    uint64_t stallCycles = 0;
+    uint64_t instructions = 0;
+    uint64_t executedInstructions = 0;
+    uint64_t tmuLoads = 0;
+    uint64_t vpmAccesses = 0;
+    uint64_t dmaAccesses = 0;
+};
+
+static const std::string CSV_HEADER =
+    "kernel,level,status,cycles,stallCycles,instructions,executedInstructions,tmuLoads,vpmAccesses,dmaAccesses";
+
+static void printHelp()
+{
+    std::cout << "Usage: vc4c_code_benchmark [options]" << std::endl;
+    std::cout << "Compiles and emulates the emulator test kernels and reports the emulated execution statistics"
+              << std::endl;
+    std::cout << "options:" << std::endl;
+    std::cout << "\t-h, --help\t\tPrints this help message and exits" << std::endl;
+    std::cout << "\t-O1,-O2,-O3\t\tSelects the optimization level(s) to benchmark, defaults to -O2" << std::endl;
+    std::cout << "\t--filter=<text>\t\tOnly benchmark the kernels containing the given text" << std::endl;
+    std::cout << "\t--output=<file>\t\tWrites the results as CSV into the given file" << std::endl;
+    std::cout << "\t--baseline=<file>\tCompares the results against the CSV results in the given file" << std::endl;
+    std::cout << "\t--threshold=<percent>\tThe maximum increase of emulated cycles over the baseline not considered a "
+                 "regression, defaults to 2"
+              << std::endl;
+    std::cout << "\t--verbose\t\tEnables verbose compiler log output" << std::endl;
+}
+
+static std::vector<CodeBenchmarkCase> collectCases(const std::string& filter)
+{
+    std::vector<CodeBenchmarkCase> cases;
+    const auto addCases = [&](const std::string& prefix,
+                              const std::vector<std::pair<EmulationData, std::map<uint32_t, std::vector<uint32_t>>>>&
+                                  tests,
+                              bool isFloatingPoint) {
+        for(const auto& test : tests)
+        {
+            // the same kernel can be used multiple times with different inputs, so add the test-set to the name
+            std::string name = prefix + "/" + test.first.kernelName;
+            if(filter.empty() || name.find(filter) != std::string::npos)
+                cases.emplace_back(CodeBenchmarkCase{name, test.first, test.second, isFloatingPoint});
+        }
+    };
+    addCases("integer", test::integerTests, false);
+    addCases("float", test::floatTests, true);
+    return cases;
+}
+
+static void compileModule(std::ostream& output, const std::string& sourceFile, OptimizationLevel level)
+{
+    // use the pre-generated module, if available to not depend on the OpenCL C front-end
+    std::string inputFile = sourceFile;
+    for(const auto& extension : PRECOMPILED_EXTENSIONS)
+    {
+        if(access((sourceFile + extension).data(), R_OK) == 0)
+        {
+            inputFile = sourceFile + extension;
+            break;
+        }
+    }
+
+    Configuration config;
+    config.outputMode = OutputMode::BINARY;
+    config.writeKernelInfo = true;
+    config.optimizationLevel = level;
+
+    std::ifstream input(inputFile);
+    if(!input.is_open())
+        throw CompilationError(CompilationStep::GENERAL, "Failed to open benchmark kernel", inputFile);
+    TemporaryFile tmpFile;
+    std::unique_ptr<std::istream> precompiled;
+    Precompiler::precompile(input, precompiled, config, "", inputFile, tmpFile.fileName);
+    tmpFile.openInputStream(precompiled);
+    Compiler::compile(*precompiled, output, config, "", tmpFile.fileName);
+}
+
+static bool checkResults(const CodeBenchmarkCase& benchCase, const EmulationResult& result)
+{
+    for(const auto& pair : benchCase.expectedResults)
+    {
+        const auto& output = *result.results.at(pair.first).second;
+        const auto& expected = pair.second;
+        if(expected.size() > output.size())
+            return false;
+        for(std::size_t i = 0; i < expected.size(); ++i)
+        {
+            if(expected[i] == output[i])
+                continue;
+            if(!benchCase.isFloatingPoint)
+                return false;
+            // same as for the emulation tests, allow an error of 1 ULP
+            float e = bit_cast<uint32_t, float>(expected[i]);
+            float o = bit_cast<uint32_t, float>(output[i]);
+            if(std::abs(e - o) > std::abs(e * std::numeric_limits<float>::epsilon()))
+                return false;
+        }
+    }
+    return true;
+}
+
+static CodeBenchmarkResult runCase(
+    const CodeBenchmarkCase& benchCase, const std::pair<std::string, OptimizationLevel>& level)
+{
+    CodeBenchmarkResult result;
+    result.name = benchCase.name;
+    result.level = level.first;
+    result.status = "failed";
+
+    try
+    {
+        std::stringstream buffer;
+        compileModule(buffer, benchCase.data.module.first, level.second);
+
+        EmulationData data = benchCase.data;
+        data.module = std::make_pair("", &buffer);
+        const auto emulationResult = emulate(data);
+        if(!emulationResult.executionSuccessful)
+            return result;
+
+        result.status = checkResults(benchCase, emulationResult) ? "ok" : "wrong";
+        result.cycles = emulationResult.numCycles;
+        result.instructions = emulationResult.instrumentation.size();
+        for(const auto& instrumentation : emulationResult.instrumentation)
+        {
+            result.stallCycles += instrumentation.numStalls;
+            result.executedInstructions += instrumentation.numExecutions;
+            result.tmuLoads += instrumentation.numTMULoads;
+            result.vpmAccesses += instrumentation.numVPMAccesses;
+            result.dmaAccesses += instrumentation.numDMAAccesses;
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Benchmark of '" << benchCase.name << "' failed: " << e.what() << std::endl;
+    }
+    return result;
+}
+
+static std::string toCSV(const CodeBenchmarkResult& result)
+{
+    std::stringstream ss;
+    ss << result.name << ',' << result.level << ',' << result.status << ',' << result.cycles << ','
+       << result.stallCycles << ',' << result.instructions << ',' << result.executedInstructions << ','
+       << result.tmuLoads << ',' << result.vpmAccesses << ',' << result.dmaAccesses;
+    return ss.str();
+}
+
+static std::map<std::string, CodeBenchmarkResult> readBaseline(const std::string& fileName)
+{
+    std::map<std::string, CodeBenchmarkResult> results;
+    std::ifstream in(fileName);
+    if(!in.is_open())
+        throw CompilationError(CompilationStep::GENERAL, "Failed to open code quality baseline", fileName);
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(line.empty() || line == CSV_HEADER)
+            continue;
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::stringstream ss(line);
+        CodeBenchmarkResult result;
+        ss >> result.name >> result.level >> result.status >> result.cycles >> result.stallCycles >>
+            result.instructions >> result.executedInstructions >> result.tmuLoads >> result.vpmAccesses >>
+            result.dmaAccesses;
+        if(ss.fail())
+            throw CompilationError(CompilationStep::GENERAL, "Invalid baseline line", line);
+        results.emplace(result.name + "@" + result.level, result);
+    }
+    return results;
+}
+
+/*
+ * Compares the result against the baseline, prints all regressions and returns whether there are any
+ */
+static bool checkRegression(const CodeBenchmarkResult& baseline, const CodeBenchmarkResult& current, double threshold)
+{
+    std::string regression;
+    if(baseline.status == "ok" && current.status != "ok")
+        regression = current.status == "wrong" ? "wrong results" : "execution failed";
+    else if(baseline.status == "ok" &&
+        static_cast<double>(current.cycles) > static_cast<double>(baseline.cycles) * (1.0 + threshold / 100.0))
+        regression = "cycles " + std::to_string(baseline.cycles) + " -> " + std::to_string(current.cycles);
+    if(!regression.empty())
+        std::cout << "REGRESSION " << current.name << " (" << current.level << "): " << regression << std::endl;
+    return !regression.empty();
+}
+
+int main(int argc, char** argv)
+{
+    std::string outputFile;
+    std::string baselineFile;
+    std::string filter;
+    double threshold = 2.0;
+    LogLevel logLevel = LogLevel::ERROR;
+    std::vector<std::pair<std::string, OptimizationLevel>> levels;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if(arg == "--help" || arg == "-h")
+        {
+            printHelp();
+            return 0;
+        }
+        else if(arg == "-O1")
+            levels.emplace_back("O1", OptimizationLevel::BASIC);
+        else if(arg == "-O2")
+            levels.emplace_back("O2", OptimizationLevel::MEDIUM);
+        else if(arg == "-O3")
+            levels.emplace_back("O3", OptimizationLevel::FULL);
+        else if(arg == "--verbose")
+            logLevel = LogLevel::DEBUG;
+        else if(arg.find("--filter=") == 0)
+            filter = arg.substr(arg.find('=') + 1);
+        else if(arg.find("--output=") == 0)
+            outputFile = arg.substr(arg.find('=') + 1);
+        else if(arg.find("--baseline=") == 0)
+            baselineFile = arg.substr(arg.find('=') + 1);
+        else if(arg.find("--threshold=") == 0)
+            threshold = std::stod(arg.substr(arg.find('=') + 1));
+        else
+        {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printHelp();
+            return 2;
+        }
+    }
+    if(levels.empty())
+        levels.emplace_back("O2", OptimizationLevel::MEDIUM);
+    setLogger(std::wcerr, true, logLevel);
+
+    const auto baseline =
+        baselineFile.empty() ? std::map<std::string, CodeBenchmarkResult>{} : readBaseline(baselineFile);
+
+    std::unique_ptr<std::ofstream> csv;
+    if(!outputFile.empty())
+    {
+        csv.reset(new std::ofstream(outputFile, std::ios_base::out | std::ios_base::trunc));
+        *csv << CSV_HEADER << std::endl;
+    }
+
+    std::cout << std::left << std::setw(32) << "kernel" << std::right << std::setw(4) << "opt" << std::setw(8)
+              << "status" << std::setw(10) << "cycles" << std::setw(10) << "stalls" << std::setw(8) << "instr."
+              << std::setw(10) << "executed" << std::setw(8) << "TMU" << std::setw(8) << "VPM" << std::setw(8)
+              << "DMA" << std::endl;
+
+    unsigned numFailed = 0;
+    unsigned numRegressions = 0;
+    unsigned numCompared = 0;
+    // the logarithmic sum of the cycle ratios against the baseline per optimization level for the geometric mean
+    std::map<std::string, std::pair<double, unsigned>> baselineRatios;
+    for(const auto& benchCase : collectCases(filter))
+    {
+        for(const auto& level : levels)
+        {
+            const auto result = runCase(benchCase, level);
+            std::cout << std::left << std::setw(32) << result.name << std::right << std::setw(4) << result.level
+                      << std::setw(8) << result.status << std::setw(10) << result.cycles << std::setw(10)
+                      << result.stallCycles << std::setw(8) << result.instructions << std::setw(10)
+                      << result.executedInstructions << std::setw(8) << result.tmuLoads << std::setw(8)
+                      << result.vpmAccesses << std::setw(8) << result.dmaAccesses << std::endl;
+            if(result.status != "ok")
+                ++numFailed;
+            if(csv)
+                *csv << toCSV(result) << std::endl;
+
+            auto it = baseline.find(result.name + "@" + result.level);
+            if(it != baseline.end())
+            {
+                ++numCompared;
+                if(checkRegression(it->second, result, threshold))
+                    ++numRegressions;
+                if(it->second.status == "ok" && result.status == "ok" && it->second.cycles != 0 && result.cycles != 0)
+                {
+                    auto& ratio = baselineRatios[result.level];
+                    ratio.first +=
+                        std::log(static_cast<double>(result.cycles) / static_cast<double>(it->second.cycles));
+                    ++ratio.second;
+                }
+            }
+        }
+    }
+
+    std::cout << std::endl << numFailed << " kernel executions failed or produced wrong results" << std::endl;
+    for(const auto& ratio : baselineRatios)
+        std::cout << "Emulated cycles relative to baseline (" << ratio.first << ", geometric mean): " << std::fixed
+                  << std::setprecision(3) << std::exp(ratio.second.first / ratio.second.second) << std::endl;
+    if(!baselineFile.empty())
+    {
+        std::cout << numRegressions << " regressions over the threshold of " << threshold << "%" << std::endl;
+        if(numCompared == 0)
+        {
+            // otherwise a stale or unrelated baseline silently disables the regression check
+            std::cerr << "No benchmarked kernel is contained in the baseline '" << baselineFile << "'" << std::endl;
+            return 1;
+        }
+    }
+    return numRegressions == 0 ? 0 : 1;
+}
@@ -149,12 +149,18 @@ static void printHelp()
 	std::cout << "\t-g <num-groups>\t\tUses the given number of work-groups in the format x y z (3 parameter), defaults to single execution" << std::endl;
 	std::cout << "\t-i <dump-file>\t\tWrites the result of the instrumentation into the file specified" << std::endl;
 	std::cout << "\t-o <number>\t\tSpecifies the given parameter index as output and prints it when finished" << std::endl;
+	std::cout << "\t--native\t\tUse the faster native emulation backend" << std::endl;
+	std::cout << "\t--threads <number>\tDistributes the work-groups over the given number of host threads" << std::endl;
+	std::cout << "\t--snapshot <number> <prefix>\tWrites a snapshot of the emulator state every <number> cycles into the files <prefix>.<cycle>.snapshot" << std::endl;
+	std::cout << "\t--resume <snapshot-file>\tResumes the emulation from the given snapshot, the emulation needs to be configured as the one writing the snapshot" << std::endl;
 	std::cout << "\t-h, --help\t\tPrint this help message" << std::endl;
 	std::cout << "\t-q, --quiet\t\tQuiet all debug output" << std::endl;
 	std::cout << "\t--verbose\t\tPrint verbose debug output" << std::endl;
 	std::cout << "[args] specify the values for the input parameters and can take following values:" << std::endl;
 	std::cout << "\t-f <file-name>\t\tRead <file-name> as binary file" << std::endl;
 	std::cout << "\t-s <string>\t\tUse <string> as input string" << std::endl;
+	std::cout << "\t-mf <file-name>\t\tMap <file-name> as buffer without loading it, modifications are written back to the file" << std::endl;
+	std::cout << "\t-mb <file-name> <num>\tMap <file-name> as buffer of at least <num> words, creating or enlarging the file if required" << std::endl;
 	std::cout << "\t-b <num>\t\tAllocate an empty buffer with <num> words of size" << std::endl;
 	std::cout << "\t-ib <values>\t\tAllocate a buffer containing the given values. The values are passed space-separated inside a string (double-quotes, e.g. \"0 1 2 3 ...\")" << std::endl;
 	std::cout << "\t-fb <values>\t\tAllocate a buffer containing the given values. The values are passed space-separated inside a string (double-quotes, e.g. \"0.0 1.0 2.0 3.0 ...\")" << std::endl;
@@ -233,6 +239,23 @@ int main(int argc, char** argv)
 			data.parameter.emplace_back(0u, readBinaryFile(argv[i]));
 			bufferTypes.push_back(BufferType::BINARY);
 		}
+		else if(std::string("-mf") == argv[i])
+		{
+			++i;
+			data.mappedParameters.emplace(data.parameter.size(), tools::MappedFile{argv[i], 0});
+			data.parameter.emplace_back(0u, Optional<std::vector<uint32_t>>{});
+			bufferTypes.push_back(BufferType::BINARY);
+		}
+		else if(std::string("-mb") == argv[i])
+		{
+			++i;
+			const std::string fileName(argv[i]);
+			++i;
+			const auto numWords = static_cast<std::size_t>(std::strtol(argv[i], nullptr, 0));
+			data.mappedParameters.emplace(data.parameter.size(), tools::MappedFile{fileName, numWords * sizeof(tools::Word)});
+			data.parameter.emplace_back(0u, Optional<std::vector<uint32_t>>{});
+			bufferTypes.push_back(BufferType::BINARY);
+		}
 		else if(std::string("-s") == argv[i])
 		{
 			++i;
@@ -270,6 +293,27 @@ int main(int argc, char** argv)
 		{
 			setLogger(std::wcout, true, LogLevel::DEBUG);
 		}
+		else if(std::string("--native") == argv[i])
+		{
+			data.useNativeBackend = true;
+		}
+		else if(std::string("--threads") == argv[i])
+		{
+			++i;
+			data.numThreads = static_cast<uint32_t>(std::strtol(argv[i], nullptr, 0));
+		}
+		else if(std::string("--snapshot") == argv[i])
+		{
+			++i;
+			data.snapshots.interval = static_cast<uint32_t>(std::strtol(argv[i], nullptr, 0));
+			++i;
+			data.snapshots.filePrefix = argv[i];
+		}
+		else if(std::string("--resume") == argv[i])
+		{
+			++i;
+			data.snapshots.resumeFile = argv[i];
+		}
 		else
 			//TODO hexadecimal support, float support
 			data.parameter.emplace_back(static_cast<tools::Word>(std::strtol(argv[i], nullptr, 0)), Optional<std::vector<uint32_t>>{});
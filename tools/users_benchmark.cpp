@@ -0,0 +1,178 @@
+/*
+ * Author: doe300
+ *
+ * See the file "LICENSE" for the full license governing this code.
+ */
+
+/*
+ * Micro-benchmark of the container tracking the users of a Local.
+ *
+ * Compares the LocalUsersMap (flat list with an additional hash-index for locals with many users, with and without a
+ * memory arena) against the sorted map used before. For every number of users, the typical accesses of the compiler
+ * are run on one container per simulated local:
+ * - adding all users (Local#addUser)
+ * - looking up every user (Local#removeUser, the register allocation)
+ * - iterating all users (Local#forUsers, Local#countUsers, Local#getSingleWriter)
+ * - copying the container (Local#copyUsers)
+ * - removing all users again (e.g. when instructions are replaced or removed)
+ *
+ * The users are never dereferenced, so arbitrary distinct addresses are used.
+ */
+
+#include "Locals.h"
+#include "MemoryArena.h"
+#include "performance.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace vc4c;
+
+using Clock = std::chrono::steady_clock;
+
+// the number of user accesses per measured operation and number of users, to get comparable run-times
+static constexpr std::size_t NUM_ACCESSES = 1 << 22;
+
+struct Timings
+{
+    double insertNs = 0;
+    double findNs = 0;
+    double iterateNs = 0;
+    double copyNs = 0;
+    double eraseNs = 0;
+};
+
+static double toNanosecondsPerAccess(Clock::duration duration, std::size_t numAccesses)
+{
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()) /
+        static_cast<double>(numAccesses);
+}
+
+/*
+ * Runs all operations for the given number of users on containers created by the given factory and returns the time
+ * per user access
+ */
+template <typename Container, typename Factory>
+static Timings runWorkload(const std::vector<const LocalUser*>& users, std::size_t numUsers, const Factory& factory)
+{
+    const std::size_t numLocals = std::max(NUM_ACCESSES / numUsers, std::size_t{1});
+    const std::size_t numAccesses = numLocals * numUsers;
+    // the users are looked up and removed in another order than inserted, like it is the case in the compiler
+    std::vector<const LocalUser*> shuffledUsers(users.begin(), users.begin() + static_cast<std::ptrdiff_t>(numUsers));
+    std::shuffle(shuffledUsers.begin(), shuffledUsers.end(), std::mt19937(42));
+
+    std::vector<Container> containers;
+    containers.reserve(numLocals);
+    for(std::size_t i = 0; i < numLocals; ++i)
+        containers.emplace_back(factory());
+
+    Timings timings;
+    // also sum up some values, so the compiler cannot optimize the accesses away
+    uint64_t checksum = 0;
+
+    auto start = Clock::now();
+    for(auto& container : containers)
+    {
+        for(std::size_t u = 0; u < numUsers; ++u)
+            ++container[users[u]].numReads;
+    }
+    timings.insertNs = toNanosecondsPerAccess(Clock::now() - start, numAccesses);
+
+    start = Clock::now();
+    for(auto& container : containers)
+    {
+        for(const LocalUser* user : shuffledUsers)
+            checksum += container.find(user)->second.numReads;
+    }
+    timings.findNs = toNanosecondsPerAccess(Clock::now() - start, numAccesses);
+
+    start = Clock::now();
+    for(const auto& container : containers)
+    {
+        for(const auto& entry : container)
+            checksum += entry.second.numReads;
+    }
+    timings.iterateNs = toNanosecondsPerAccess(Clock::now() - start, numAccesses);
+
+    start = Clock::now();
+    for(const auto& container : containers)
+    {
+        Container copy(container);
+        checksum += copy.size();
+    }
+    timings.copyNs = toNanosecondsPerAccess(Clock::now() - start, numAccesses);
+
+    start = Clock::now();
+    for(auto& container : containers)
+    {
+        for(const LocalUser* user : shuffledUsers)
+            checksum += container.erase(user);
+    }
+    timings.eraseNs = toNanosecondsPerAccess(Clock::now() - start, numAccesses);
+
+    if(checksum != 4 * numAccesses)
+        std::cerr << "Invalid checksum " << checksum << " for " << numUsers << " users" << std::endl;
+    return timings;
+}
+
+static void printTimings(const std::string& container, std::size_t numUsers, const Timings& timings)
+{
+    std::cout << std::left << std::setw(24) << container << std::right << std::setw(8) << numUsers << std::fixed
+              << std::setprecision(2) << std::setw(10) << timings.insertNs << std::setw(10) << timings.findNs
+              << std::setw(10) << timings.iterateNs << std::setw(10) << timings.copyNs << std::setw(10)
+              << timings.eraseNs << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::size_t> userCounts{1, 2, 3, 4, 6, 8, 12, 16, 17, 24, 32, 64, 128, 256, 1024};
+    if(argc > 1)
+    {
+        if(std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")
+        {
+            std::cout << "Usage: vc4c_users_benchmark [<number of users>...]" << std::endl;
+            std::cout << "Compares the containers for the users of a local for the given numbers of users, defaults "
+                         "to a range of 1 to 1024 users"
+                      << std::endl;
+            return 0;
+        }
+        userCounts.clear();
+        for(int i = 1; i < argc; ++i)
+            userCounts.push_back(static_cast<std::size_t>(std::strtoul(argv[i], nullptr, 10)));
+    }
+
+    // the users are only used as keys, their addresses are spread like those of instructions allocated in a method
+    const std::size_t maxUsers = *std::max_element(userCounts.begin(), userCounts.end());
+    std::unique_ptr<char[]> userStorage(new char[maxUsers * 64]);
+    std::vector<const LocalUser*> users;
+    users.reserve(maxUsers);
+    for(std::size_t i = 0; i < maxUsers; ++i)
+        users.push_back(reinterpret_cast<const LocalUser*>(userStorage.get() + i * 64));
+
+    std::cout << "Nanoseconds per user access:" << std::endl;
+    std::cout << std::left << std::setw(24) << "container" << std::right << std::setw(8) << "users" << std::setw(10)
+              << "insert" << std::setw(10) << "find" << std::setw(10) << "iterate" << std::setw(10) << "copy"
+              << std::setw(10) << "erase" << std::endl;
+    for(std::size_t numUsers : userCounts)
+    {
+        if(numUsers == 0)
+            continue;
+        printTimings("SortedMap", numUsers,
+            runWorkload<SortedMap<const LocalUser*, LocalUse>>(
+                users, numUsers, []() { return SortedMap<const LocalUser*, LocalUse>{}; }));
+        printTimings("LocalUsersMap (heap)", numUsers,
+            runWorkload<LocalUsersMap>(users, numUsers, []() { return LocalUsersMap{}; }));
+        // like in the compiler, all containers share the arena of their method
+        MemoryArena arena;
+        printTimings("LocalUsersMap (arena)", numUsers,
+            runWorkload<LocalUsersMap>(users, numUsers, [&arena]() { return LocalUsersMap{&arena}; }));
+    }
+    return 0;
+}